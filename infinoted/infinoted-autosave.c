@@ -122,6 +122,9 @@ infinoted_autosave_session_save(InfinotedAutosave* autosave,
   GError* error;
   gchar* path;
   InfBuffer* buffer;
+  GTimeVal begin;
+  GTimeVal end;
+  gint64 usec;
 
   directory = autosave->directory;
   iter = &session->iter;
@@ -147,6 +150,7 @@ infinoted_autosave_session_save(InfinotedAutosave* autosave,
     session
   );
 
+  g_get_current_time(&begin);
   if(infd_directory_iter_save_session(directory, iter, &error) == FALSE)
   {
     path = infd_directory_iter_get_path(directory, iter);
@@ -168,6 +172,16 @@ infinoted_autosave_session_save(InfinotedAutosave* autosave,
     /* TODO: Remove this as soon as directory itself unsets modified flag
      * on session_write */
     inf_buffer_set_modified(INF_BUFFER(buffer), FALSE);
+
+    g_get_current_time(&end);
+    usec = (gint64)(end.tv_sec - begin.tv_sec) * G_USEC_PER_SEC +
+           (end.tv_usec - begin.tv_usec);
+    if(usec < 0) usec = 0;
+
+    ++ autosave->n_saves;
+    autosave->save_usec += usec;
+    if((guint64)usec > autosave->max_save_usec)
+      autosave->max_save_usec = usec;
   }
 
   inf_signal_handlers_unblock_by_func(
@@ -330,6 +344,9 @@ infinoted_autosave_new(InfdDirectory* directory,
   autosave->directory = directory;
   autosave->autosave_interval = autosave_interval;
   autosave->sessions = NULL;
+  autosave->n_saves = 0;
+  autosave->save_usec = 0;
+  autosave->max_save_usec = 0;
   g_object_ref(directory);
 
   g_signal_connect_after(
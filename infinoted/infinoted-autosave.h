@@ -31,6 +31,11 @@ struct _InfinotedAutosave {
   InfdDirectory* directory;
   unsigned int autosave_interval;
   GSList* sessions;
+
+  /* Number of successful saves and the time they took, in microseconds */
+  unsigned int n_saves;
+  guint64 save_usec;
+  guint64 max_save_usec;
 };
 
 InfinotedAutosave*
@@ -243,6 +243,12 @@ infinoted_config_reload(InfinotedRun* run,
 
       g_object_unref(tcp6);
 
+      g_object_set(
+        G_OBJECT(run->xmpp6),
+        "compression-level", startup->options->compression_level,
+        NULL
+      );
+
       infd_server_pool_add_server(run->pool, INFD_XML_SERVER(run->xmpp6));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -266,6 +272,12 @@ infinoted_config_reload(InfinotedRun* run,
 
       g_object_unref(tcp4);
 
+      g_object_set(
+        G_OBJECT(run->xmpp4),
+        "compression-level", startup->options->compression_level,
+        NULL
+      );
+
       infd_server_pool_add_server(run->pool, INFD_XML_SERVER(run->xmpp4));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -288,6 +300,7 @@ infinoted_config_reload(InfinotedRun* run,
         G_OBJECT(run->xmpp6),
         "credentials", startup->credentials,
         "security-policy", startup->options->security_policy,
+        "compression-level", startup->options->compression_level,
         NULL
       );
     }
@@ -298,6 +311,7 @@ infinoted_config_reload(InfinotedRun* run,
         G_OBJECT(run->xmpp4),
         "credentials", startup->credentials,
         "security-policy", startup->options->security_policy,
+        "compression-level", startup->options->compression_level,
         NULL
       );
     }
@@ -314,6 +328,18 @@ infinoted_config_reload(InfinotedRun* run,
     g_object_unref(filesystem_storage);
   }
 
+  g_object_get(G_OBJECT(run->directory), "storage", &storage, NULL);
+  infd_filesystem_storage_set_format(
+    INFD_FILESYSTEM_STORAGE(storage),
+    startup->options->document_format
+  );
+
+  infd_filesystem_storage_set_use_index(
+    INFD_FILESYSTEM_STORAGE(storage),
+    startup->options->directory_index
+  );
+  g_object_unref(storage);
+
   if( (run->autosave == NULL && startup->options->autosave_interval >  0) ||
       (run->autosave != NULL && startup->options->autosave_interval !=
                                 run->autosave->autosave_interval))
@@ -333,6 +359,42 @@ infinoted_config_reload(InfinotedRun* run,
     }
   }
 
+  if( (run->metrics == NULL && startup->options->metrics_interval > 0) ||
+      (run->metrics != NULL &&
+       (startup->options->metrics_interval !=
+        run->metrics->metrics_interval ||
+        startup->options->metrics_file == NULL ||
+        strcmp(startup->options->metrics_file,
+               run->metrics->metrics_file) != 0)))
+  {
+    if(run->metrics != NULL)
+    {
+      infinoted_metrics_free(run->metrics);
+      run->metrics = NULL;
+    }
+
+    if(startup->options->metrics_interval > 0)
+    {
+      run->metrics = infinoted_metrics_new(
+        run->directory,
+        startup->options->metrics_file,
+        startup->options->metrics_interval
+      );
+    }
+  }
+
+  if(run->metrics != NULL)
+    infinoted_metrics_set_autosave(run->metrics, run->autosave);
+
+  infinoted_record_set_options(
+    run->record,
+    startup->options->record_compression,
+    startup->options->record_max_size,
+    startup->options->record_max_age
+  );
+
+  infinoted_run_set_tracing(run, startup->options);
+
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
   /* Remember whether we have been daemonized; this is not a config file
    * option, so not properly set in our newly created startup. */
@@ -140,9 +140,10 @@ infinoted_directory_sync_session_save(InfinotedDirectorySync* dsync,
   InfdDirectoryIter* iter;
   GError* error;
   InfBuffer* buffer;
-  InfTextChunk* chunk;
-  gchar* content;
-  gsize bytes;
+  InfTextBufferIter* text_iter;
+  GString* content;
+  const gchar* text;
+  gchar* copy;
 
   iter = &session->iter;
   error = NULL;
@@ -170,17 +171,44 @@ infinoted_directory_sync_session_save(InfinotedDirectorySync* dsync,
   }
   else
   {
-    /* TODO: Use the iterator API here, which should be less expensive */
-    chunk = inf_text_buffer_get_slice(
-      INF_TEXT_BUFFER(buffer),
-      0,
+    /* Collect the segments' text directly into the file content, instead
+     * of copying the whole buffer into a chunk first. */
+    content = g_string_sized_new(
       inf_text_buffer_get_length(INF_TEXT_BUFFER(buffer))
     );
 
-    content = inf_text_chunk_get_text(chunk, &bytes);
-    inf_text_chunk_free(chunk);
+    text_iter = inf_text_buffer_create_iter(INF_TEXT_BUFFER(buffer));
+    if(text_iter != NULL)
+    {
+      do
+      {
+        copy = NULL;
+        text = inf_text_buffer_iter_borrow_text(
+          INF_TEXT_BUFFER(buffer),
+          text_iter
+        );
+
+        if(text == NULL)
+        {
+          text = copy = inf_text_buffer_iter_get_text(
+            INF_TEXT_BUFFER(buffer),
+            text_iter
+          );
+        }
+
+        g_string_append_len(
+          content,
+          text,
+          inf_text_buffer_iter_get_bytes(INF_TEXT_BUFFER(buffer), text_iter)
+        );
+
+        g_free(copy);
+      } while(inf_text_buffer_iter_next(INF_TEXT_BUFFER(buffer), text_iter));
+
+      inf_text_buffer_destroy_iter(INF_TEXT_BUFFER(buffer), text_iter);
+    }
 
-    if(!g_file_set_contents(session->path, content, bytes, &error))
+    if(!g_file_set_contents(session->path, content->str, content->len, &error))
     {
       g_warning(
         _("Failed to write session for path \"%s\": %s\n\n"
@@ -193,7 +221,7 @@ infinoted_directory_sync_session_save(InfinotedDirectorySync* dsync,
       infinoted_directory_sync_session_start(session->dsync, session);
     }
 
-    g_free(content);
+    g_string_free(content, TRUE);
   }
 }
 
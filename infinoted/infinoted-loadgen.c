@@ -0,0 +1,1288 @@
+/* infinote - Collaborative notetaking application
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* infinoted-loadgen opens many client connections to a running infinoted
+ * and lets each client edit one of a set of text documents according to a
+ * script. Since all clients run in the same process, the time between a
+ * request being made by one client and its execution at every other client
+ * subscribed to the same document can be measured with a common clock.
+ * Percentiles of these latencies, and of the time it took to connect,
+ * subscribe and join, are written as text, CSV or JSON at the end. */
+
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/client/infc-session-proxy.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-protocol.h>
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Time to wait for outstanding requests after the clients stopped, in
+ * milliseconds */
+#define INFINOTED_LOADGEN_DRAIN_TIME 2000
+
+/* Time after which a request is no longer waited for by clients which did
+ * not see it, for example because they failed, in milliseconds */
+#define INFINOTED_LOADGEN_REQUEST_EXPIRY 60000
+
+typedef enum _InfinotedLoadgenStat {
+  INFINOTED_LOADGEN_STAT_CONNECT,
+  INFINOTED_LOADGEN_STAT_SUBSCRIBE,
+  INFINOTED_LOADGEN_STAT_JOIN,
+  INFINOTED_LOADGEN_STAT_LATENCY,
+
+  INFINOTED_LOADGEN_N_STATS
+} InfinotedLoadgenStat;
+
+static const gchar* const INFINOTED_LOADGEN_STAT_NAMES[] = {
+  "connect",
+  "subscribe",
+  "join",
+  "latency"
+};
+
+typedef struct _InfinotedLoadgen InfinotedLoadgen;
+typedef struct _InfinotedLoadgenDocument InfinotedLoadgenDocument;
+typedef struct _InfinotedLoadgenClient InfinotedLoadgenClient;
+typedef struct _InfinotedLoadgenRequest InfinotedLoadgenRequest;
+
+struct _InfinotedLoadgenDocument {
+  gchar* name;
+  /* Number of clients subscribed to the document */
+  guint n_subscribed;
+
+  /* Maps user IDs to a hash table which maps the user's own component of
+   * the request vector to an InfinotedLoadgenRequest. */
+  GHashTable* users;
+};
+
+struct _InfinotedLoadgenRequest {
+  GTimeVal issued;
+  /* Number of other clients which have not yet executed the request */
+  guint n_remaining;
+};
+
+struct _InfinotedLoadgenClient {
+  InfinotedLoadgen* loadgen;
+  guint index;
+  GRand* rand;
+  InfinotedLoadgenDocument* document;
+
+  InfXmppConnection* connection;
+  InfcBrowser* browser;
+  InfcSessionProxy* proxy;
+  InfTextUser* user;
+  gboolean created;
+  gboolean failed;
+
+  /* Start of the connect, subscribe or join operation currently running */
+  GTimeVal started;
+
+  InfIoTimeout* timeout;
+  guint step;
+};
+
+struct _InfinotedLoadgen {
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+
+  /* Options */
+  gchar* address;
+  gint port;
+  gchar* security_policy;
+  gint n_clients;
+  gint ramp_up;
+  gint duration;
+  gint interval;
+  gint seed;
+  gchar* script;
+  gchar** document_names;
+  gboolean create;
+  gchar* format;
+  gchar* output;
+
+  InfIpAddress* ip_address;
+  InfXmppConnectionSecurityPolicy policy;
+
+  InfinotedLoadgenDocument* documents;
+  guint n_documents;
+
+  InfinotedLoadgenClient* clients;
+  guint n_started;
+  guint n_failed;
+  gboolean stopped;
+
+  InfIoTimeout* start_timeout;
+  InfIoTimeout* stop_timeout;
+
+  /* Samples in milliseconds */
+  GArray* stats[INFINOTED_LOADGEN_N_STATS];
+};
+
+static InfSession*
+infinoted_loadgen_session_new(InfIo* io,
+                              InfCommunicationManager* manager,
+                              InfSessionStatus status,
+                              InfCommunicationJoinedGroup* sync_group,
+                              InfXmlConnection* sync_connection,
+                              gpointer user_data)
+{
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    INF_COMMUNICATION_GROUP(sync_group),
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static const InfcNotePlugin INFINOTED_LOADGEN_TEXT_PLUGIN = {
+  NULL,
+  "InfText",
+  infinoted_loadgen_session_new
+};
+
+static gint
+infinoted_loadgen_cmp_double(gconstpointer first,
+                             gconstpointer second)
+{
+  gdouble a = *(const gdouble*)first;
+  gdouble b = *(const gdouble*)second;
+  return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+static void
+infinoted_loadgen_free_request(gpointer data)
+{
+  g_slice_free(InfinotedLoadgenRequest, data);
+}
+
+static gdouble
+infinoted_loadgen_elapsed(GTimeVal* since)
+{
+  GTimeVal current;
+  g_get_current_time(&current);
+
+  return (current.tv_sec - since->tv_sec) * 1000.0 +
+         (current.tv_usec - since->tv_usec) / 1000.0;
+}
+
+static gboolean
+infinoted_loadgen_expire_request_func(gpointer key,
+                                      gpointer value,
+                                      gpointer user_data)
+{
+  InfinotedLoadgenRequest* request;
+  request = (InfinotedLoadgenRequest*)value;
+
+  return infinoted_loadgen_elapsed(&request->issued) >
+    INFINOTED_LOADGEN_REQUEST_EXPIRY;
+}
+
+static void
+infinoted_loadgen_add_sample(InfinotedLoadgen* loadgen,
+                             InfinotedLoadgenStat stat,
+                             gdouble value)
+{
+  g_array_append_val(loadgen->stats[stat], value);
+}
+
+static void
+infinoted_loadgen_client_fail(InfinotedLoadgenClient* client,
+                              const gchar* message)
+{
+  if(!client->failed)
+  {
+    fprintf(stderr, "Client %u: %s\n", client->index, message);
+
+    client->failed = TRUE;
+    ++ client->loadgen->n_failed;
+
+    /* Requests made from now on need not wait for this client anymore */
+    if(client->proxy != NULL)
+      -- client->document->n_subscribed;
+
+    if(client->timeout != NULL)
+    {
+      inf_io_remove_timeout(INF_IO(client->loadgen->io), client->timeout);
+      client->timeout = NULL;
+    }
+  }
+}
+
+static void
+infinoted_loadgen_request_failed_cb(InfcRequest* request,
+                                    const GError* error,
+                                    gpointer user_data)
+{
+  infinoted_loadgen_client_fail(
+    (InfinotedLoadgenClient*)user_data,
+    error->message
+  );
+}
+
+static void
+infinoted_loadgen_join(InfinotedLoadgenClient* client);
+
+/* Performs the next action from the script */
+static void
+infinoted_loadgen_client_step(InfinotedLoadgenClient* client)
+{
+  InfAdoptedSession* session;
+  InfAdoptedAlgorithm* algorithm;
+  InfTextBuffer* buffer;
+  InfUser* user;
+  guint length;
+  guint caret;
+  gchar c;
+
+  session = INF_ADOPTED_SESSION(infc_session_proxy_get_session(client->proxy));
+  algorithm = inf_adopted_session_get_algorithm(session);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  user = INF_USER(client->user);
+
+  length = inf_text_buffer_get_length(buffer);
+  caret = inf_text_user_get_caret_position(client->user);
+
+  switch(client->loadgen->script[client->step])
+  {
+  case 'i':
+    c = 'a' + g_rand_int_range(client->rand, 0, 26);
+    inf_text_buffer_insert_text(buffer, caret, &c, 1, 1, user);
+    break;
+  case 'e':
+    if(caret > 0)
+      inf_text_buffer_erase_text(buffer, caret - 1, 1, user);
+    break;
+  case 'u':
+    if(inf_adopted_algorithm_can_undo(algorithm, INF_ADOPTED_USER(user)))
+      inf_adopted_session_undo(session, INF_ADOPTED_USER(user), 1);
+    break;
+  case 'r':
+    if(inf_adopted_algorithm_can_redo(algorithm, INF_ADOPTED_USER(user)))
+      inf_adopted_session_redo(session, INF_ADOPTED_USER(user), 1);
+    break;
+  case 'c':
+    inf_text_user_set_selection(
+      client->user,
+      g_rand_int_range(client->rand, 0, length + 1),
+      0,
+      TRUE
+    );
+
+    break;
+  case 'l':
+    /* Leave, and join again right away */
+    inf_session_set_user_status(
+      INF_SESSION(session),
+      user,
+      INF_USER_UNAVAILABLE
+    );
+
+    client->user = NULL;
+    infinoted_loadgen_join(client);
+    break;
+  default:
+    break;
+  }
+
+  ++ client->step;
+  if(client->loadgen->script[client->step] == '\0')
+    client->step = 0;
+}
+
+static void
+infinoted_loadgen_client_timeout_func(gpointer user_data)
+{
+  InfinotedLoadgenClient* client;
+  client = (InfinotedLoadgenClient*)user_data;
+
+  client->timeout = NULL;
+  infinoted_loadgen_client_step(client);
+
+  /* Wait for the user to join again if it left */
+  if(client->user != NULL && !client->failed)
+  {
+    client->timeout = inf_io_add_timeout(
+      INF_IO(client->loadgen->io),
+      client->loadgen->interval,
+      infinoted_loadgen_client_timeout_func,
+      client,
+      NULL
+    );
+  }
+}
+
+static void
+infinoted_loadgen_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                     InfAdoptedUser* user,
+                                     InfAdoptedRequest* request,
+                                     gboolean apply,
+                                     gpointer user_data)
+{
+  InfinotedLoadgenClient* client;
+  GHashTable* pending;
+  InfinotedLoadgenRequest* pending_request;
+  guint id;
+  guint component;
+
+  client = (InfinotedLoadgenClient*)user_data;
+
+  id = inf_user_get_id(INF_USER(user));
+  component = inf_adopted_state_vector_get(
+    inf_adopted_request_get_vector(request),
+    id
+  );
+
+  pending = g_hash_table_lookup(client->document->users, GUINT_TO_POINTER(id));
+
+  if(client->user != NULL && INF_USER(user) == INF_USER(client->user))
+  {
+    /* Nobody else to measure the latency */
+    if(client->document->n_subscribed <= 1)
+      return;
+
+    if(pending == NULL)
+    {
+      pending = g_hash_table_new_full(
+        NULL,
+        NULL,
+        NULL,
+        infinoted_loadgen_free_request
+      );
+
+      g_hash_table_insert(
+        client->document->users,
+        GUINT_TO_POINTER(id),
+        pending
+      );
+    }
+    else
+    {
+      /* Drop requests that some client will never see */
+      g_hash_table_foreach_remove(
+        pending,
+        infinoted_loadgen_expire_request_func,
+        NULL
+      );
+    }
+
+    pending_request = g_slice_new(InfinotedLoadgenRequest);
+    g_get_current_time(&pending_request->issued);
+    pending_request->n_remaining = client->document->n_subscribed - 1;
+
+    g_hash_table_insert(
+      pending,
+      GUINT_TO_POINTER(component),
+      pending_request
+    );
+  }
+  else if(pending != NULL)
+  {
+    pending_request =
+      g_hash_table_lookup(pending, GUINT_TO_POINTER(component));
+
+    if(pending_request != NULL)
+    {
+      infinoted_loadgen_add_sample(
+        client->loadgen,
+        INFINOTED_LOADGEN_STAT_LATENCY,
+        infinoted_loadgen_elapsed(&pending_request->issued)
+      );
+
+      -- pending_request->n_remaining;
+      if(pending_request->n_remaining == 0)
+        g_hash_table_remove(pending, GUINT_TO_POINTER(component));
+    }
+  }
+}
+
+static void
+infinoted_loadgen_userjoin_finished_cb(InfcUserRequest* request,
+                                       InfUser* user,
+                                       gpointer user_data)
+{
+  InfinotedLoadgenClient* client;
+  client = (InfinotedLoadgenClient*)user_data;
+
+  infinoted_loadgen_add_sample(
+    client->loadgen,
+    INFINOTED_LOADGEN_STAT_JOIN,
+    infinoted_loadgen_elapsed(&client->started)
+  );
+
+  client->user = INF_TEXT_USER(user);
+
+  if(!client->loadgen->stopped && !client->failed && client->timeout == NULL)
+  {
+    client->timeout = inf_io_add_timeout(
+      INF_IO(client->loadgen->io),
+      g_rand_int_range(client->rand, 0, client->loadgen->interval) + 1,
+      infinoted_loadgen_client_timeout_func,
+      client,
+      NULL
+    );
+  }
+}
+
+static void
+infinoted_loadgen_join(InfinotedLoadgenClient* client)
+{
+  InfAdoptedSession* session;
+  InfcUserRequest* request;
+  GError* error;
+
+  GParameter params[3] = {
+    { "name", { 0 } },
+    { "vector", { 0 } },
+    { "caret-position", { 0 } }
+  };
+
+  session = INF_ADOPTED_SESSION(infc_session_proxy_get_session(client->proxy));
+
+  g_value_init(&params[0].value, G_TYPE_STRING);
+  g_value_init(&params[1].value, INF_ADOPTED_TYPE_STATE_VECTOR);
+  g_value_init(&params[2].value, G_TYPE_UINT);
+
+  g_value_take_string(
+    &params[0].value,
+    g_strdup_printf("loadgen-%u", client->index)
+  );
+
+  g_value_set_boxed(
+    &params[1].value,
+    inf_adopted_algorithm_get_current(
+      inf_adopted_session_get_algorithm(session)
+    )
+  );
+
+  g_value_set_uint(&params[2].value, 0);
+
+  g_get_current_time(&client->started);
+
+  error = NULL;
+  request = infc_session_proxy_join_user(
+    client->proxy,
+    params,
+    G_N_ELEMENTS(params),
+    &error
+  );
+
+  g_value_unset(&params[0].value);
+  g_value_unset(&params[1].value);
+  g_value_unset(&params[2].value);
+
+  if(request == NULL)
+  {
+    infinoted_loadgen_client_fail(client, error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "failed",
+      G_CALLBACK(infinoted_loadgen_request_failed_cb),
+      client
+    );
+
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "finished",
+      G_CALLBACK(infinoted_loadgen_userjoin_finished_cb),
+      client
+    );
+  }
+}
+
+static void
+infinoted_loadgen_synchronization_complete_cb(InfSession* session,
+                                              InfXmlConnection* connection,
+                                              gpointer user_data)
+{
+  InfinotedLoadgenClient* client;
+  client = (InfinotedLoadgenClient*)user_data;
+
+  infinoted_loadgen_add_sample(
+    client->loadgen,
+    INFINOTED_LOADGEN_STAT_SUBSCRIBE,
+    infinoted_loadgen_elapsed(&client->started)
+  );
+
+  if(!client->loadgen->stopped)
+    infinoted_loadgen_join(client);
+}
+
+static void
+infinoted_loadgen_synchronization_failed_cb(InfSession* session,
+                                            InfXmlConnection* connection,
+                                            const GError* error,
+                                            gpointer user_data)
+{
+  infinoted_loadgen_client_fail(
+    (InfinotedLoadgenClient*)user_data,
+    error->message
+  );
+}
+
+static void
+infinoted_loadgen_subscribe_session_cb(InfcBrowser* browser,
+                                       InfcBrowserIter* iter,
+                                       InfcSessionProxy* proxy,
+                                       gpointer user_data)
+{
+  InfinotedLoadgenClient* client;
+  InfSession* session;
+
+  client = (InfinotedLoadgenClient*)user_data;
+
+  /* We only subscribe to a single document */
+  g_assert(client->proxy == NULL);
+  client->proxy = proxy;
+  g_object_ref(proxy);
+  ++ client->document->n_subscribed;
+
+  session = infc_session_proxy_get_session(proxy);
+
+  g_signal_connect(
+    G_OBJECT(inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))),
+    "execute-request",
+    G_CALLBACK(infinoted_loadgen_execute_request_cb),
+    client
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(session),
+    "synchronization-complete",
+    G_CALLBACK(infinoted_loadgen_synchronization_complete_cb),
+    client
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(session),
+    "synchronization-failed",
+    G_CALLBACK(infinoted_loadgen_synchronization_failed_cb),
+    client
+  );
+}
+
+static void
+infinoted_loadgen_find_document(InfinotedLoadgenClient* client);
+
+static void
+infinoted_loadgen_add_note_failed_cb(InfcRequest* request,
+                                     const GError* error,
+                                     gpointer user_data)
+{
+  InfinotedLoadgenClient* client;
+  client = (InfinotedLoadgenClient*)user_data;
+
+  /* Another client might have created the document at the same time, in
+   * which case it is now known to the browser. */
+  infinoted_loadgen_find_document(client);
+}
+
+static void
+infinoted_loadgen_find_document(InfinotedLoadgenClient* client)
+{
+  InfcBrowserIter iter;
+  InfcNodeRequest* request;
+  gboolean found;
+
+  found = FALSE;
+  infc_browser_iter_get_root(client->browser, &iter);
+
+  if(infc_browser_iter_get_child(client->browser, &iter))
+  {
+    do
+    {
+      if(strcmp(infc_browser_iter_get_name(client->browser, &iter),
+                client->document->name) == 0)
+      {
+        found = TRUE;
+      }
+    } while(!found && infc_browser_iter_get_next(client->browser, &iter));
+  }
+
+  g_get_current_time(&client->started);
+
+  if(found)
+  {
+    if(infc_browser_iter_is_subdirectory(client->browser, &iter))
+    {
+      infinoted_loadgen_client_fail(client, "Document is a subdirectory");
+      return;
+    }
+
+    request = infc_browser_iter_subscribe_session(client->browser, &iter);
+
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "failed",
+      G_CALLBACK(infinoted_loadgen_request_failed_cb),
+      client
+    );
+  }
+  else if(client->loadgen->create && !client->created)
+  {
+    client->created = TRUE;
+    infc_browser_iter_get_root(client->browser, &iter);
+
+    request = infc_browser_add_note(
+      client->browser,
+      &iter,
+      client->document->name,
+      &INFINOTED_LOADGEN_TEXT_PLUGIN,
+      TRUE
+    );
+
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "failed",
+      G_CALLBACK(infinoted_loadgen_add_note_failed_cb),
+      client
+    );
+  }
+  else
+  {
+    infinoted_loadgen_client_fail(client, "Document does not exist");
+  }
+}
+
+static void
+infinoted_loadgen_explore_finished_cb(InfcExploreRequest* request,
+                                      gpointer user_data)
+{
+  infinoted_loadgen_find_document((InfinotedLoadgenClient*)user_data);
+}
+
+static void
+infinoted_loadgen_notify_status_cb(GObject* object,
+                                   GParamSpec* pspec,
+                                   gpointer user_data)
+{
+  InfinotedLoadgenClient* client;
+  InfcBrowserIter iter;
+  InfcExploreRequest* request;
+
+  client = (InfinotedLoadgenClient*)user_data;
+
+  switch(infc_browser_get_status(client->browser))
+  {
+  case INFC_BROWSER_CONNECTED:
+    infinoted_loadgen_add_sample(
+      client->loadgen,
+      INFINOTED_LOADGEN_STAT_CONNECT,
+      infinoted_loadgen_elapsed(&client->started)
+    );
+
+    infc_browser_iter_get_root(client->browser, &iter);
+    if(infc_browser_iter_get_explored(client->browser, &iter))
+    {
+      infinoted_loadgen_find_document(client);
+    }
+    else
+    {
+      request = infc_browser_iter_explore(client->browser, &iter);
+
+      g_signal_connect_after(
+        G_OBJECT(request),
+        "failed",
+        G_CALLBACK(infinoted_loadgen_request_failed_cb),
+        client
+      );
+
+      g_signal_connect_after(
+        G_OBJECT(request),
+        "finished",
+        G_CALLBACK(infinoted_loadgen_explore_finished_cb),
+        client
+      );
+    }
+
+    break;
+  case INFC_BROWSER_DISCONNECTED:
+    if(!client->loadgen->stopped)
+      infinoted_loadgen_client_fail(client, "Connection closed");
+    break;
+  default:
+    break;
+  }
+}
+
+static void
+infinoted_loadgen_error_cb(InfcBrowser* browser,
+                           const GError* error,
+                           gpointer user_data)
+{
+  InfinotedLoadgenClient* client;
+  client = (InfinotedLoadgenClient*)user_data;
+
+  /* If the error is fatal, then the status changes to disconnected */
+  fprintf(stderr, "Client %u: %s\n", client->index, error->message);
+}
+
+static void
+infinoted_loadgen_client_start(InfinotedLoadgen* loadgen,
+                               InfinotedLoadgenClient* client)
+{
+  InfTcpConnection* tcp;
+  GError* error;
+
+  g_get_current_time(&client->started);
+
+  error = NULL;
+  tcp = inf_tcp_connection_new_and_open(
+    INF_IO(loadgen->io),
+    loadgen->ip_address,
+    loadgen->port,
+    &error
+  );
+
+  if(tcp == NULL)
+  {
+    infinoted_loadgen_client_fail(client, error->message);
+    g_error_free(error);
+    return;
+  }
+
+  client->connection = inf_xmpp_connection_new(
+    tcp,
+    INF_XMPP_CONNECTION_CLIENT,
+    NULL,
+    loadgen->address,
+    loadgen->policy,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(tcp);
+
+  client->browser = infc_browser_new(
+    INF_IO(loadgen->io),
+    loadgen->manager,
+    INF_XML_CONNECTION(client->connection)
+  );
+
+  infc_browser_add_plugin(client->browser, &INFINOTED_LOADGEN_TEXT_PLUGIN);
+
+  g_signal_connect_after(
+    G_OBJECT(client->browser),
+    "notify::status",
+    G_CALLBACK(infinoted_loadgen_notify_status_cb),
+    client
+  );
+
+  g_signal_connect(
+    G_OBJECT(client->browser),
+    "error",
+    G_CALLBACK(infinoted_loadgen_error_cb),
+    client
+  );
+
+  g_signal_connect(
+    G_OBJECT(client->browser),
+    "subscribe-session",
+    G_CALLBACK(infinoted_loadgen_subscribe_session_cb),
+    client
+  );
+}
+
+static void
+infinoted_loadgen_start_timeout_func(gpointer user_data)
+{
+  InfinotedLoadgen* loadgen;
+  loadgen = (InfinotedLoadgen*)user_data;
+
+  loadgen->start_timeout = NULL;
+
+  /* Start the next client, or all remaining ones without ramp-up */
+  do
+  {
+    infinoted_loadgen_client_start(
+      loadgen,
+      &loadgen->clients[loadgen->n_started]
+    );
+
+    ++ loadgen->n_started;
+  } while(loadgen->ramp_up == 0 && loadgen->n_started < loadgen->n_clients);
+
+  if(loadgen->n_started < (guint)loadgen->n_clients)
+  {
+    loadgen->start_timeout = inf_io_add_timeout(
+      INF_IO(loadgen->io),
+      loadgen->ramp_up,
+      infinoted_loadgen_start_timeout_func,
+      loadgen,
+      NULL
+    );
+  }
+}
+
+static void
+infinoted_loadgen_drain_timeout_func(gpointer user_data)
+{
+  InfinotedLoadgen* loadgen;
+  InfXmlConnection* connection;
+  InfXmlConnectionStatus status;
+  guint i;
+
+  loadgen = (InfinotedLoadgen*)user_data;
+  loadgen->stop_timeout = NULL;
+
+  for(i = 0; i < loadgen->n_started; ++i)
+  {
+    connection = INF_XML_CONNECTION(loadgen->clients[i].connection);
+    if(connection != NULL)
+    {
+      g_object_get(G_OBJECT(connection), "status", &status, NULL);
+      if(status != INF_XML_CONNECTION_CLOSED &&
+         status != INF_XML_CONNECTION_CLOSING)
+      {
+        inf_xml_connection_close(connection);
+      }
+    }
+  }
+
+  inf_standalone_io_loop_quit(loadgen->io);
+}
+
+static void
+infinoted_loadgen_stop_timeout_func(gpointer user_data)
+{
+  InfinotedLoadgen* loadgen;
+  InfinotedLoadgenClient* client;
+  guint i;
+
+  loadgen = (InfinotedLoadgen*)user_data;
+  loadgen->stopped = TRUE;
+
+  if(loadgen->start_timeout != NULL)
+  {
+    inf_io_remove_timeout(INF_IO(loadgen->io), loadgen->start_timeout);
+    loadgen->start_timeout = NULL;
+  }
+
+  for(i = 0; i < loadgen->n_started; ++i)
+  {
+    client = &loadgen->clients[i];
+    if(client->timeout != NULL)
+    {
+      inf_io_remove_timeout(INF_IO(loadgen->io), client->timeout);
+      client->timeout = NULL;
+    }
+  }
+
+  /* Give requests still in transit the chance to arrive */
+  loadgen->stop_timeout = inf_io_add_timeout(
+    INF_IO(loadgen->io),
+    INFINOTED_LOADGEN_DRAIN_TIME,
+    infinoted_loadgen_drain_timeout_func,
+    loadgen,
+    NULL
+  );
+}
+
+static gdouble
+infinoted_loadgen_percentile(GArray* samples,
+                             guint percent)
+{
+  return g_array_index(samples, gdouble, samples->len * percent / 100);
+}
+
+static void
+infinoted_loadgen_report(InfinotedLoadgen* loadgen,
+                         FILE* stream)
+{
+  GArray* samples;
+  guint i;
+
+  if(strcmp(loadgen->format, "csv") == 0)
+    fprintf(stream, "metric,count,p50,p90,p99,max\n");
+  else if(strcmp(loadgen->format, "json") == 0)
+    fprintf(stream, "{\n  \"clients\": %d,\n  \"failed\": %u",
+            loadgen->n_clients, loadgen->n_failed);
+  else
+    fprintf(stream, "%d clients, %u failed\n",
+            loadgen->n_clients, loadgen->n_failed);
+
+  for(i = 0; i < INFINOTED_LOADGEN_N_STATS; ++i)
+  {
+    samples = loadgen->stats[i];
+    g_array_sort(samples, infinoted_loadgen_cmp_double);
+
+    if(strcmp(loadgen->format, "csv") == 0)
+    {
+      if(samples->len > 0)
+      {
+        fprintf(
+          stream,
+          "%s,%u,%.3f,%.3f,%.3f,%.3f\n",
+          INFINOTED_LOADGEN_STAT_NAMES[i],
+          samples->len,
+          infinoted_loadgen_percentile(samples, 50),
+          infinoted_loadgen_percentile(samples, 90),
+          infinoted_loadgen_percentile(samples, 99),
+          g_array_index(samples, gdouble, samples->len - 1)
+        );
+      }
+      else
+      {
+        fprintf(stream, "%s,0,,,,\n", INFINOTED_LOADGEN_STAT_NAMES[i]);
+      }
+    }
+    else if(strcmp(loadgen->format, "json") == 0)
+    {
+      fprintf(
+        stream,
+        ",\n  \"%s\": { \"count\": %u",
+        INFINOTED_LOADGEN_STAT_NAMES[i],
+        samples->len
+      );
+
+      if(samples->len > 0)
+      {
+        fprintf(
+          stream,
+          ", \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f",
+          infinoted_loadgen_percentile(samples, 50),
+          infinoted_loadgen_percentile(samples, 90),
+          infinoted_loadgen_percentile(samples, 99),
+          g_array_index(samples, gdouble, samples->len - 1)
+        );
+      }
+
+      fprintf(stream, " }");
+    }
+    else if(samples->len > 0)
+    {
+      fprintf(
+        stream,
+        "%-10s %8u samples, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, "
+        "max %.1f ms\n",
+        INFINOTED_LOADGEN_STAT_NAMES[i],
+        samples->len,
+        infinoted_loadgen_percentile(samples, 50),
+        infinoted_loadgen_percentile(samples, 90),
+        infinoted_loadgen_percentile(samples, 99),
+        g_array_index(samples, gdouble, samples->len - 1)
+      );
+    }
+  }
+
+  if(strcmp(loadgen->format, "json") == 0)
+    fprintf(stream, "\n}\n");
+}
+
+static gboolean
+infinoted_loadgen_policy_from_string(const gchar* string,
+                                     InfXmppConnectionSecurityPolicy* pol)
+{
+  if(strcmp(string, "no-tls") == 0)
+    *pol = INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED;
+  else if(strcmp(string, "allow-tls") == 0)
+    *pol = INF_XMPP_CONNECTION_SECURITY_BOTH_PREFER_TLS;
+  else if(strcmp(string, "require-tls") == 0)
+    *pol = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+infinoted_loadgen_parse_options(InfinotedLoadgen* loadgen,
+                                int* argc,
+                                char*** argv)
+{
+  GOptionContext* context;
+  GError* error;
+  gboolean result;
+
+  GOptionEntry entries[] = {
+    { "address", 'a', 0, G_OPTION_ARG_STRING, NULL,
+      "IP address of the server", "ADDRESS" },
+    { "port-number", 'p', 0, G_OPTION_ARG_INT, NULL,
+      "Port number of the server", "PORT" },
+    { "security-policy", 0, 0, G_OPTION_ARG_STRING, NULL,
+      "Whether to use TLS", "no-tls|allow-tls|require-tls" },
+    { "clients", 'n', 0, G_OPTION_ARG_INT, NULL,
+      "Number of client connections", "N" },
+    { "ramp-up", 0, 0, G_OPTION_ARG_INT, NULL,
+      "Time between opening two connections, in milliseconds", "MSECS" },
+    { "duration", 'd', 0, G_OPTION_ARG_INT, NULL,
+      "Time the clients edit the documents, in seconds", "SECS" },
+    { "interval", 'i', 0, G_OPTION_ARG_INT, NULL,
+      "Time between two actions of a client, in milliseconds", "MSECS" },
+    { "seed", 0, 0, G_OPTION_ARG_INT, NULL,
+      "Seed for the random number generator", "SEED" },
+    { "script", 's', 0, G_OPTION_ARG_STRING, NULL,
+      "Actions each client repeats: i inserts a character at the caret, "
+      "e erases the character before the caret, u undoes, r redoes, c "
+      "moves the caret to a random position, l leaves and joins again, "
+      "anything else does nothing", "SCRIPT" },
+    { "document", 'D', 0, G_OPTION_ARG_STRING_ARRAY, NULL,
+      "Name of a text document in the root directory. Can be given more "
+      "than once, in which case the clients are distributed evenly across "
+      "the documents", "NAME" },
+    { "create", 'c', 0, G_OPTION_ARG_NONE, NULL,
+      "Create documents which do not exist", NULL },
+    { "format", 'f', 0, G_OPTION_ARG_STRING, NULL,
+      "Format of the results", "text|csv|json" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, NULL,
+      "File to write the results to instead of standard output", "FILE" },
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  entries[0].arg_data = &loadgen->address;
+  entries[1].arg_data = &loadgen->port;
+  entries[2].arg_data = &loadgen->security_policy;
+  entries[3].arg_data = &loadgen->n_clients;
+  entries[4].arg_data = &loadgen->ramp_up;
+  entries[5].arg_data = &loadgen->duration;
+  entries[6].arg_data = &loadgen->interval;
+  entries[7].arg_data = &loadgen->seed;
+  entries[8].arg_data = &loadgen->script;
+  entries[9].arg_data = &loadgen->document_names;
+  entries[10].arg_data = &loadgen->create;
+  entries[11].arg_data = &loadgen->format;
+  entries[12].arg_data = &loadgen->output;
+
+  error = NULL;
+  context = g_option_context_new("- Generate load on an infinote server");
+  g_option_context_add_main_entries(context, entries, NULL);
+  result = g_option_context_parse(context, argc, argv, &error);
+  g_option_context_free(context);
+
+  if(!result)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  if(loadgen->address == NULL)
+    loadgen->address = g_strdup("127.0.0.1");
+  if(loadgen->security_policy == NULL)
+    loadgen->security_policy = g_strdup("allow-tls");
+  if(loadgen->script == NULL || *loadgen->script == '\0')
+  {
+    g_free(loadgen->script);
+    loadgen->script = g_strdup("iiiiiiiieiiiiciiiiiiiiuriiii");
+  }
+  if(loadgen->document_names == NULL)
+  {
+    loadgen->document_names = g_new(gchar*, 2);
+    loadgen->document_names[0] = g_strdup("loadgen");
+    loadgen->document_names[1] = NULL;
+  }
+  if(loadgen->format == NULL)
+    loadgen->format = g_strdup("text");
+
+  loadgen->ip_address = inf_ip_address_new_from_string(loadgen->address);
+  if(loadgen->ip_address == NULL)
+  {
+    fprintf(stderr, "\"%s\" is not a valid IP address\n", loadgen->address);
+    return FALSE;
+  }
+
+  if(!infinoted_loadgen_policy_from_string(loadgen->security_policy,
+                                           &loadgen->policy))
+  {
+    fprintf(
+      stderr,
+      "\"%s\" is not a valid security policy. Allowed values are "
+      "\"no-tls\", \"allow-tls\" or \"require-tls\"\n",
+      loadgen->security_policy
+    );
+
+    return FALSE;
+  }
+
+  if(strcmp(loadgen->format, "text") != 0 &&
+     strcmp(loadgen->format, "csv") != 0 &&
+     strcmp(loadgen->format, "json") != 0)
+  {
+    fprintf(stderr, "\"%s\" is not a valid format\n", loadgen->format);
+    return FALSE;
+  }
+
+  if(loadgen->port <= 0 || loadgen->port > 65535 ||
+     loadgen->n_clients <= 0 || loadgen->ramp_up < 0 ||
+     loadgen->duration <= 0 || loadgen->interval <= 0)
+  {
+    fprintf(stderr, "Invalid arguments\n");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+  InfinotedLoadgen loadgen;
+  InfinotedLoadgenClient* client;
+  FILE* stream;
+  guint i;
+  int ret;
+
+  gnutls_global_init();
+  g_type_init();
+
+  memset(&loadgen, 0, sizeof(InfinotedLoadgen));
+  loadgen.port = inf_protocol_get_default_port();
+  loadgen.n_clients = 100;
+  loadgen.ramp_up = 10;
+  loadgen.duration = 60;
+  loadgen.interval = 200;
+  loadgen.seed = 42;
+
+  ret = 0;
+  if(!infinoted_loadgen_parse_options(&loadgen, &argc, &argv))
+    ret = 1;
+
+  if(ret == 0)
+  {
+    loadgen.io = inf_standalone_io_new();
+    loadgen.manager = inf_communication_manager_new();
+
+    loadgen.n_documents = g_strv_length(loadgen.document_names);
+    loadgen.documents = g_new(InfinotedLoadgenDocument, loadgen.n_documents);
+    for(i = 0; i < loadgen.n_documents; ++i)
+    {
+      loadgen.documents[i].name = loadgen.document_names[i];
+      loadgen.documents[i].n_subscribed = 0;
+      loadgen.documents[i].users = g_hash_table_new_full(
+        NULL,
+        NULL,
+        NULL,
+        (GDestroyNotify)g_hash_table_destroy
+      );
+    }
+
+    for(i = 0; i < INFINOTED_LOADGEN_N_STATS; ++i)
+      loadgen.stats[i] = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+    loadgen.clients = g_new0(InfinotedLoadgenClient, loadgen.n_clients);
+    for(i = 0; i < (guint)loadgen.n_clients; ++i)
+    {
+      client = &loadgen.clients[i];
+      client->loadgen = &loadgen;
+      client->index = i;
+      client->rand = g_rand_new_with_seed(loadgen.seed + i);
+      client->document = &loadgen.documents[i % loadgen.n_documents];
+    }
+
+    loadgen.start_timeout = inf_io_add_timeout(
+      INF_IO(loadgen.io),
+      0,
+      infinoted_loadgen_start_timeout_func,
+      &loadgen,
+      NULL
+    );
+
+    loadgen.stop_timeout = inf_io_add_timeout(
+      INF_IO(loadgen.io),
+      loadgen.duration * 1000,
+      infinoted_loadgen_stop_timeout_func,
+      &loadgen,
+      NULL
+    );
+
+    inf_standalone_io_loop(loadgen.io);
+
+    stream = stdout;
+    if(loadgen.output != NULL)
+    {
+      stream = fopen(loadgen.output, "w");
+      if(stream == NULL)
+      {
+        fprintf(stderr, "Could not open \"%s\"\n", loadgen.output);
+        ret = 1;
+      }
+    }
+
+    if(stream != NULL)
+    {
+      infinoted_loadgen_report(&loadgen, stream);
+      if(stream != stdout)
+        fclose(stream);
+    }
+
+    for(i = 0; i < (guint)loadgen.n_clients; ++i)
+    {
+      client = &loadgen.clients[i];
+      if(client->proxy != NULL)
+        g_object_unref(client->proxy);
+      if(client->browser != NULL)
+        g_object_unref(client->browser);
+      if(client->connection != NULL)
+        g_object_unref(client->connection);
+      g_rand_free(client->rand);
+    }
+
+    for(i = 0; i < loadgen.n_documents; ++i)
+      g_hash_table_destroy(loadgen.documents[i].users);
+    for(i = 0; i < INFINOTED_LOADGEN_N_STATS; ++i)
+      g_array_free(loadgen.stats[i], TRUE);
+
+    g_free(loadgen.clients);
+    g_free(loadgen.documents);
+    g_object_unref(loadgen.manager);
+    g_object_unref(loadgen.io);
+
+    if(loadgen.n_failed > 0)
+      ret = 1;
+  }
+
+  if(loadgen.ip_address != NULL)
+    inf_ip_address_free(loadgen.ip_address);
+
+  g_free(loadgen.address);
+  g_free(loadgen.security_policy);
+  g_free(loadgen.script);
+  g_strfreev(loadgen.document_names);
+  g_free(loadgen.format);
+  g_free(loadgen.output);
+
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
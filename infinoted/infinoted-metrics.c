@@ -0,0 +1,740 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-metrics.h>
+#include <infinoted/infinoted-util.h>
+
+#include <libinftext/inf-text-session.h>
+
+#include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
+#include <libinfinity/adopted/inf-adopted-user.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+
+#include <libinfinity/inf-i18n.h>
+
+#include <string.h>
+
+/* The metrics are written in the Prometheus text exposition format, so that
+ * the file can be picked up by the node exporter's textfile collector, or
+ * served by any web server. Collecting them only reads counters that are
+ * maintained anyway, so nothing is done in the hot paths of the server apart
+ * from incrementing those counters. */
+
+typedef struct _InfinotedMetricsSession InfinotedMetricsSession;
+struct _InfinotedMetricsSession {
+  gchar* path;
+  InfAdoptedAlgorithmStatistics statistics;
+  guint n_users;
+  guint log_size;
+  InfTextSessionLogStatistics text_log;
+  gboolean synchronizing;
+};
+
+typedef struct _InfinotedMetricsConnection InfinotedMetricsConnection;
+struct _InfinotedMetricsConnection {
+  gchar* remote_id;
+  guint64 bytes_in;
+  guint64 bytes_out;
+};
+
+static void
+infinoted_metrics_append_header(GString* str,
+                                const gchar* name,
+                                const gchar* type,
+                                const gchar* help)
+{
+  g_string_append_printf(str, "# HELP %s %s\n", name, help);
+  g_string_append_printf(str, "# TYPE %s %s\n", name, type);
+}
+
+static void
+infinoted_metrics_append_label(GString* str,
+                               const gchar* name,
+                               const gchar* value)
+{
+  const gchar* pos;
+
+  g_string_append_printf(str, "{%s=\"", name);
+  for(pos = value; *pos != '\0'; ++ pos)
+  {
+    switch(*pos)
+    {
+    case '\\':
+      g_string_append(str, "\\\\");
+      break;
+    case '"':
+      g_string_append(str, "\\\"");
+      break;
+    case '\n':
+      g_string_append(str, "\\n");
+      break;
+    default:
+      g_string_append_c(str, *pos);
+      break;
+    }
+  }
+
+  g_string_append(str, "\"}");
+}
+
+static void
+infinoted_metrics_append_value(GString* str,
+                               const gchar* name,
+                               guint64 value)
+{
+  g_string_append_printf(
+    str,
+    "%s %" G_GUINT64_FORMAT "\n",
+    name,
+    value
+  );
+}
+
+static void
+infinoted_metrics_append_session_value(GString* str,
+                                       const gchar* name,
+                                       InfinotedMetricsSession* session,
+                                       guint64 value)
+{
+  g_string_append(str, name);
+  infinoted_metrics_append_label(str, "path", session->path);
+  g_string_append_printf(str, " %" G_GUINT64_FORMAT "\n", value);
+}
+
+static void
+infinoted_metrics_count_log_cb(InfUser* user,
+                               gpointer user_data)
+{
+  InfinotedMetricsSession* session;
+  InfAdoptedRequestLog* log;
+
+  session = (InfinotedMetricsSession*)user_data;
+  ++ session->n_users;
+
+  if(INF_ADOPTED_IS_USER(user))
+  {
+    log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+    session->log_size += inf_adopted_request_log_get_end(log) -
+                         inf_adopted_request_log_get_begin(log);
+  }
+}
+
+static void
+infinoted_metrics_collect_sessions(InfinotedMetrics* metrics,
+                                   InfdDirectoryIter* iter,
+                                   GArray* sessions)
+{
+  InfdDirectoryIter child;
+  InfdSessionProxy* proxy;
+  InfSession* session;
+  InfinotedMetricsSession entry;
+  InfAdoptedAlgorithm* algorithm;
+
+  if(infd_directory_iter_get_node_type(metrics->directory, iter) ==
+     INFD_STORAGE_NODE_SUBDIRECTORY)
+  {
+    if(infd_directory_iter_get_explored(metrics->directory, iter) == TRUE)
+    {
+      /* Errors can't happen as the directory is already explored */
+      child = *iter;
+      if(infd_directory_iter_get_child(metrics->directory, &child, NULL))
+      {
+        do {
+          infinoted_metrics_collect_sessions(metrics, &child, sessions);
+        } while(infd_directory_iter_get_next(metrics->directory, &child));
+      }
+    }
+  }
+  else
+  {
+    proxy = infd_directory_iter_peek_session(metrics->directory, iter);
+    if(proxy != NULL)
+    {
+      session = infd_session_proxy_get_session(proxy);
+
+      entry.path = infd_directory_iter_get_path(metrics->directory, iter);
+      entry.n_users = 0;
+      entry.log_size = 0;
+      entry.synchronizing =
+        inf_session_get_status(session) == INF_SESSION_SYNCHRONIZING ||
+        inf_session_has_synchronizations(session);
+
+      if(INF_ADOPTED_IS_SESSION(session))
+      {
+        algorithm =
+          inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+        inf_adopted_algorithm_get_statistics(algorithm, &entry.statistics);
+      }
+      else
+      {
+        memset(&entry.statistics, 0, sizeof(entry.statistics));
+      }
+
+      inf_user_table_foreach_user(
+        inf_session_get_user_table(session),
+        infinoted_metrics_count_log_cb,
+        &entry
+      );
+
+      if(INF_TEXT_IS_SESSION(session))
+      {
+        inf_text_session_get_log_statistics(
+          INF_TEXT_SESSION(session),
+          &entry.text_log
+        );
+      }
+      else
+      {
+        memset(&entry.text_log, 0, sizeof(entry.text_log));
+      }
+
+      g_array_append_val(sessions, entry);
+    }
+  }
+}
+
+static void
+infinoted_metrics_collect_connections_cb(InfXmlConnection* connection,
+                                         gpointer user_data)
+{
+  GArray* connections;
+  InfinotedMetricsConnection entry;
+
+  connections = (GArray*)user_data;
+  if(INF_IS_XMPP_CONNECTION(connection))
+  {
+    g_object_get(
+      G_OBJECT(connection),
+      "remote-id", &entry.remote_id,
+      "bytes-in", &entry.bytes_in,
+      "bytes-out", &entry.bytes_out,
+      NULL
+    );
+
+    g_array_append_val(connections, entry);
+  }
+}
+
+static void
+infinoted_metrics_append_sessions(GString* str,
+                                  GArray* sessions)
+{
+  InfinotedMetricsSession* session;
+  guint i;
+
+#define INFINOTED_METRICS_FOREACH_SESSION(name, value) \
+  for(i = 0; i < sessions->len; ++ i) \
+  { \
+    session = &g_array_index(sessions, InfinotedMetricsSession, i); \
+    infinoted_metrics_append_session_value(str, name, session, value); \
+  }
+
+  infinoted_metrics_append_header(
+    str, "infinoted_sessions", "gauge",
+    "Number of sessions currently running."
+  );
+  infinoted_metrics_append_value(str, "infinoted_sessions", sessions->len);
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_requests_total", "counter",
+    "Requests executed in a session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_requests_total",
+    session->statistics.n_executed
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_transformations_total", "counter",
+    "Transformations performed to translate requests in a session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_transformations_total",
+    session->statistics.n_transformed
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_cache_hits_total", "counter",
+    "Translations found in the request cache of a session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_cache_hits_total",
+    session->statistics.n_cache_hits
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_cache_misses_total", "counter",
+    "Translations not found in the request cache of a session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_cache_misses_total",
+    session->statistics.n_cache_misses
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_cache_size", "gauge",
+    "Requests in the request cache of a session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_cache_size",
+    session->statistics.cache_size
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_request_log_size", "gauge",
+    "Requests stored in the request logs of all users of a session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_request_log_size",
+    session->log_size
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_log_text_bytes", "gauge",
+    "Size of the text kept in the request logs of a text session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_log_text_bytes",
+    session->text_log.n_bytes
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_log_text_segments", "gauge",
+    "Segments of the text kept in the request logs of a text session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_log_text_segments",
+    session->text_log.n_segments
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_log_text_chunks", "gauge",
+    "Distinct text chunks in the request logs of a text session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_log_text_chunks",
+    session->text_log.n_chunks
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_log_text_references", "gauge",
+    "Operations referencing a text chunk in the request logs of a text "
+    "session."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_log_text_references",
+    session->text_log.n_references
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_users", "gauge",
+    "Users known to a session, including unavailable ones."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_users",
+    session->n_users
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_session_synchronizing", "gauge",
+    "Whether a session is being synchronized from or to a client."
+  );
+  INFINOTED_METRICS_FOREACH_SESSION(
+    "infinoted_session_synchronizing",
+    session->synchronizing ? 1 : 0
+  );
+
+#undef INFINOTED_METRICS_FOREACH_SESSION
+}
+
+static void
+infinoted_metrics_append_connections(GString* str,
+                                     GArray* connections)
+{
+  InfinotedMetricsConnection* connection;
+  guint i;
+
+  infinoted_metrics_append_header(
+    str, "infinoted_connections", "gauge",
+    "Number of client connections."
+  );
+  infinoted_metrics_append_value(
+    str,
+    "infinoted_connections",
+    connections->len
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_connection_received_bytes_total", "counter",
+    "Bytes of XML received on a connection, before decompression."
+  );
+  for(i = 0; i < connections->len; ++ i)
+  {
+    connection = &g_array_index(connections, InfinotedMetricsConnection, i);
+    g_string_append(str, "infinoted_connection_received_bytes_total");
+    infinoted_metrics_append_label(str, "remote", connection->remote_id);
+    g_string_append_printf(str, " %" G_GUINT64_FORMAT "\n",
+                           connection->bytes_in);
+  }
+
+  infinoted_metrics_append_header(
+    str, "infinoted_connection_sent_bytes_total", "counter",
+    "Bytes of XML sent on a connection, before compression."
+  );
+  for(i = 0; i < connections->len; ++ i)
+  {
+    connection = &g_array_index(connections, InfinotedMetricsConnection, i);
+    g_string_append(str, "infinoted_connection_sent_bytes_total");
+    infinoted_metrics_append_label(str, "remote", connection->remote_id);
+    g_string_append_printf(str, " %" G_GUINT64_FORMAT "\n",
+                           connection->bytes_out);
+  }
+}
+
+static void
+infinoted_metrics_append_trace_site_cb(const InfStandaloneIoTraceSite* site,
+                                       gpointer user_data)
+{
+  GString* str;
+  guint64 count;
+  guint i;
+
+  str = (GString*)user_data;
+  count = 0;
+
+  for(i = 0; i < INF_STANDALONE_IO_TRACE_BUCKETS; ++ i)
+  {
+    count += site->histogram[i];
+
+    g_string_append_printf(
+      str,
+      "infinoted_io_callback_microseconds_bucket"
+      "{type=\"%s\",func=\"%p\",le=\"",
+      site->type,
+      site->func
+    );
+
+    if(i < INF_STANDALONE_IO_TRACE_BUCKETS - 1)
+      g_string_append_printf(str, "%" G_GUINT64_FORMAT, (guint64)2 << i);
+    else
+      g_string_append(str, "+Inf");
+
+    g_string_append_printf(str, "\"} %" G_GUINT64_FORMAT "\n", count);
+  }
+
+  g_string_append_printf(
+    str,
+    "infinoted_io_callback_microseconds_sum{type=\"%s\",func=\"%p\"} "
+    "%" G_GUINT64_FORMAT "\n"
+    "infinoted_io_callback_microseconds_count{type=\"%s\",func=\"%p\"} "
+    "%" G_GUINT64_FORMAT "\n",
+    site->type, site->func, site->total_usec,
+    site->type, site->func, site->n_calls
+  );
+}
+
+static void
+infinoted_metrics_append_server(GString* str,
+                                InfinotedMetrics* metrics)
+{
+  InfCommunicationManager* manager;
+  InfCommunicationRegistry* registry;
+  InfIo* io;
+  InfStandaloneIoStatistics io_statistics;
+  guint n_inner;
+  guint n_outer;
+
+  manager = infd_directory_get_communication_manager(metrics->directory);
+  registry = inf_communication_manager_get_registry(manager);
+  inf_communication_registry_get_queue_lengths(registry, &n_inner, &n_outer);
+
+  infinoted_metrics_append_header(
+    str, "infinoted_registry_inner_queue", "gauge",
+    "Messages passed to connections, but not yet sent."
+  );
+  infinoted_metrics_append_value(
+    str,
+    "infinoted_registry_inner_queue",
+    n_inner
+  );
+
+  infinoted_metrics_append_header(
+    str, "infinoted_registry_outer_queue", "gauge",
+    "Messages waiting to be passed to connections."
+  );
+  infinoted_metrics_append_value(
+    str,
+    "infinoted_registry_outer_queue",
+    n_outer
+  );
+
+  io = infd_directory_get_io(metrics->directory);
+  if(INF_IS_STANDALONE_IO(io))
+  {
+    inf_standalone_io_get_statistics(INF_STANDALONE_IO(io), &io_statistics);
+
+    infinoted_metrics_append_header(
+      str, "infinoted_io_iterations_total", "counter",
+      "Main loop iterations."
+    );
+    infinoted_metrics_append_value(
+      str,
+      "infinoted_io_iterations_total",
+      io_statistics.n_iterations
+    );
+
+    infinoted_metrics_append_header(
+      str, "infinoted_io_busy_microseconds_total", "counter",
+      "Time the main loop spent processing events."
+    );
+    infinoted_metrics_append_value(
+      str,
+      "infinoted_io_busy_microseconds_total",
+      io_statistics.busy_usec
+    );
+
+    infinoted_metrics_append_header(
+      str, "infinoted_io_busy_microseconds_max", "gauge",
+      "Longest time a single main loop iteration spent processing events."
+    );
+    infinoted_metrics_append_value(
+      str,
+      "infinoted_io_busy_microseconds_max",
+      io_statistics.max_busy_usec
+    );
+
+    /* Only available if tracing is enabled with --slow-callback-threshold
+     * or --trace-file. */
+    infinoted_metrics_append_header(
+      str, "infinoted_io_callback_microseconds", "histogram",
+      "Time main loop callbacks took, by callback function."
+    );
+    inf_standalone_io_foreach_trace_site(
+      INF_STANDALONE_IO(io),
+      infinoted_metrics_append_trace_site_cb,
+      str
+    );
+  }
+
+  if(metrics->autosave != NULL)
+  {
+    infinoted_metrics_append_header(
+      str, "infinoted_autosave_saves_total", "counter",
+      "Documents saved by autosave."
+    );
+    infinoted_metrics_append_value(
+      str,
+      "infinoted_autosave_saves_total",
+      metrics->autosave->n_saves
+    );
+
+    infinoted_metrics_append_header(
+      str, "infinoted_autosave_microseconds_total", "counter",
+      "Time spent saving documents by autosave."
+    );
+    infinoted_metrics_append_value(
+      str,
+      "infinoted_autosave_microseconds_total",
+      metrics->autosave->save_usec
+    );
+
+    infinoted_metrics_append_header(
+      str, "infinoted_autosave_microseconds_max", "gauge",
+      "Longest time saving a single document by autosave took."
+    );
+    infinoted_metrics_append_value(
+      str,
+      "infinoted_autosave_microseconds_max",
+      metrics->autosave->max_save_usec
+    );
+  }
+}
+
+static void
+infinoted_metrics_timeout_cb(gpointer user_data)
+{
+  InfinotedMetrics* metrics;
+  metrics = (InfinotedMetrics*)user_data;
+
+  metrics->timeout = NULL;
+  infinoted_metrics_write(metrics);
+}
+
+/**
+ * infinoted_metrics_new:
+ * @directory: A #InfdDirectory.
+ * @metrics_file: The file to write metrics into.
+ * @metrics_interval: The interval in which to write the metrics, in
+ * seconds.
+ *
+ * Creates a new #InfinotedMetrics object which will write runtime metrics
+ * of @directory, its sessions and its connections into @metrics_file
+ * every @metrics_interval seconds. The file is replaced atomically, so that
+ * readers never see a partially written file.
+ *
+ * Returns: A new #InfinotedMetrics. Free with infinoted_metrics_free().
+ */
+InfinotedMetrics*
+infinoted_metrics_new(InfdDirectory* directory,
+                      const gchar* metrics_file,
+                      unsigned int metrics_interval)
+{
+  InfinotedMetrics* metrics;
+
+  metrics = g_slice_new(InfinotedMetrics);
+
+  metrics->directory = directory;
+  metrics->autosave = NULL;
+  metrics->metrics_file = g_strdup(metrics_file);
+  metrics->metrics_interval = metrics_interval;
+  g_object_ref(directory);
+
+  metrics->timeout = inf_io_add_timeout(
+    infd_directory_get_io(directory),
+    metrics_interval * 1000,
+    infinoted_metrics_timeout_cb,
+    metrics,
+    NULL
+  );
+
+  return metrics;
+}
+
+/**
+ * infinoted_metrics_free:
+ * @metrics: A #InfinotedMetrics.
+ *
+ * Frees the given #InfinotedMetrics. The metrics file is left in place.
+ */
+void
+infinoted_metrics_free(InfinotedMetrics* metrics)
+{
+  if(metrics->timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infd_directory_get_io(metrics->directory),
+      metrics->timeout
+    );
+  }
+
+  g_object_unref(metrics->directory);
+  g_free(metrics->metrics_file);
+  g_slice_free(InfinotedMetrics, metrics);
+}
+
+/**
+ * infinoted_metrics_set_autosave:
+ * @metrics: A #InfinotedMetrics.
+ * @autosave: The #InfinotedAutosave of the server, or %NULL.
+ *
+ * Sets the #InfinotedAutosave whose save times to include in the metrics.
+ * This needs to be called again, with %NULL if autosave was disabled, when
+ * the autosave object is replaced.
+ */
+void
+infinoted_metrics_set_autosave(InfinotedMetrics* metrics,
+                               InfinotedAutosave* autosave)
+{
+  metrics->autosave = autosave;
+}
+
+/**
+ * infinoted_metrics_write:
+ * @metrics: A #InfinotedMetrics.
+ *
+ * Writes the current metrics into the metrics file immediately, instead of
+ * waiting for the interval to elapse. The interval starts again afterwards.
+ */
+void
+infinoted_metrics_write(InfinotedMetrics* metrics)
+{
+  InfdDirectoryIter iter;
+  GArray* sessions;
+  GArray* connections;
+  InfinotedMetricsConnection* connection;
+  GString* str;
+  GError* error;
+  guint i;
+
+  if(metrics->timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infd_directory_get_io(metrics->directory),
+      metrics->timeout
+    );
+
+    metrics->timeout = NULL;
+  }
+
+  sessions = g_array_new(FALSE, FALSE, sizeof(InfinotedMetricsSession));
+  infd_directory_iter_get_root(metrics->directory, &iter);
+  infinoted_metrics_collect_sessions(metrics, &iter, sessions);
+
+  connections = g_array_new(FALSE, FALSE, sizeof(InfinotedMetricsConnection));
+  infd_directory_foreach_connection(
+    metrics->directory,
+    infinoted_metrics_collect_connections_cb,
+    connections
+  );
+
+  str = g_string_sized_new(4096);
+  infinoted_metrics_append_sessions(str, sessions);
+  infinoted_metrics_append_connections(str, connections);
+  infinoted_metrics_append_server(str, metrics);
+
+  error = NULL;
+  if(!infinoted_util_create_dirname(metrics->metrics_file, &error) ||
+     !g_file_set_contents(metrics->metrics_file, str->str, str->len, &error))
+  {
+    g_warning(
+      _("Failed to write metrics file \"%s\": %s\n\n"
+        "Will retry in %u seconds."),
+      metrics->metrics_file, error->message, metrics->metrics_interval
+    );
+
+    g_error_free(error);
+  }
+
+  g_string_free(str, TRUE);
+
+  for(i = 0; i < connections->len; ++ i)
+  {
+    connection = &g_array_index(connections, InfinotedMetricsConnection, i);
+    g_free(connection->remote_id);
+  }
+
+  g_array_free(connections, TRUE);
+
+  for(i = 0; i < sessions->len; ++ i)
+    g_free(g_array_index(sessions, InfinotedMetricsSession, i).path);
+  g_array_free(sessions, TRUE);
+
+  metrics->timeout = inf_io_add_timeout(
+    infd_directory_get_io(metrics->directory),
+    metrics->metrics_interval * 1000,
+    infinoted_metrics_timeout_cb,
+    metrics,
+    NULL
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -99,6 +99,36 @@ infinoted_options_policy_from_string(const gchar* string,
   }
 }
 
+static gboolean
+infinoted_options_format_from_string(const gchar* string,
+                                     InfdFilesystemStorageFormat* format,
+                                     GError** error)
+{
+  if(strcmp(string, "xml") == 0)
+  {
+    *format = INFD_FILESYSTEM_STORAGE_FORMAT_XML;
+    return TRUE;
+  }
+  else if(strcmp(string, "binary") == 0)
+  {
+    *format = INFD_FILESYSTEM_STORAGE_FORMAT_BINARY;
+    return TRUE;
+  }
+  else
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_DOCUMENT_FORMAT,
+      _("\"%s\" is not a valid document format. Allowed values are "
+        "\"xml\" or \"binary\""),
+      string
+    );
+
+    return FALSE;
+  }
+}
+
 /* TODO: Correct error handling? We only use this at one point where we know
  * the port is valid anyway. */
 static gint
@@ -130,6 +160,29 @@ infinoted_options_interval_from_integer(gint value,
   return TRUE;
 }
 
+static gboolean
+infinoted_options_compression_level_from_integer(gint value,
+                                                 guint* level,
+                                                 GError** error)
+{
+  if(value < 0 || value > 9)
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_COMPRESSION_LEVEL,
+      _("\"%d\" is not a valid compression level. Compression levels range "
+        "from 0 (no compression) to 9"),
+      value
+    );
+
+    return FALSE;
+  }
+
+  *level = value;
+  return TRUE;
+}
+
 static gboolean
 infinoted_options_port_from_integer(gint value,
                                     guint* port,
@@ -153,6 +206,52 @@ infinoted_options_port_from_integer(gint value,
   return TRUE;
 }
 
+static gboolean
+infinoted_options_preload_threads_from_integer(gint value,
+                                               guint* threads,
+                                               GError** error)
+{
+  if(value < 0)
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_PRELOAD_THREADS,
+      _("\"%d\" is not a valid number of preload threads. The number of "
+        "threads must not be negative"),
+      value
+    );
+
+    return FALSE;
+  }
+
+  *threads = value;
+  return TRUE;
+}
+
+static gboolean
+infinoted_options_preload_max_memory_from_integer(gint value,
+                                                  guint* max_memory,
+                                                  GError** error)
+{
+  if(value < 0)
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_PRELOAD_MAX_MEMORY,
+      _("\"%d\" is not a valid preload memory limit. The limit must not be "
+        "negative, and 0 means no limit"),
+      value
+    );
+
+    return FALSE;
+  }
+
+  *max_memory = value;
+  return TRUE;
+}
+
 static gboolean
 infinoted_options_propagate_key_file_error(GError** error,
                                            GError* key_file_error)
@@ -578,6 +677,36 @@ infinoted_options_validate(InfinotedOptions* options,
 
     return FALSE;
   }
+  else if(options->metrics_file != NULL && options->metrics_interval == 0)
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_METRICS_COMBINATION,
+      "%s",
+      _("A metrics file is given, but the metrics interval is not set. "
+        "Please either set a nonzero metrics interval or unset the metrics "
+        "file using the --metrics-file and --metrics-interval command line "
+        "or config file options.")
+    );
+
+    return FALSE;
+  }
+  else if(options->metrics_file == NULL && options->metrics_interval != 0)
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_METRICS_COMBINATION,
+      "%s",
+      _("A metrics interval is given, but the metrics file is not set. "
+        "Please either set a metrics file, or set the metrics interval to "
+        "zero using the --metrics-file and --metrics-interval command line "
+        "or config file options.")
+    );
+
+    return FALSE;
+  }
 
   return TRUE;
 }
@@ -592,6 +721,8 @@ infinoted_options_load(InfinotedOptions* options,
   const gchar* const* file;
 
   gchar* security_policy;
+  gchar* document_format;
+  gint compression_level;
   gint port_number;
   gboolean display_version;
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
@@ -599,6 +730,13 @@ infinoted_options_load(InfinotedOptions* options,
 #endif
   gint autosave_interval;
   gint sync_interval;
+  gint metrics_interval;
+  gint preload_threads;
+  gint preload_max_memory;
+  gint record_compression;
+  gint record_max_size;
+  gint record_max_age;
+  gint slow_callback_threshold;
   guint i;
 
   gboolean result;
@@ -628,9 +766,38 @@ infinoted_options_load(InfinotedOptions* options,
     { "security-policy", 0, 0,
       G_OPTION_ARG_STRING, NULL,
       N_("How to decide whether to use TLS"), "no-tls|allow-tls|require-tls" },
+    { "compression-level", 0, 0,
+      G_OPTION_ARG_INT, NULL,
+      N_("The zlib compression level to offer clients stream compression "
+         "with, or 0 to disable stream compression"), N_("LEVEL") },
     { "root-directory", 'r', 0,
       G_OPTION_ARG_FILENAME, NULL,
       N_("The directory to store documents into"), N_("DIRECTORY") },
+    { "document-format", 0, 0,
+      G_OPTION_ARG_STRING, NULL,
+      N_("The format to save documents in"), "xml|binary" },
+    { "directory-index", 0, 0,
+      G_OPTION_ARG_NONE, NULL,
+      N_("Keep an index of each directory to explore it without scanning "
+         "it"), NULL },
+    { "preload", 0, 0,
+      G_OPTION_ARG_STRING_ARRAY, NULL,
+      N_("Document to load into memory at startup"), N_("PATH") },
+    { "preload-working-set", 0, 0,
+      G_OPTION_ARG_FILENAME, NULL,
+      N_("A file into which to store the recently used documents at "
+         "shutdown, to load them into memory at the next startup"),
+         N_("FILE") },
+    { "preload-threads", 0, 0,
+      G_OPTION_ARG_INT, NULL,
+      N_("Number of threads loading documents at startup"), N_("THREADS") },
+    { "preload-max-memory", 0, 0,
+      G_OPTION_ARG_INT, NULL,
+      N_("Stop preloading documents once their total size on disk reaches "
+         "this, in megabytes, or 0 for no limit"), N_("SIZE") },
+    { "preload-wait", 0, 0,
+      G_OPTION_ARG_NONE, NULL,
+      N_("Finish preloading documents before accepting connections"), NULL },
     { "autosave-interval", 0, 0,
       G_OPTION_ARG_INT, NULL,
       N_("Interval within which to save documents, in seconds, or 0 to "
@@ -661,6 +828,34 @@ infinoted_options_load(InfinotedOptions* options,
       N_("Interval within which to store documents to the specified "
          "sync-directory, or 0 to disable directory synchronization"),
          N_("INTERVAL") },
+    { "metrics-file", 0, 0,
+      G_OPTION_ARG_FILENAME, NULL,
+      N_("A file into which to periodically write runtime metrics of the "
+         "server"), N_("FILE") },
+    { "metrics-interval", 0, 0,
+      G_OPTION_ARG_INT, NULL,
+      N_("Interval within which to write the metrics file, in seconds, or 0 "
+         "to disable metrics"), N_("INTERVAL") },
+    { "record-compression", 0, 0,
+      G_OPTION_ARG_INT, NULL,
+      N_("The zlib compression level to write session records with, or 0 "
+         "to write uncompressed records"), N_("LEVEL") },
+    { "record-max-size", 0, 0,
+      G_OPTION_ARG_INT, NULL,
+      N_("Continue a session record in a new file once it has reached this "
+         "size, in kilobytes, or 0 for no limit"), N_("SIZE") },
+    { "record-max-age", 0, 0,
+      G_OPTION_ARG_INT, NULL,
+      N_("Continue a session record in a new file after this time, in "
+         "seconds, or 0 for no limit"), N_("SECONDS") },
+    { "slow-callback-threshold", 0, 0,
+      G_OPTION_ARG_INT, NULL,
+      N_("Log main loop callbacks taking longer than this, in milliseconds, "
+         "or 0 to disable"), N_("MSECS") },
+    { "trace-file", 0, 0,
+      G_OPTION_ARG_FILENAME, NULL,
+      N_("A file into which to write a trace of the main loop callbacks of "
+         "the last seconds when receiving SIGUSR1"), N_("FILE") },
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
     { "daemonize", 'd', 0,
       G_OPTION_ARG_NONE, NULL,
@@ -686,7 +881,15 @@ infinoted_options_load(InfinotedOptions* options,
   entries[i++].arg_data = &options->create_certificate;
   entries[i++].arg_data = &port_number;
   entries[i++].arg_data = &security_policy;
+  entries[i++].arg_data = &compression_level;
   entries[i++].arg_data = &options->root_directory;
+  entries[i++].arg_data = &document_format;
+  entries[i++].arg_data = &options->directory_index;
+  entries[i++].arg_data = &options->preload_documents;
+  entries[i++].arg_data = &options->preload_working_set;
+  entries[i++].arg_data = &preload_threads;
+  entries[i++].arg_data = &preload_max_memory;
+  entries[i++].arg_data = &options->preload_wait;
   entries[i++].arg_data = &autosave_interval;
   entries[i++].arg_data = &options->password;
 #ifdef LIBINFINITY_HAVE_PAM
@@ -696,6 +899,13 @@ infinoted_options_load(InfinotedOptions* options,
 #endif /* LIBINFINITY_HAVE_PAM */
   entries[i++].arg_data = &options->sync_directory;
   entries[i++].arg_data = &sync_interval;
+  entries[i++].arg_data = &options->metrics_file;
+  entries[i++].arg_data = &metrics_interval;
+  entries[i++].arg_data = &record_compression;
+  entries[i++].arg_data = &record_max_size;
+  entries[i++].arg_data = &record_max_age;
+  entries[i++].arg_data = &slow_callback_threshold;
+  entries[i++].arg_data = &options->trace_file;
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
   entries[i++].arg_data = &options->daemonize;
   entries[i++].arg_data = &kill_daemon;
@@ -707,9 +917,18 @@ infinoted_options_load(InfinotedOptions* options,
   kill_daemon = FALSE;
 #endif
   security_policy = NULL;
+  document_format = NULL;
+  compression_level = options->compression_level;
   port_number = infinoted_options_port_to_integer(options->port);
   autosave_interval = options->autosave_interval;
   sync_interval = options->sync_interval;
+  metrics_interval = options->metrics_interval;
+  preload_threads = options->preload_threads;
+  preload_max_memory = options->preload_max_memory;
+  record_compression = options->record_compression;
+  record_max_size = options->record_max_size;
+  record_max_age = options->record_max_age;
+  slow_callback_threshold = options->slow_callback_threshold;
 
   if(config_files)
   {
@@ -719,6 +938,7 @@ infinoted_options_load(InfinotedOptions* options,
       {
         g_prefix_error(error, "%s: ", *file);
         g_free(security_policy);
+        g_free(document_format);
         return FALSE;
       }
     }
@@ -735,6 +955,7 @@ infinoted_options_load(InfinotedOptions* options,
     {
       g_option_context_free(context);
       g_free(security_policy);
+      g_free(document_format);
       return FALSE;
     }
 
@@ -748,6 +969,7 @@ infinoted_options_load(InfinotedOptions* options,
     if(kill_daemon)
     {
       g_free(security_policy);
+      g_free(document_format);
 
       infinoted_util_daemon_set_global_pid_file_proc();
       if(infinoted_util_daemon_pid_file_kill(SIGTERM) != 0)
@@ -777,11 +999,34 @@ infinoted_options_load(InfinotedOptions* options,
     );
 
     g_free(security_policy);
+    if(!result)
+    {
+      g_free(document_format);
+      return FALSE;
+    }
+  }
+
+  if(document_format != NULL)
+  {
+    result = infinoted_options_format_from_string(
+      document_format,
+      &options->document_format,
+      error
+    );
+
+    g_free(document_format);
     if(!result) return FALSE;
   }
 
   /* TODO: Do we leak security_policy at this point? */
 
+  result = infinoted_options_compression_level_from_integer(
+    compression_level,
+    &options->compression_level,
+    error
+  );
+  if(!result) return FALSE;
+
   result = infinoted_options_port_from_integer(
     port_number,
     &options->port,
@@ -796,6 +1041,20 @@ infinoted_options_load(InfinotedOptions* options,
   );
   if(!result) return FALSE;
 
+  result = infinoted_options_preload_threads_from_integer(
+    preload_threads,
+    &options->preload_threads,
+    error
+  );
+  if(!result) return FALSE;
+
+  result = infinoted_options_preload_max_memory_from_integer(
+    preload_max_memory,
+    &options->preload_max_memory,
+    error
+  );
+  if(!result) return FALSE;
+
   result = infinoted_options_interval_from_integer(
     sync_interval,
     &options->sync_interval,
@@ -803,12 +1062,64 @@ infinoted_options_load(InfinotedOptions* options,
   );
   if(!result) return FALSE;
 
+  result = infinoted_options_interval_from_integer(
+    metrics_interval,
+    &options->metrics_interval,
+    error
+  );
+  if(!result) return FALSE;
+
+  result = infinoted_options_compression_level_from_integer(
+    record_compression,
+    &options->record_compression,
+    error
+  );
+  if(!result) return FALSE;
+
+  result = infinoted_options_interval_from_integer(
+    record_max_size,
+    &options->record_max_size,
+    error
+  );
+  if(!result) return FALSE;
+
+  result = infinoted_options_interval_from_integer(
+    record_max_age,
+    &options->record_max_age,
+    error
+  );
+  if(!result) return FALSE;
+
+  result = infinoted_options_interval_from_integer(
+    slow_callback_threshold,
+    &options->slow_callback_threshold,
+    error
+  );
+  if(!result) return FALSE;
+
   if(options->password != NULL && strcmp(options->password, "") == 0)
   {
     g_free(options->password);
     options->password = NULL;
   }
 
+  /* treat it as undefining the option if only one entry, which is empty,
+   * is given */
+  if(options->preload_documents != NULL
+     && strcmp(options->preload_documents[0], "") == 0
+     && options->preload_documents[1] == NULL)
+  {
+    g_strfreev(options->preload_documents);
+    options->preload_documents = NULL;
+  }
+
+  if(options->preload_working_set != NULL &&
+     strcmp(options->preload_working_set, "") == 0)
+  {
+    g_free(options->preload_working_set);
+    options->preload_working_set = NULL;
+  }
+
 #ifdef LIBINFINITY_HAVE_PAM
   if(options->pam_service != NULL && strcmp(options->pam_service, "") == 0)
   {
@@ -840,6 +1151,19 @@ infinoted_options_load(InfinotedOptions* options,
     options->sync_directory = NULL;
   }
 
+  if(options->metrics_file != NULL &&
+     strcmp(options->metrics_file, "") == 0)
+  {
+    g_free(options->metrics_file);
+    options->metrics_file = NULL;
+  }
+
+  if(options->trace_file != NULL && strcmp(options->trace_file, "") == 0)
+  {
+    g_free(options->trace_file);
+    options->trace_file = NULL;
+  }
+
   return infinoted_options_validate(options, error);
 }
 
@@ -880,8 +1204,16 @@ infinoted_options_new(const gchar* const* config_files,
   options->create_certificate = FALSE;
   options->port = inf_protocol_get_default_port();
   options->security_policy = INF_XMPP_CONNECTION_SECURITY_BOTH_PREFER_TLS;
+  options->compression_level = 0;
   options->root_directory =
     g_build_filename(g_get_home_dir(), ".infinote", NULL);
+  options->document_format = INFD_FILESYSTEM_STORAGE_FORMAT_XML;
+  options->directory_index = FALSE;
+  options->preload_documents = NULL;
+  options->preload_working_set = NULL;
+  options->preload_threads = 4;
+  options->preload_max_memory = 0;
+  options->preload_wait = FALSE;
   options->autosave_interval = 0;
   options->password = NULL;
 #ifdef LIBINFINITY_HAVE_PAM
@@ -891,6 +1223,13 @@ infinoted_options_new(const gchar* const* config_files,
 #endif /* LIBINFINITY_HAVE_PAM */
   options->sync_directory = NULL;
   options->sync_interval = 0;
+  options->metrics_file = NULL;
+  options->metrics_interval = 0;
+  options->record_compression = 0;
+  options->record_max_size = 0;
+  options->record_max_age = 0;
+  options->slow_callback_threshold = 0;
+  options->trace_file = NULL;
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
   options->daemonize = FALSE;
@@ -918,6 +1257,8 @@ infinoted_options_free(InfinotedOptions* options)
   g_free(options->certificate_file);
   g_free(options->certificate_chain_file);
   g_free(options->root_directory);
+  g_strfreev(options->preload_documents);
+  g_free(options->preload_working_set);
   g_free(options->password);
 #ifdef LIBINFINITY_HAVE_PAM
   g_free(options->pam_service);
@@ -925,6 +1266,8 @@ infinoted_options_free(InfinotedOptions* options)
   g_strfreev(options->pam_allowed_groups);
 #endif
   g_free(options->sync_directory);
+  g_free(options->metrics_file);
+  g_free(options->trace_file);
   g_slice_free(InfinotedOptions, options);
 }
 
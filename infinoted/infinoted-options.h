@@ -20,6 +20,7 @@
 #ifndef __INFINOTED_OPTIONS_H__
 #define __INFINOTED_OPTIONS_H__
 
+#include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/inf-config.h>
 
@@ -36,7 +37,15 @@ struct _InfinotedOptions {
   gboolean create_certificate;
   guint port;
   InfXmppConnectionSecurityPolicy security_policy;
+  guint compression_level;
   gchar* root_directory;
+  InfdFilesystemStorageFormat document_format;
+  gboolean directory_index;
+  gchar** preload_documents;
+  gchar* preload_working_set;
+  guint preload_threads;
+  guint preload_max_memory;
+  gboolean preload_wait;
   guint autosave_interval;
   gchar* password;
 #ifdef LIBINFINITY_HAVE_PAM
@@ -48,6 +57,16 @@ struct _InfinotedOptions {
   gchar* sync_directory;
   guint sync_interval;
 
+  gchar* metrics_file;
+  guint metrics_interval;
+
+  guint record_compression;
+  guint record_max_size;
+  guint record_max_age;
+
+  guint slow_callback_threshold;
+  gchar* trace_file;
+
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
   gboolean daemonize;
 #endif
@@ -61,7 +80,12 @@ typedef enum _InfinotedOptionsError {
   INFINOTED_OPTIONS_ERROR_EMPTY_KEY_FILE,
   INFINOTED_OPTIONS_ERROR_EMPTY_CERTIFICATE_FILE,
   INFINOTED_OPTIONS_ERROR_INVALID_SYNC_COMBINATION,
-  INFINOTED_OPTIONS_ERROR_INVALID_AUTHENTICATION_SETTINGS
+  INFINOTED_OPTIONS_ERROR_INVALID_AUTHENTICATION_SETTINGS,
+  INFINOTED_OPTIONS_ERROR_INVALID_COMPRESSION_LEVEL,
+  INFINOTED_OPTIONS_ERROR_INVALID_METRICS_COMBINATION,
+  INFINOTED_OPTIONS_ERROR_INVALID_DOCUMENT_FORMAT,
+  INFINOTED_OPTIONS_ERROR_INVALID_PRELOAD_THREADS,
+  INFINOTED_OPTIONS_ERROR_INVALID_PRELOAD_MAX_MEMORY
 } InfinotedOptionsError;
 
 InfinotedOptions*
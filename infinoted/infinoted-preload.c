@@ -0,0 +1,803 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-preload.h>
+#include <infinoted/infinoted-util.h>
+
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/inf-i18n.h>
+#include <libinfinity/inf-signals.h>
+
+#include <libxml/parser.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+
+/* Minimum time between two progress messages, in seconds */
+#define INFINOTED_PRELOAD_PROGRESS_INTERVAL 1
+
+/* Maximum number of documents remembered in the working set file */
+#define INFINOTED_PRELOAD_MAX_WORKING_SET 1000
+
+typedef struct _InfinotedPreloadDocument InfinotedPreloadDocument;
+struct _InfinotedPreloadDocument {
+  gchar* path;
+  const InfdNotePlugin* plugin;
+
+  /* Result of loading the document, set by the worker thread */
+  InfSession* session;
+  GError* error;
+  gboolean skipped;
+
+  /* Set in the main thread when the directory opened the document itself
+   * while it was being loaded. The loaded session is outdated then, since
+   * the document might have been changed, saved and unloaded again. */
+  gboolean opened;
+};
+
+/* A preloaded session which has not been used yet. Once it is, its
+ * document is moved to the front of the working set. */
+typedef struct _InfinotedPreloadWatch InfinotedPreloadWatch;
+struct _InfinotedPreloadWatch {
+  InfinotedPreload* preload;
+  InfdSessionProxy* proxy;
+  gchar* path;
+};
+
+static void
+infinoted_preload_document_free(InfinotedPreloadDocument* document)
+{
+  if(document->session != NULL)
+    g_object_unref(document->session);
+  if(document->error != NULL)
+    g_error_free(document->error);
+
+  g_free(document->path);
+  g_slice_free(InfinotedPreloadDocument, document);
+}
+
+/* Marks the document with the given path as the most recently used one */
+static void
+infinoted_preload_touch(InfinotedPreload* preload,
+                        const gchar* path)
+{
+  GList* item;
+
+  for(item = preload->working_set; item != NULL; item = item->next)
+    if(strcmp(item->data, path) == 0)
+      break;
+
+  if(item != NULL)
+  {
+    preload->working_set = g_list_remove_link(preload->working_set, item);
+    preload->working_set = g_list_concat(item, preload->working_set);
+  }
+  else
+  {
+    preload->working_set =
+      g_list_prepend(preload->working_set, g_strdup(path));
+  }
+}
+
+/* Sets iter to the node with the given path. Does not set an error, since
+ * documents in the working set might have been removed in the meanwhile. */
+static gboolean
+infinoted_preload_lookup(InfdDirectory* directory,
+                         const gchar* path,
+                         InfdDirectoryIter* iter)
+{
+  gchar** components;
+  gchar** component;
+  gboolean found;
+
+  infd_directory_iter_get_root(directory, iter);
+  components = g_strsplit(path, "/", 0);
+  found = TRUE;
+
+  for(component = components; *component != NULL && found; ++ component)
+  {
+    if(**component == '\0')
+      continue;
+
+    if(infd_directory_iter_get_node_type(directory, iter) !=
+       INFD_STORAGE_NODE_SUBDIRECTORY)
+    {
+      found = FALSE;
+    }
+    else if(!infd_directory_iter_get_child(directory, iter, NULL))
+    {
+      found = FALSE;
+    }
+    else
+    {
+      while(strcmp(infd_directory_iter_get_name(directory, iter),
+                   *component) != 0)
+      {
+        if(!infd_directory_iter_get_next(directory, iter))
+        {
+          found = FALSE;
+          break;
+        }
+      }
+    }
+  }
+
+  g_strfreev(components);
+  return found;
+}
+
+static void
+infinoted_preload_watch_free(InfinotedPreloadWatch* watch);
+
+static void
+infinoted_preload_watch_notify_idle_cb(GObject* object,
+                                       GParamSpec* pspec,
+                                       gpointer user_data)
+{
+  InfinotedPreloadWatch* watch;
+  watch = (InfinotedPreloadWatch*)user_data;
+
+  if(!infd_session_proxy_is_idle(watch->proxy))
+  {
+    infinoted_preload_touch(watch->preload, watch->path);
+    infinoted_preload_watch_free(watch);
+  }
+}
+
+static void
+infinoted_preload_watch_weak_notify(gpointer data,
+                                    GObject* where_the_object_was)
+{
+  InfinotedPreloadWatch* watch;
+  watch = (InfinotedPreloadWatch*)data;
+
+  watch->preload->watches = g_slist_remove(watch->preload->watches, watch);
+  g_free(watch->path);
+  g_slice_free(InfinotedPreloadWatch, watch);
+}
+
+static void
+infinoted_preload_watch_free(InfinotedPreloadWatch* watch)
+{
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(watch->proxy),
+    G_CALLBACK(infinoted_preload_watch_notify_idle_cb),
+    watch
+  );
+
+  g_object_weak_unref(
+    G_OBJECT(watch->proxy),
+    infinoted_preload_watch_weak_notify,
+    watch
+  );
+
+  infinoted_preload_watch_weak_notify(watch, G_OBJECT(watch->proxy));
+}
+
+static void
+infinoted_preload_watch(InfinotedPreload* preload,
+                        InfdSessionProxy* proxy,
+                        const gchar* path)
+{
+  InfinotedPreloadWatch* watch;
+
+  watch = g_slice_new(InfinotedPreloadWatch);
+  watch->preload = preload;
+  watch->proxy = proxy;
+  watch->path = g_strdup(path);
+
+  g_signal_connect(
+    G_OBJECT(proxy),
+    "notify::idle",
+    G_CALLBACK(infinoted_preload_watch_notify_idle_cb),
+    watch
+  );
+
+  g_object_weak_ref(
+    G_OBJECT(proxy),
+    infinoted_preload_watch_weak_notify,
+    watch
+  );
+
+  preload->watches = g_slist_prepend(preload->watches, watch);
+}
+
+static void
+infinoted_preload_directory_add_session_cb(InfdDirectory* directory,
+                                           InfdDirectoryIter* iter,
+                                           InfdSessionProxy* proxy,
+                                           gpointer user_data)
+{
+  InfinotedPreload* preload;
+  InfinotedPreloadDocument* document;
+  gchar* path;
+
+  preload = (InfinotedPreload*)user_data;
+
+  /* Sessions we preloaded ourselves only count as used once somebody
+   * subscribes to them. */
+  if(preload->linking)
+    return;
+
+  path = infd_directory_iter_get_path(directory, iter);
+
+  document = g_hash_table_lookup(preload->documents, path);
+  if(document != NULL)
+    document->opened = TRUE;
+
+  infinoted_preload_touch(preload, path);
+  g_free(path);
+}
+
+/* Returns the size of the document on disk, which we use as an estimate of
+ * the memory it takes when loaded. */
+static guint64
+infinoted_preload_get_size(InfdStorage* storage,
+                           InfinotedPreloadDocument* document)
+{
+  FILE* stream;
+  struct stat stat_buf;
+  guint64 size;
+
+  if(!INFD_IS_FILESYSTEM_STORAGE(storage))
+    return 0;
+
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    document->plugin->note_type,
+    document->path,
+    "r",
+    NULL
+  );
+
+  if(stream == NULL)
+    return 0;
+
+  size = 0;
+  if(fstat(fileno(stream), &stat_buf) == 0)
+    size = stat_buf.st_size;
+
+  fclose(stream);
+  return size;
+}
+
+static void
+infinoted_preload_dispatch_func(gpointer user_data);
+
+static gpointer
+infinoted_preload_thread_func(gpointer data)
+{
+  InfinotedPreload* preload;
+  InfinotedPreloadDocument* document;
+  guint64 size;
+
+  preload = (InfinotedPreload*)data;
+
+  g_mutex_lock(preload->mutex);
+  while((document = g_queue_pop_head(preload->pending)) != NULL)
+  {
+    g_mutex_unlock(preload->mutex);
+    size = infinoted_preload_get_size(preload->storage, document);
+    g_mutex_lock(preload->mutex);
+
+    if(preload->max_memory > 0 &&
+       preload->memory + size > preload->max_memory)
+    {
+      document->skipped = TRUE;
+    }
+    else
+    {
+      preload->memory += size;
+      g_mutex_unlock(preload->mutex);
+
+      /* The session is not known to anyone else until it is handed to the
+       * directory in the main thread, so it is safe to create it here. */
+      document->session = document->plugin->session_read(
+        preload->storage,
+        infd_directory_get_io(preload->directory),
+        infd_directory_get_communication_manager(preload->directory),
+        document->path,
+        document->plugin->user_data,
+        &document->error
+      );
+
+      g_mutex_lock(preload->mutex);
+    }
+
+    g_queue_push_tail(preload->loaded, document);
+    if(preload->dispatch == NULL)
+    {
+      preload->dispatch = inf_io_add_dispatch(
+        infd_directory_get_io(preload->directory),
+        infinoted_preload_dispatch_func,
+        preload,
+        NULL
+      );
+    }
+  }
+
+  g_mutex_unlock(preload->mutex);
+  return NULL;
+}
+
+static void
+infinoted_preload_link(InfinotedPreload* preload,
+                       InfinotedPreloadDocument* document)
+{
+  InfdDirectoryIter iter;
+  InfdSessionProxy* proxy;
+
+  /* The document might have been opened by the directory, or removed, or
+   * the storage might have been replaced by a config reload, while it was
+   * loaded. */
+  if(document->opened ||
+     infd_directory_get_storage(preload->directory) != preload->storage ||
+     !infinoted_preload_lookup(preload->directory, document->path, &iter) ||
+     infd_directory_iter_get_node_type(preload->directory, &iter) !=
+       INFD_STORAGE_NODE_NOTE ||
+     infd_directory_iter_get_plugin(preload->directory, &iter) !=
+       document->plugin)
+  {
+    ++ preload->n_skipped;
+    return;
+  }
+
+  preload->linking = TRUE;
+  proxy = infd_directory_iter_set_session(
+    preload->directory,
+    &iter,
+    document->session
+  );
+  preload->linking = FALSE;
+
+  /* Somebody might have opened the document before we were done */
+  if(infd_session_proxy_get_session(proxy) == document->session)
+    infinoted_preload_watch(preload, proxy, document->path);
+
+  ++ preload->n_done;
+}
+
+static void
+infinoted_preload_report(InfinotedPreload* preload)
+{
+  GTimeVal now;
+  guint n_processed;
+
+  n_processed = preload->n_done + preload->n_failed + preload->n_skipped;
+  g_get_current_time(&now);
+
+  if(n_processed == preload->n_total)
+  {
+    infinoted_util_log_info(
+      _("Preloaded %u of %u documents in %.1f seconds (%u failed, "
+        "%u skipped)"),
+      preload->n_done,
+      preload->n_total,
+      (now.tv_sec - preload->started.tv_sec) +
+        (now.tv_usec - preload->started.tv_usec) / 1e6,
+      preload->n_failed,
+      preload->n_skipped
+    );
+  }
+  else if(now.tv_sec - preload->last_progress.tv_sec >=
+          INFINOTED_PRELOAD_PROGRESS_INTERVAL)
+  {
+    infinoted_util_log_info(
+      _("Preloading documents: %u of %u done"),
+      n_processed,
+      preload->n_total
+    );
+
+    preload->last_progress = now;
+  }
+}
+
+static void
+infinoted_preload_dispatch_func(gpointer user_data)
+{
+  InfinotedPreload* preload;
+  InfinotedPreloadDocument* document;
+  GQueue* loaded;
+
+  preload = (InfinotedPreload*)user_data;
+
+  g_mutex_lock(preload->mutex);
+  loaded = preload->loaded;
+  preload->loaded = g_queue_new();
+  preload->dispatch = NULL;
+  g_mutex_unlock(preload->mutex);
+
+  while((document = g_queue_pop_head(loaded)) != NULL)
+  {
+    if(document->skipped)
+    {
+      ++ preload->n_skipped;
+    }
+    else if(document->session == NULL)
+    {
+      infinoted_util_log_warning(
+        _("Failed to preload document \"%s\": %s"),
+        document->path,
+        document->error->message
+      );
+
+      ++ preload->n_failed;
+    }
+    else
+    {
+      infinoted_preload_link(preload, document);
+    }
+
+    g_hash_table_remove(preload->documents, document->path);
+    infinoted_preload_document_free(document);
+  }
+
+  g_queue_free(loaded);
+  infinoted_preload_report(preload);
+}
+
+static void
+infinoted_preload_add(InfinotedPreload* preload,
+                      const gchar* path,
+                      gboolean warn)
+{
+  InfinotedPreloadDocument* document;
+  InfdDirectoryIter iter;
+
+  if(g_hash_table_lookup(preload->documents, path) != NULL)
+    return;
+
+  if(!infinoted_preload_lookup(preload->directory, path, &iter) ||
+     infd_directory_iter_get_node_type(preload->directory, &iter) !=
+       INFD_STORAGE_NODE_NOTE)
+  {
+    if(warn)
+    {
+      infinoted_util_log_warning(
+        _("Document \"%s\" to preload does not exist"),
+        path
+      );
+    }
+
+    return;
+  }
+
+  /* Only load documents which are not loaded yet */
+  if(infd_directory_iter_peek_session(preload->directory, &iter) != NULL)
+    return;
+
+  document = g_slice_new(InfinotedPreloadDocument);
+  document->path = g_strdup(path);
+  document->plugin =
+    infd_directory_iter_get_plugin(preload->directory, &iter);
+  document->session = NULL;
+  document->error = NULL;
+  document->skipped = FALSE;
+  document->opened = FALSE;
+
+  g_hash_table_insert(preload->documents, document->path, document);
+  g_queue_push_tail(preload->pending, document);
+  ++ preload->n_total;
+}
+
+static void
+infinoted_preload_read_working_set(InfinotedPreload* preload)
+{
+  gchar* content;
+  gchar** lines;
+  gchar** line;
+  GError* error;
+
+  error = NULL;
+  if(!g_file_get_contents(preload->working_set_file, &content, NULL, &error))
+  {
+    /* There is no working set before the first run */
+    if(error->domain != G_FILE_ERROR || error->code != G_FILE_ERROR_NOENT)
+    {
+      infinoted_util_log_warning(
+        _("Failed to read working set \"%s\": %s"),
+        preload->working_set_file,
+        error->message
+      );
+    }
+
+    g_error_free(error);
+    return;
+  }
+
+  lines = g_strsplit(content, "\n", 0);
+  g_free(content);
+
+  for(line = lines; *line != NULL; ++ line)
+  {
+    if(**line != '\0')
+    {
+      preload->working_set =
+        g_list_prepend(preload->working_set, g_strdup(*line));
+    }
+  }
+
+  preload->working_set = g_list_reverse(preload->working_set);
+  g_strfreev(lines);
+}
+
+static void
+infinoted_preload_write_working_set(InfinotedPreload* preload)
+{
+  GString* content;
+  GList* item;
+  guint count;
+  GError* error;
+
+  content = g_string_new(NULL);
+  count = 0;
+  for(item = preload->working_set;
+      item != NULL && count < INFINOTED_PRELOAD_MAX_WORKING_SET;
+      item = item->next, ++ count)
+  {
+    g_string_append(content, item->data);
+    g_string_append_c(content, '\n');
+  }
+
+  error = NULL;
+  if(!infinoted_util_create_dirname(preload->working_set_file, &error) ||
+     !g_file_set_contents(preload->working_set_file, content->str,
+                          content->len, &error))
+  {
+    infinoted_util_log_warning(
+      _("Failed to write working set \"%s\": %s"),
+      preload->working_set_file,
+      error->message
+    );
+
+    g_error_free(error);
+  }
+
+  g_string_free(content, TRUE);
+}
+
+/**
+ * infinoted_preload_new:
+ * @directory: The directory whose documents to preload.
+ * @documents: A %NULL-terminated list of document paths to preload, or
+ * %NULL.
+ * @working_set_file: A file to keep the documents used in a run in, or
+ * %NULL.
+ * @n_threads: The number of threads to load documents with.
+ * @max_memory: The total size in bytes of the documents to preload, or 0
+ * for no limit.
+ *
+ * Starts loading the given documents, and the documents in the working set
+ * file, in @n_threads background threads. Loaded documents are handed to
+ * @directory in the main loop, which keeps them until they have been used.
+ * Documents in the working set are loaded most recently used first. The
+ * size of a document on disk is used as an estimate of the memory it needs
+ * for checking @max_memory.
+ *
+ * If @working_set_file is non-%NULL, then the documents that are used while
+ * the preloader exists are recorded, and written into that file when it
+ * is freed, so that they can be preloaded on the next start.
+ *
+ * Returns: A new #InfinotedPreload. Free with infinoted_preload_free().
+ */
+InfinotedPreload*
+infinoted_preload_new(InfdDirectory* directory,
+                      const gchar* const* documents,
+                      const gchar* working_set_file,
+                      guint n_threads,
+                      guint64 max_memory)
+{
+  InfinotedPreload* preload;
+  const gchar* const* document;
+  GList* item;
+  GThread* thread;
+  GError* error;
+  guint i;
+
+  preload = g_slice_new(InfinotedPreload);
+  preload->directory = directory;
+  preload->storage = infd_directory_get_storage(directory);
+  preload->working_set_file = g_strdup(working_set_file);
+  preload->max_memory = max_memory;
+  preload->working_set = NULL;
+  preload->watches = NULL;
+  preload->linking = FALSE;
+  preload->documents = g_hash_table_new(g_str_hash, g_str_equal);
+  preload->mutex = g_mutex_new();
+  preload->threads = NULL;
+  preload->pending = g_queue_new();
+  preload->loaded = g_queue_new();
+  preload->dispatch = NULL;
+  preload->memory = 0;
+  preload->n_total = 0;
+  preload->n_done = 0;
+  preload->n_failed = 0;
+  preload->n_skipped = 0;
+
+  g_object_ref(directory);
+  if(preload->storage != NULL)
+    g_object_ref(preload->storage);
+
+  g_get_current_time(&preload->started);
+  preload->last_progress = preload->started;
+
+  g_signal_connect_after(
+    G_OBJECT(directory),
+    "add-session",
+    G_CALLBACK(infinoted_preload_directory_add_session_cb),
+    preload
+  );
+
+  if(preload->working_set_file != NULL)
+    infinoted_preload_read_working_set(preload);
+
+  /* Without a storage, all documents are in memory anyway */
+  if(preload->storage == NULL)
+    return preload;
+
+  if(documents != NULL)
+    for(document = documents; *document != NULL; ++ document)
+      infinoted_preload_add(preload, *document, TRUE);
+
+  for(item = preload->working_set; item != NULL; item = item->next)
+    infinoted_preload_add(preload, item->data, FALSE);
+
+  if(preload->n_total == 0)
+    return preload;
+
+  infinoted_util_log_info(
+    _("Preloading %u documents"),
+    preload->n_total
+  );
+
+  /* libxml2 needs to be initialized in the main thread */
+  xmlInitParser();
+
+  if(n_threads > preload->n_total) n_threads = preload->n_total;
+  if(n_threads == 0) n_threads = 1;
+
+  for(i = 0; i < n_threads; ++ i)
+  {
+    error = NULL;
+    thread = g_thread_create(
+      infinoted_preload_thread_func,
+      preload,
+      TRUE,
+      &error
+    );
+
+    if(thread == NULL)
+    {
+      infinoted_util_log_warning(
+        _("Failed to start preload thread: %s"),
+        error->message
+      );
+
+      g_error_free(error);
+      break;
+    }
+
+    preload->threads = g_slist_prepend(preload->threads, thread);
+  }
+
+  /* Load everything in the main thread if we could not start a thread */
+  if(preload->threads == NULL)
+  {
+    infinoted_preload_thread_func(preload);
+    if(preload->dispatch != NULL)
+    {
+      inf_io_remove_dispatch(
+        infd_directory_get_io(preload->directory),
+        preload->dispatch
+      );
+    }
+
+    infinoted_preload_dispatch_func(preload);
+  }
+
+  return preload;
+}
+
+/**
+ * infinoted_preload_free:
+ * @preload: A #InfinotedPreload.
+ *
+ * Stops preloading documents and frees @preload. Documents that have been
+ * preloaded already stay in the directory. If a working set file was given,
+ * the working set is written into it.
+ */
+void
+infinoted_preload_free(InfinotedPreload* preload)
+{
+  InfinotedPreloadDocument* document;
+  GSList* item;
+  GList* set_item;
+
+  /* The documents are freed below */
+  g_hash_table_destroy(preload->documents);
+
+  g_mutex_lock(preload->mutex);
+  while((document = g_queue_pop_head(preload->pending)) != NULL)
+    infinoted_preload_document_free(document);
+  g_mutex_unlock(preload->mutex);
+
+  for(item = preload->threads; item != NULL; item = item->next)
+    g_thread_join((GThread*)item->data);
+  g_slist_free(preload->threads);
+
+  if(preload->dispatch != NULL)
+  {
+    inf_io_remove_dispatch(
+      infd_directory_get_io(preload->directory),
+      preload->dispatch
+    );
+  }
+
+  while((document = g_queue_pop_head(preload->loaded)) != NULL)
+    infinoted_preload_document_free(document);
+
+  while(preload->watches != NULL)
+    infinoted_preload_watch_free(preload->watches->data);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(preload->directory),
+    G_CALLBACK(infinoted_preload_directory_add_session_cb),
+    preload
+  );
+
+  if(preload->working_set_file != NULL)
+    infinoted_preload_write_working_set(preload);
+
+  for(set_item = preload->working_set; set_item != NULL;
+      set_item = set_item->next)
+  {
+    g_free(set_item->data);
+  }
+
+  g_list_free(preload->working_set);
+  g_queue_free(preload->pending);
+  g_queue_free(preload->loaded);
+  g_mutex_free(preload->mutex);
+  g_free(preload->working_set_file);
+
+  if(preload->storage != NULL)
+    g_object_unref(preload->storage);
+  g_object_unref(preload->directory);
+
+  g_slice_free(InfinotedPreload, preload);
+}
+
+/**
+ * infinoted_preload_is_finished:
+ * @preload: A #InfinotedPreload.
+ *
+ * Returns whether all documents have been preloaded, or could not be
+ * preloaded.
+ *
+ * Returns: Whether preloading has finished.
+ */
+gboolean
+infinoted_preload_is_finished(InfinotedPreload* preload)
+{
+  return preload->n_done + preload->n_failed + preload->n_skipped ==
+    preload->n_total;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,81 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INFINOTED_PRELOAD_H__
+#define __INFINOTED_PRELOAD_H__
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _InfinotedPreload InfinotedPreload;
+struct _InfinotedPreload {
+  InfdDirectory* directory;
+  InfdStorage* storage;
+  gchar* working_set_file;
+  guint64 max_memory;
+
+  /* Recently used documents, most recently used first */
+  GList* working_set;
+  /* Preloaded sessions that have not been used yet */
+  GSList* watches;
+  /* Set while handing a preloaded session to the directory */
+  gboolean linking;
+  /* Documents that have not been handed to the directory yet, by path.
+   * Only used in the main thread. */
+  GHashTable* documents;
+
+  GMutex* mutex;
+  GSList* threads;
+  /* Documents still to be loaded, and loaded documents to be handed to the
+   * directory. Protected by mutex. */
+  GQueue* pending;
+  GQueue* loaded;
+  InfIoDispatch* dispatch;
+  guint64 memory;
+
+  guint n_total;
+  guint n_done;
+  guint n_failed;
+  guint n_skipped;
+  GTimeVal started;
+  GTimeVal last_progress;
+};
+
+InfinotedPreload*
+infinoted_preload_new(InfdDirectory* directory,
+                      const gchar* const* documents,
+                      const gchar* working_set_file,
+                      guint n_threads,
+                      guint64 max_memory);
+
+void
+infinoted_preload_free(InfinotedPreload* preload);
+
+gboolean
+infinoted_preload_is_finished(InfinotedPreload* preload);
+
+G_END_DECLS
+
+#endif /* __INFINOTED_PRELOAD_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -24,63 +24,100 @@
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
-static InfAdoptedSessionRecord*
-infinoted_record_start_real(InfAdoptedSession* session,
-                            const gchar* filename,
-                            const gchar* title)
-{
-  GError* error;
-  InfAdoptedSessionRecord* record;
+/* Interval in which to check whether records need to be rotated, in
+ * seconds. */
+#define INFINOTED_RECORD_CHECK_INTERVAL 10
 
-  record = inf_adopted_session_record_new(session);
-  error = NULL;
+/* Maximum number of record files per document */
+#define INFINOTED_RECORD_MAX_FILES 100000
 
-  inf_adopted_session_record_start_recording(record, filename, &error);
+typedef struct _InfinotedRecordSession InfinotedRecordSession;
+struct _InfinotedRecordSession {
+  InfAdoptedSessionRecord* record;
+  gchar* title;
 
-  if(error != NULL)
-  {
-    g_warning(_("Error while writing record for session "
-                "\"%s\" into \"%s\": %s"),
-              title, filename, error->message);
-    g_error_free(error);
-    g_object_unref(record);
-    return NULL;
-  }
-  else
-  {
-    return record;
-  }
-}
+  /* When the current file was started, and how large it was after the
+   * initial state has been written to it. */
+  time_t started;
+  guint64 initial_size;
+};
 
-static InfAdoptedSessionRecord*
-infinoted_record_start(InfAdoptedSession* session,
-                       const gchar* title)
+static void
+infinoted_record_schedule_check(InfinotedRecord* record);
+
+/* Returns the name of the next record file for the document with the given
+ * title. The number of the next file is kept in an index file next to the
+ * records, so that we do not need to probe for an unused filename. */
+static gchar*
+infinoted_record_make_filename(InfinotedRecord* record,
+                               const gchar* title)
 {
   gchar* dirname;
   gchar* basename;
+  gchar* index_file;
+  gchar* contents;
   gchar* filename;
+  gchar* compressed;
+  gboolean exists;
+  GError* error;
   guint i;
-  gsize pos;
-  InfAdoptedSessionRecord* record;
 
   dirname = g_build_filename(g_get_home_dir(), ".infinoted-records", NULL);
-  basename = g_build_filename(dirname, title, NULL);
 
-  pos = strlen(basename) + 8;
-  filename = g_strdup_printf("%s.record-00000.xml", basename);
-  g_free(basename);
+  /* TODO: Use GetLastError() on Win32 */
+  if(g_mkdir_with_parents(dirname, 0700) == -1)
+  {
+    g_warning(
+      _("Could not create record file directory \"%s\": %s"),
+      dirname,
+      strerror(errno)
+    );
+
+    g_free(dirname);
+    return NULL;
+  }
+
+  basename = g_build_filename(dirname, title, NULL);
+  index_file = g_strdup_printf("%s.record-index", basename);
 
   i = 0;
-  while(g_file_test(filename, G_FILE_TEST_EXISTS) && ++i < 100000)
+  if(g_file_get_contents(index_file, &contents, NULL, NULL))
   {
-    g_snprintf(filename + pos, 10, "%05u.xml", i);
+    i = strtoul(contents, NULL, 10);
+    g_free(contents);
   }
 
-  record = NULL;
-  if(i >= 100000)
+  /* Normally the file the index points to is unused. Still check, in case
+   * the index is missing or out of date. */
+  filename = NULL;
+  for(; i < INFINOTED_RECORD_MAX_FILES; ++i)
+  {
+    filename = g_strdup_printf("%s.record-%05u.xml", basename, i);
+    compressed = g_strdup_printf("%s.gz", filename);
+
+    exists = g_file_test(filename, G_FILE_TEST_EXISTS) ||
+             g_file_test(compressed, G_FILE_TEST_EXISTS);
+
+    if(!exists && record->compression > 0)
+    {
+      g_free(filename);
+      filename = compressed;
+      break;
+    }
+
+    g_free(compressed);
+    if(!exists) break;
+
+    g_free(filename);
+    filename = NULL;
+  }
+
+  if(filename == NULL)
   {
     g_warning(
       _("Could not create record file for session \"%s\": Could not generate "
@@ -91,24 +128,171 @@ infinoted_record_start(InfAdoptedSession* session,
   }
   else
   {
-    /* TODO: Use GetLastError() on Win32 */
-    if(g_mkdir_with_parents(dirname, 0700) == -1)
+    contents = g_strdup_printf("%u\n", i + 1);
+    error = NULL;
+
+    if(!g_file_set_contents(index_file, contents, -1, &error))
     {
       g_warning(
-        _("Could not create record file directory \"%s\": %s"),
-        strerror(errno)
+        _("Could not write record index \"%s\": %s"),
+        index_file,
+        error->message
       );
+
+      g_error_free(error);
     }
-    else
+
+    g_free(contents);
+  }
+
+  g_free(index_file);
+  g_free(basename);
+  g_free(dirname);
+
+  return filename;
+}
+
+static InfinotedRecordSession*
+infinoted_record_start(InfinotedRecord* record,
+                       InfAdoptedSession* session,
+                       const gchar* title)
+{
+  InfinotedRecordSession* rec;
+  InfAdoptedSessionRecord* session_record;
+  gchar* filename;
+  GError* error;
+
+  filename = infinoted_record_make_filename(record, title);
+  if(filename == NULL) return NULL;
+
+  session_record = inf_adopted_session_record_new(session);
+
+  g_object_set(
+    G_OBJECT(session_record),
+    "compression", record->compression,
+    NULL
+  );
+
+  error = NULL;
+  inf_adopted_session_record_start_recording(session_record, filename, &error);
+
+  if(error != NULL)
+  {
+    g_warning(_("Error while writing record for session "
+                "\"%s\" into \"%s\": %s"),
+              title, filename, error->message);
+    g_error_free(error);
+    g_object_unref(session_record);
+    g_free(filename);
+    return NULL;
+  }
+
+  g_free(filename);
+
+  rec = g_slice_new(InfinotedRecordSession);
+  rec->record = session_record;
+  rec->title = g_strdup(title);
+  rec->started = time(NULL);
+  rec->initial_size =
+    inf_adopted_session_record_get_bytes_written(session_record);
+
+  return rec;
+}
+
+static void
+infinoted_record_session_free(InfinotedRecordSession* rec)
+{
+  g_object_unref(rec->record);
+  g_free(rec->title);
+  g_slice_free(InfinotedRecordSession, rec);
+}
+
+static void
+infinoted_record_rotate(InfinotedRecord* record,
+                        InfinotedRecordSession* rec)
+{
+  gchar* filename;
+  GError* error;
+
+  filename = infinoted_record_make_filename(record, rec->title);
+  if(filename == NULL) return;
+
+  g_object_set(
+    G_OBJECT(rec->record),
+    "compression", record->compression,
+    NULL
+  );
+
+  error = NULL;
+  if(!inf_adopted_session_record_rotate(rec->record, filename, &error))
+  {
+    g_warning(_("Error while writing record for session "
+                "\"%s\" into \"%s\": %s"),
+              rec->title, filename, error->message);
+    g_error_free(error);
+  }
+
+  rec->started = time(NULL);
+  rec->initial_size =
+    inf_adopted_session_record_get_bytes_written(rec->record);
+
+  g_free(filename);
+}
+
+static void
+infinoted_record_check_cb(gpointer user_data)
+{
+  InfinotedRecord* record;
+  InfinotedRecordSession* rec;
+  GSList* item;
+  time_t now;
+  guint64 size;
+
+  record = (InfinotedRecord*)user_data;
+  record->timeout = NULL;
+  now = time(NULL);
+
+  for(item = record->records; item != NULL; item = item->next)
+  {
+    rec = (InfinotedRecordSession*)item->data;
+    if(!inf_adopted_session_record_is_recording(rec->record))
+      continue;
+
+    size = inf_adopted_session_record_get_bytes_written(rec->record);
+
+    /* Do not start a new file for a session in which nothing happened. The
+     * initial state does not count towards the size limit, since a new
+     * file starts with it again. */
+    if(record->max_size > 0 && size > rec->initial_size &&
+       size - rec->initial_size >= (guint64)record->max_size * 1024)
     {
-      record = infinoted_record_start_real(session, filename, title);
+      infinoted_record_rotate(record, rec);
+    }
+    else if(record->max_age > 0 && size > rec->initial_size &&
+            now - rec->started >= (time_t)record->max_age)
+    {
+      infinoted_record_rotate(record, rec);
     }
   }
 
-  g_free(filename);
-  g_free(dirname);
+  infinoted_record_schedule_check(record);
+}
 
-  return record;
+static void
+infinoted_record_schedule_check(InfinotedRecord* record)
+{
+  g_assert(record->timeout == NULL);
+
+  if(record->max_size > 0 || record->max_age > 0)
+  {
+    record->timeout = inf_io_add_timeout(
+      infd_directory_get_io(record->directory),
+      INFINOTED_RECORD_CHECK_INTERVAL * 1000,
+      infinoted_record_check_cb,
+      record,
+      NULL
+    );
+  }
 }
 
 static void
@@ -119,7 +303,7 @@ infinoted_record_directory_add_session_cb(InfdDirectory* directory,
 {
   InfinotedRecord* record;
   const gchar* title;
-  InfAdoptedSessionRecord* rec;
+  InfinotedRecordSession* rec;
 
   record = (InfinotedRecord*)user_data;
 
@@ -128,6 +312,7 @@ infinoted_record_directory_add_session_cb(InfdDirectory* directory,
     title = infd_directory_iter_get_name(directory, iter);
 
     rec = infinoted_record_start(
+      record,
       INF_ADOPTED_SESSION(infd_session_proxy_get_session(proxy)),
       title
     );
@@ -147,7 +332,7 @@ infinoted_record_directory_remove_session_cb(InfdDirectory* directory,
   InfSession* session;
   GSList* item;
 
-  InfAdoptedSessionRecord* rec;
+  InfinotedRecordSession* rec;
   InfSession* cur_session;
 
   session = infd_session_proxy_get_session(proxy);
@@ -155,13 +340,13 @@ infinoted_record_directory_remove_session_cb(InfdDirectory* directory,
 
   for(item = record->records; item != NULL; item = item->next)
   {
-    rec = INF_ADOPTED_SESSION_RECORD(item->data);
-    g_object_get(G_OBJECT(rec), "session", &cur_session, NULL);
+    rec = (InfinotedRecordSession*)item->data;
+    g_object_get(G_OBJECT(rec->record), "session", &cur_session, NULL);
     if(session == cur_session)
     {
       record->records = g_slist_remove(record->records, rec);
       g_object_unref(cur_session);
-      g_object_unref(rec);
+      infinoted_record_session_free(rec);
       break;
     }
     else
@@ -189,6 +374,10 @@ infinoted_record_new(InfdDirectory* directory)
   record = g_slice_new(InfinotedRecord);
   record->directory = directory;
   record->records = NULL;
+  record->compression = 0;
+  record->max_size = 0;
+  record->max_age = 0;
+  record->timeout = NULL;
   g_object_ref(directory);
 
   g_signal_connect(
@@ -219,7 +408,6 @@ void
 infinoted_record_free(InfinotedRecord* record)
 {
   GSList* item;
-  InfAdoptedSessionRecord* rec;
 
   inf_signal_handlers_disconnect_by_func(
     record->directory,
@@ -233,13 +421,57 @@ infinoted_record_free(InfinotedRecord* record)
     record
   );
 
-  for(item = record->records; item != NULL; item = item->next)
+  if(record->timeout != NULL)
   {
-    rec = INF_ADOPTED_SESSION_RECORD(item->data);
-    g_object_unref(rec);
+    inf_io_remove_timeout(
+      infd_directory_get_io(record->directory),
+      record->timeout
+    );
   }
 
+  for(item = record->records; item != NULL; item = item->next)
+    infinoted_record_session_free((InfinotedRecordSession*)item->data);
+
   g_slist_free(record->records);
   g_object_unref(record->directory);
   g_slice_free(InfinotedRecord, record);
 }
+
+/**
+ * infinoted_record_set_options:
+ * @record: A #InfinotedRecord.
+ * @compression: The zlib compression level for record files, or 0.
+ * @max_size: Size in kilobytes of requests after which to continue a record
+ * in a new file, or 0. The initial document state is not counted.
+ * @max_age: Time in seconds after which to continue a record in a new file,
+ * or 0.
+ *
+ * Changes how records are written. The compression level applies to record
+ * files created from now on. If @max_size or @max_age is nonzero, then
+ * records are periodically checked and continued in a new file once they
+ * exceed one of the limits.
+ */
+void
+infinoted_record_set_options(InfinotedRecord* record,
+                             guint compression,
+                             guint max_size,
+                             guint max_age)
+{
+  record->compression = compression;
+  record->max_size = max_size;
+  record->max_age = max_age;
+
+  if(record->timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infd_directory_get_io(record->directory),
+      record->timeout
+    );
+
+    record->timeout = NULL;
+  }
+
+  infinoted_record_schedule_check(record);
+}
+
+/* vim:set et sw=2 ts=2: */
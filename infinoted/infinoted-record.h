@@ -30,6 +30,11 @@ typedef struct _InfinotedRecord InfinotedRecord;
 struct _InfinotedRecord {
   InfdDirectory* directory;
   GSList* records;
+
+  guint compression;
+  guint max_size;
+  guint max_age;
+  InfIoTimeout* timeout;
 };
 
 InfinotedRecord*
@@ -38,6 +43,12 @@ infinoted_record_new(InfdDirectory* directory);
 void
 infinoted_record_free(InfinotedRecord* record);
 
+void
+infinoted_record_set_options(InfinotedRecord* record,
+                             guint compression,
+                             guint max_size,
+                             guint max_age);
+
 G_END_DECLS
 
 #endif /* __INFINOTED_RECORD_H__ */
@@ -35,6 +35,23 @@
 static const guint8 INFINOTED_RUN_IPV6_ANY_ADDR[16] =
   { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
+/* Time in milliseconds for which main loop callbacks are kept to be
+ * written to the trace file */
+static const guint INFINOTED_RUN_TRACE_WINDOW = 10000;
+
+static void
+infinoted_run_slow_callback_cb(InfStandaloneIo* io,
+                               const InfStandaloneIoTraceEvent* event,
+                               gpointer user_data)
+{
+  infinoted_util_log_warning(
+    _("Main loop %s callback %p took %u ms"),
+    event->type,
+    event->func,
+    (guint)(event->duration / 1000)
+  );
+}
+
 static gboolean
 infinoted_run_load_directory(InfinotedRun* run,
                              InfinotedStartup* startup,
@@ -50,6 +67,15 @@ infinoted_run_load_directory(InfinotedRun* run,
   gchar* plugin_path;
 
   storage = infd_filesystem_storage_new(startup->options->root_directory);
+  infd_filesystem_storage_set_format(
+    storage,
+    startup->options->document_format
+  );
+
+  infd_filesystem_storage_set_use_index(
+    storage,
+    startup->options->directory_index
+  );
 
   communication_manager = inf_communication_manager_new();
 
@@ -130,6 +156,12 @@ infinoted_run_create_server(InfinotedRun* run,
     startup->sasl_context ? "PLAIN" : NULL
   );
 
+  g_object_set(
+    G_OBJECT(xmpp),
+    "compression-level", startup->options->compression_level,
+    NULL
+  );
+
   infd_server_pool_add_server(run->pool, INFD_XML_SERVER(xmpp));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -227,6 +259,13 @@ infinoted_run_new(InfinotedStartup* startup,
 
   run->record = infinoted_record_new(run->directory);
 
+  infinoted_record_set_options(
+    run->record,
+    startup->options->record_compression,
+    startup->options->record_max_size,
+    startup->options->record_max_age
+  );
+
   if(startup->options->autosave_interval > 0)
   {
     run->autosave = infinoted_autosave_new(
@@ -253,6 +292,46 @@ infinoted_run_new(InfinotedStartup* startup,
     run->dsync = NULL;
   }
 
+  if(startup->options->metrics_interval > 0 &&
+     startup->options->metrics_file != NULL)
+  {
+    run->metrics = infinoted_metrics_new(
+      run->directory,
+      startup->options->metrics_file,
+      startup->options->metrics_interval
+    );
+
+    infinoted_metrics_set_autosave(run->metrics, run->autosave);
+  }
+  else
+  {
+    run->metrics = NULL;
+  }
+
+  if(startup->options->preload_documents != NULL ||
+     startup->options->preload_working_set != NULL)
+  {
+    run->preload = infinoted_preload_new(
+      run->directory,
+      (const gchar* const*)startup->options->preload_documents,
+      startup->options->preload_working_set,
+      startup->options->preload_threads,
+      (guint64)startup->options->preload_max_memory * 1024 * 1024
+    );
+  }
+  else
+  {
+    run->preload = NULL;
+  }
+
+  g_signal_connect(
+    G_OBJECT(run->io),
+    "slow-callback",
+    G_CALLBACK(infinoted_run_slow_callback_cb),
+    run
+  );
+
+  infinoted_run_set_tracing(run, startup->options);
   return run;
 }
 
@@ -274,6 +353,10 @@ infinoted_run_free(InfinotedRun* run)
     infinoted_autosave_free(run->autosave);
   if(run->dsync != NULL)
     infinoted_directory_sync_free(run->dsync);
+  if(run->metrics != NULL)
+    infinoted_metrics_free(run->metrics);
+  if(run->preload != NULL)
+    infinoted_preload_free(run->preload);
 
   if(run->xmpp6 != NULL)
   {
@@ -352,6 +435,12 @@ infinoted_run_start(InfinotedRun* run)
     }
   }
 
+  /* Let the preloaded documents come in before accepting connections, if
+   * requested. */
+  if(run->preload != NULL && run->startup->options->preload_wait)
+    while(!infinoted_preload_is_finished(run->preload))
+      inf_standalone_io_iteration(run->io);
+
   /* Open server sockets, accepting incoming connections... TODO: Prevent
    * code duplication here. */
   if(run->xmpp6 != NULL)
@@ -422,4 +511,23 @@ infinoted_run_stop(InfinotedRun* run)
   inf_standalone_io_loop_quit(run->io);
 }
 
+/**
+ * infinoted_run_set_tracing:
+ * @run: A #InfinotedRun.
+ * @options: The #InfinotedOptions to take the tracing settings from.
+ *
+ * Enables or disables main loop callback tracing according to the
+ * slow-callback-threshold and trace-file options in @options.
+ */
+void
+infinoted_run_set_tracing(InfinotedRun* run,
+                          InfinotedOptions* options)
+{
+  inf_standalone_io_set_tracing(
+    run->io,
+    options->slow_callback_threshold,
+    options->trace_file != NULL ? INFINOTED_RUN_TRACE_WINDOW : 0
+  );
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -26,6 +26,8 @@
 #include <infinoted/infinoted-startup.h>
 #include <infinoted/infinoted-autosave.h>
 #include <infinoted/infinoted-directory-sync.h>
+#include <infinoted/infinoted-metrics.h>
+#include <infinoted/infinoted-preload.h>
 
 #include <libinfinity/server/infd-server-pool.h>
 #include <libinfinity/server/infd-directory.h>
@@ -45,6 +47,8 @@ struct _InfinotedRun {
   InfdServerPool* pool;
   InfinotedAutosave* autosave;
   InfinotedDirectorySync* dsync;
+  InfinotedMetrics* metrics;
+  InfinotedPreload* preload;
 
   InfdXmppServer* xmpp4;
   InfdXmppServer* xmpp6;
@@ -70,6 +74,10 @@ infinoted_run_start(InfinotedRun* run);
 void
 infinoted_run_stop(InfinotedRun* run);
 
+void
+infinoted_run_set_tracing(InfinotedRun* run,
+                          InfinotedOptions* options);
+
 G_END_DECLS
 
 #endif /* __INFINOTED_RUN_H__ */
@@ -32,6 +32,34 @@
 #endif
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
+static void
+infinoted_signal_write_trace(InfinotedRun* run)
+{
+  const gchar* trace_file;
+  GError* error;
+
+  trace_file = run->startup->options->trace_file;
+  if(trace_file == NULL)
+  {
+    infinoted_util_log_warning(_("Received SIGUSR1, but no trace file is "
+                                 "set"));
+  }
+  else
+  {
+    error = NULL;
+    if(!inf_standalone_io_write_trace(run->io, trace_file, &error))
+    {
+      infinoted_util_log_error(_("Failed to write trace file \"%s\": %s"),
+                               trace_file, error->message);
+      g_error_free(error);
+    }
+    else
+    {
+      infinoted_util_log_info(_("Trace written to \"%s\""), trace_file);
+    }
+  }
+}
+
 static void
 infinoted_signal_sig_func(InfNativeSocket* fd,
                           InfIoEvent event,
@@ -77,6 +105,10 @@ infinoted_signal_sig_func(InfNativeSocket* fd,
         infinoted_util_log_info(_("Config reloaded"));
       }
     }
+    else if(occured == SIGUSR1)
+    {
+      infinoted_signal_write_trace(sig->run);
+    }
   }
 }
 #else
@@ -133,6 +165,17 @@ infinoted_signal_sighup_handler(int sig)
   /* Make sure the signal handler is not reset */
   signal(SIGHUP, infinoted_signal_sighup_handler);
 }
+
+static void
+infinoted_signal_sigusr1_handler(int sig)
+{
+  /* As for SIGHUP, writing the trace is not safe in a signal handler. */
+  infinoted_util_log_error(_("For trace writing to work libinfinity needs "
+                             "to be compiled with libdaemon support"));
+
+  /* Make sure the signal handler is not reset */
+  signal(SIGUSR1, infinoted_signal_sigusr1_handler);
+}
 #endif /* !G_OS_WIN32 */
 #endif /* !LIBINFINITY_HAVE_LIBDAEMON */
 
@@ -167,7 +210,7 @@ infinoted_signal_register(InfinotedRun* run)
 
   /* TODO: Should we report when this fails? Should ideally happen before
    * actually forking then - are signal connections kept in fork()'s child? */
-  if(daemon_signal_init(SIGINT, SIGTERM, SIGQUIT, SIGHUP, 0) == 0)
+  if(daemon_signal_init(SIGINT, SIGTERM, SIGQUIT, SIGHUP, SIGUSR1, 0) == 0)
   {
     sig->signal_fd = daemon_signal_fd();
 
@@ -191,6 +234,8 @@ infinoted_signal_register(InfinotedRun* run)
     signal(SIGQUIT, &infinoted_signal_sigquit_handler);
   sig->previous_sighup_handler =
     signal(SIGHUP, &infinoted_signal_sighup_handler);
+  sig->previous_sigusr1_handler =
+    signal(SIGUSR1, &infinoted_signal_sigusr1_handler);
 #endif /* !G_OS_WIN32 */
   _infinoted_signal_server = run;
 #endif /* !LIBINFINITY_HAVE_LIBDAEMON */
@@ -229,6 +274,7 @@ infinoted_signal_unregister(InfinotedSignal* sig)
 #ifndef G_OS_WIN32
   signal(SIGQUIT, sig->previous_sigquit_handler);
   signal(SIGHUP, sig->previous_sighup_handler);
+  signal(SIGUSR1, sig->previous_sigusr1_handler);
 #endif /* !G_OS_WIN32 */
   _infinoted_signal_server = NULL;
 #endif /* !LIBINFINITY_HAVE_LIBDAEMON */
@@ -43,6 +43,7 @@ struct _InfinotedSignal {
   InfinotedSignalFunc previous_sigterm_handler;
   InfinotedSignalFunc previous_sigquit_handler;
   InfinotedSignalFunc previous_sighup_handler;
+  InfinotedSignalFunc previous_sigusr1_handler;
 #endif
 };
 
@@ -28,18 +28,47 @@
 #include <libinftext/inf-text-session.h>
 #include <libinftext/inf-text-default-buffer.h>
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-chunk.h>
 #include <libinftext/inf-text-user.h>
 
 #include <string.h>
+#include <errno.h>
+
+#ifndef G_OS_WIN32
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+#endif
+
+/* Layout of the binary format. All integers are stored in little endian.
+ *
+ * Header:   magic[8] | guint32 version | guint32 n_users | guint32 n_segments
+ * User:     guint32 id | guint64 hue (IEEE 754 double) | guint32 name_len
+ *           | name[name_len]
+ * Segment:  guint32 author | guint32 n_bytes | text[n_bytes] (UTF-8)
+ *
+ * Users come before segments, so that segment authors can be resolved
+ * while reading. */
+#define INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC "InfText\n"
+#define INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC_LEN 8
+#define INFD_NOTE_PLUGIN_TEXT_BINARY_VERSION 1
 
 /* TODO: Expose them to the client library? */
 typedef enum InfdNotePluginTextError {
   INFD_NOTE_PLUGIN_TEXT_ERROR_NOT_A_TEXT_SESSION,
   INFD_NOTE_PLUGIN_TEXT_ERROR_USER_EXISTS,
   INFD_NOTE_PLUGIN_TEXT_ERROR_NO_SUCH_USER,
-  INFD_NOTE_PLUGIN_TEXT_ERROR_UNEXPECTED_NODE
+  INFD_NOTE_PLUGIN_TEXT_ERROR_UNEXPECTED_NODE,
+  INFD_NOTE_PLUGIN_TEXT_ERROR_INVALID_BINARY
 } InfdNotePluginTextError;
 
+typedef struct _InfdNotePluginTextBinaryWriteData
+  InfdNotePluginTextBinaryWriteData;
+struct _InfdNotePluginTextBinaryWriteData {
+  FILE* stream;
+  guint n_users;
+};
+
 static InfSession*
 infd_note_plugin_text_session_new(InfIo* io,
                                   InfCommunicationManager* manager,
@@ -98,26 +127,15 @@ infd_note_plugin_text_session_unexpected_node(xmlNodePtr node,
 }
 
 static gboolean
-infd_note_plugin_text_read_user(InfUserTable* user_table,
-                                xmlNodePtr node,
-                                GError** error)
+infd_note_plugin_text_add_user(InfUserTable* user_table,
+                               guint id,
+                               const gchar* name,
+                               gdouble hue,
+                               GError** error)
 {
-  guint id;
-  gdouble hue;
-  xmlChar* name;
   gboolean result;
   InfUser* user;
 
-  if(!inf_xml_util_get_attribute_uint_required(node, "id", &id, error))
-    return FALSE;
-
-  if(!inf_xml_util_get_attribute_double_required(node, "hue", &hue, error))
-    return FALSE;
-
-  name = inf_xml_util_get_attribute_required(node, "name", error);
-  if(name == NULL)
-    return FALSE;
-
   if(inf_user_table_lookup_user_by_id(user_table, id) != NULL)
   {
     g_set_error(
@@ -132,14 +150,14 @@ infd_note_plugin_text_read_user(InfUserTable* user_table,
   }
   else
   {
-    if(inf_user_table_lookup_user_by_name(user_table, (const gchar*)name))
+    if(inf_user_table_lookup_user_by_name(user_table, name))
     {
       g_set_error(
         error,
         g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
         INFD_NOTE_PLUGIN_TEXT_ERROR_USER_EXISTS,
         "User with name `%s' exists already",
-        (const gchar*)name
+        name
       );
 
       result = FALSE;
@@ -162,10 +180,70 @@ infd_note_plugin_text_read_user(InfUserTable* user_table,
     }
   }
 
+  return result;
+}
+
+static gboolean
+infd_note_plugin_text_read_user(InfUserTable* user_table,
+                                xmlNodePtr node,
+                                GError** error)
+{
+  guint id;
+  gdouble hue;
+  xmlChar* name;
+  gboolean result;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "id", &id, error))
+    return FALSE;
+
+  if(!inf_xml_util_get_attribute_double_required(node, "hue", &hue, error))
+    return FALSE;
+
+  name = inf_xml_util_get_attribute_required(node, "name", error);
+  if(name == NULL)
+    return FALSE;
+
+  result = infd_note_plugin_text_add_user(
+    user_table,
+    id,
+    (const gchar*)name,
+    hue,
+    error
+  );
+
   xmlFree(name);
   return result;
 }
 
+static gboolean
+infd_note_plugin_text_lookup_author(InfUserTable* user_table,
+                                    guint author,
+                                    InfUser** user,
+                                    GError** error)
+{
+  if(author == 0)
+  {
+    *user = NULL;
+    return TRUE;
+  }
+
+  *user = inf_user_table_lookup_user_by_id(user_table, author);
+  if(*user == NULL)
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
+      INFD_NOTE_PLUGIN_TEXT_ERROR_NO_SUCH_USER,
+      "User with ID %u does not exist",
+      author
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 static gboolean
 infd_note_plugin_text_read_buffer(InfTextBuffer* buffer,
                                   InfUserTable* user_table,
@@ -204,27 +282,17 @@ infd_note_plugin_text_read_buffer(InfTextBuffer* buffer,
         break;
       }
 
-      if(author != 0)
-      {
-        user = inf_user_table_lookup_user_by_id(user_table, author);
-
-        if(user == NULL)
-        {
-          g_set_error(
-            error,
-            g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
-            INFD_NOTE_PLUGIN_TEXT_ERROR_NO_SUCH_USER,
-            "User with ID %u does not exist",
-            author
-          );
+      res = infd_note_plugin_text_lookup_author(
+        user_table,
+        author,
+        &user,
+        error
+      );
 
-          result = FALSE;
-          break;
-        }
-      }
-      else
+      if(res == FALSE)
       {
-        user = NULL;
+        result = FALSE;
+        break;
       }
 
       content = inf_xml_util_get_child_text(child, &bytes, &chars, error);
@@ -263,41 +331,21 @@ infd_note_plugin_text_read_buffer(InfTextBuffer* buffer,
   return result;
 }
 
-static InfSession*
-infd_note_plugin_text_session_read(InfdStorage* storage,
-                                   InfIo* io,
-                                   InfCommunicationManager* manager,
-                                   const gchar* path,
-                                   gpointer user_data,
-                                   GError** error)
+/* Reads a note in XML format from stream, and closes stream. */
+static gboolean
+infd_note_plugin_text_read_xml(FILE* stream,
+                               const gchar* path,
+                               InfTextBuffer* buffer,
+                               InfUserTable* user_table,
+                               GError** error)
 {
-  InfUserTable* user_table;
-  InfTextBuffer* buffer;
-  InfTextSession* session;
-
-  FILE* stream;
   xmlDocPtr doc;
   xmlErrorPtr xmlerror;
   xmlNodePtr root;
   xmlNodePtr child;
   gboolean result;
 
-  g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
-
-  user_table = inf_user_table_new();
-  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
-
   /* TODO: Use a SAX parser for better performance */
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "r",
-    error
-  );
-
-  if(stream == NULL) return FALSE;
-
   doc = xmlReadIO(
     infd_note_plugin_text_session_read_read_func,
     infd_note_plugin_text_sesison_read_close_func,
@@ -381,8 +429,394 @@ infd_note_plugin_text_session_read(InfdStorage* storage,
     xmlFreeDoc(doc);
   }
 
+  return result;
+}
+
+static gboolean
+infd_note_plugin_text_binary_error(GError** error,
+                                   const gchar* message)
+{
+  g_set_error(
+    error,
+    g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
+    INFD_NOTE_PLUGIN_TEXT_ERROR_INVALID_BINARY,
+    "%s",
+    message
+  );
+
+  return FALSE;
+}
+
+/* Checks whether stream contains a note in binary format. If it does not,
+ * then the stream is rewound so that it can be read as XML. */
+static gboolean
+infd_note_plugin_text_is_binary(FILE* stream)
+{
+  gchar magic[INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC_LEN];
+  size_t len;
+
+  len = fread(magic, 1, INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC_LEN, stream);
+  if(len == INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC_LEN &&
+     memcmp(magic, INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC, len) == 0)
+  {
+    return TRUE;
+  }
+
+  rewind(stream);
+  return FALSE;
+}
+
+/* Makes the whole content of stream available in memory. The file is mapped
+ * if possible, and read otherwise. Release with
+ * infd_note_plugin_text_unmap_file(). */
+static gchar*
+infd_note_plugin_text_map_file(FILE* stream,
+                               gsize* size,
+                               gboolean* mapped,
+                               GError** error)
+{
+  gchar* data;
+  gsize alloc;
+  size_t len;
+  int save_errno;
+#ifndef G_OS_WIN32
+  struct stat st;
+  void* map;
+
+  if(fstat(fileno(stream), &st) == 0 && st.st_size > 0)
+  {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(stream), 0);
+    if(map != MAP_FAILED)
+    {
+      *size = st.st_size;
+      *mapped = TRUE;
+      return map;
+    }
+  }
+#endif
+
+  rewind(stream);
+
+  alloc = 64 * 1024;
+  data = g_malloc(alloc);
+  *size = 0;
+
+  while((len = fread(data + *size, 1, alloc - *size, stream)) > 0)
+  {
+    *size += len;
+    if(*size == alloc)
+    {
+      alloc *= 2;
+      data = g_realloc(data, alloc);
+    }
+  }
+
+  if(ferror(stream))
+  {
+    save_errno = errno;
+    g_free(data);
+
+    g_set_error(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(save_errno),
+      "%s",
+      g_strerror(save_errno)
+    );
+
+    return NULL;
+  }
+
+  *mapped = FALSE;
+  return data;
+}
+
+static void
+infd_note_plugin_text_unmap_file(gchar* data,
+                                 gsize size,
+                                 gboolean mapped)
+{
+#ifndef G_OS_WIN32
+  if(mapped)
+  {
+    munmap(data, size);
+    return;
+  }
+#endif
+
+  g_free(data);
+}
+
+static gboolean
+infd_note_plugin_text_binary_read_uint32(const gchar** cur,
+                                         const gchar* end,
+                                         guint32* value)
+{
+  guint32 le;
+
+  if(end - *cur < 4)
+    return FALSE;
+
+  memcpy(&le, *cur, 4);
+  *value = GUINT32_FROM_LE(le);
+  *cur += 4;
+  return TRUE;
+}
+
+static gboolean
+infd_note_plugin_text_binary_read_double(const gchar** cur,
+                                         const gchar* end,
+                                         gdouble* value)
+{
+  union {
+    guint64 u;
+    gdouble d;
+  } conv;
+
+  if(end - *cur < 8)
+    return FALSE;
+
+  memcpy(&conv.u, *cur, 8);
+  conv.u = GUINT64_FROM_LE(conv.u);
+  *value = conv.d;
+  *cur += 8;
+  return TRUE;
+}
+
+static gboolean
+infd_note_plugin_text_binary_read_users(const gchar** cur,
+                                        const gchar* end,
+                                        guint n_users,
+                                        InfUserTable* user_table,
+                                        GError** error)
+{
+  guint i;
+  guint32 id;
+  gdouble hue;
+  guint32 name_len;
+  gchar* name;
+  gboolean result;
+
+  for(i = 0; i < n_users; ++i)
+  {
+    if(!infd_note_plugin_text_binary_read_uint32(cur, end, &id) ||
+       !infd_note_plugin_text_binary_read_double(cur, end, &hue) ||
+       !infd_note_plugin_text_binary_read_uint32(cur, end, &name_len) ||
+       (gsize)(end - *cur) < name_len)
+    {
+      return infd_note_plugin_text_binary_error(error, "Truncated user");
+    }
+
+    if(!g_utf8_validate(*cur, name_len, NULL))
+      return infd_note_plugin_text_binary_error(error, "Invalid user name");
+
+    name = g_strndup(*cur, name_len);
+    *cur += name_len;
+
+    result = infd_note_plugin_text_add_user(user_table, id, name, hue, error);
+    g_free(name);
+
+    if(result == FALSE)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Reads the segments directly from the file mapping into a chunk, which is
+ * then inserted into the buffer at once. */
+static gboolean
+infd_note_plugin_text_binary_read_segments(const gchar** cur,
+                                           const gchar* end,
+                                           guint n_segments,
+                                           InfTextBuffer* buffer,
+                                           InfUserTable* user_table,
+                                           GError** error)
+{
+  InfTextChunk* chunk;
+  InfUser* user;
+  guint i;
+  guint32 author;
+  guint32 bytes;
+  gboolean result;
+
+  g_assert(inf_text_buffer_get_length(buffer) == 0);
+
+  chunk = inf_text_chunk_new("UTF-8");
+  result = TRUE;
+
+  for(i = 0; i < n_segments && result == TRUE; ++i)
+  {
+    if(!infd_note_plugin_text_binary_read_uint32(cur, end, &author) ||
+       !infd_note_plugin_text_binary_read_uint32(cur, end, &bytes) ||
+       (gsize)(end - *cur) < bytes)
+    {
+      result = infd_note_plugin_text_binary_error(error, "Truncated segment");
+    }
+    else if(!g_utf8_validate(*cur, bytes, NULL))
+    {
+      result = infd_note_plugin_text_binary_error(error, "Invalid UTF-8");
+    }
+    else
+    {
+      result = infd_note_plugin_text_lookup_author(
+        user_table,
+        author,
+        &user,
+        error
+      );
+
+      if(result == TRUE && bytes > 0)
+      {
+        inf_text_chunk_insert_text(
+          chunk,
+          inf_text_chunk_get_length(chunk),
+          *cur,
+          bytes,
+          g_utf8_strlen(*cur, bytes),
+          author
+        );
+      }
+
+      *cur += bytes;
+    }
+  }
+
+  if(result == TRUE && inf_text_chunk_get_length(chunk) > 0)
+    inf_text_buffer_insert_chunk(buffer, 0, chunk, NULL);
+
+  inf_text_chunk_free(chunk);
+  return result;
+}
+
+/* Reads a note in binary format from stream. The magic number has already
+ * been read. */
+static gboolean
+infd_note_plugin_text_read_binary(FILE* stream,
+                                  InfTextBuffer* buffer,
+                                  InfUserTable* user_table,
+                                  GError** error)
+{
+  gchar* data;
+  gsize size;
+  gboolean mapped;
+  const gchar* cur;
+  const gchar* end;
+  guint32 version;
+  guint32 n_users;
+  guint32 n_segments;
+  gboolean result;
+
+  data = infd_note_plugin_text_map_file(stream, &size, &mapped, error);
+  if(data == NULL)
+    return FALSE;
+
+  cur = data + INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC_LEN;
+  end = data + size;
+
+  if(!infd_note_plugin_text_binary_read_uint32(&cur, end, &version) ||
+     !infd_note_plugin_text_binary_read_uint32(&cur, end, &n_users) ||
+     !infd_note_plugin_text_binary_read_uint32(&cur, end, &n_segments))
+  {
+    result = infd_note_plugin_text_binary_error(error, "Truncated header");
+  }
+  else if(version != INFD_NOTE_PLUGIN_TEXT_BINARY_VERSION)
+  {
+    result = infd_note_plugin_text_binary_error(
+      error,
+      "Unsupported format version"
+    );
+  }
+  else
+  {
+    result = infd_note_plugin_text_binary_read_users(
+      &cur,
+      end,
+      n_users,
+      user_table,
+      error
+    );
+
+    if(result == TRUE)
+    {
+      result = infd_note_plugin_text_binary_read_segments(
+        &cur,
+        end,
+        n_segments,
+        buffer,
+        user_table,
+        error
+      );
+    }
+
+    if(result == TRUE && cur != end)
+      result = infd_note_plugin_text_binary_error(error, "Trailing data");
+  }
+
+  infd_note_plugin_text_unmap_file(data, size, mapped);
+  return result;
+}
+
+static InfSession*
+infd_note_plugin_text_session_read(InfdStorage* storage,
+                                   InfIo* io,
+                                   InfCommunicationManager* manager,
+                                   const gchar* path,
+                                   gpointer user_data,
+                                   GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  FILE* stream;
+  gboolean result;
+
+  g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    "InfText",
+    path,
+    "r",
+    error
+  );
+
+  if(stream == NULL) return FALSE;
+
+  if(infd_note_plugin_text_is_binary(stream))
+  {
+    result = infd_note_plugin_text_read_binary(
+      stream,
+      buffer,
+      user_table,
+      error
+    );
+
+    fclose(stream);
+    if(result == FALSE)
+      g_prefix_error(error, "Error processing file '%s': ", path);
+  }
+  else
+  {
+    result = infd_note_plugin_text_read_xml(
+      stream,
+      path,
+      buffer,
+      user_table,
+      error
+    );
+  }
+
   if(result == FALSE)
+  {
+    g_object_unref(buffer);
+    g_object_unref(user_table);
     return NULL;
+  }
 
   session = inf_text_session_new_with_user_table(
     manager,
@@ -416,6 +850,179 @@ infd_note_plugin_text_session_write_foreach_user_func(InfUser* user,
   );
 }
 
+static void
+infd_note_plugin_text_binary_write_uint32(FILE* stream,
+                                          guint32 value)
+{
+  guint32 le;
+  le = GUINT32_TO_LE(value);
+  fwrite(&le, 4, 1, stream);
+}
+
+static void
+infd_note_plugin_text_binary_write_double(FILE* stream,
+                                          gdouble value)
+{
+  union {
+    guint64 u;
+    gdouble d;
+  } conv;
+
+  conv.d = value;
+  conv.u = GUINT64_TO_LE(conv.u);
+  fwrite(&conv.u, 8, 1, stream);
+}
+
+static void
+infd_note_plugin_text_binary_count_users_func(InfUser* user,
+                                              gpointer user_data)
+{
+  InfdNotePluginTextBinaryWriteData* data;
+  data = (InfdNotePluginTextBinaryWriteData*)user_data;
+
+  ++ data->n_users;
+}
+
+static void
+infd_note_plugin_text_binary_write_user_func(InfUser* user,
+                                             gpointer user_data)
+{
+  InfdNotePluginTextBinaryWriteData* data;
+  const gchar* name;
+  gsize name_len;
+
+  data = (InfdNotePluginTextBinaryWriteData*)user_data;
+  name = inf_user_get_name(user);
+  name_len = strlen(name);
+
+  infd_note_plugin_text_binary_write_uint32(
+    data->stream,
+    inf_user_get_id(user)
+  );
+
+  infd_note_plugin_text_binary_write_double(
+    data->stream,
+    inf_text_user_get_hue(INF_TEXT_USER(user))
+  );
+
+  infd_note_plugin_text_binary_write_uint32(data->stream, name_len);
+  fwrite(name, 1, name_len, data->stream);
+}
+
+/* Writes the note in binary format into stream, and closes stream. */
+static gboolean
+infd_note_plugin_text_write_binary(FILE* stream,
+                                   InfSession* session,
+                                   GError** error)
+{
+  InfdNotePluginTextBinaryWriteData data;
+  InfUserTable* table;
+  InfTextBuffer* buffer;
+  InfTextBufferIter* iter;
+  guint n_segments;
+  const gchar* content;
+  gchar* copy;
+  gsize bytes;
+  int save_errno;
+  gboolean result;
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  table = inf_session_get_user_table(session);
+
+  data.stream = stream;
+  data.n_users = 0;
+
+  inf_user_table_foreach_user(
+    table,
+    infd_note_plugin_text_binary_count_users_func,
+    &data
+  );
+
+  n_segments = 0;
+  iter = inf_text_buffer_create_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      ++ n_segments;
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  fwrite(
+    INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC,
+    1,
+    INFD_NOTE_PLUGIN_TEXT_BINARY_MAGIC_LEN,
+    stream
+  );
+
+  infd_note_plugin_text_binary_write_uint32(
+    stream,
+    INFD_NOTE_PLUGIN_TEXT_BINARY_VERSION
+  );
+
+  infd_note_plugin_text_binary_write_uint32(stream, data.n_users);
+  infd_note_plugin_text_binary_write_uint32(stream, n_segments);
+
+  inf_user_table_foreach_user(
+    table,
+    infd_note_plugin_text_binary_write_user_func,
+    &data
+  );
+
+  iter = inf_text_buffer_create_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      copy = NULL;
+      content = inf_text_buffer_iter_borrow_text(buffer, iter);
+      if(content == NULL)
+        content = copy = inf_text_buffer_iter_get_text(buffer, iter);
+
+      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+
+      infd_note_plugin_text_binary_write_uint32(
+        stream,
+        inf_text_buffer_iter_get_author(buffer, iter)
+      );
+
+      infd_note_plugin_text_binary_write_uint32(stream, bytes);
+      fwrite(content, 1, bytes, stream);
+      g_free(copy);
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  result = TRUE;
+  if(ferror(stream))
+  {
+    save_errno = errno;
+    fclose(stream);
+    result = FALSE;
+  }
+  else if(fclose(stream) != 0)
+  {
+    save_errno = errno;
+    result = FALSE;
+  }
+
+  if(result == FALSE)
+  {
+    g_set_error(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(save_errno),
+      "%s",
+      g_strerror(save_errno)
+    );
+  }
+
+  return result;
+}
+
 static gboolean
 infd_note_plugin_text_session_write(InfdStorage* storage,
                                     InfSession* session,
@@ -431,7 +1038,8 @@ infd_note_plugin_text_session_write(InfdStorage* storage,
   xmlNodePtr segment_node;
 
   guint author;
-  gchar* content;
+  const gchar* content;
+  gchar* copy;
   gsize bytes;
 
   FILE* stream;
@@ -454,6 +1062,12 @@ infd_note_plugin_text_session_write(InfdStorage* storage,
   if(stream == NULL)
     return FALSE;
 
+  if(infd_filesystem_storage_get_format(INFD_FILESYSTEM_STORAGE(storage)) ==
+     INFD_FILESYSTEM_STORAGE_FORMAT_BINARY)
+  {
+    return infd_note_plugin_text_write_binary(stream, session, error);
+  }
+
   root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
   buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
   table = inf_session_get_user_table(session);
@@ -471,7 +1085,11 @@ infd_note_plugin_text_session_write(InfdStorage* storage,
     do
     {
       author = inf_text_buffer_iter_get_author(buffer, iter);
-      content = inf_text_buffer_iter_get_text(buffer, iter);
+      copy = NULL;
+      content = inf_text_buffer_iter_borrow_text(buffer, iter);
+      if(content == NULL)
+        content = copy = inf_text_buffer_iter_get_text(buffer, iter);
+
       bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
 
       segment_node = xmlNewChild(
@@ -483,7 +1101,7 @@ infd_note_plugin_text_session_write(InfdStorage* storage,
 
       inf_xml_util_set_attribute_uint(segment_node, "author", author);
       inf_xml_util_add_child_text(segment_node, content, bytes);
-      g_free(content);
+      g_free(copy);
     } while(inf_text_buffer_iter_next(buffer, iter));
 
     inf_text_buffer_destroy_iter(buffer, iter);
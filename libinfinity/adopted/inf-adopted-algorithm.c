@@ -68,11 +68,6 @@
 
 /* TODO: Do only cleanup if too much entries in cache? */
 
-/* TODO: If users are not issuing any requests for some time, and we can be
- * sure that we do not need to transform any requests, then remove them from
- * the users array (users_begin, users_end). Readd users as soon as they
- * issue buffer-altering requests. */
-
 typedef struct _InfAdoptedAlgorithmLocalUser InfAdoptedAlgorithmLocalUser;
 struct _InfAdoptedAlgorithmLocalUser {
   InfAdoptedUser* user;
@@ -95,6 +90,56 @@ struct _InfAdoptedAlgorithmRequestKey {
   guint user_id;
 };
 
+typedef enum _InfAdoptedAlgorithmTranslateStep {
+  /* Not started yet */
+  INF_ADOPTED_ALGORITHM_TRANSLATE_START,
+  /* Waiting for the associated request to be translated, to mirror it */
+  INF_ADOPTED_ALGORITHM_TRANSLATE_MIRROR,
+  /* Waiting for the request to be translated, to fold it */
+  INF_ADOPTED_ALGORITHM_TRANSLATE_FOLD,
+  /* Waiting for the requests to be translated to the state at which they
+   * are transformed against each other */
+  INF_ADOPTED_ALGORITHM_TRANSLATE_AGAINST_AT,
+  INF_ADOPTED_ALGORITHM_TRANSLATE_REQUEST_AT,
+  /* Waiting for the requests to be translated to their least common
+   * successor, to find the concurrency ID */
+  INF_ADOPTED_ALGORITHM_TRANSLATE_LCS_AGAINST,
+  INF_ADOPTED_ALGORITHM_TRANSLATE_LCS_REQUEST
+} InfAdoptedAlgorithmTranslateStep;
+
+typedef struct _InfAdoptedAlgorithmTranslateFrame
+  InfAdoptedAlgorithmTranslateFrame;
+struct _InfAdoptedAlgorithmTranslateFrame {
+  InfAdoptedAlgorithmTranslateStep step;
+  InfAdoptedRequest* request;
+  InfAdoptedStateVector* to;
+
+  /* Late mirror and fold */
+  guint user_id;
+  gint by;
+
+  /* Transformation */
+  InfAdoptedRequest* against;
+  InfAdoptedStateVector* at;
+  InfAdoptedStateVector* lcs;
+  InfAdoptedRequest* against_at;
+  InfAdoptedRequest* request_at;
+  InfAdoptedRequest* lcs_against;
+};
+
+/* State of a single call to inf_adopted_algorithm_translate_request() */
+typedef struct _InfAdoptedAlgorithmTranslate InfAdoptedAlgorithmTranslate;
+struct _InfAdoptedAlgorithmTranslate {
+  InfAdoptedAlgorithm* algorithm;
+  /* InfAdoptedAlgorithmTranslateFrame, topmost first */
+  GSList* stack;
+  /* InfAdoptedStateVector -> reachable, see
+   * inf_adopted_algorithm_translate_is_reachable() */
+  GTree* reachable;
+  /* Translated requests that cannot be put into the request cache */
+  GTree* requests;
+};
+
 typedef struct _InfAdoptedAlgorithmPrivate InfAdoptedAlgorithmPrivate;
 struct _InfAdoptedAlgorithmPrivate {
   /* request log policy */
@@ -113,12 +158,28 @@ struct _InfAdoptedAlgorithmPrivate {
   InfAdoptedUser** users_begin;
   InfAdoptedUser** users_end;
 
+  /* Users that are available or have requests in their request log, in the
+   * same order as in the array above. Other users cannot be involved in any
+   * transformation anymore, so we skip them on every request. Long-lived
+   * documents can have many users who joined once and left again. */
+  InfAdoptedUser** active_begin;
+  InfAdoptedUser** active_end;
+
   /* Request cache */
   /* TODO: Consider using a hash table here... given a good hash function it
    * could perhaps speedup lookup. */
   GTree* cache;
 
   GSList* local_users;
+
+  /* Nesting depth of inf_adopted_algorithm_begin_bulk() calls */
+  guint bulk;
+
+  /* Statistics, see inf_adopted_algorithm_get_statistics() */
+  guint64 n_executed;
+  guint64 n_transformed;
+  guint64 n_cache_hits;
+  guint64 n_cache_misses;
 };
 
 enum {
@@ -190,9 +251,12 @@ inf_adopted_algorithm_least_common_successor(InfAdoptedAlgorithm* algorithm,
   guint id;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
 
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  /* Components of inactive users cannot differ between first and second,
+   * since their request logs are empty. */
+  result = inf_adopted_state_vector_copy(first);
+
+  for(user = priv->active_begin; user != priv->active_end; ++ user)
   {
     id = inf_user_get_id(INF_USER(*user));
     inf_adopted_state_vector_set(
@@ -228,9 +292,12 @@ inf_adopted_algorithm_least_common_predecessor(InfAdoptedAlgorithm* algorithm,
   guint id;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
 
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  /* Components of inactive users cannot differ between first and second,
+   * since their request logs are empty. */
+  result = inf_adopted_state_vector_copy(first);
+
+  for(user = priv->active_begin; user != priv->active_end; ++ user)
   {
     id = inf_user_get_id(INF_USER(*user));
     inf_adopted_state_vector_set(
@@ -337,6 +404,42 @@ inf_adopted_algorithm_cleanup_cache_traverse_func(gpointer key,
   return FALSE;
 }
 
+/* A user is active if it is available or if there are requests in its
+ * request log. Users that are neither do not take part in any
+ * transformation, and cannot be reached by any request anymore. */
+static gboolean
+inf_adopted_algorithm_is_active_user(InfAdoptedAlgorithm* algorithm,
+                                     InfAdoptedUser* user)
+{
+  InfAdoptedRequestLog* log;
+
+  if(inf_user_get_status(INF_USER(user)) != INF_USER_UNAVAILABLE)
+    return TRUE;
+
+  log = inf_adopted_user_get_request_log(user);
+  if(inf_adopted_request_log_get_begin(log) !=
+     inf_adopted_request_log_get_end(log))
+  {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void
+inf_adopted_algorithm_update_active_users(InfAdoptedAlgorithm* algorithm)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  priv->active_end = priv->active_begin;
+
+  for(user = priv->users_begin; user != priv->users_end; ++ user)
+    if(inf_adopted_algorithm_is_active_user(algorithm, *user))
+      *(priv->active_end ++) = *user;
+}
+
 /* TODO: This is "only" some kind of garbage collection that does not need
  * to be done after _every_ request received. */
 static void
@@ -353,6 +456,7 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
   guint n;
   guint id;
   guint vdiff;
+  gboolean users_changed;
 
   InfAdoptedAlgorithmCacheCleanupData cleanup_data;
   GSList* item;
@@ -387,7 +491,7 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
    * are just kept a bit longer than necessary, in favor of simplicity. */
 
   cleanup_data.lcp = inf_adopted_state_vector_copy(priv->current);
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  for(user = priv->active_begin; user != priv->active_end; ++ user)
   {
     if(inf_user_get_status(INF_USER(*user)) != INF_USER_UNAVAILABLE)
     {
@@ -402,7 +506,8 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
     }
   }
 
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  users_changed = FALSE;
+  for(user = priv->active_begin; user != priv->active_end; ++ user)
   {
     id = inf_user_get_id(INF_USER(*user));
     log = inf_adopted_user_get_request_log(*user);
@@ -454,8 +559,14 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
     }
 
     inf_adopted_request_log_remove_requests(log, n);
+
+    if(!inf_adopted_algorithm_is_active_user(algorithm, *user))
+      users_changed = TRUE;
   }
 
+  if(users_changed)
+    inf_adopted_algorithm_update_active_users(algorithm);
+
   cleanup_data.algorithm = algorithm;
   cleanup_data.rem_keys = NULL;
 
@@ -567,6 +678,14 @@ inf_adopted_algorithm_local_user_free(InfAdoptedAlgorithm* algorithm,
   g_slice_free(InfAdoptedAlgorithmLocalUser, local);
 }
 
+static void
+inf_adopted_algorithm_user_notify_status_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  inf_adopted_algorithm_update_active_users(INF_ADOPTED_ALGORITHM(user_data));
+}
+
 static void
 inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
                                InfAdoptedUser* user)
@@ -592,6 +711,17 @@ inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
     g_realloc(priv->users_begin, sizeof(InfAdoptedUser*) * user_count);
   priv->users_end = priv->users_begin + user_count;
   priv->users_begin[user_count - 1] = user;
+
+  priv->active_begin =
+    g_realloc(priv->active_begin, sizeof(InfAdoptedUser*) * user_count);
+  inf_adopted_algorithm_update_active_users(algorithm);
+
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify::status",
+    G_CALLBACK(inf_adopted_algorithm_user_notify_status_cb),
+    algorithm
+  );
 }
 
 static void
@@ -862,7 +992,9 @@ inf_adopted_algorithm_is_reachable(InfAdoptedAlgorithm* algorithm,
     inf_adopted_state_vector_causally_before(v, priv->current) == TRUE
   );
 
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  /* The component of an inactive user is always reachable since there are
+   * no requests in its log. */
+  for(user = priv->active_begin; user != priv->active_end; ++ user)
     if(!inf_adopted_algorithm_is_component_reachable(algorithm, v, *user))
       return FALSE;
   
@@ -895,127 +1027,232 @@ inf_adopted_algorithm_can_cache(InfAdoptedRequest* request)
   return flags == INF_ADOPTED_OPERATION_CACHABLE;
 }
 
-/* Translates two requests to state at and then transforms them against each
- * other. The result needs to be unref()ed. */
-static InfAdoptedRequest*
-inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
-                                        InfAdoptedRequest* request,
-                                        InfAdoptedRequest* against,
-                                        InfAdoptedStateVector* at)
+static int
+inf_adopted_algorithm_state_vector_cmp(gconstpointer a,
+                                       gconstpointer b,
+                                       gpointer user_data)
 {
-  InfAdoptedRequest* request_at;
-  InfAdoptedRequest* against_at;
-  InfAdoptedConcurrencyId concurrency_id;
-  InfAdoptedStateVector* lcs;
-  InfAdoptedRequest* lcs_against;
-  InfAdoptedRequest* lcs_request;
-  InfAdoptedRequest* result;
-
-  g_assert(
-    inf_adopted_state_vector_causally_before(
-      inf_adopted_request_get_vector(request),
-      at
-    )
+  return inf_adopted_state_vector_compare(
+    (InfAdoptedStateVector*)a,
+    (InfAdoptedStateVector*)b
   );
-  g_assert(
-    inf_adopted_state_vector_causally_before(
-      inf_adopted_request_get_vector(against),
-      at
-    )
+}
+
+static void
+inf_adopted_algorithm_translate_init(InfAdoptedAlgorithm* algorithm,
+                                     InfAdoptedAlgorithmTranslate* translate)
+{
+  translate->algorithm = algorithm;
+  translate->stack = NULL;
+
+  translate->reachable = g_tree_new_full(
+    inf_adopted_algorithm_state_vector_cmp,
+    NULL,
+    (GDestroyNotify)inf_adopted_state_vector_free,
+    NULL
   );
 
-  against_at = inf_adopted_algorithm_translate_request(
-    algorithm,
-    against,
-    at
+  translate->requests = g_tree_new_full(
+    inf_adopted_algorithm_request_key_cmp,
+    NULL,
+    inf_adopted_algorithm_request_key_free,
+    g_object_unref
   );
+}
 
-  request_at = inf_adopted_algorithm_translate_request(
-    algorithm,
-    request,
-    at
+static void
+inf_adopted_algorithm_translate_finalize(
+  InfAdoptedAlgorithmTranslate* translate)
+{
+  g_assert(translate->stack == NULL);
+
+  g_tree_destroy(translate->reachable);
+  g_tree_destroy(translate->requests);
+}
+
+/* Same as inf_adopted_algorithm_is_reachable(), but remembers the result
+ * for the duration of the translation, since the same intermediate states
+ * are checked over and over again. */
+static gboolean
+inf_adopted_algorithm_translate_is_reachable(
+  InfAdoptedAlgorithmTranslate* translate,
+  InfAdoptedStateVector* v)
+{
+  gpointer value;
+  gboolean reachable;
+
+  value = g_tree_lookup(translate->reachable, v);
+  if(value != NULL)
+    return GPOINTER_TO_UINT(value) == 2;
+
+  reachable = inf_adopted_algorithm_is_reachable(translate->algorithm, v);
+
+  g_tree_insert(
+    translate->reachable,
+    inf_adopted_state_vector_copy(v),
+    GUINT_TO_POINTER(reachable ? 2 : 1)
   );
 
-  concurrency_id = INF_ADOPTED_CONCURRENCY_NONE;
-  if(inf_adopted_request_need_concurrency_id(request_at, against_at) == TRUE)
-  {
-    lcs = inf_adopted_algorithm_least_common_successor(
-      algorithm,
-      inf_adopted_request_get_vector(request),
-      inf_adopted_request_get_vector(against)
-    );
+  return reachable;
+}
 
-    g_assert(inf_adopted_state_vector_causally_before(lcs, at));
+/* Takes ownership of to */
+static void
+inf_adopted_algorithm_translate_push(InfAdoptedAlgorithmTranslate* translate,
+                                     InfAdoptedRequest* request,
+                                     InfAdoptedStateVector* to)
+{
+  InfAdoptedAlgorithmTranslateFrame* frame;
+
+  frame = g_slice_new(InfAdoptedAlgorithmTranslateFrame);
+  frame->step = INF_ADOPTED_ALGORITHM_TRANSLATE_START;
+  frame->request = request;
+  frame->to = to;
+  frame->at = NULL;
+  frame->lcs = NULL;
+  frame->against = NULL;
+  frame->against_at = NULL;
+  frame->request_at = NULL;
+  frame->lcs_against = NULL;
+
+  translate->stack = g_slist_prepend(translate->stack, frame);
+}
 
-    if(inf_adopted_state_vector_compare(lcs, at) != 0)
-    {
-      lcs_against = inf_adopted_algorithm_translate_request(
-        algorithm,
-        against,
-        lcs
-      );
+static void
+inf_adopted_algorithm_translate_pop(InfAdoptedAlgorithmTranslate* translate)
+{
+  InfAdoptedAlgorithmTranslateFrame* frame;
 
-      lcs_request = inf_adopted_algorithm_translate_request(
-        algorithm,
-        request,
-        lcs
-      );
+  g_assert(translate->stack != NULL);
+  frame = (InfAdoptedAlgorithmTranslateFrame*)translate->stack->data;
+  translate->stack = g_slist_delete_link(translate->stack, translate->stack);
 
-      concurrency_id =
-        inf_adopted_request_get_concurrency_id(lcs_request, lcs_against);
-      
-      g_object_unref(lcs_request);
-      g_object_unref(lcs_against);
-    }
+  g_assert(frame->against_at == NULL);
+  g_assert(frame->request_at == NULL);
+  g_assert(frame->lcs_against == NULL);
+
+  inf_adopted_state_vector_free(frame->to);
+  if(frame->at != NULL) inf_adopted_state_vector_free(frame->at);
+  if(frame->lcs != NULL) inf_adopted_state_vector_free(frame->lcs);
+  g_slice_free(InfAdoptedAlgorithmTranslateFrame, frame);
+}
+
+/* Looks up the translation of request to to in the request cache, and in
+ * the requests translated so far during this translation which could not
+ * be cached. Returns a new reference, or NULL. */
+static InfAdoptedRequest*
+inf_adopted_algorithm_translate_lookup(InfAdoptedAlgorithmTranslate* translate,
+                                       InfAdoptedRequest* request,
+                                       InfAdoptedStateVector* to)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmRequestKey lookup_key;
+  InfAdoptedRequest* result;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(translate->algorithm);
 
-    inf_adopted_state_vector_free(lcs);
+  lookup_key.vector = to;
+  lookup_key.user_id = inf_adopted_request_get_user_id(request);
+
+  /* If the request affects the buffer, then it might have been cached
+   * earlier. */
+  result = NULL;
+  if(inf_adopted_request_affects_buffer(request))
+  {
+    result = g_tree_lookup(priv->cache, &lookup_key);
+    if(result != NULL)
+      ++ priv->n_cache_hits;
+    else
+      ++ priv->n_cache_misses;
   }
 
-  result = inf_adopted_request_transform(
-    request_at,
-    against_at,
-    concurrency_id
+  if(result == NULL)
+    result = g_tree_lookup(translate->requests, &lookup_key);
+
+  if(result != NULL)
+    g_object_ref(result);
+  return result;
+}
+
+/* Stores result as the translation of the request in the topmost frame,
+ * and removes that frame from the stack. Returns result. */
+static InfAdoptedRequest*
+inf_adopted_algorithm_translate_finish(InfAdoptedAlgorithmTranslate* translate,
+                                       InfAdoptedRequest* result)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmTranslateFrame* frame;
+  InfAdoptedAlgorithmRequestKey* insert_key;
+  guint user_id;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(translate->algorithm);
+  frame = (InfAdoptedAlgorithmTranslateFrame*)translate->stack->data;
+  user_id = inf_adopted_request_get_user_id(frame->request);
+
+  g_assert(
+    inf_adopted_state_vector_compare(
+      inf_adopted_request_get_vector(result),
+      frame->to
+    ) == 0
   );
 
-  g_object_unref(request_at);
-  g_object_unref(against_at);
+  insert_key = g_slice_new(InfAdoptedAlgorithmRequestKey);
+  insert_key->vector = inf_adopted_request_get_vector(result);
+  insert_key->user_id = user_id;
+  g_object_ref(result);
 
+  if(inf_adopted_algorithm_can_cache(result))
+  {
+    g_assert(g_tree_lookup(priv->cache, insert_key) == NULL);
+    g_tree_replace(priv->cache, insert_key, result);
+  }
+  else
+  {
+    /* Keep it around for the rest of this translation anyway */
+    g_assert(g_tree_lookup(translate->requests, insert_key) == NULL);
+    g_tree_insert(translate->requests, insert_key, result);
+  }
+
+  inf_adopted_algorithm_translate_pop(translate);
   return result;
 }
 
-/* This should only ever be called by
- * inf_adopted_algorithm_translate_request() after it did the cache and
- * validity checks */
+/* Decides how to translate the request in the topmost frame, as described
+ * in the adOPTed paper: Late mirror for undo and redo requests, late fold
+ * over undo and redo requests of other users, or transformation against
+ * another user's request otherwise. Pushes the translation this depends on
+ * onto the stack. Returns the translated request if there is no such
+ * dependency. */
 static InfAdoptedRequest*
-inf_adopted_algorithm_translate_request_nocache(InfAdoptedAlgorithm* algorithm,
-                                                InfAdoptedRequest* request,
-                                                InfAdoptedStateVector* to)
+inf_adopted_algorithm_translate_step(InfAdoptedAlgorithmTranslate* translate)
 {
   InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmTranslateFrame* frame;
   InfAdoptedUser** user_it; /* user iterator */
   InfUser* user; /* points to current user (mostly *user_it) */
   guint user_id; /* Corresponding ID */
   InfAdoptedRequestLog* log; /* points to current log */
   InfAdoptedStateVector* vector; /* always points to request's vector */
+  InfAdoptedStateVector* to;
 
   InfAdoptedRequest* associated;
-  InfAdoptedRequest* translated;
-  InfAdoptedRequest* result;
   gint by;
   guint n;
 
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  vector = inf_adopted_request_get_vector(request);
-  result = NULL;
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(translate->algorithm);
+  frame = (InfAdoptedAlgorithmTranslateFrame*)translate->stack->data;
+  vector = inf_adopted_request_get_vector(frame->request);
+  to = frame->to;
 
-  if(inf_adopted_request_get_request_type(request) != INF_ADOPTED_REQUEST_DO)
+  if(inf_adopted_request_get_request_type(frame->request) !=
+     INF_ADOPTED_REQUEST_DO)
   {
-    user_id = inf_adopted_request_get_user_id(request);
+    user_id = inf_adopted_request_get_user_id(frame->request);
     user = inf_user_table_lookup_user_by_id(priv->user_table, user_id);
     log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
 
     /* Try late mirror if this is not a do request */
-    associated = inf_adopted_request_log_prev_associated(log, request);
+    associated = inf_adopted_request_log_prev_associated(log, frame->request);
     g_assert(associated != NULL);
 
     n = inf_adopted_state_vector_get(to, user_id);
@@ -1026,22 +1263,21 @@ inf_adopted_algorithm_translate_request_nocache(InfAdoptedAlgorithm* algorithm,
 
     inf_adopted_state_vector_add(to, user_id, -by);
 
-    if(inf_adopted_algorithm_is_reachable(algorithm, to))
+    if(inf_adopted_algorithm_translate_is_reachable(translate, to))
     {
-      translated = inf_adopted_algorithm_translate_request(
-        algorithm,
+      frame->step = INF_ADOPTED_ALGORITHM_TRANSLATE_MIRROR;
+      frame->by = by;
+
+      inf_adopted_algorithm_translate_push(
+        translate,
         associated,
-        to
+        inf_adopted_state_vector_copy(to)
       );
-
-      result = inf_adopted_request_mirror(translated, by);
-
-      g_object_unref(translated);
     }
 
     /* Reset to for other routines to use */
     inf_adopted_state_vector_set(to, user_id, n);
-    if(result) return result;
+    if(frame->step != INF_ADOPTED_ALGORITHM_TRANSLATE_START) return NULL;
   }
   else
   {
@@ -1049,16 +1285,17 @@ inf_adopted_algorithm_translate_request_nocache(InfAdoptedAlgorithm* algorithm,
      * already at the state we are supposed to translate request to. */
     if(inf_adopted_state_vector_compare(vector, to) == 0)
     {
-      g_object_ref(request);
-      return request;
+      g_object_ref(frame->request);
+      return frame->request;
     }
   }
 
-  for(user_it = priv->users_begin; user_it != priv->users_end; ++ user_it)
+  /* Inactive users have no requests in their log to transform against */
+  for(user_it = priv->active_begin; user_it != priv->active_end; ++ user_it)
   {
     user = INF_USER(*user_it);
     user_id = inf_user_get_id(user);
-    if(user_id == inf_adopted_request_get_user_id(request)) continue;
+    if(user_id == inf_adopted_request_get_user_id(frame->request)) continue;
 
     n = inf_adopted_state_vector_get(to, user_id);
     log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
@@ -1081,94 +1318,227 @@ inf_adopted_algorithm_translate_request_nocache(InfAdoptedAlgorithm* algorithm,
 
       inf_adopted_state_vector_add(to, user_id, -by);
 
-      if(inf_adopted_algorithm_is_reachable(algorithm, to) &&
+      if(inf_adopted_algorithm_translate_is_reachable(translate, to) &&
          inf_adopted_state_vector_causally_before(vector, to) == TRUE)
       {
-        translated = inf_adopted_algorithm_translate_request(
-          algorithm,
-          request,
-          to
-        );
-
-        result = inf_adopted_request_fold(
-          translated,
-          user_id,
-          by
+        frame->step = INF_ADOPTED_ALGORITHM_TRANSLATE_FOLD;
+        frame->user_id = user_id;
+        frame->by = by;
+
+        inf_adopted_algorithm_translate_push(
+          translate,
+          frame->request,
+          inf_adopted_state_vector_copy(to)
         );
-
-        g_object_unref(translated);
       }
 
       /* Reset to for other routines to use */
       inf_adopted_state_vector_set(to, user_id, n);
-      if(result) return result;
+      if(frame->step != INF_ADOPTED_ALGORITHM_TRANSLATE_START) return NULL;
     }
 
     /* Transform into direction we are not going to fold later */
     if(inf_adopted_state_vector_get(vector, user_id) < n)
-/*       inf_adopted_state_vector_get(to, user_id))*/
     {
       inf_adopted_state_vector_set(to, user_id, n - 1);
-      if(inf_adopted_algorithm_is_reachable(algorithm, to))
+      if(inf_adopted_algorithm_translate_is_reachable(translate, to))
       {
-        associated = inf_adopted_request_log_get_request(log, n - 1);
+        frame->step = INF_ADOPTED_ALGORITHM_TRANSLATE_AGAINST_AT;
+        frame->against = inf_adopted_request_log_get_request(log, n - 1);
+        frame->at = inf_adopted_state_vector_copy(to);
 
-        result = inf_adopted_algorithm_transform_request(
-          algorithm,
-          request,
-          associated,
-          to
+        g_assert(
+          inf_adopted_state_vector_causally_before(vector, frame->at)
+        );
+        g_assert(
+          inf_adopted_state_vector_causally_before(
+            inf_adopted_request_get_vector(frame->against),
+            frame->at
+          )
+        );
+
+        /* Translate both requests to state at and then transform them
+         * against each other. */
+        inf_adopted_algorithm_translate_push(
+          translate,
+          frame->against,
+          inf_adopted_state_vector_copy(frame->at)
         );
       }
 
       /* Reset to be reused */
       inf_adopted_state_vector_set(to, user_id, n);
-      if(result) return result;
+      if(frame->step != INF_ADOPTED_ALGORITHM_TRANSLATE_START) return NULL;
     }
   }
 
-#if 0
-  /* Last resort: Transform always */
-  for(user_it = priv->users_begin; user_it != priv->users_end; ++ user_it)
-  {
-    user = INF_USER(*user_it);
-    user_id = inf_user_get_id(user);
-    if(user_id == inf_adopted_request_get_user_id(request)) continue;
+  g_assert_not_reached();
+  return NULL;
+}
 
-    n = inf_adopted_state_vector_get(v, user_id);
-    log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+/* Continues the translation of the topmost frame once the translation it
+ * depended on, result, is available. Takes ownership of result. Returns
+ * the translated request if the frame is done, or NULL if it pushed
+ * another dependency onto the stack. */
+static InfAdoptedRequest*
+inf_adopted_algorithm_translate_resume(InfAdoptedAlgorithmTranslate* translate,
+                                       InfAdoptedRequest* result)
+{
+  InfAdoptedAlgorithmTranslateFrame* frame;
+  InfAdoptedConcurrencyId concurrency_id;
+  InfAdoptedRequest* translated;
 
-    g_assert(n >= inf_adopted_request_log_get_begin(log));
-    if(n == inf_adopted_request_log_get_begin(log)) continue;
+  frame = (InfAdoptedAlgorithmTranslateFrame*)translate->stack->data;
+
+  switch(frame->step)
+  {
+  case INF_ADOPTED_ALGORITHM_TRANSLATE_MIRROR:
+    translated = inf_adopted_request_mirror(result, frame->by);
+    g_object_unref(result);
+    return translated;
+  case INF_ADOPTED_ALGORITHM_TRANSLATE_FOLD:
+    translated = inf_adopted_request_fold(result, frame->user_id, frame->by);
+    g_object_unref(result);
+    return translated;
+  case INF_ADOPTED_ALGORITHM_TRANSLATE_AGAINST_AT:
+    frame->against_at = result;
+    frame->step = INF_ADOPTED_ALGORITHM_TRANSLATE_REQUEST_AT;
+
+    inf_adopted_algorithm_translate_push(
+      translate,
+      frame->request,
+      inf_adopted_state_vector_copy(frame->at)
+    );
+
+    return NULL;
+  case INF_ADOPTED_ALGORITHM_TRANSLATE_REQUEST_AT:
+    frame->request_at = result;
+    concurrency_id = INF_ADOPTED_CONCURRENCY_NONE;
 
-    if(inf_adopted_state_vector_get(vector, user_id) <
-       inf_adopted_state_vector_get(to, user_id))
+    if(inf_adopted_request_need_concurrency_id(frame->request_at,
+                                               frame->against_at) == TRUE)
     {
-      inf_adopted_state_vector_set(v, user_id, n - 1);
-      if(inf_adopted_algorithm_is_reachable(algorithm, v))
+      frame->lcs = inf_adopted_algorithm_least_common_successor(
+        translate->algorithm,
+        inf_adopted_request_get_vector(frame->request),
+        inf_adopted_request_get_vector(frame->against)
+      );
+
+      g_assert(inf_adopted_state_vector_causally_before(frame->lcs, frame->at));
+
+      if(inf_adopted_state_vector_compare(frame->lcs, frame->at) != 0)
       {
-        associated = inf_adopted_request_log_get_request(log, n - 1);
+        frame->step = INF_ADOPTED_ALGORITHM_TRANSLATE_LCS_AGAINST;
 
-        result = inf_adopted_algorithm_transform_request(
-          algorithm,
-          request,
-          associated,
-          v
+        inf_adopted_algorithm_translate_push(
+          translate,
+          frame->against,
+          inf_adopted_state_vector_copy(frame->lcs)
         );
 
-        goto done;
+        return NULL;
       }
-      else
+    }
+
+    break;
+  case INF_ADOPTED_ALGORITHM_TRANSLATE_LCS_AGAINST:
+    frame->lcs_against = result;
+    frame->step = INF_ADOPTED_ALGORITHM_TRANSLATE_LCS_REQUEST;
+
+    inf_adopted_algorithm_translate_push(
+      translate,
+      frame->request,
+      inf_adopted_state_vector_copy(frame->lcs)
+    );
+
+    return NULL;
+  case INF_ADOPTED_ALGORITHM_TRANSLATE_LCS_REQUEST:
+    concurrency_id =
+      inf_adopted_request_get_concurrency_id(result, frame->lcs_against);
+
+    g_object_unref(result);
+    g_object_unref(frame->lcs_against);
+    frame->lcs_against = NULL;
+    break;
+  case INF_ADOPTED_ALGORITHM_TRANSLATE_START:
+  default:
+    g_assert_not_reached();
+    return NULL;
+  }
+
+  translated = inf_adopted_request_transform(
+    frame->request_at,
+    frame->against_at,
+    concurrency_id
+  );
+
+  ++ INF_ADOPTED_ALGORITHM_PRIVATE(translate->algorithm)->n_transformed;
+
+  g_object_unref(frame->request_at);
+  g_object_unref(frame->against_at);
+  frame->request_at = NULL;
+  frame->against_at = NULL;
+
+  return translated;
+}
+
+/* Translates request to state to, without recursion. Every translation
+ * that is still in progress has a frame on the work stack, and the
+ * translation of the topmost frame is carried out first. The results
+ * of all intermediate translations are either put into the request cache
+ * or remembered in the InfAdoptedAlgorithmTranslate so that no request is
+ * translated twice to the same state. */
+static InfAdoptedRequest*
+inf_adopted_algorithm_translate_run(InfAdoptedAlgorithmTranslate* translate,
+                                    InfAdoptedRequest* request,
+                                    InfAdoptedStateVector* to)
+{
+  InfAdoptedAlgorithmTranslateFrame* frame;
+  InfAdoptedRequest* result;
+
+  inf_adopted_algorithm_translate_push(
+    translate,
+    request,
+    inf_adopted_state_vector_copy(to)
+  );
+
+  result = NULL;
+  while(translate->stack != NULL)
+  {
+    frame = (InfAdoptedAlgorithmTranslateFrame*)translate->stack->data;
+
+    if(frame->step == INF_ADOPTED_ALGORITHM_TRANSLATE_START)
+    {
+      g_assert(result == NULL);
+
+      result = inf_adopted_algorithm_translate_lookup(
+        translate,
+        frame->request,
+        frame->to
+      );
+
+      if(result != NULL)
       {
-        /* Reset to be reused */
-        inf_adopted_state_vector_set(v, user_id, n);
+        inf_adopted_algorithm_translate_pop(translate);
+        continue;
       }
+
+      result = inf_adopted_algorithm_translate_step(translate);
     }
+    else
+    {
+      g_assert(result != NULL);
+      result = inf_adopted_algorithm_translate_resume(translate, result);
+    }
+
+    /* The reference we got is passed on to the frame below, or to the
+     * caller if this was the last one. */
+    if(result != NULL)
+      result = inf_adopted_algorithm_translate_finish(translate, result);
   }
-#endif
 
-  g_assert_not_reached();
-  return NULL;
+  g_assert(result != NULL);
+  return result;
 }
 
 static void
@@ -1194,6 +1564,8 @@ inf_adopted_algorithm_init(GTypeInstance* instance,
    * reference anyway. */
   priv->users_begin = NULL;
   priv->users_end = NULL;
+  priv->active_begin = NULL;
+  priv->active_end = NULL;
 
   priv->cache = g_tree_new_full(
     inf_adopted_algorithm_request_key_cmp,
@@ -1203,6 +1575,12 @@ inf_adopted_algorithm_init(GTypeInstance* instance,
   );
 
   priv->local_users = NULL;
+  priv->bulk = 0;
+
+  priv->n_executed = 0;
+  priv->n_transformed = 0;
+  priv->n_cache_hits = 0;
+  priv->n_cache_misses = 0;
 }
 
 static void
@@ -1273,6 +1651,7 @@ inf_adopted_algorithm_dispose(GObject* object)
 {
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user;
   GList* item;
 
   algorithm = INF_ADOPTED_ALGORITHM(object);
@@ -1289,7 +1668,21 @@ inf_adopted_algorithm_dispose(GObject* object)
   g_tree_destroy(priv->cache);
   priv->cache = NULL;
 
+  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(*user),
+      G_CALLBACK(inf_adopted_algorithm_user_notify_status_cb),
+      algorithm
+    );
+  }
+
   g_free(priv->users_begin);
+  g_free(priv->active_begin);
+  priv->users_begin = NULL;
+  priv->users_end = NULL;
+  priv->active_begin = NULL;
+  priv->active_end = NULL;
 
   if(priv->buffer != NULL)
   {
@@ -1495,6 +1888,7 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
   gboolean equivalent;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  ++ priv->n_executed;
 
   g_assert(
     inf_adopted_state_vector_causally_before(
@@ -1553,11 +1947,28 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     g_object_ref(log_request);
   }
 
-  translated = inf_adopted_algorithm_translate_request(
-    algorithm,
-    log_request,
-    priv->current
-  );
+  /* When replaying a history in bulk, most requests were made at the
+   * current state. There is nothing to translate for them, so avoid
+   * setting up the translation and looking up the cache. */
+  if(priv->bulk > 0 &&
+     inf_adopted_request_get_request_type(request) ==
+     INF_ADOPTED_REQUEST_DO &&
+     inf_adopted_state_vector_compare(
+       inf_adopted_request_get_vector(request),
+       priv->current
+     ) == 0)
+  {
+    translated = request;
+    g_object_ref(translated);
+  }
+  else
+  {
+    translated = inf_adopted_algorithm_translate_request(
+      algorithm,
+      log_request,
+      priv->current
+    );
+  }
 
   if(inf_adopted_request_get_request_type(request) == INF_ADOPTED_REQUEST_DO)
   {
@@ -1602,6 +2013,13 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
   {
     inf_adopted_request_log_add_request(log, log_request);
 
+    /* The user could have been inactive if its log was empty before */
+    if(inf_adopted_request_log_get_begin(log) + 1 ==
+       inf_adopted_request_log_get_end(log))
+    {
+      inf_adopted_algorithm_update_active_users(algorithm);
+    }
+
     inf_adopted_state_vector_add(
       priv->current,
       inf_adopted_request_get_user_id(request),
@@ -1620,6 +2038,8 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
 
   if(apply == TRUE)
   {
+    /* Always emit the signal, also in bulk mode: sessions connect to it to
+     * tell apart changes made by the algorithm from local changes. */
     g_signal_emit(
       G_OBJECT(algorithm),
       algorithm_signals[APPLY_REQUEST],
@@ -2236,11 +2656,9 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
   InfAdoptedAlgorithmPrivate* priv;
   guint user_id;
 
+  InfAdoptedAlgorithmTranslate translate;
   InfAdoptedRequest* result;
 
-  InfAdoptedAlgorithmRequestKey lookup_key;
-  InfAdoptedAlgorithmRequestKey* insert_key;
-
   g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(to != NULL, NULL);
@@ -2276,47 +2694,16 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
     NULL
   );
 
-  g_return_val_if_fail(
-    inf_adopted_algorithm_is_reachable(algorithm, to) == TRUE,
-    NULL
-  );
+  inf_adopted_algorithm_translate_init(algorithm, &translate);
 
-  /* If the request affects the buffer, then it might have been cached
-   * earlier. */
-  if(inf_adopted_request_affects_buffer(request))
+  if(!inf_adopted_algorithm_translate_is_reachable(&translate, to))
   {
-    lookup_key.vector = to;
-    lookup_key.user_id = user_id;
-    result = g_tree_lookup(priv->cache, &lookup_key);
-    if(result != NULL)
-    {
-      g_object_ref(result);
-      return result;
-    }
+    inf_adopted_algorithm_translate_finalize(&translate);
+    g_return_val_if_reached(NULL);
   }
 
-  result = inf_adopted_algorithm_translate_request_nocache(
-    algorithm,
-    request,
-    to
-  );
-
-  g_assert(
-    inf_adopted_state_vector_compare(
-      inf_adopted_request_get_vector(result),
-      to
-    ) == 0
-  );
-
-  if(inf_adopted_algorithm_can_cache(result))
-  {
-    insert_key = g_slice_new(InfAdoptedAlgorithmRequestKey);
-    insert_key->vector = inf_adopted_request_get_vector(result);
-    insert_key->user_id = user_id;
-    g_assert(g_tree_lookup(priv->cache, insert_key) == NULL);
-    g_tree_replace(priv->cache, insert_key, result);
-    g_object_ref(result);
-  }
+  result = inf_adopted_algorithm_translate_run(&translate, request, to);
+  inf_adopted_algorithm_translate_finalize(&translate);
 
   return result;
 }
@@ -2420,8 +2807,12 @@ inf_adopted_algorithm_receive_request(InfAdoptedAlgorithm* algorithm,
     } while(item != NULL);
   }
 
-  inf_adopted_algorithm_cleanup(algorithm);
-  inf_adopted_algorithm_update_undo_redo(algorithm);
+  /* Done once in inf_adopted_algorithm_end_bulk() instead */
+  if(priv->bulk == 0)
+  {
+    inf_adopted_algorithm_cleanup(algorithm);
+    inf_adopted_algorithm_update_undo_redo(algorithm);
+  }
 }
 
 /**
@@ -2506,4 +2897,85 @@ inf_adopted_algorithm_can_redo(InfAdoptedAlgorithm* algorithm,
   }
 }
 
+/**
+ * inf_adopted_algorithm_get_statistics:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ * @statistics: Location to store the statistics.
+ *
+ * Fills @statistics with counters describing how much work @algorithm has
+ * done since it was created. The counters are maintained at all times, and
+ * reading them is cheap, so this can be used to periodically export
+ * runtime metrics.
+ **/
+void
+inf_adopted_algorithm_get_statistics(InfAdoptedAlgorithm* algorithm,
+                                     InfAdoptedAlgorithmStatistics* statistics)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm));
+  g_return_if_fail(statistics != NULL);
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  statistics->n_executed = priv->n_executed;
+  statistics->n_transformed = priv->n_transformed;
+  statistics->n_cache_hits = priv->n_cache_hits;
+  statistics->n_cache_misses = priv->n_cache_misses;
+  statistics->cache_size = g_tree_nnodes(priv->cache);
+}
+
+/**
+ * inf_adopted_algorithm_begin_bulk:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ *
+ * Puts @algorithm into bulk mode, which is meant for replaying a long
+ * history of requests as fast as possible, for example when loading a
+ * document. While in bulk mode, requests that were issued at the current
+ * state are applied without translating them. The
+ * #InfAdoptedAlgorithm::execute-request and
+ * #InfAdoptedAlgorithm::apply-request signals are still emitted for every
+ * request.
+ *
+ * Cleanup of the request logs and updating the undo and redo state is
+ * deferred until inf_adopted_algorithm_end_bulk() is called. Calls to this
+ * function can be nested; bulk mode ends with the last matching call to
+ * inf_adopted_algorithm_end_bulk().
+ **/
+void
+inf_adopted_algorithm_begin_bulk(InfAdoptedAlgorithm* algorithm)
+{
+  g_return_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm));
+  ++ INF_ADOPTED_ALGORITHM_PRIVATE(algorithm)->bulk;
+}
+
+/**
+ * inf_adopted_algorithm_end_bulk:
+ * @algorithm: A #InfAdoptedAlgorithm in bulk mode.
+ *
+ * Leaves bulk mode entered with inf_adopted_algorithm_begin_bulk(). When
+ * bulk mode ends, the request logs are cleaned up and the
+ * #InfAdoptedAlgorithm::can-undo-changed and
+ * #InfAdoptedAlgorithm::can-redo-changed signals are emitted for local
+ * users whose undo or redo state changed in the meanwhile.
+ **/
+void
+inf_adopted_algorithm_end_bulk(InfAdoptedAlgorithm* algorithm)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm));
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  g_return_if_fail(priv->bulk > 0);
+
+  -- priv->bulk;
+  if(priv->bulk == 0)
+  {
+    if(priv->users_begin != priv->users_end)
+      inf_adopted_algorithm_cleanup(algorithm);
+    inf_adopted_algorithm_update_undo_redo(algorithm);
+  }
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -39,6 +39,28 @@ G_BEGIN_DECLS
 typedef struct _InfAdoptedAlgorithm InfAdoptedAlgorithm;
 typedef struct _InfAdoptedAlgorithmClass InfAdoptedAlgorithmClass;
 
+/**
+ * InfAdoptedAlgorithmStatistics:
+ * @n_executed: The number of requests executed.
+ * @n_transformed: The number of transformations performed while translating
+ * requests.
+ * @n_cache_hits: The number of translations found in the request cache.
+ * @n_cache_misses: The number of translations not found in the request
+ * cache.
+ * @cache_size: The number of requests currently in the request cache.
+ *
+ * Counters describing the work done by a #InfAdoptedAlgorithm, see
+ * inf_adopted_algorithm_get_statistics().
+ */
+typedef struct _InfAdoptedAlgorithmStatistics InfAdoptedAlgorithmStatistics;
+struct _InfAdoptedAlgorithmStatistics {
+  guint64 n_executed;
+  guint64 n_transformed;
+  guint64 n_cache_hits;
+  guint64 n_cache_misses;
+  guint cache_size;
+};
+
 /**
  * InfAdoptedAlgorithmClass:
  * @can_undo_changed: Default signal handler for the
@@ -139,6 +161,16 @@ gboolean
 inf_adopted_algorithm_can_redo(InfAdoptedAlgorithm* algorithm,
                                InfAdoptedUser* user);
 
+void
+inf_adopted_algorithm_begin_bulk(InfAdoptedAlgorithm* algorithm);
+
+void
+inf_adopted_algorithm_end_bulk(InfAdoptedAlgorithm* algorithm);
+
+void
+inf_adopted_algorithm_get_statistics(InfAdoptedAlgorithm* algorithm,
+                                     InfAdoptedAlgorithmStatistics* statistics);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_ALGORITHM_H__ */
@@ -110,6 +110,36 @@ inf_adopted_request_finalize(GObject* object)
   G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
+/* Creates a new request without going through the GObject property
+ * machinery. This is used for the requests created during transformation,
+ * which are the bulk of all requests. Ownership of vector is transferred to
+ * the new request, so the caller does not need to copy it once more. */
+static InfAdoptedRequest*
+inf_adopted_request_new_take(InfAdoptedRequestType type,
+                             InfAdoptedStateVector* vector,
+                             guint user_id,
+                             InfAdoptedOperation* operation)
+{
+  InfAdoptedRequest* request;
+  InfAdoptedRequestPrivate* priv;
+
+  g_assert(user_id != 0);
+  g_assert( (type == INF_ADOPTED_REQUEST_DO && operation != NULL) ||
+            (type != INF_ADOPTED_REQUEST_DO && operation == NULL) );
+
+  request = INF_ADOPTED_REQUEST(g_object_new(INF_ADOPTED_TYPE_REQUEST, NULL));
+  priv = INF_ADOPTED_REQUEST_PRIVATE(request);
+
+  priv->type = type;
+  priv->vector = vector;
+  priv->user_id = user_id;
+
+  if(operation != NULL)
+    priv->operation = g_object_ref(operation);
+
+  return request;
+}
+
 static void
 inf_adopted_request_set_property(GObject* object,
                                  guint prop_id,
@@ -327,22 +357,16 @@ inf_adopted_request_new_do(InfAdoptedStateVector* vector,
                            guint user_id,
                            InfAdoptedOperation* operation)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operation), NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_DO,
-    "vector", vector,
-    "user-id", user_id,
-    "operation", operation,
-    NULL
+  return inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_DO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    operation
   );
-
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -361,20 +385,15 @@ InfAdoptedRequest*
 inf_adopted_request_new_undo(InfAdoptedStateVector* vector,
                              guint user_id)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_UNDO,
-    "vector", vector,
-    "user-id", user_id,
+  return inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_UNDO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
     NULL
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -393,20 +412,15 @@ InfAdoptedRequest*
 inf_adopted_request_new_redo(InfAdoptedStateVector* vector,
                              guint user_id)
 {
-  GObject* object;
-  
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
   
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_REDO,
-    "vector", vector,
-    "user-id", user_id,
+  return inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_REDO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
     NULL
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -421,34 +435,16 @@ InfAdoptedRequest*
 inf_adopted_request_copy(InfAdoptedRequest* request)
 {
   InfAdoptedRequestPrivate* priv;
-  GObject* object;
   
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   priv = INF_ADOPTED_REQUEST_PRIVATE(request);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "operation", priv->operation,
-      NULL
-    );
-  }
-  else
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      NULL
-    );
-  }
-
-  return INF_ADOPTED_REQUEST(object);
+  return inf_adopted_request_new_take(
+    priv->type,
+    inf_adopted_state_vector_copy(priv->vector),
+    priv->user_id,
+    priv->operation
+  );
 }
 
 /**
@@ -718,14 +714,14 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(request_priv->vector);
   inf_adopted_state_vector_add(new_vector, against_priv->user_id, 1);
 
-  new_request = inf_adopted_request_new_do(
+  new_request = inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     request_priv->user_id,
     new_operation
   );
 
   g_object_unref(new_operation);
-  inf_adopted_state_vector_free(new_vector);
   return new_request;
 }
 
@@ -770,14 +766,14 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, priv->user_id, by);
 
-  new_request = inf_adopted_request_new_do(
+  new_request = inf_adopted_request_new_take(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     priv->user_id,
     new_operation
   );
 
   g_object_unref(new_operation);
-  inf_adopted_state_vector_free(new_vector);
   return new_request;
 }
 
@@ -805,7 +801,6 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
 {
   InfAdoptedRequestPrivate* priv;
   InfAdoptedStateVector* new_vector;
-  InfAdoptedRequest* new_request;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(into != 0, NULL);
@@ -817,33 +812,12 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, into, by);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "operation", priv->operation,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        NULL
-      )
-    );
-  }
-  else
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "vector", new_vector,
-        "user-id", priv->user_id
-      )
-    );
-  }
-
-  inf_adopted_state_vector_free(new_vector);
-  return new_request;
+  return inf_adopted_request_new_take(
+    priv->type,
+    new_vector,
+    priv->user_id,
+    priv->operation
+  );
 }
 
 /**
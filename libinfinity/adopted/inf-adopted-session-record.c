@@ -51,6 +51,11 @@
  *
  * To replay a record, use #InfAdoptedSessionReplay or the tool
  * <literal>inf-test-text-replay</literal> in the infinote test suite.
+ *
+ * Records can be written gzip-compressed by setting the
+ * #InfAdoptedSessionRecord:compression property, and they can be continued
+ * in a new file with inf_adopted_session_record_rotate(). Each file starts
+ * with a snapshot of the session, so that it can be replayed on its own.
  */
 
 /* TODO: Record user join/leave events, and update last send vectors on
@@ -60,8 +65,12 @@ typedef struct _InfAdoptedSessionRecordPrivate InfAdoptedSessionRecordPrivate;
 struct _InfAdoptedSessionRecordPrivate {
   InfAdoptedSession* session;
   xmlTextWriterPtr writer;
+  /* Owned by writer */
+  xmlOutputBufferPtr output;
   FILE* file;
   gchar* filename;
+  guint compression;
+  guint64 bytes_written;
 
   GHashTable* last_send_table;
 };
@@ -70,7 +79,9 @@ enum {
   PROP_0,
 
   /* construct only */
-  PROP_SESSION
+  PROP_SESSION,
+
+  PROP_COMPRESSION
 };
 
 #define INF_ADOPTED_SESSION_RECORD_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_ADOPTED_TYPE_SESSION_RECORD, InfAdoptedSessionRecordPrivate))
@@ -126,10 +137,8 @@ inf_adopted_session_record_write_node(InfAdoptedSessionRecord* record,
     }
     else if(child->type == XML_TEXT_NODE)
     {
-      value = xmlNodeGetContent(child);
-      result = xmlTextWriterWriteString(priv->writer, value);
+      result = xmlTextWriterWriteString(priv->writer, child->content);
       if(result < 0) inf_adopted_session_record_handle_xml_error(record);
-      xmlFree(value);
     }
   }
 
@@ -137,6 +146,30 @@ inf_adopted_session_record_write_node(InfAdoptedSessionRecord* record,
   if(result < 0) inf_adopted_session_record_handle_xml_error(record);
 }
 
+static void
+inf_adopted_session_record_flush(InfAdoptedSessionRecord* record)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  int result;
+
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+
+  result = xmlTextWriterFlush(priv->writer);
+  if(result < 0)
+    inf_adopted_session_record_handle_xml_error(record);
+
+  /* The return value of xmlTextWriterFlush() only covers what was still
+   * buffered, not what the output buffer had already written by itself
+   * when it filled up, so ask the output buffer for the total. */
+  if(priv->output != NULL)
+    priv->bytes_written = (guint)priv->output->written;
+
+  /* Compressed output is not flushed to the file after every write, since
+   * that would hurt the compression ratio. */
+  if(priv->file != NULL)
+    fflush(priv->file);
+}
+
 static void
 inf_adopted_session_record_user_joined(InfAdoptedSessionRecord* record,
                                        InfAdoptedUser* user)
@@ -163,7 +196,6 @@ inf_adopted_session_record_execute_request_cb(InfAdoptedAlgorithm* algorithm,
   InfAdoptedSessionClass* session_class;
   InfAdoptedStateVector* previous;
   xmlNodePtr xml;
-  int result;
 
   record = INF_ADOPTED_SESSION_RECORD(user_data);
   priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
@@ -177,9 +209,7 @@ inf_adopted_session_record_execute_request_cb(InfAdoptedAlgorithm* algorithm,
   inf_adopted_session_record_write_node(record, xml);
   xmlFreeNode(xml);
 
-  result = xmlTextWriterFlush(priv->writer);
-  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
-  fflush(priv->file);
+  inf_adopted_session_record_flush(record);
 
   /* Update last send entry */
   previous =
@@ -212,9 +242,7 @@ inf_adopted_session_record_add_user_cb(InfUserTable* user_table,
   inf_adopted_session_record_write_node(record, xml);
   xmlFreeNode(xml);
 
-  result = xmlTextWriterFlush(priv->writer);
-  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
-  fflush(priv->file);
+  inf_adopted_session_record_flush(record);
 }
 
 static void
@@ -227,46 +255,23 @@ inf_adopted_session_record_start_foreach_user_func(InfUser* user,
   );
 }
 
+/* Writes the beginning of a record file, containing the current state of
+ * the session. */
 static void
-inf_adopted_session_record_real_start(InfAdoptedSessionRecord* record)
+inf_adopted_session_record_write_initial(InfAdoptedSessionRecord* record)
 {
   InfAdoptedSessionRecordPrivate* priv;
-  InfAdoptedAlgorithm* algorithm;
-  InfUserTable* user_table;
+  InfSessionClass* session_class;
   xmlNodePtr xml;
   xmlNodePtr child;
   xmlNodePtr cur;
   int result;
   guint total;
 
-  InfSessionClass* session_class;
-
   priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
-  algorithm = inf_adopted_session_get_algorithm(priv->session);
-  user_table = inf_session_get_user_table(INF_SESSION(priv->session));
   session_class = INF_SESSION_GET_CLASS(priv->session);
 
-  g_signal_connect(
-    G_OBJECT(algorithm),
-    "execute-request",
-    G_CALLBACK(inf_adopted_session_record_execute_request_cb),
-    record
-  );
-
-  g_signal_connect(
-    G_OBJECT(user_table),
-    "add-user",
-    G_CALLBACK(inf_adopted_session_record_add_user_cb),
-    record
-  );
-
-  priv->last_send_table = g_hash_table_new_full(
-    NULL,
-    NULL,
-    NULL,
-    (GDestroyNotify)inf_adopted_state_vector_free
-  );
-
+  /* Requests in the new file are relative to the state written here */
   inf_user_table_foreach_user(
     inf_session_get_user_table(INF_SESSION(priv->session)),
     inf_adopted_session_record_start_foreach_user_func,
@@ -297,9 +302,42 @@ inf_adopted_session_record_real_start(InfAdoptedSessionRecord* record)
   inf_adopted_session_record_write_node(record, xml);
   xmlFreeNode(xml);
 
-  result = xmlTextWriterFlush(priv->writer);
-  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
-  fflush(priv->file);
+  inf_adopted_session_record_flush(record);
+}
+
+static void
+inf_adopted_session_record_real_start(InfAdoptedSessionRecord* record)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  InfAdoptedAlgorithm* algorithm;
+  InfUserTable* user_table;
+
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+  algorithm = inf_adopted_session_get_algorithm(priv->session);
+  user_table = inf_session_get_user_table(INF_SESSION(priv->session));
+
+  g_signal_connect(
+    G_OBJECT(algorithm),
+    "execute-request",
+    G_CALLBACK(inf_adopted_session_record_execute_request_cb),
+    record
+  );
+
+  g_signal_connect(
+    G_OBJECT(user_table),
+    "add-user",
+    G_CALLBACK(inf_adopted_session_record_add_user_cb),
+    record
+  );
+
+  priv->last_send_table = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    (GDestroyNotify)inf_adopted_state_vector_free
+  );
+
+  inf_adopted_session_record_write_initial(record);
 }
 
 static void
@@ -319,6 +357,198 @@ inf_adopted_session_record_synchronization_complete_cb(InfSession* session,
   inf_adopted_session_record_real_start(record);
 }
 
+static void
+inf_adopted_session_record_set_xml_error(GError** error)
+{
+  xmlErrorPtr xmlerror;
+  xmlerror = xmlGetLastError();
+
+  if(xmlerror != NULL)
+  {
+    g_set_error(
+      error,
+      libxml2_writer_error_quark,
+      xmlerror->code,
+      "%s",
+      xmlerror->message
+    );
+  }
+  else
+  {
+    g_set_error(
+      error,
+      libxml2_writer_error_quark,
+      XML_ERR_INTERNAL_ERROR,
+      "%s",
+      _("Unknown error")
+    );
+  }
+}
+
+/* Opens filename and sets up the writer for it. This does not write
+ * anything into the file yet. */
+static gboolean
+inf_adopted_session_record_open(InfAdoptedSessionRecord* record,
+                                const gchar* filename,
+                                GError** error)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  xmlOutputBufferPtr buffer;
+  int errcode;
+
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+  g_assert(priv->writer == NULL && priv->file == NULL);
+
+  if(priv->compression > 0)
+  {
+    /* libxml2 writes the file through zlib itself in this case */
+    buffer = xmlOutputBufferCreateFilename(
+      filename,
+      NULL,
+      priv->compression
+    );
+
+    if(buffer == NULL)
+    {
+      inf_adopted_session_record_set_xml_error(error);
+      return FALSE;
+    }
+  }
+  else
+  {
+    priv->file = fopen(filename, "w");
+    if(priv->file == NULL)
+    {
+      errcode = errno;
+
+      g_set_error(
+        error,
+        g_quark_from_static_string("ERRNO_ERROR"),
+        errcode,
+        "%s",
+        strerror(errcode)
+      );
+
+      return FALSE;
+    }
+
+    buffer = xmlOutputBufferCreateFile(priv->file, NULL);
+    if(buffer == NULL)
+    {
+      fclose(priv->file);
+      priv->file = NULL;
+
+      inf_adopted_session_record_set_xml_error(error);
+      return FALSE;
+    }
+  }
+
+  priv->writer = xmlNewTextWriter(buffer);
+  if(priv->writer == NULL)
+  {
+    xmlOutputBufferClose(buffer);
+    if(priv->file != NULL)
+    {
+      fclose(priv->file);
+      priv->file = NULL;
+    }
+
+    inf_adopted_session_record_set_xml_error(error);
+    return FALSE;
+  }
+
+  xmlTextWriterSetIndent(priv->writer, 1);
+  priv->output = buffer;
+  priv->bytes_written = 0;
+  return TRUE;
+}
+
+/* Finishes the document and closes the current file. The writer is
+ * released even if an error occurs. */
+static gboolean
+inf_adopted_session_record_close(InfAdoptedSessionRecord* record,
+                                 GError** error)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  int result;
+
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+  g_assert(priv->writer != NULL);
+
+  result = xmlTextWriterWriteString(priv->writer, (const xmlChar*)"\n");
+  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
+
+  result = xmlTextWriterEndDocument(priv->writer);
+  if(result < 0) inf_adopted_session_record_set_xml_error(error);
+
+  /* This closes the output buffer, but a FILE* passed to
+   * xmlOutputBufferCreateFile() is only flushed, not closed. */
+  xmlFreeTextWriter(priv->writer);
+  priv->writer = NULL;
+  priv->output = NULL;
+
+  if(priv->file != NULL)
+  {
+    fclose(priv->file);
+    priv->file = NULL;
+  }
+
+  return result >= 0;
+}
+
+/* Disconnects from the session, so that no further requests are recorded */
+static void
+inf_adopted_session_record_disconnect(InfAdoptedSessionRecord* record)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  InfSessionStatus status;
+  InfAdoptedAlgorithm* algorithm;
+  InfUserTable* user_table;
+
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(priv->session),
+    G_CALLBACK(inf_adopted_session_record_synchronization_complete_cb),
+    record
+  );
+
+  /* In synchronizing state we did not yet connect to these signals, and
+   * the algorithm doesn't even exist. */
+  status = inf_session_get_status(INF_SESSION(priv->session));
+  if(status != INF_SESSION_SYNCHRONIZING)
+  {
+    user_table = inf_session_get_user_table(INF_SESSION(priv->session));
+
+    /* The algorithm has been destroyed when the session has been closed. */
+    if(status != INF_SESSION_CLOSED)
+    {
+      algorithm = inf_adopted_session_get_algorithm(priv->session);
+      g_assert(algorithm != NULL);
+
+      inf_signal_handlers_disconnect_by_func(
+        G_OBJECT(algorithm),
+        G_CALLBACK(inf_adopted_session_record_execute_request_cb),
+        record
+      );
+    }
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(user_table),
+      G_CALLBACK(inf_adopted_session_record_add_user_cb),
+      record
+    );
+  }
+
+  /* This has only been created if the session has entered running state
+   * already. */
+  if(priv->last_send_table != NULL)
+  {
+    g_hash_table_unref(priv->last_send_table);
+    priv->last_send_table = NULL;
+  }
+}
+
 /*
  * GObject overrides.
  */
@@ -335,8 +565,11 @@ inf_adopted_session_record_init(GTypeInstance* instance,
 
   priv->session = NULL;
   priv->writer = NULL;
+  priv->output = NULL;
   priv->file = NULL;
   priv->filename = NULL;
+  priv->compression = 0;
+  priv->bytes_written = 0;
   priv->last_send_table = NULL;
 }
 
@@ -410,6 +643,9 @@ inf_adopted_session_record_set_property(GObject* object,
     g_assert(priv->session == NULL); /* construct only */
     priv->session = INF_ADOPTED_SESSION(g_value_dup_object(value));
     break;
+  case PROP_COMPRESSION:
+    priv->compression = g_value_get_uint(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -433,6 +669,9 @@ inf_adopted_session_record_get_property(GObject* object,
   case PROP_SESSION:
     g_value_set_object(value, G_OBJECT(priv->session));
     break;
+  case PROP_COMPRESSION:
+    g_value_set_uint(value, priv->compression);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -472,6 +711,21 @@ inf_adopted_session_record_class_init(gpointer g_class,
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
     )
   );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION,
+    g_param_spec_uint(
+      "compression",
+      "Compression",
+      "The zlib compression level for record files, or 0 for uncompressed "
+      "records. Takes effect for the next file opened",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 GType
@@ -544,6 +798,9 @@ inf_adopted_session_record_new(InfAdoptedSession* session)
  * before calling this function. If an error occurs, such as if @filename
  * could not be opened, then the function returns %FALSE and @error is set.
  *
+ * If the #InfAdoptedSessionRecord:compression property is nonzero, then the
+ * record is written gzip-compressed.
+ *
  * Return Value: %TRUE if the session is started to be recorded, %FALSE on
  * error.
  **/
@@ -554,9 +811,6 @@ inf_adopted_session_record_start_recording(InfAdoptedSessionRecord* record,
 {
   InfAdoptedSessionRecordPrivate* priv;
   InfSessionStatus status;
-  xmlOutputBufferPtr buffer;
-  xmlErrorPtr xmlerror;
-  int errcode;
 
   g_return_val_if_fail(INF_ADOPTED_IS_SESSION_RECORD(record), FALSE);
   g_return_val_if_fail(filename != NULL, FALSE);
@@ -568,62 +822,11 @@ inf_adopted_session_record_start_recording(InfAdoptedSessionRecord* record,
   g_return_val_if_fail(priv->writer == NULL, FALSE);
   g_return_val_if_fail(status != INF_SESSION_CLOSED, FALSE);
 
-  priv->file = fopen(filename, "w");
-  if(priv->file == NULL)
-  {
-    errcode = errno;
-
-    g_set_error(
-      error,
-      g_quark_from_static_string("ERRNO_ERROR"),
-      errcode,
-      "%s",
-      strerror(errcode)
-    );
-
+  if(!inf_adopted_session_record_open(record, filename, error))
     return FALSE;
-  }
-
-  buffer = xmlOutputBufferCreateFile(priv->file, NULL);
-  if(buffer == NULL)
-  {
-    fclose(priv->file);
-    priv->file = NULL;
-
-    xmlerror = xmlGetLastError();
-
-    g_set_error(
-      error,
-      libxml2_writer_error_quark,
-      xmlerror->code,
-      "%s",
-      xmlerror->message
-    );
-
-    return FALSE;
-  }
 
-  priv->writer = xmlNewTextWriter(buffer);
-  if(priv->writer == NULL)
-  {
-    /* TODO: Does this also fclose our file? */
-    xmlOutputBufferClose(buffer);
-    priv->file = NULL;
-
-    xmlerror = xmlGetLastError();
-
-    g_set_error(
-      error,
-      libxml2_writer_error_quark,
-      xmlerror->code,
-      "%s",
-      xmlerror->message
-    );
-
-    return FALSE;
-  }
-
-  xmlTextWriterSetIndent(priv->writer, 1);
+  g_assert(priv->filename == NULL);
+  priv->filename = g_strdup(filename);
 
   switch(status)
   {
@@ -644,8 +847,6 @@ inf_adopted_session_record_start_recording(InfAdoptedSessionRecord* record,
     break;
   }
 
-  g_assert(priv->filename == NULL);
-  priv->filename = g_strdup(filename);
   return TRUE;
 }
 
@@ -669,11 +870,7 @@ inf_adopted_session_record_stop_recording(InfAdoptedSessionRecord* record,
                                           GError** error)
 {
   InfAdoptedSessionRecordPrivate* priv;
-  InfSessionStatus status;
-  InfAdoptedAlgorithm* algorithm;
-  InfUserTable* user_table;
-  xmlErrorPtr xmlerror;
-  int result;
+  gboolean result;
 
   g_return_val_if_fail(INF_ADOPTED_IS_SESSION_RECORD(record), FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
@@ -682,75 +879,97 @@ inf_adopted_session_record_stop_recording(InfAdoptedSessionRecord* record,
 
   g_return_val_if_fail(priv->writer != NULL, FALSE);
 
-  inf_signal_handlers_disconnect_by_func(
-    G_OBJECT(priv->session),
-    G_CALLBACK(inf_adopted_session_record_synchronization_complete_cb),
-    record
-  );
+  inf_adopted_session_record_disconnect(record);
+  result = inf_adopted_session_record_close(record, error);
 
-  /* In synchronizing state we did not yet connect to these signals, and
-   * the algorithm doesn't even exist. */
-  status = inf_session_get_status(INF_SESSION(priv->session));
-  if(status != INF_SESSION_SYNCHRONIZING)
-  {
-    user_table = inf_session_get_user_table(INF_SESSION(priv->session));
+  g_free(priv->filename);
+  priv->filename = NULL;
 
-    /* The algorithm has been destroyed when the session has been closed. */
-    if(status != INF_SESSION_CLOSED)
-    {
-      algorithm = inf_adopted_session_get_algorithm(priv->session);
-      g_assert(algorithm != NULL);
+  return result;
+}
 
-      inf_signal_handlers_disconnect_by_func(
-        G_OBJECT(algorithm),
-        G_CALLBACK(inf_adopted_session_record_execute_request_cb),
-        record
-      );
-    }
+/**
+ * inf_adopted_session_record_rotate:
+ * @record: A #InfAdoptedSessionRecord.
+ * @filename: The file in which to continue the record.
+ * @error: Location to store error information, if any.
+ *
+ * Finishes the file the session is currently recorded into, and continues
+ * the recording in @filename. The new file starts with the current state
+ * of the session, so that it can be replayed independently of the previous
+ * one.
+ *
+ * If @filename cannot be opened, then the function returns %FALSE, @error
+ * is set and the recording is stopped. Errors finishing the previous file
+ * are only reported as warnings.
+ *
+ * Return Value: %TRUE if the recording continues in @filename, %FALSE on
+ * error.
+ */
+gboolean
+inf_adopted_session_record_rotate(InfAdoptedSessionRecord* record,
+                                  const gchar* filename,
+                                  GError** error)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  GError* local_error;
 
-    inf_signal_handlers_disconnect_by_func(
-      G_OBJECT(user_table),
-      G_CALLBACK(inf_adopted_session_record_add_user_cb),
-      record
-    );
-  }
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION_RECORD(record), FALSE);
+  g_return_val_if_fail(filename != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-  result = xmlTextWriterWriteString(priv->writer, (const xmlChar*)"\n");
-  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
 
-  result = xmlTextWriterEndDocument(priv->writer);
-  if(result < 0)
-  {
-    xmlerror = xmlGetLastError();
+  g_return_val_if_fail(priv->writer != NULL, FALSE);
 
-    g_set_error(
-      error,
-      libxml2_writer_error_quark,
-      xmlerror->code,
-      "%s",
-      xmlerror->message
+  local_error = NULL;
+  if(!inf_adopted_session_record_close(record, &local_error))
+  {
+    g_warning(
+      /* Error while finishing record `<Filename>': <Reason> */
+      "Error while finishing record `%s': %s",
+      priv->filename,
+      local_error->message
     );
 
-    return FALSE;
+    g_error_free(local_error);
   }
 
-  /* TODO: Does this fclose our file? */
-  xmlFreeTextWriter(priv->writer);
-  priv->writer = NULL;
-  priv->file = NULL;
+  if(!inf_adopted_session_record_open(record, filename, error))
+  {
+    inf_adopted_session_record_disconnect(record);
+
+    g_free(priv->filename);
+    priv->filename = NULL;
+    return FALSE;
+  }
 
   g_free(priv->filename);
-  priv->filename = NULL;
+  priv->filename = g_strdup(filename);
 
-  /* This has only been created if the session has entered running state
-   * already. */
+  /* If the session is still synchronizing, then the initial state is
+   * written as soon as synchronization has finished. */
   if(priv->last_send_table != NULL)
-  {
-    g_hash_table_unref(priv->last_send_table);
-    priv->last_send_table = NULL;
-  }
+    inf_adopted_session_record_write_initial(record);
 
-  return result >= 0;
+  return TRUE;
+}
+
+/**
+ * inf_adopted_session_record_get_bytes_written:
+ * @record: A #InfAdoptedSessionRecord.
+ *
+ * Returns the number of bytes written into the current record file so far,
+ * before compression. This can be used to decide when to rotate the record
+ * with inf_adopted_session_record_rotate().
+ *
+ * Returns: The number of uncompressed bytes in the current record file.
+ */
+guint64
+inf_adopted_session_record_get_bytes_written(InfAdoptedSessionRecord* record)
+{
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION_RECORD(record), 0);
+  return INF_ADOPTED_SESSION_RECORD_PRIVATE(record)->bytes_written;
 }
 
 /**
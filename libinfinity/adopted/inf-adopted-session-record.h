@@ -72,6 +72,14 @@ gboolean
 inf_adopted_session_record_stop_recording(InfAdoptedSessionRecord* record,
                                           GError** error);
 
+gboolean
+inf_adopted_session_record_rotate(InfAdoptedSessionRecord* record,
+                                  const gchar* filename,
+                                  GError** error);
+
+guint64
+inf_adopted_session_record_get_bytes_written(InfAdoptedSessionRecord* record);
+
 gboolean
 inf_adopted_session_record_is_recording(InfAdoptedSessionRecord* record);
 
@@ -739,6 +739,9 @@ inf_adopted_session_replay_new(void)
  * #InfAdoptedSessionRecord. @plugin should match the type of the recorded
  * session. If an error occurs, the function returns %FALSE and @error is set.
  *
+ * Records written with compression enabled are decompressed transparently
+ * while reading.
+ *
  * Returns: %TRUE on success, or %FALSE if the record file could not be set.
  */
 gboolean
@@ -1083,4 +1086,46 @@ inf_adopted_session_replay_play_to_end(InfAdoptedSessionReplay* replay,
   return TRUE;
 }
 
+/**
+ * inf_adopted_session_replay_play_to_end_bulk:
+ * @replay: A #InfAdoptedSessionReplay.
+ * @error: Location to store error information, if any.
+ *
+ * Plays all requests that are contained in the recording, like
+ * inf_adopted_session_replay_play_to_end(). However, the requests are
+ * played with the session's algorithm in bulk mode, see
+ * inf_adopted_algorithm_begin_bulk(). This is considerably faster for long
+ * recordings. The final state of the session is the same as with
+ * inf_adopted_session_replay_play_to_end().
+ *
+ * If an error occurs during replay, then the function returns %FALSE and
+ * @error is set. Otherwise it returns %TRUE.
+ *
+ * Returns: %TRUE on success, or %FALSE if an error occurs.
+ */
+gboolean
+inf_adopted_session_replay_play_to_end_bulk(InfAdoptedSessionReplay* replay,
+                                            GError** error)
+{
+  InfAdoptedSessionReplayPrivate* priv;
+  InfAdoptedAlgorithm* algorithm;
+  gboolean result;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION_REPLAY(replay), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  priv = INF_ADOPTED_SESSION_REPLAY_PRIVATE(replay);
+  g_return_val_if_fail(priv->session != NULL, FALSE);
+
+  algorithm = inf_adopted_session_get_algorithm(priv->session);
+  g_object_ref(algorithm);
+
+  inf_adopted_algorithm_begin_bulk(algorithm);
+  result = inf_adopted_session_replay_play_to_end(replay, error);
+  inf_adopted_algorithm_end_bulk(algorithm);
+
+  g_object_unref(algorithm);
+  return result;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -110,6 +110,10 @@ gboolean
 inf_adopted_session_replay_play_to_end(InfAdoptedSessionReplay* replay,
                                        GError** error);
 
+gboolean
+inf_adopted_session_replay_play_to_end_bulk(InfAdoptedSessionReplay* replay,
+                                            GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_SESSION_REPLAY_H__ */
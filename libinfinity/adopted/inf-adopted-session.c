@@ -21,13 +21,15 @@
 
 #include <libinfinity/adopted/inf-adopted-session.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/communication/inf-communication-joined-group.h>
+#include <libinfinity/common/inf-protocol.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 
 #include <string.h>
-#include <time.h>
 
 /**
  * SECTION:inf-adopted-session
@@ -58,21 +60,28 @@ typedef struct _InfAdoptedSessionLocalUser InfAdoptedSessionLocalUser;
 struct _InfAdoptedSessionLocalUser {
   InfAdoptedUser* user;
   InfAdoptedStateVector* last_send_vector;
-  time_t noop_time;
+  /* Time when the user fell behind the current state, in milliseconds, or
+   * 0 if the user is up to date */
+  guint64 noop_time;
 };
 
 typedef struct _InfAdoptedSessionPrivate InfAdoptedSessionPrivate;
 struct _InfAdoptedSessionPrivate {
   InfIo* io;
   guint max_total_log_size;
+  guint noop_interval;
+  guint noop_lag;
 
   InfAdoptedAlgorithm* algorithm;
   GSList* local_users; /* having zero or one item in 99.9% of all cases */
 
   /* Timeout for sending noop with our current vector time */
   InfIoTimeout* noop_timeout;
-  /* User to send the time for */
+  /* User to send the time for, and when */
   InfAdoptedSessionLocalUser* next_noop_user;
+  guint64 noop_deadline;
+  /* Requests executed since remote users' lag has last been checked */
+  guint n_unchecked_requests;
 };
 
 enum {
@@ -82,16 +91,21 @@ enum {
   PROP_IO,
   PROP_MAX_TOTAL_LOG_SIZE,
 
+  PROP_NOOP_INTERVAL,
+  PROP_NOOP_LAG,
+
   /* read only */
   PROP_ALGORITHM
 };
 
+/* How much, in milliseconds, the time at which a noop becomes due needs to
+ * change before the noop timer is rescheduled for it */
+#define INF_ADOPTED_SESSION_NOOP_RESCHEDULE_THRESHOLD 50
+
 #define INF_ADOPTED_SESSION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_ADOPTED_TYPE_SESSION, InfAdoptedSessionPrivate))
 
 static InfSessionClass* parent_class;
 static GQuark inf_adopted_session_error_quark;
-/* TODO: This should perhaps be a property: */
-static const int INF_ADOPTED_SESSION_NOOP_INTERVAL = 30;
 
 /*
  * Utility functions.
@@ -236,27 +250,91 @@ inf_adopted_session_user_from_request_xml(InfAdoptedSession* session,
   return INF_ADOPTED_USER(user);
 }
 
+/* Lets the subclass send requests it has delayed for local users, so that
+ * the request log is in sync with the buffer again. */
+static void
+inf_adopted_session_flush_requests(InfAdoptedSession* session)
+{
+  InfAdoptedSessionClass* session_class;
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+
+  if(session_class->flush_requests != NULL)
+    session_class->flush_requests(session);
+}
+
 /*
  * Noop timer
  */
 
+/* Returns the current time in milliseconds */
+static guint64
+inf_adopted_session_get_time(void)
+{
+  GTimeVal current;
+  g_get_current_time(&current);
+  return (guint64)current.tv_sec * 1000 + current.tv_usec / 1000;
+}
+
+/* Returns the number of requests that have been executed since the given
+ * user has last told others about the state it is in. */
+static guint
+inf_adopted_session_get_lag(InfAdoptedSession* session,
+                            InfAdoptedStateVector* vector)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedStateVector* current;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  current = inf_adopted_algorithm_get_current(priv->algorithm);
+
+  if(!inf_adopted_state_vector_causally_before(vector, current))
+    return 0;
+
+  return inf_adopted_state_vector_vdiff(vector, current);
+}
+
+/* Returns the time at which to send a noop for the given local user. This
+ * is noop-interval after the user fell behind, but the more requests the
+ * user has not yet acknowledged, the earlier it is, since others can not
+ * remove these requests from their logs before. */
+static guint64
+inf_adopted_session_get_noop_deadline(InfAdoptedSession* session,
+                                      InfAdoptedSessionLocalUser* local)
+{
+  InfAdoptedSessionPrivate* priv;
+  guint64 delay;
+  guint lag;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  g_assert(local->noop_time != 0);
+
+  delay = priv->noop_interval;
+  if(priv->noop_lag > 0)
+  {
+    lag = inf_adopted_session_get_lag(session, local->last_send_vector);
+    if(lag >= priv->noop_lag)
+      delay = 0;
+    else
+      delay = delay * (priv->noop_lag - lag) / priv->noop_lag;
+  }
+
+  return local->noop_time + delay;
+}
+
 static void
-inf_adopted_session_noop_timeout_func(gpointer user_data)
+inf_adopted_session_send_noop(InfAdoptedSession* session,
+                              InfAdoptedSessionLocalUser* local)
 {
-  InfAdoptedSession* session;
   InfAdoptedSessionPrivate* priv;
   InfAdoptedOperation* op;
   InfAdoptedRequest* request;
 
-  session = INF_ADOPTED_SESSION(user_data);
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
-  priv->noop_timeout = NULL;
-  g_assert(priv->next_noop_user != NULL);
 
   op = INF_ADOPTED_OPERATION(inf_adopted_no_operation_new());
   request = inf_adopted_algorithm_generate_request_noexec(
     priv->algorithm,
-    priv->next_noop_user->user,
+    local->user,
     op
   );
   g_object_unref(op);
@@ -267,36 +345,70 @@ inf_adopted_session_noop_timeout_func(gpointer user_data)
   g_object_unref(request);
 }
 
-static InfAdoptedSessionLocalUser*
-inf_adopted_session_find_next_noop_user(InfAdoptedSession* session)
+static void
+inf_adopted_session_noop_timeout_func(gpointer user_data)
+{
+  InfAdoptedSession* session;
+  InfAdoptedSessionPrivate* priv;
+
+  session = INF_ADOPTED_SESSION(user_data);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  priv->noop_timeout = NULL;
+  g_assert(priv->next_noop_user != NULL);
+
+  /* Flushing delayed requests broadcasts them, which in turn might already
+   * reschedule the noop timer, in which case we don't need a noop anymore. */
+  inf_adopted_session_flush_requests(session);
+  if(priv->noop_timeout != NULL || priv->next_noop_user == NULL)
+    return;
+
+  inf_adopted_session_send_noop(session, priv->next_noop_user);
+}
+
+/* Schedules the noop timer for the local user whose noop is due first,
+ * or removes it if all local users are up to date. This is called for every
+ * executed request, so unless force is set, the timer is left alone if it is
+ * already scheduled for the right user and the noop has not become due
+ * considerably earlier or later. */
+static void
+inf_adopted_session_schedule_noop_timer(InfAdoptedSession* session,
+                                        gboolean force)
 {
   InfAdoptedSessionPrivate* priv;
   GSList* item;
   InfAdoptedSessionLocalUser* local;
   InfAdoptedSessionLocalUser* next_user;
+  guint64 deadline;
+  guint64 next_deadline;
+  guint64 current;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
   next_user = NULL;
+  next_deadline = 0;
 
   for(item = priv->local_users; item != NULL; item = g_slist_next(item))
   {
     local = (InfAdoptedSessionLocalUser*)item->data;
     if(local->noop_time != 0)
-      if(next_user == NULL || local->noop_time < next_user->noop_time)
+    {
+      deadline = inf_adopted_session_get_noop_deadline(session, local);
+      if(next_user == NULL || deadline < next_deadline)
+      {
         next_user = local;
+        next_deadline = deadline;
+      }
+    }
   }
 
-  return next_user;
-}
-
-static void
-inf_adopted_session_schedule_noop_timer(InfAdoptedSession* session)
-{
-  InfAdoptedSessionPrivate* priv;
-  time_t current;
-  time_t sched;
-
-  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  if(!force && priv->noop_timeout != NULL &&
+     next_user == priv->next_noop_user &&
+     next_deadline + INF_ADOPTED_SESSION_NOOP_RESCHEDULE_THRESHOLD >
+       priv->noop_deadline &&
+     next_deadline <=
+       priv->noop_deadline + INF_ADOPTED_SESSION_NOOP_RESCHEDULE_THRESHOLD)
+  {
+    return;
+  }
 
   if(priv->noop_timeout != NULL)
   {
@@ -304,20 +416,16 @@ inf_adopted_session_schedule_noop_timer(InfAdoptedSession* session)
     priv->noop_timeout = NULL;
   }
 
-  if(priv->next_noop_user != NULL)
-  {
-    current = time(NULL);
-    sched =
-      priv->next_noop_user->noop_time + INF_ADOPTED_SESSION_NOOP_INTERVAL;
+  priv->next_noop_user = next_user;
+  priv->noop_deadline = next_deadline;
 
-    if(sched >= current)
-      sched -= current;
-    else
-      sched = 0;
+  if(next_user != NULL)
+  {
+    current = inf_adopted_session_get_time();
 
     priv->noop_timeout = inf_io_add_timeout(
       priv->io,
-      sched * 1000,
+      next_deadline > current ? next_deadline - current : 0,
       inf_adopted_session_noop_timeout_func,
       session,
       NULL
@@ -329,43 +437,86 @@ static void
 inf_adopted_session_start_noop_timer(InfAdoptedSession* session,
                                      InfAdoptedSessionLocalUser* local)
 {
-  InfAdoptedSessionPrivate* priv;
-  priv = INF_ADOPTED_SESSION_PRIVATE(session);
-
   g_assert(local->noop_time == 0);
-  local->noop_time = time(NULL);
-
-  if(priv->noop_timeout == NULL)
-  {
-    priv->next_noop_user = inf_adopted_session_find_next_noop_user(session);
-    g_assert(priv->next_noop_user != NULL);
+  local->noop_time = inf_adopted_session_get_time();
 
-    inf_adopted_session_schedule_noop_timer(session);
-  }
+  inf_adopted_session_schedule_noop_timer(session, FALSE);
 }
 
 static void
 inf_adopted_session_stop_noop_timer(InfAdoptedSession* session,
                                     InfAdoptedSessionLocalUser* local)
 {
+  if(local->noop_time > 0)
+  {
+    local->noop_time = 0;
+    inf_adopted_session_schedule_noop_timer(session, FALSE);
+  }
+}
+
+static void
+inf_adopted_session_request_acks_foreach_func(InfUser* user,
+                                              gpointer user_data)
+{
+  InfAdoptedSession* session;
   InfAdoptedSessionPrivate* priv;
-  InfAdoptedSessionLocalUser* next_noop_user;
+  InfCommunicationGroup* group;
+  xmlNodePtr xml;
+  guint lag;
 
+  session = INF_ADOPTED_SESSION(user_data);
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
-  if(local->noop_time > 0)
+  /* request-ack was added in protocol version 1.1 */
+  if(inf_user_get_status(user) == INF_USER_UNAVAILABLE ||
+     (inf_user_get_flags(user) & INF_USER_LOCAL) != 0 ||
+     inf_user_get_connection(user) == NULL ||
+     !inf_protocol_check_remote_version(inf_user_get_connection(user), 1, 1))
   {
-    local->noop_time = 0;
+    return;
+  }
 
-    next_noop_user = inf_adopted_session_find_next_noop_user(session);
-    if(next_noop_user != priv->next_noop_user)
-    {
-      priv->next_noop_user = next_noop_user;
-      inf_adopted_session_schedule_noop_timer(session);
-    }
+  lag = inf_adopted_session_get_lag(
+    session,
+    inf_adopted_user_get_vector(INF_ADOPTED_USER(user))
+  );
+
+  /* Give the user's own noop timer a chance first */
+  if(lag >= 2 * priv->noop_lag)
+  {
+    group = inf_session_get_subscription_group(INF_SESSION(session));
+
+    xml = xmlNewNode(NULL, (const xmlChar*)"request-ack");
+    inf_xml_util_set_attribute_uint(xml, "user", inf_user_get_id(user));
+
+    inf_communication_group_send_message(
+      group,
+      inf_user_get_connection(user),
+      xml
+    );
   }
 }
 
+/* Asks remote users which are far behind the current state to tell us
+ * which state they are in, so that they do not prevent request logs from
+ * being cleaned up. This is done by the server only, so that users which
+ * never make a request themselves are acknowledged regularly. */
+static void
+inf_adopted_session_request_acks(InfAdoptedSession* session)
+{
+  InfCommunicationGroup* group;
+
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+  if(group == NULL || !INF_COMMUNICATION_IS_HOSTED_GROUP(group))
+    return;
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_adopted_session_request_acks_foreach_func,
+    session
+  );
+}
+
 /* Breadcasts a request N times - makes only sense for undo and redo requests,
  * so that's the only thing we offer API for. */
 static void
@@ -546,6 +697,19 @@ inf_adopted_session_execute_request_cb(InfAdoptedAlgorithm* algorithm,
         if(inf_user_get_id(INF_USER(local->user)) != id)
           inf_adopted_session_start_noop_timer(session, local);
     }
+
+    if(priv->noop_lag > 0)
+    {
+      /* Noops become due earlier the more requests have been executed */
+      inf_adopted_session_schedule_noop_timer(session, FALSE);
+
+      ++ priv->n_unchecked_requests;
+      if(priv->n_unchecked_requests >= priv->noop_lag)
+      {
+        priv->n_unchecked_requests = 0;
+        inf_adopted_session_request_acks(session);
+      }
+    }
   }
 
   /* Mark inactive users active if they do something */
@@ -611,10 +775,14 @@ inf_adopted_session_init(GTypeInstance* instance,
 
   priv->io = NULL;
   priv->max_total_log_size = 2048;
+  priv->noop_interval = 30000;
+  priv->noop_lag = 128;
   priv->algorithm = NULL;
   priv->local_users = NULL;
   priv->noop_timeout = NULL;
   priv->next_noop_user = NULL;
+  priv->noop_deadline = 0;
+  priv->n_unchecked_requests = 0;
 }
 
 static GObject*
@@ -777,6 +945,16 @@ inf_adopted_session_set_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     priv->max_total_log_size = g_value_get_uint(value);
     break;
+  case PROP_NOOP_INTERVAL:
+    priv->noop_interval = g_value_get_uint(value);
+    if(priv->algorithm != NULL)
+      inf_adopted_session_schedule_noop_timer(session, TRUE);
+    break;
+  case PROP_NOOP_LAG:
+    priv->noop_lag = g_value_get_uint(value);
+    if(priv->algorithm != NULL)
+      inf_adopted_session_schedule_noop_timer(session, TRUE);
+    break;
   case PROP_ALGORITHM:
     /* read only */
   default:
@@ -805,6 +983,12 @@ inf_adopted_session_get_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     g_value_set_uint(value, priv->max_total_log_size);
     break;
+  case PROP_NOOP_INTERVAL:
+    g_value_set_uint(value, priv->noop_interval);
+    break;
+  case PROP_NOOP_LAG:
+    g_value_set_uint(value, priv->noop_lag);
+    break;
   case PROP_ALGORITHM:
     g_value_set_object(value, G_OBJECT(priv->algorithm));
     break;
@@ -865,6 +1049,10 @@ inf_adopted_session_to_xml_sync(InfSession* session,
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
   g_assert(priv->algorithm != NULL);
 
+  /* The buffer content is synchronized as-is, so the request log must not
+   * lag behind it. */
+  inf_adopted_session_flush_requests(INF_ADOPTED_SESSION(session));
+
   INF_SESSION_CLASS(parent_class)->to_xml_sync(session, parent);
 
   foreach_data.session = INF_ADOPTED_SESSION(session);
@@ -947,6 +1135,8 @@ inf_adopted_session_process_xml_run(InfSession* session,
   GError* local_error;
   InfAdoptedRequest* copy_req;
   guint i;
+  InfAdoptedSessionLocalUser* local;
+  InfCommunicationGroup* group;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
@@ -997,6 +1187,9 @@ inf_adopted_session_process_xml_run(InfSession* session,
     if(request == NULL)
       return INF_COMMUNICATION_SCOPE_PTP;
 
+    /* Local requests that have been delayed need to be in the request log
+     * before the remote request is transformed against it. */
+    inf_adopted_session_flush_requests(INF_ADOPTED_SESSION(session));
     inf_adopted_algorithm_receive_request(priv->algorithm, request);
 
     /* Apply the request more than once if num is given. This is mostly used
@@ -1026,6 +1219,45 @@ inf_adopted_session_process_xml_run(InfSession* session,
     /* Requests can always be forwarded since user is given. */
     return INF_COMMUNICATION_SCOPE_GROUP;
   }
+  else if(strcmp((const char*)xml->name, "request-ack") == 0)
+  {
+    /* Only the server asks for acknowledgements. Ignore them from anyone
+     * else, including clients of a session we host, so that nobody can make
+     * other clients send noops. */
+    group = inf_session_get_subscription_group(session);
+    if(group == NULL || !INF_COMMUNICATION_IS_JOINED_GROUP(group) ||
+       inf_communication_joined_group_get_publisher(
+         INF_COMMUNICATION_JOINED_GROUP(group)) != connection)
+    {
+      return INF_COMMUNICATION_SCOPE_PTP;
+    }
+
+    user = inf_adopted_session_user_from_request_xml(
+      INF_ADOPTED_SESSION(session),
+      xml,
+      error
+    );
+
+    if(user == NULL)
+      return INF_COMMUNICATION_SCOPE_PTP;
+
+    /* The server asks us to tell others which requests we have processed
+     * because we fell far behind. Send a noop right away, unless we are up
+     * to date already. */
+    local = inf_adopted_session_lookup_local_user(
+      INF_ADOPTED_SESSION(session),
+      user
+    );
+
+    if(local != NULL && local->noop_time != 0)
+    {
+      inf_adopted_session_flush_requests(INF_ADOPTED_SESSION(session));
+      if(local->noop_time != 0)
+        inf_adopted_session_send_noop(INF_ADOPTED_SESSION(session), local);
+    }
+
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
 
   return INF_SESSION_CLASS(parent_class)->process_xml_run(
     session,
@@ -1284,6 +1516,7 @@ inf_adopted_session_class_init(gpointer g_class,
 
   adopted_session_class->xml_to_request = NULL;
   adopted_session_class->request_to_xml = NULL;
+  adopted_session_class->flush_requests = NULL;
 
   inf_adopted_session_error_quark = g_quark_from_static_string(
     "INF_ADOPTED_SESSION_ERROR"
@@ -1315,6 +1548,37 @@ inf_adopted_session_class_init(gpointer g_class,
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_NOOP_INTERVAL,
+    g_param_spec_uint(
+      "noop-interval",
+      "Noop interval",
+      "Maximum number of milliseconds after which a local user that has "
+      "fallen behind tells others about the state it is in",
+      0,
+      G_MAXUINT,
+      30000,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_NOOP_LAG,
+    g_param_spec_uint(
+      "noop-lag",
+      "Noop lag",
+      "Number of requests a user may fall behind before telling others "
+      "about the state it is in right away, or 0 to only do so after the "
+      "noop interval",
+      0,
+      G_MAXUINT,
+      128,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_ALGORITHM,
@@ -1442,6 +1706,8 @@ inf_adopted_session_undo(InfAdoptedSession* session,
   /* TODO: Check whether we can issue n undo requests before doing anything */
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  inf_adopted_session_flush_requests(session);
+
   request = inf_adopted_algorithm_generate_undo(priv->algorithm, user);
   for(i = 1; i < n; ++i)
     inf_adopted_algorithm_generate_undo(priv->algorithm, user);
@@ -1474,6 +1740,8 @@ inf_adopted_session_redo(InfAdoptedSession* session,
   g_return_if_fail(n >= 1);
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  inf_adopted_session_flush_requests(session);
+
   request = inf_adopted_algorithm_generate_redo(priv->algorithm, user);
   for(i = 1; i < n; ++i)
     inf_adopted_algorithm_generate_redo(priv->algorithm, user);
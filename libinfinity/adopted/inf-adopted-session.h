@@ -75,6 +75,12 @@ typedef enum _InfAdoptedSessionError {
  * to XML. This function should add properties and children to the given XML
  * node. At might use inf_adopted_session_write_request_info() to write the
  * common info.
+ * @flush_requests: Virtual function to generate and broadcast all requests
+ * that have been delayed for local users. This is called before a remote
+ * request is processed, before a local undo, redo or noop request is
+ * generated and before the session is synchronized to someone else, so that
+ * these always see a request log that matches the buffer contents. Can be
+ * %NULL if the session never delays requests.
  *
  * Virtual functions for #InfAdoptedSession.
  */
@@ -96,6 +102,8 @@ struct _InfAdoptedSessionClass {
                         InfAdoptedRequest* request,
                         InfAdoptedStateVector* diff_vec,
                         gboolean for_sync);
+
+  void(*flush_requests)(InfAdoptedSession* session);
 };
 
 /**
@@ -17,6 +17,7 @@
  * MA 02110-1301, USA.
  */
 
+
 /**
  * SECTION:inf-adopted-split-operation
  * @short_description: Operation wrapping two operations
@@ -26,6 +27,15 @@
  * #InfAdoptedSplitOperation is a wrapper around that two
  * #InfAdoptedOperation<!-- -->s. This is normally not required directly but
  * may be a result of some transformation.
+ *
+ * Split operations are never nested: When one of the wrapped operations is
+ * a split operation itself, then its parts are taken over instead, so that
+ * a split operation always consists of a flat list of operations which all
+ * refer to the same state. This way transformation is linear in the number
+ * of parts, no matter how often a split operation has been split again.
+ * Applying a split operation, or transforming another operation against it,
+ * requires the parts to be transformed against each other first, which is
+ * quadratic in the number of parts. This is done only once per operation.
  **/
 
 #include <libinfinity/adopted/inf-adopted-split-operation.h>
@@ -35,9 +45,17 @@
 
 typedef struct _InfAdoptedSplitOperationPrivate InfAdoptedSplitOperationPrivate;
 struct _InfAdoptedSplitOperationPrivate {
+  /* Only set during construction via properties */
   InfAdoptedOperation* first;
   InfAdoptedOperation* second;
-  /* TODO: Cache new_second? We should probably profile before */
+
+  /* None of these is a split operation */
+  InfAdoptedOperation** operations;
+  guint n_operations;
+
+  /* operations[i] transformed against sequence[0] to sequence[i-1], so that
+   * these can be applied one after the other. Created on first use. */
+  InfAdoptedOperation** sequence;
 };
 
 enum {
@@ -51,39 +69,163 @@ enum {
 
 static GObjectClass* parent_class;
 
+/* Sets the parts of a newly created split operation, flattening operations
+ * that are split operations themselves. This takes ownership of the
+ * references in operations, but not of the array itself. */
 static void
-inf_adopted_split_operation_unsplit_impl(InfAdoptedSplitOperation* operation,
-                                         GSList** list)
+inf_adopted_split_operation_set_operations(
+  InfAdoptedSplitOperation* operation,
+  InfAdoptedOperation** operations,
+  guint n_operations)
 {
   InfAdoptedSplitOperationPrivate* priv;
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+  InfAdoptedSplitOperationPrivate* part_priv;
+  guint n;
+  guint i;
+  guint j;
 
-  /* Since we prepend the entries to the list, we begin with the second
-   * operation so that the list actually contains the operations in order. */
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+  g_assert(priv->operations == NULL);
 
-  if(INF_ADOPTED_IS_SPLIT_OPERATION(priv->second))
+  n = 0;
+  for(i = 0; i < n_operations; ++i)
   {
-    inf_adopted_split_operation_unsplit_impl(
-      INF_ADOPTED_SPLIT_OPERATION(priv->second),
-      list
-    );
+    g_assert(operations[i] != INF_ADOPTED_OPERATION(operation));
+
+    if(INF_ADOPTED_IS_SPLIT_OPERATION(operations[i]))
+    {
+      part_priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operations[i]);
+      n += part_priv->n_operations;
+    }
+    else
+    {
+      ++n;
+    }
   }
-  else
+
+  priv->operations = g_new(InfAdoptedOperation*, n);
+  priv->n_operations = 0;
+
+  for(i = 0; i < n_operations; ++i)
   {
-    *list = g_slist_prepend(*list, priv->second);
+    if(INF_ADOPTED_IS_SPLIT_OPERATION(operations[i]))
+    {
+      part_priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operations[i]);
+      for(j = 0; j < part_priv->n_operations; ++j)
+      {
+        priv->operations[priv->n_operations++] =
+          g_object_ref(part_priv->operations[j]);
+      }
+
+      g_object_unref(operations[i]);
+    }
+    else
+    {
+      priv->operations[priv->n_operations++] = operations[i];
+    }
   }
 
-  if(INF_ADOPTED_IS_SPLIT_OPERATION(priv->first))
+  g_assert(priv->n_operations == n);
+}
+
+static InfAdoptedSplitOperation*
+inf_adopted_split_operation_new_take(InfAdoptedOperation** operations,
+                                     guint n_operations)
+{
+  InfAdoptedSplitOperation* operation;
+
+  operation = INF_ADOPTED_SPLIT_OPERATION(
+    g_object_new(INF_ADOPTED_TYPE_SPLIT_OPERATION, NULL)
+  );
+
+  inf_adopted_split_operation_set_operations(
+    operation,
+    operations,
+    n_operations
+  );
+
+  return operation;
+}
+
+/* Returns the parts of operation transformed so that they can be applied
+ * one after the other. */
+static InfAdoptedOperation**
+inf_adopted_split_operation_get_sequence(InfAdoptedSplitOperation* operation)
+{
+  InfAdoptedSplitOperationPrivate* priv;
+  InfAdoptedOperation* op;
+  InfAdoptedOperation* transformed;
+  guint i;
+  guint j;
+
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+
+  if(priv->sequence == NULL)
   {
-    inf_adopted_split_operation_unsplit_impl(
-      INF_ADOPTED_SPLIT_OPERATION(priv->first),
-      list
-    );
+    priv->sequence = g_new(InfAdoptedOperation*, priv->n_operations);
+
+    for(i = 0; i < priv->n_operations; ++i)
+    {
+      op = g_object_ref(priv->operations[i]);
+      for(j = 0; j < i; ++j)
+      {
+        transformed = inf_adopted_operation_transform(
+          op,
+          priv->sequence[j],
+          0
+        );
+
+        g_object_unref(op);
+        op = transformed;
+      }
+
+      priv->sequence[i] = op;
+    }
   }
-  else
+
+  return priv->sequence;
+}
+
+static GObject*
+inf_adopted_split_operation_constructor(GType type,
+                                        guint n_construct_properties,
+                                        GObjectConstructParam* construct_props)
+{
+  GObject* object;
+  InfAdoptedSplitOperationPrivate* priv;
+  InfAdoptedOperation* operations[2];
+  guint n_operations;
+
+  object = G_OBJECT_CLASS(parent_class)->constructor(
+    type,
+    n_construct_properties,
+    construct_props
+  );
+
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(object);
+
+  /* If first and second have been set as construction properties, then
+   * flatten them. inf_adopted_split_operation_new() sets the parts
+   * directly. */
+  n_operations = 0;
+  if(priv->first != NULL)
+    operations[n_operations++] = priv->first;
+  if(priv->second != NULL)
+    operations[n_operations++] = priv->second;
+
+  priv->first = NULL;
+  priv->second = NULL;
+
+  if(n_operations > 0)
   {
-    *list = g_slist_prepend(*list, priv->first);
+    inf_adopted_split_operation_set_operations(
+      INF_ADOPTED_SPLIT_OPERATION(object),
+      operations,
+      n_operations
+    );
   }
+
+  return object;
 }
 
 static void
@@ -98,6 +240,9 @@ inf_adopted_split_operation_init(GTypeInstance* instance,
 
   priv->first = NULL;
   priv->second = NULL;
+  priv->operations = NULL;
+  priv->n_operations = 0;
+  priv->sequence = NULL;
 }
 
 static void
@@ -105,15 +250,29 @@ inf_adopted_split_operation_dispose(GObject* object)
 {
   InfAdoptedSplitOperation* operation;
   InfAdoptedSplitOperationPrivate* priv;
+  guint i;
 
   operation = INF_ADOPTED_SPLIT_OPERATION(object);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
 
-  if(priv->first != NULL)
-    g_object_unref(G_OBJECT(priv->first));
+  if(priv->sequence != NULL)
+  {
+    for(i = 0; i < priv->n_operations; ++i)
+      g_object_unref(priv->sequence[i]);
 
-  if(priv->second != NULL)
-    g_object_unref(G_OBJECT(priv->second));
+    g_free(priv->sequence);
+    priv->sequence = NULL;
+  }
+
+  if(priv->operations != NULL)
+  {
+    for(i = 0; i < priv->n_operations; ++i)
+      g_object_unref(priv->operations[i]);
+
+    g_free(priv->operations);
+    priv->operations = NULL;
+    priv->n_operations = 0;
+  }
 
   G_OBJECT_CLASS(parent_class)->dispose(object);
 }
@@ -133,14 +292,12 @@ inf_adopted_split_operation_set_property(GObject* object,
   switch(prop_id)
   {
   case PROP_FIRST:
-    if(priv->first != NULL) g_object_unref(G_OBJECT(priv->first));
+    g_assert(priv->first == NULL); /* construct only */
     priv->first = INF_ADOPTED_OPERATION(g_value_dup_object(value));
-    g_assert(priv->first != INF_ADOPTED_OPERATION(operation));
     break;
   case PROP_SECOND:
-    if(priv->second != NULL) g_object_unref(G_OBJECT(priv->second));
+    g_assert(priv->second == NULL); /* construct only */
     priv->second = INF_ADOPTED_OPERATION(g_value_dup_object(value));
-    g_assert(priv->second != INF_ADOPTED_OPERATION(operation));
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -156,6 +313,9 @@ inf_adopted_split_operation_get_property(GObject* object,
 {
   InfAdoptedSplitOperation* operation;
   InfAdoptedSplitOperationPrivate* priv;
+  InfAdoptedOperation** operations;
+  InfAdoptedSplitOperation* rest;
+  guint i;
 
   operation = INF_ADOPTED_SPLIT_OPERATION(object);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
@@ -163,10 +323,28 @@ inf_adopted_split_operation_get_property(GObject* object,
   switch(prop_id)
   {
   case PROP_FIRST:
-    g_value_set_object(value, G_OBJECT(priv->first));
+    g_value_set_object(value, G_OBJECT(priv->operations[0]));
     break;
   case PROP_SECOND:
-    g_value_set_object(value, G_OBJECT(priv->second));
+    /* All parts but the first one */
+    if(priv->n_operations == 2)
+    {
+      g_value_set_object(value, G_OBJECT(priv->operations[1]));
+    }
+    else
+    {
+      operations = g_new(InfAdoptedOperation*, priv->n_operations - 1);
+      for(i = 1; i < priv->n_operations; ++i)
+        operations[i - 1] = g_object_ref(priv->operations[i]);
+
+      rest = inf_adopted_split_operation_new_take(
+        operations,
+        priv->n_operations - 1
+      );
+
+      g_free(operations);
+      g_value_take_object(value, G_OBJECT(rest));
+    }
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -184,6 +362,7 @@ inf_adopted_split_operation_class_init(gpointer g_class,
   parent_class = G_OBJECT_CLASS(g_type_class_peek_parent(g_class));
   g_type_class_add_private(g_class, sizeof(InfAdoptedSplitOperationPrivate));
 
+  object_class->constructor = inf_adopted_split_operation_constructor;
   object_class->dispose = inf_adopted_split_operation_dispose;
   object_class->set_property = inf_adopted_split_operation_set_property;
   object_class->get_property = inf_adopted_split_operation_get_property;
@@ -219,12 +398,18 @@ inf_adopted_split_operation_need_concurrency_id(InfAdoptedOperation* op,
 {
   InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
+  guint i;
 
   split = INF_ADOPTED_SPLIT_OPERATION(op);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
 
-  return inf_adopted_operation_need_concurrency_id(priv->first, against) ||
-         inf_adopted_operation_need_concurrency_id(priv->second, against);
+  for(i = 0; i < priv->n_operations; ++i)
+  {
+    if(inf_adopted_operation_need_concurrency_id(priv->operations[i], against))
+      return TRUE;
+  }
+
+  return FALSE;
 }
 
 static InfAdoptedConcurrencyId
@@ -233,27 +418,38 @@ inf_adopted_split_operation_get_concurrency_id(InfAdoptedOperation* operation,
 {
   InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-  InfAdoptedConcurrencyId first_id;
-  InfAdoptedConcurrencyId second_id;
+  InfAdoptedConcurrencyId result;
+  InfAdoptedConcurrencyId id;
+  guint i;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
+  result = INF_ADOPTED_CONCURRENCY_NONE;
 
-  first_id = inf_adopted_operation_get_concurrency_id(priv->first, against);
-  second_id = inf_adopted_operation_get_concurrency_id(priv->second, against);
-
-  /* everything is fine if both split parts agree, or if only one can
+  /* everything is fine if all split parts agree, or if only some can
    * make a decision. Problem if they are contradictory. */
+  for(i = 0; i < priv->n_operations; ++i)
+  {
+    id = inf_adopted_operation_get_concurrency_id(
+      priv->operations[i],
+      against
+    );
 
-  if(first_id == second_id)
-    return first_id;
-  else if(first_id == INF_ADOPTED_CONCURRENCY_NONE)
-    return second_id;
-  else if(second_id == INF_ADOPTED_CONCURRENCY_NONE)
-    return first_id;
+    if(id != INF_ADOPTED_CONCURRENCY_NONE)
+    {
+      if(result == INF_ADOPTED_CONCURRENCY_NONE)
+      {
+        result = id;
+      }
+      else if(result != id)
+      {
+        _inf_adopted_concurrency_warning(INF_ADOPTED_TYPE_SPLIT_OPERATION);
+        return INF_ADOPTED_CONCURRENCY_NONE;
+      }
+    }
+  }
 
-  _inf_adopted_concurrency_warning(INF_ADOPTED_TYPE_SPLIT_OPERATION);
-  return INF_ADOPTED_CONCURRENCY_NONE;
+  return result;
 }
 
 static InfAdoptedOperation*
@@ -263,37 +459,35 @@ inf_adopted_split_operation_transform(InfAdoptedOperation* operation,
 {
   InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-
-  InfAdoptedOperation* new_first;
-  InfAdoptedOperation* new_second;
-  InfAdoptedOperation* result;
+  InfAdoptedOperation** operations;
+  InfAdoptedSplitOperation* result;
+  guint i;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
 
-  new_first = inf_adopted_operation_transform(
-    priv->first,
-    against,
-    concurrency_id
-  );
-
-  new_second = inf_adopted_operation_transform(
-    priv->second,
-    against,
-    concurrency_id
-  );
+  /* All parts refer to the same state, so each can be transformed on its
+   * own. Parts that are split again are flattened into the result. */
+  operations = g_new(InfAdoptedOperation*, priv->n_operations);
+  for(i = 0; i < priv->n_operations; ++i)
+  {
+    operations[i] = inf_adopted_operation_transform(
+      priv->operations[i],
+      against,
+      concurrency_id
+    );
+  }
 
-  /* TODO: Check whether one of these is a noop and return only the other
-   * one in that case. */
+  /* TODO: Check whether some of these are noops and leave them out in
+   * that case. */
 
-  result = INF_ADOPTED_OPERATION(
-    inf_adopted_split_operation_new(new_first, new_second)
+  result = inf_adopted_split_operation_new_take(
+    operations,
+    priv->n_operations
   );
 
-  g_object_unref(G_OBJECT(new_first));
-  g_object_unref(G_OBJECT(new_second));
-
-  return result;
+  g_free(operations);
+  return INF_ADOPTED_OPERATION(result);
 }
 
 static InfAdoptedOperation*
@@ -301,16 +495,24 @@ inf_adopted_split_operation_copy(InfAdoptedOperation* operation)
 {
   InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
+  InfAdoptedOperation** operations;
+  InfAdoptedSplitOperation* result;
+  guint i;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
 
-  return INF_ADOPTED_OPERATION(
-    inf_adopted_split_operation_new(
-      inf_adopted_operation_copy(priv->first),
-      inf_adopted_operation_copy(priv->second)
-    )
+  operations = g_new(InfAdoptedOperation*, priv->n_operations);
+  for(i = 0; i < priv->n_operations; ++i)
+    operations[i] = inf_adopted_operation_copy(priv->operations[i]);
+
+  result = inf_adopted_split_operation_new_take(
+    operations,
+    priv->n_operations
   );
+
+  g_free(operations);
+  return INF_ADOPTED_OPERATION(result);
 }
 
 static InfAdoptedOperationFlags
@@ -318,27 +520,23 @@ inf_adopted_split_operation_get_flags(InfAdoptedOperation* operation)
 {
   InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-  InfAdoptedOperationFlags flags1;
-  InfAdoptedOperationFlags flags2;
+  InfAdoptedOperationFlags flags;
   InfAdoptedOperationFlags result;
+  guint i;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
 
-  flags1 = inf_adopted_operation_get_flags(priv->first);
-  flags2 = inf_adopted_operation_get_flags(priv->second);
-  result = 0;
+  result = INF_ADOPTED_OPERATION_REVERSIBLE;
 
-  if( (flags1 & INF_ADOPTED_OPERATION_AFFECTS_BUFFER) != 0 ||
-      (flags2 & INF_ADOPTED_OPERATION_AFFECTS_BUFFER) != 0)
+  for(i = 0; i < priv->n_operations; ++i)
   {
-    result |= INF_ADOPTED_OPERATION_AFFECTS_BUFFER;
-  }
+    flags = inf_adopted_operation_get_flags(priv->operations[i]);
 
-  if( (flags1 & INF_ADOPTED_OPERATION_REVERSIBLE) != 0 &&
-      (flags2 & INF_ADOPTED_OPERATION_REVERSIBLE) != 0)
-  {
-    result |= INF_ADOPTED_OPERATION_REVERSIBLE;
+    if( (flags & INF_ADOPTED_OPERATION_AFFECTS_BUFFER) != 0)
+      result |= INF_ADOPTED_OPERATION_AFFECTS_BUFFER;
+    if( (flags & INF_ADOPTED_OPERATION_REVERSIBLE) == 0)
+      result &= ~INF_ADOPTED_OPERATION_REVERSIBLE;
   }
 
   return result;
@@ -351,17 +549,15 @@ inf_adopted_split_operation_apply(InfAdoptedOperation* operation,
 {
   InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-  InfAdoptedOperation* new_second;
+  InfAdoptedOperation** sequence;
+  guint i;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
 
-  new_second = inf_adopted_operation_transform(priv->second, priv->first, 0);
-
-  inf_adopted_operation_apply(priv->first, by, buffer);
-  inf_adopted_operation_apply(new_second, by, buffer);
-
-  g_object_unref(G_OBJECT(new_second));
+  sequence = inf_adopted_split_operation_get_sequence(split);
+  for(i = 0; i < priv->n_operations; ++i)
+    inf_adopted_operation_apply(sequence[i], by, buffer);
 }
 
 static InfAdoptedOperation*
@@ -369,26 +565,26 @@ inf_adopted_split_operation_revert(InfAdoptedOperation* operation)
 {
   InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-  InfAdoptedOperation* new_second;
-
-  InfAdoptedOperation* revert_first;
-  InfAdoptedOperation* revert_second;
+  InfAdoptedOperation** sequence;
+  InfAdoptedOperation** operations;
   InfAdoptedSplitOperation* result;
+  guint i;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
 
-  new_second = inf_adopted_operation_transform(priv->second, priv->first, 0);
+  sequence = inf_adopted_split_operation_get_sequence(split);
+  operations = g_new(InfAdoptedOperation*, priv->n_operations);
 
-  revert_first = inf_adopted_operation_revert(priv->first);
-  revert_second = inf_adopted_operation_revert(new_second);
-  g_object_unref(new_second);
+  for(i = 0; i < priv->n_operations; ++i)
+    operations[i] = inf_adopted_operation_revert(sequence[i]);
 
-  result = inf_adopted_split_operation_new(revert_first, revert_second);
-
-  g_object_unref(revert_first);
-  g_object_unref(revert_second);
+  result = inf_adopted_split_operation_new_take(
+    operations,
+    priv->n_operations
+  );
 
+  g_free(operations);
   return INF_ADOPTED_OPERATION(result);
 }
 
@@ -399,25 +595,39 @@ inf_adopted_split_operation_make_reversible(InfAdoptedOperation* operation,
 {
   InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-  InfAdoptedOperation* first;
-  InfAdoptedOperation* second;
+  InfAdoptedOperation** operations;
+  InfAdoptedSplitOperation* result;
+  guint i;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
 
-  first = inf_adopted_operation_make_reversible(priv->first, with, buffer);
-  if(first == NULL) return NULL;
-
-  second = inf_adopted_operation_make_reversible(priv->second, with, buffer);
-  if(second == NULL)
+  operations = g_new(InfAdoptedOperation*, priv->n_operations);
+  for(i = 0; i < priv->n_operations; ++i)
   {
-    g_object_unref(G_OBJECT(first));
-    return NULL;
+    operations[i] = inf_adopted_operation_make_reversible(
+      priv->operations[i],
+      with,
+      buffer
+    );
+
+    if(operations[i] == NULL)
+    {
+      while(i > 0)
+        g_object_unref(operations[--i]);
+
+      g_free(operations);
+      return NULL;
+    }
   }
 
-  return INF_ADOPTED_OPERATION(
-    inf_adopted_split_operation_new(first, second)
+  result = inf_adopted_split_operation_new_take(
+    operations,
+    priv->n_operations
   );
+
+  g_free(operations);
+  return INF_ADOPTED_OPERATION(result);
 }
 
 static void
@@ -488,6 +698,8 @@ inf_adopted_split_operation_get_type(void)
  *
  * Creates a new #InfAdoptedSplitOperation. A split operation is simply a
  * wrapper around two operations (which may in turn be split operations).
+ * If @first or @second are split operations, then the new split operation
+ * takes over their parts, instead of nesting them.
  *
  * Return Value: A new #InfAdoptedSplitOperation.
  **/
@@ -495,19 +707,15 @@ InfAdoptedSplitOperation*
 inf_adopted_split_operation_new(InfAdoptedOperation* first,
                                 InfAdoptedOperation* second)
 {
-  GObject* object;
+  InfAdoptedOperation* operations[2];
 
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(first), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(second), NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_SPLIT_OPERATION,
-    "first", first,
-    "second", second,
-    NULL
-  );
+  operations[0] = g_object_ref(first);
+  operations[1] = g_object_ref(second);
 
-  return INF_ADOPTED_SPLIT_OPERATION(object);
+  return inf_adopted_split_operation_new_take(operations, 2);
 }
 
 /**
@@ -524,10 +732,17 @@ inf_adopted_split_operation_new(InfAdoptedOperation* first,
 GSList*
 inf_adopted_split_operation_unsplit(InfAdoptedSplitOperation* operation)
 {
+  InfAdoptedSplitOperationPrivate* priv;
   GSList* result;
+  guint i;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_SPLIT_OPERATION(operation), NULL);
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
 
   result = NULL;
-  inf_adopted_split_operation_unsplit_impl(operation, &result);
+  for(i = priv->n_operations; i > 0; --i)
+    result = g_slist_prepend(result, priv->operations[i - 1]);
+
   return result;
 }
 
@@ -548,21 +763,30 @@ inf_adopted_split_operation_transform_other(InfAdoptedSplitOperation* op,
                                             gint concurrency_id)
 {
   InfAdoptedSplitOperationPrivate* priv;
-  InfAdoptedOperation* tmp;
-  InfAdoptedOperation* new_second;
+  InfAdoptedOperation** sequence;
   InfAdoptedOperation* result;
+  InfAdoptedOperation* transformed;
+  guint i;
 
   g_return_val_if_fail(INF_ADOPTED_IS_SPLIT_OPERATION(op), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(other), NULL);
 
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(op);
+  sequence = inf_adopted_split_operation_get_sequence(op);
+
+  result = g_object_ref(other);
+  for(i = 0; i < priv->n_operations; ++i)
+  {
+    transformed = inf_adopted_operation_transform(
+      result,
+      sequence[i],
+      concurrency_id
+    );
 
-  tmp = inf_adopted_operation_transform(other, priv->first, concurrency_id);
-  new_second = inf_adopted_operation_transform(priv->second, priv->first, 0);
-  result = inf_adopted_operation_transform(tmp, new_second, concurrency_id);
+    g_object_unref(result);
+    result = transformed;
+  }
 
-  g_object_unref(G_OBJECT(tmp));
-  g_object_unref(G_OBJECT(new_second));
   return result;
 }
 
@@ -2124,6 +2124,7 @@ infc_browser_handle_welcome(InfcBrowser* browser,
   guint own_major;
   guint own_minor;
   gboolean result;
+  xmlNodePtr reply;
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
@@ -2150,7 +2151,9 @@ infc_browser_handle_welcome(InfcBrowser* browser,
 
   g_assert(result == TRUE);
 
-  if(server_major < own_major || server_minor < own_minor)
+  /* Servers with an older minor version are fine, we just do not send
+   * messages they do not understand. */
+  if(server_major < own_major)
   {
     g_set_error(
       error,
@@ -2189,6 +2192,26 @@ infc_browser_handle_welcome(InfcBrowser* browser,
   g_assert(priv->request_manager == NULL);
   priv->request_manager = infc_request_manager_new(priv->seq_id);
 
+  inf_protocol_set_remote_version(connection, server_major, server_minor);
+
+  /* Tell the server which version we speak, unless it does not know about
+   * that message yet. */
+  if(inf_protocol_check_remote_version(connection, 1, 1))
+  {
+    reply = xmlNewNode(NULL, (const xmlChar*)"hello");
+    inf_xml_util_set_attribute(
+      reply,
+      "protocol-version",
+      inf_protocol_get_version()
+    );
+
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(priv->group),
+      connection,
+      reply
+    );
+  }
+
   priv->status = INFC_BROWSER_CONNECTED;
   g_object_notify(G_OBJECT(browser), "status");
 
@@ -27,15 +27,210 @@
  *
  * This is a thin wrapper class for #gnutls_certificate_credentials_t. It
  * provides reference counting and a boxed GType for it.
+ *
+ * In addition, it keeps a cache of TLS sessions so that connections sharing
+ * the same credentials can resume a previous session instead of performing
+ * a full handshake, see inf_certificate_credentials_set_session_cache_size().
  **/
 
 #include <libinfinity/common/inf-certificate-credentials.h>
+#include <libinfinity/common/inf-certificate-credentials-private.h>
+
+#include <string.h>
+#include <time.h>
+
+/* Number of sessions to remember by default */
+static const guint INF_CERTIFICATE_CREDENTIALS_SESSION_CACHE_SIZE = 256;
+/* Seconds after which a cached session can no longer be resumed */
+static const time_t INF_CERTIFICATE_CREDENTIALS_SESSION_EXPIRATION = 3600;
+
+typedef struct _InfCertificateCredentialsSession
+  InfCertificateCredentialsSession;
+struct _InfCertificateCredentialsSession {
+  /* Table the session is stored in, and the key it is stored with. The key
+   * is either the session ID (server side) or the hostname (client side). */
+  GHashTable* table;
+  gpointer key;
+
+  gnutls_datum_t id;
+  gchar* hostname;
+  gnutls_datum_t data;
+  time_t timestamp;
+
+  /* Link in the queue of all cached sessions, oldest first */
+  GList* link;
+};
 
 struct _InfCertificateCredentials {
   guint ref_count;
   gnutls_certificate_credentials_t creds;
+
+  guint session_cache_size;
+  GQueue* sessions;
+  GHashTable* server_sessions; /* session ID -> session */
+  GHashTable* client_sessions; /* hostname -> session */
 };
 
+static guint
+inf_certificate_credentials_datum_hash(gconstpointer key)
+{
+  const gnutls_datum_t* datum;
+  guint hash;
+  unsigned int i;
+
+  datum = (const gnutls_datum_t*)key;
+  hash = 5381;
+  for(i = 0; i < datum->size; ++ i)
+    hash = (hash << 5) + hash + datum->data[i];
+
+  return hash;
+}
+
+static gboolean
+inf_certificate_credentials_datum_equal(gconstpointer first,
+                                        gconstpointer second)
+{
+  const gnutls_datum_t* first_datum;
+  const gnutls_datum_t* second_datum;
+
+  first_datum = (const gnutls_datum_t*)first;
+  second_datum = (const gnutls_datum_t*)second;
+
+  if(first_datum->size != second_datum->size)
+    return FALSE;
+
+  return memcmp(first_datum->data, second_datum->data, first_datum->size) == 0;
+}
+
+static void
+inf_certificate_credentials_session_remove(InfCertificateCredentials* creds,
+                                           InfCertificateCredentialsSession* s)
+{
+  g_hash_table_remove(s->table, s->key);
+  g_queue_delete_link(creds->sessions, s->link);
+
+  g_free(s->id.data);
+  g_free(s->hostname);
+  g_free(s->data.data);
+  g_slice_free(InfCertificateCredentialsSession, s);
+}
+
+static void
+inf_certificate_credentials_session_add(InfCertificateCredentials* creds,
+                                        InfCertificateCredentialsSession* s)
+{
+  InfCertificateCredentialsSession* old_session;
+
+  old_session = g_hash_table_lookup(s->table, s->key);
+  if(old_session != NULL)
+    inf_certificate_credentials_session_remove(creds, old_session);
+
+  /* Make room by dropping the oldest sessions */
+  while(creds->sessions->length >= creds->session_cache_size)
+  {
+    inf_certificate_credentials_session_remove(
+      creds,
+      (InfCertificateCredentialsSession*)creds->sessions->head->data
+    );
+  }
+
+  s->timestamp = time(NULL);
+  g_queue_push_tail(creds->sessions, s);
+  s->link = creds->sessions->tail;
+  g_hash_table_insert(s->table, s->key, s);
+}
+
+static InfCertificateCredentialsSession*
+inf_certificate_credentials_session_lookup(InfCertificateCredentials* creds,
+                                           GHashTable* table,
+                                           gconstpointer key)
+{
+  InfCertificateCredentialsSession* session;
+
+  session = g_hash_table_lookup(table, key);
+  if(session == NULL) return NULL;
+
+  if(time(NULL) - session->timestamp >
+     INF_CERTIFICATE_CREDENTIALS_SESSION_EXPIRATION)
+  {
+    inf_certificate_credentials_session_remove(creds, session);
+    return NULL;
+  }
+
+  return session;
+}
+
+static int
+inf_certificate_credentials_db_store(void* ptr,
+                                     gnutls_datum_t key,
+                                     gnutls_datum_t data)
+{
+  InfCertificateCredentials* creds;
+  InfCertificateCredentialsSession* session;
+
+  creds = (InfCertificateCredentials*)ptr;
+  if(creds->session_cache_size == 0) return -1;
+
+  session = g_slice_new(InfCertificateCredentialsSession);
+  session->table = creds->server_sessions;
+  session->key = &session->id;
+  session->id.data = g_memdup(key.data, key.size);
+  session->id.size = key.size;
+  session->hostname = NULL;
+  session->data.data = g_memdup(data.data, data.size);
+  session->data.size = data.size;
+
+  inf_certificate_credentials_session_add(creds, session);
+  return 0;
+}
+
+static gnutls_datum_t
+inf_certificate_credentials_db_retrieve(void* ptr,
+                                        gnutls_datum_t key)
+{
+  InfCertificateCredentials* creds;
+  InfCertificateCredentialsSession* session;
+  gnutls_datum_t result;
+
+  creds = (InfCertificateCredentials*)ptr;
+  session = inf_certificate_credentials_session_lookup(
+    creds,
+    creds->server_sessions,
+    &key
+  );
+
+  result.data = NULL;
+  result.size = 0;
+
+  if(session != NULL)
+  {
+    /* GnuTLS frees the returned data with gnutls_free() */
+    result.data = gnutls_malloc(session->data.size);
+    if(result.data != NULL)
+    {
+      memcpy(result.data, session->data.data, session->data.size);
+      result.size = session->data.size;
+    }
+  }
+
+  return result;
+}
+
+static int
+inf_certificate_credentials_db_remove(void* ptr,
+                                      gnutls_datum_t key)
+{
+  InfCertificateCredentials* creds;
+  InfCertificateCredentialsSession* session;
+
+  creds = (InfCertificateCredentials*)ptr;
+  session = g_hash_table_lookup(creds->server_sessions, &key);
+  if(session == NULL) return -1;
+
+  inf_certificate_credentials_session_remove(creds, session);
+  return 0;
+}
+
 GType
 inf_certificate_credentials_get_type(void)
 {
@@ -72,6 +267,16 @@ inf_certificate_credentials_new(void)
   creds->ref_count = 1;
   gnutls_certificate_allocate_credentials(&creds->creds);
 
+  creds->session_cache_size = INF_CERTIFICATE_CREDENTIALS_SESSION_CACHE_SIZE;
+  creds->sessions = g_queue_new();
+
+  creds->server_sessions = g_hash_table_new(
+    inf_certificate_credentials_datum_hash,
+    inf_certificate_credentials_datum_equal
+  );
+
+  creds->client_sessions = g_hash_table_new(g_str_hash, g_str_equal);
+
   return creds;
 }
 
@@ -104,6 +309,18 @@ inf_certificate_credentials_unref(InfCertificateCredentials* creds)
   g_return_if_fail(creds != NULL);
   if(!--creds->ref_count)
   {
+    while(creds->sessions->head != NULL)
+    {
+      inf_certificate_credentials_session_remove(
+        creds,
+        (InfCertificateCredentialsSession*)creds->sessions->head->data
+      );
+    }
+
+    g_hash_table_destroy(creds->client_sessions);
+    g_hash_table_destroy(creds->server_sessions);
+    g_queue_free(creds->sessions);
+
     gnutls_certificate_free_credentials(creds->creds);
     g_slice_free(InfCertificateCredentials, creds);
   }
@@ -125,4 +342,158 @@ inf_certificate_credentials_get(InfCertificateCredentials* creds)
   return creds->creds;
 }
 
+/**
+ * inf_certificate_credentials_set_session_cache_size:
+ * @creds: A #InfCertificateCredentials.
+ * @size: The maximum number of TLS sessions to remember, or 0.
+ *
+ * Sets how many TLS sessions @creds remembers for later resumption. A
+ * resumed session does not require a full TLS handshake, including the
+ * Diffie-Hellman key exchange, which makes reconnects considerably cheaper.
+ *
+ * On the server side, every #InfXmppConnection using @creds stores its
+ * session in @creds, so that a client reconnecting to the server can resume
+ * it. On the client side, the session is stored per remote hostname, and
+ * offered to the server again on the next connection to the same host. If
+ * the server does not accept it, a full handshake is performed.
+ *
+ * Sessions expire after one hour. When the cache is full, the oldest
+ * session is dropped. If @size is 0, no sessions are cached at all. The
+ * default is to cache up to 256 sessions.
+ */
+void
+inf_certificate_credentials_set_session_cache_size(
+  InfCertificateCredentials* creds,
+  guint size)
+{
+  g_return_if_fail(creds != NULL);
+
+  creds->session_cache_size = size;
+  while(creds->sessions->length > size)
+  {
+    inf_certificate_credentials_session_remove(
+      creds,
+      (InfCertificateCredentialsSession*)creds->sessions->head->data
+    );
+  }
+}
+
+/**
+ * inf_certificate_credentials_get_session_cache_size:
+ * @creds: A #InfCertificateCredentials.
+ *
+ * Returns the maximum number of TLS sessions that @creds remembers, see
+ * inf_certificate_credentials_set_session_cache_size().
+ *
+ * Returns: The size of @creds' session cache.
+ */
+guint
+inf_certificate_credentials_get_session_cache_size(
+  InfCertificateCredentials* creds)
+{
+  g_return_val_if_fail(creds != NULL, 0);
+  return creds->session_cache_size;
+}
+
+void
+_inf_certificate_credentials_prepare_server_session(
+  InfCertificateCredentials* creds,
+  gnutls_session_t session)
+{
+  if(creds->session_cache_size > 0)
+  {
+    gnutls_db_set_retrieve_function(
+      session,
+      inf_certificate_credentials_db_retrieve
+    );
+
+    gnutls_db_set_store_function(
+      session,
+      inf_certificate_credentials_db_store
+    );
+
+    gnutls_db_set_remove_function(
+      session,
+      inf_certificate_credentials_db_remove
+    );
+
+    gnutls_db_set_ptr(session, creds);
+    gnutls_db_set_cache_expiration(
+      session,
+      INF_CERTIFICATE_CREDENTIALS_SESSION_EXPIRATION
+    );
+  }
+}
+
+void
+_inf_certificate_credentials_prepare_client_session(
+  InfCertificateCredentials* creds,
+  gnutls_session_t session,
+  const gchar* hostname)
+{
+  InfCertificateCredentialsSession* cached;
+
+  if(hostname == NULL) return;
+
+  cached = inf_certificate_credentials_session_lookup(
+    creds,
+    creds->client_sessions,
+    hostname
+  );
+
+  if(cached != NULL)
+    gnutls_session_set_data(session, cached->data.data, cached->data.size);
+}
+
+void
+_inf_certificate_credentials_store_client_session(
+  InfCertificateCredentials* creds,
+  gnutls_session_t session,
+  const gchar* hostname)
+{
+  InfCertificateCredentialsSession* cached;
+  size_t size;
+  int res;
+
+  if(hostname == NULL || creds->session_cache_size == 0) return;
+
+  size = 0;
+  res = gnutls_session_get_data(session, NULL, &size);
+  if(res != 0 || size == 0) return;
+
+  cached = g_slice_new(InfCertificateCredentialsSession);
+  cached->data.data = g_malloc(size);
+
+  res = gnutls_session_get_data(session, cached->data.data, &size);
+  if(res != 0)
+  {
+    g_free(cached->data.data);
+    g_slice_free(InfCertificateCredentialsSession, cached);
+    return;
+  }
+
+  cached->table = creds->client_sessions;
+  cached->id.data = NULL;
+  cached->id.size = 0;
+  cached->hostname = g_strdup(hostname);
+  cached->key = cached->hostname;
+  cached->data.size = size;
+
+  inf_certificate_credentials_session_add(creds, cached);
+}
+
+void
+_inf_certificate_credentials_forget_client_session(
+  InfCertificateCredentials* creds,
+  const gchar* hostname)
+{
+  InfCertificateCredentialsSession* cached;
+
+  if(hostname == NULL) return;
+
+  cached = g_hash_table_lookup(creds->client_sessions, hostname);
+  if(cached != NULL)
+    inf_certificate_credentials_session_remove(creds, cached);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -52,6 +52,15 @@ inf_certificate_credentials_unref(InfCertificateCredentials* creds);
 gnutls_certificate_credentials_t
 inf_certificate_credentials_get(InfCertificateCredentials* creds);
 
+void
+inf_certificate_credentials_set_session_cache_size(
+  InfCertificateCredentials* creds,
+  guint size);
+
+guint
+inf_certificate_credentials_get_session_cache_size(
+  InfCertificateCredentials* creds);
+
 G_END_DECLS
 
 #endif /* __INF_CERTIFICATE_CREDENTIALS_H__ */
@@ -32,18 +32,51 @@
 #include <libinfinity/common/inf-chat-session.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-protocol.h>
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-marshal.h>
 #include <libinfinity/inf-signals.h>
 
+#include <stdarg.h>
 #include <errno.h>
 #include <string.h>
 
+/* Number of seconds the log writer waits for more lines before writing
+ * what it has to the log file. */
+#define INF_CHAT_SESSION_LOG_FLUSH_INTERVAL 1
+
+/* If this many bytes are pending, the log writer writes them out without
+ * waiting for the flush interval to pass. */
+#define INF_CHAT_SESSION_LOG_FLUSH_SIZE (16 * 1024)
+
+/* Upper bound for the number of bytes pending in the log buffer. If the log
+ * writer cannot keep up, further lines are dropped until it has caught up,
+ * instead of blocking the main loop. */
+#define INF_CHAT_SESSION_LOG_MAX_SIZE (256 * 1024)
+
+/* Maximum number of backlog messages sent within a single sync stanza. */
+#define INF_CHAT_SESSION_SYNC_BATCH_SIZE 64
+
+typedef struct _InfChatSessionLog InfChatSessionLog;
+struct _InfChatSessionLog {
+  FILE* file;
+  GThread* thread;
+
+  GMutex* mutex;
+  GCond* wakeup_cond;
+
+  /* Protected by mutex */
+  GString* buffer;
+  GString* spare;
+  guint n_dropped;
+  gboolean closing;
+};
+
 typedef struct _InfChatSessionLogUserlistForeachData
   InfChatSessionLogUserlistForeachData;
 struct _InfChatSessionLogUserlistForeachData {
-  FILE* log_file;
+  InfChatSessionLog* log;
   gchar* time_str;
   guint users_total;
 };
@@ -51,7 +84,11 @@ struct _InfChatSessionLogUserlistForeachData {
 typedef struct _InfChatSessionPrivate InfChatSessionPrivate;
 struct _InfChatSessionPrivate {
   gchar* log_filename;
-  FILE* log_file;
+  InfChatSessionLog* log;
+
+  /* Whether to_xml_sync may use <sync-messages>. Only unset while
+   * synchronizing to a peer that does not understand it. */
+  gboolean sync_batches;
 };
 
 enum {
@@ -328,6 +365,151 @@ inf_chat_session_strdup_strftime(const char* format,
   return str;
 }
 
+static gpointer
+inf_chat_session_log_thread_func(gpointer data)
+{
+  InfChatSessionLog* log;
+  GString* pending;
+  guint n_dropped;
+  GTimeVal deadline;
+
+  log = (InfChatSessionLog*)data;
+  g_mutex_lock(log->mutex);
+
+  for(;;)
+  {
+    while(log->buffer->len == 0 && !log->closing)
+      g_cond_wait(log->wakeup_cond, log->mutex);
+
+    /* Nothing left to write and asked to shut down */
+    if(log->buffer->len == 0)
+      break;
+
+    /* Wait a bit for more lines to arrive so that we do not need to write
+     * and flush the file for every single message. */
+    g_get_current_time(&deadline);
+    g_time_val_add(
+      &deadline,
+      INF_CHAT_SESSION_LOG_FLUSH_INTERVAL * G_USEC_PER_SEC
+    );
+
+    while(!log->closing &&
+          log->buffer->len < INF_CHAT_SESSION_LOG_FLUSH_SIZE)
+    {
+      if(!g_cond_timed_wait(log->wakeup_cond, log->mutex, &deadline))
+        break;
+    }
+
+    pending = log->buffer;
+    n_dropped = log->n_dropped;
+    log->buffer = log->spare;
+    log->spare = NULL;
+    log->n_dropped = 0;
+    g_mutex_unlock(log->mutex);
+
+    fwrite(pending->str, 1, pending->len, log->file);
+    if(n_dropped > 0)
+      fprintf(log->file, "(%u lines dropped from the log)\n", n_dropped);
+    fflush(log->file);
+    g_string_truncate(pending, 0);
+
+    g_mutex_lock(log->mutex);
+    log->spare = pending;
+  }
+
+  g_mutex_unlock(log->mutex);
+  return NULL;
+}
+
+static InfChatSessionLog*
+inf_chat_session_log_new(FILE* file,
+                         GError** error)
+{
+  InfChatSessionLog* log;
+  log = g_slice_new(InfChatSessionLog);
+
+  log->file = file;
+  log->mutex = g_mutex_new();
+  log->wakeup_cond = g_cond_new();
+  log->buffer = g_string_sized_new(1024);
+  log->spare = g_string_sized_new(1024);
+  log->n_dropped = 0;
+  log->closing = FALSE;
+
+  log->thread = g_thread_create(
+    inf_chat_session_log_thread_func,
+    log,
+    TRUE,
+    error
+  );
+
+  if(log->thread == NULL)
+  {
+    g_string_free(log->spare, TRUE);
+    g_string_free(log->buffer, TRUE);
+    g_cond_free(log->wakeup_cond);
+    g_mutex_free(log->mutex);
+    g_slice_free(InfChatSessionLog, log);
+    return NULL;
+  }
+
+  return log;
+}
+
+/* Writes out all pending lines, stops the writer thread and closes the
+ * log file. */
+static void
+inf_chat_session_log_free(InfChatSessionLog* log)
+{
+  g_mutex_lock(log->mutex);
+  log->closing = TRUE;
+  g_cond_signal(log->wakeup_cond);
+  g_mutex_unlock(log->mutex);
+
+  g_thread_join(log->thread);
+  fclose(log->file);
+
+  g_string_free(log->spare, TRUE);
+  g_string_free(log->buffer, TRUE);
+  g_cond_free(log->wakeup_cond);
+  g_mutex_free(log->mutex);
+  g_slice_free(InfChatSessionLog, log);
+}
+
+/* Queues a line for the writer thread. This does not touch the file itself,
+ * and never waits for the writer thread, so it is cheap to call from the
+ * main loop. */
+static void
+inf_chat_session_log_printf(InfChatSessionLog* log,
+                            const gchar* format,
+                            ...)
+{
+  va_list args;
+  gboolean was_empty;
+
+  g_mutex_lock(log->mutex);
+
+  /* Keep the memory used for the log bounded if the disk is slower than
+   * the chat. The writer thread notes how many lines were lost. */
+  if(log->buffer->len >= INF_CHAT_SESSION_LOG_MAX_SIZE)
+  {
+    ++ log->n_dropped;
+    g_mutex_unlock(log->mutex);
+    return;
+  }
+
+  was_empty = (log->buffer->len == 0);
+
+  va_start(args, format);
+  g_string_append_vprintf(log->buffer, format, args);
+  va_end(args);
+
+  if(was_empty || log->buffer->len >= INF_CHAT_SESSION_LOG_FLUSH_SIZE)
+    g_cond_signal(log->wakeup_cond);
+
+  g_mutex_unlock(log->mutex);
+}
+
 static void
 inf_chat_session_log_message(InfChatSession* session,
                              const InfChatBufferMessage* message)
@@ -340,7 +522,7 @@ inf_chat_session_log_message(InfChatSession* session,
 
   priv = INF_CHAT_SESSION_PRIVATE(session);
 
-  if(priv->log_file != NULL)
+  if(priv->log != NULL)
   {
     tm = localtime(&message->time);
     time_str = inf_chat_session_strdup_strftime("%c", tm, NULL);
@@ -350,16 +532,38 @@ inf_chat_session_log_message(InfChatSession* session,
     switch(message->type)
     {
     case INF_CHAT_BUFFER_MESSAGE_NORMAL:
-      fprintf(priv->log_file, "%s <%s> %s\n", time_str, name, message->text);
+      inf_chat_session_log_printf(
+        priv->log,
+        "%s <%s> %s\n",
+        time_str,
+        name,
+        message->text
+      );
       break;
     case INF_CHAT_BUFFER_MESSAGE_EMOTE:
-      fprintf(priv->log_file, "%s * %s %s\n", time_str, name, message->text);
+      inf_chat_session_log_printf(
+        priv->log,
+        "%s * %s %s\n",
+        time_str,
+        name,
+        message->text
+      );
       break;
     case INF_CHAT_BUFFER_MESSAGE_USERJOIN:
-      fprintf(priv->log_file, _("%s --- %s has joined\n"), time_str, name);
+      inf_chat_session_log_printf(
+        priv->log,
+        _("%s --- %s has joined\n"),
+        time_str,
+        name
+      );
       break;
     case INF_CHAT_BUFFER_MESSAGE_USERPART:
-      fprintf(priv->log_file, _("%s --- %s has left\n"), time_str, name);
+      inf_chat_session_log_printf(
+        priv->log,
+        _("%s --- %s has left\n"),
+        time_str,
+        name
+      );
       break;
     default:
       g_assert_not_reached();
@@ -367,7 +571,6 @@ inf_chat_session_log_message(InfChatSession* session,
     }
 
     g_free(time_str);
-    fflush(priv->log_file);
   }
 }
 
@@ -380,8 +583,8 @@ inf_chat_session_log_userlist_foreach_func(InfUser* user,
 
   if(inf_user_get_status(user) != INF_USER_UNAVAILABLE)
   {
-    fprintf(
-      data->log_file,
+    inf_chat_session_log_printf(
+      data->log,
       "%s --- [%s]\n",
       data->time_str,
       inf_user_get_name(user)
@@ -400,13 +603,13 @@ inf_chat_session_log_userlist(InfChatSession* session)
   struct tm* tm;
 
   priv = INF_CHAT_SESSION_PRIVATE(session);
-  if(priv->log_file != NULL)
+  if(priv->log != NULL)
   {
     cur_time = time(NULL);
     tm = localtime(&cur_time);
 
     data.time_str = inf_chat_session_strdup_strftime("%c", tm, NULL);
-    data.log_file = priv->log_file;
+    data.log = priv->log;
     data.users_total = 0;
 
     inf_user_table_foreach_user(
@@ -415,15 +618,14 @@ inf_chat_session_log_userlist(InfChatSession* session)
       &data
     );
 
-    fprintf(
-      data.log_file,
+    inf_chat_session_log_printf(
+      data.log,
       _("%s --- %u users total\n"),
       data.time_str,
       data.users_total
     );
 
     g_free(data.time_str);
-    fflush(data.log_file);
   }
 }
 
@@ -609,7 +811,8 @@ inf_chat_session_init(GTypeInstance* instance,
   priv = INF_CHAT_SESSION_PRIVATE(session);
 
   priv->log_filename = NULL;
-  priv->log_file = NULL;
+  priv->log = NULL;
+  priv->sync_batches = TRUE;
 }
 
 static void
@@ -801,18 +1004,28 @@ static void
 inf_chat_session_to_xml_sync(InfSession* session,
                              xmlNodePtr parent)
 {
+  InfChatSessionPrivate* priv;
   InfChatBuffer* buffer;
   const InfChatBufferMessage* message;
+  xmlNodePtr batch;
   xmlNodePtr child;
   guint i;
 
+  priv = INF_CHAT_SESSION_PRIVATE(session);
   buffer = INF_CHAT_BUFFER(inf_session_get_buffer(session));
 
   g_assert(parent_class->to_xml_sync != NULL);
   parent_class->to_xml_sync(session, parent);
 
+  /* Send the backlog in batches of messages, instead of one stanza per
+   * message, to keep the number of stanzas for the synchronization low.
+   * Peers speaking protocol version 1.0 get one stanza per message. */
+  batch = parent;
   for(i = 0; i < inf_chat_buffer_get_n_messages(buffer); ++i)
   {
+    if(priv->sync_batches && i % INF_CHAT_SESSION_SYNC_BATCH_SIZE == 0)
+      batch = xmlNewChild(parent, NULL, (const xmlChar*)"sync-messages", NULL);
+
     message = inf_chat_buffer_get_message(buffer, i);
 
     child = inf_chat_session_message_to_xml(
@@ -821,7 +1034,7 @@ inf_chat_session_to_xml_sync(InfSession* session,
       TRUE
     );
 
-    xmlAddChild(parent, child);
+    xmlAddChild(batch, child);
   }
 }
 
@@ -831,6 +1044,9 @@ inf_chat_session_process_xml_sync(InfSession* session,
                                   xmlNodePtr xml,
                                   GError** error)
 {
+  xmlNodePtr child;
+  gboolean result;
+
   if(strcmp((const char*)xml->name, "message") == 0)
   {
     return inf_chat_session_receive_message(
@@ -840,6 +1056,37 @@ inf_chat_session_process_xml_sync(InfSession* session,
       error
     );
   }
+  else if(strcmp((const char*)xml->name, "sync-messages") == 0)
+  {
+    for(child = xml->children; child != NULL; child = child->next)
+    {
+      if(child->type != XML_ELEMENT_NODE) continue;
+
+      if(strcmp((const char*)child->name, "message") != 0)
+      {
+        g_set_error(
+          error,
+          inf_chat_session_error_quark,
+          INF_CHAT_SESSION_ERROR_FAILED,
+          "Unexpected node \"%s\" in backlog",
+          (const gchar*)child->name
+        );
+
+        return FALSE;
+      }
+
+      result = inf_chat_session_receive_message(
+        INF_CHAT_SESSION(session),
+        connection,
+        child,
+        error
+      );
+
+      if(result == FALSE) return FALSE;
+    }
+
+    return TRUE;
+  }
   else
   {
     g_assert(parent_class->process_xml_sync != NULL);
@@ -876,6 +1123,24 @@ inf_chat_session_process_xml_run(InfSession* session,
   }
 }
 
+static void
+inf_chat_session_synchronization_begin(InfSession* session,
+                                       InfCommunicationGroup* group,
+                                       InfXmlConnection* connection)
+{
+  InfChatSessionPrivate* priv;
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+
+  /* The default handler creates the synchronization messages for
+   * connection via to_xml_sync. */
+  priv->sync_batches = inf_protocol_check_remote_version(connection, 1, 1);
+
+  g_assert(parent_class->synchronization_begin != NULL);
+  parent_class->synchronization_begin(session, group, connection);
+
+  priv->sync_batches = TRUE;
+}
+
 static void
 inf_chat_session_synchronization_complete(InfSession* session,
                                           InfXmlConnection* connection)
@@ -900,14 +1165,14 @@ inf_chat_session_synchronization_failed(InfSession* session,
   if(inf_session_get_status(session) == INF_SESSION_SYNCHRONIZING)
   {
     priv = INF_CHAT_SESSION_PRIVATE(session);
-    if(priv->log_file != NULL)
+    if(priv->log != NULL)
     {
       cur_time = time(NULL);
       tm = localtime(&cur_time);
       time_str = inf_chat_session_strdup_strftime("%c", tm, NULL);
 
-      fprintf(
-        priv->log_file,
+      inf_chat_session_log_printf(
+        priv->log,
         "%s --- Synchronization failed: %s\n",
         time_str,
         error->message
@@ -1041,6 +1306,8 @@ inf_chat_session_class_init(gpointer g_class,
   session_class->to_xml_sync = inf_chat_session_to_xml_sync;
   session_class->process_xml_sync = inf_chat_session_process_xml_sync;
   session_class->process_xml_run = inf_chat_session_process_xml_run;
+  session_class->synchronization_begin =
+    inf_chat_session_synchronization_begin;
   session_class->synchronization_complete =
     inf_chat_session_synchronization_complete;
   session_class->synchronization_failed =
@@ -1230,6 +1497,13 @@ inf_chat_session_new(InfCommunicationManager* manager,
  *
  * Backlog messages received upon synchronization are not logged.
  *
+ * Messages are written to the file by a background thread, in batches,
+ * so that logging does not block the main loop. If the file cannot be
+ * written as fast as messages arrive, then messages are left out of the log,
+ * and a note in the file says how many. All pending messages are written
+ * before the file is closed, i.e. when setting another log file or when the
+ * session is finalized.
+ *
  * Returns: %TRUE if the log file could be opened, %FALSE otherwise (in which
  * case @error is set).
  */
@@ -1240,6 +1514,7 @@ inf_chat_session_set_log_file(InfChatSession* session,
 {
   InfChatSessionPrivate* priv;
   FILE* new_file;
+  InfChatSessionLog* new_log;
   int save_errno;
   long offset;
   time_t cur_time;
@@ -1282,16 +1557,28 @@ inf_chat_session_set_log_file(InfChatSession* session,
 
       return FALSE;
     }
+
+    new_log = inf_chat_session_log_new(new_file, error);
+    if(new_log == NULL)
+    {
+      fclose(new_file);
+      return FALSE;
+    }
   }
 
   cur_time = time(NULL);
   tm = localtime(&cur_time);
   time_str = inf_chat_session_strdup_strftime("%c", tm, NULL);
 
-  if(priv->log_file != NULL)
+  if(priv->log != NULL)
   {
-    fprintf(priv->log_file, _("%s --- Log closed\n"), time_str);
-    fclose(priv->log_file);
+    inf_chat_session_log_printf(
+      priv->log,
+      _("%s --- Log closed\n"),
+      time_str
+    );
+
+    inf_chat_session_log_free(priv->log);
   }
 
   if(log_file != NULL)
@@ -1301,21 +1588,24 @@ inf_chat_session_set_log_file(InfChatSession* session,
       g_realloc(priv->log_filename, (len + 1) * sizeof(gchar));
     memcpy(priv->log_filename, log_file, len);
     priv->log_filename[len] = '\0';
-    priv->log_file = new_file;
+    priv->log = new_log;
 
-    if(offset > 0) fprintf(priv->log_file, "\n");
-    fprintf(priv->log_file, _("%s --- Log opened\n"), time_str);
+    if(offset > 0) inf_chat_session_log_printf(priv->log, "\n");
+
+    inf_chat_session_log_printf(
+      priv->log,
+      _("%s --- Log opened\n"),
+      time_str
+    );
 
     if(inf_session_get_status(INF_SESSION(session)) == INF_SESSION_RUNNING)
       inf_chat_session_log_userlist(session);
-    else
-      fflush(priv->log_file);
   }
   else
   {
     g_free(priv->log_filename);
     priv->log_filename = NULL;
-    priv->log_file = NULL;
+    priv->log = NULL;
   }
 
   g_free(time_str);
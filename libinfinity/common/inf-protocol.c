@@ -25,6 +25,13 @@
  * @stability: Unstable
  *
  * This section defines common protocol parameters used by libinfinity.
+ *
+ * Peers speaking the same major version of the protocol can talk to each
+ * other. Messages introduced in a newer minor version must only be sent to
+ * peers which understand them, see inf_protocol_check_remote_version().
+ * Version 1.1 added the hello message, with which a client tells the server
+ * its protocol version, batched chat backlogs, caret updates outside of the
+ * request log and request acknowledgement requests.
  **/
 
 #include <libinfinity/common/inf-protocol.h>
@@ -34,6 +41,8 @@
 #include <stdlib.h>
 #include <errno.h>
 
+static GQuark inf_protocol_remote_version_quark;
+
 /**
  * inf_protocol_get_version:
  *
@@ -45,7 +54,7 @@
 const gchar*
 inf_protocol_get_version(void)
 {
-  return "1.0";
+  return "1.1";
 }
 
 /**
@@ -149,4 +158,75 @@ inf_protocol_get_default_port(void)
   return 6523;
 }
 
+/**
+ * inf_protocol_set_remote_version:
+ * @connection: A #InfXmlConnection.
+ * @major: The major protocol version of the remote site.
+ * @minor: The minor protocol version of the remote site.
+ *
+ * Remembers which version of the protocol the remote site of @connection
+ * speaks, so that later calls to inf_protocol_check_remote_version() for
+ * @connection can tell which messages it understands. This is done by
+ * #InfcBrowser and #InfdDirectory when the versions are exchanged.
+ */
+void
+inf_protocol_set_remote_version(InfXmlConnection* connection,
+                                guint major,
+                                guint minor)
+{
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(minor <= 0xffff);
+
+  if(inf_protocol_remote_version_quark == 0)
+  {
+    inf_protocol_remote_version_quark =
+      g_quark_from_static_string("inf-protocol-remote-version");
+  }
+
+  g_object_set_qdata(
+    G_OBJECT(connection),
+    inf_protocol_remote_version_quark,
+    GUINT_TO_POINTER((major << 16) | minor)
+  );
+}
+
+/**
+ * inf_protocol_check_remote_version:
+ * @connection: A #InfXmlConnection.
+ * @major: A major protocol version.
+ * @minor: A minor protocol version.
+ *
+ * Returns whether the remote site of @connection speaks at least version
+ * @major.@minor of the protocol. If its version has not been set with
+ * inf_protocol_set_remote_version(), then it is assumed to speak version
+ * 1.0.
+ *
+ * Returns: Whether the remote site supports version @major.@minor.
+ */
+gboolean
+inf_protocol_check_remote_version(InfXmlConnection* connection,
+                                  guint major,
+                                  guint minor)
+{
+  guint version;
+
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+
+  version = 0;
+  if(inf_protocol_remote_version_quark != 0)
+  {
+    version = GPOINTER_TO_UINT(
+      g_object_get_qdata(
+        G_OBJECT(connection),
+        inf_protocol_remote_version_quark
+      )
+    );
+  }
+
+  if(version == 0)
+    version = (1 << 16) | 0;
+
+  return version >= ((major << 16) | minor);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -20,6 +20,8 @@
 #ifndef __INF_PROTOCOL_H__
 #define __INF_PROTOCOL_H__
 
+#include <libinfinity/common/inf-xml-connection.h>
+
 #include <glib-object.h>
 
 G_BEGIN_DECLS
@@ -36,6 +38,16 @@ inf_protocol_parse_version(const gchar* version,
 guint
 inf_protocol_get_default_port(void);
 
+void
+inf_protocol_set_remote_version(InfXmlConnection* connection,
+                                guint major,
+                                guint minor);
+
+gboolean
+inf_protocol_check_remote_version(InfXmlConnection* connection,
+                                  guint major,
+                                  guint minor);
+
 G_END_DECLS
 
 #endif /* __INF_PROTOCOL_H__ */
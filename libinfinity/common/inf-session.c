@@ -2545,10 +2545,15 @@ inf_session_set_user_status(InfSession* session,
       inf_user_status_to_string(status)
     );
 
+    /* Change the status first, so that whatever is sent on behalf of the
+     * user in reaction to it, such as delayed requests, reaches the other
+     * sites before the status change does. */
+    g_object_set(G_OBJECT(user), "status", status, NULL);
+
     if(priv->subscription_group != NULL)
       inf_session_send_to_subscriptions(session, xml);
-
-    g_object_set(G_OBJECT(user), "status", status, NULL);
+    else
+      xmlFreeNode(xml);
   }
 }
 
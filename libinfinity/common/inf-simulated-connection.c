@@ -32,6 +32,11 @@
  * where a #InfXmlConnection is expected. Use
  * inf_simulated_connection_connect() to connect two such connections so that
  * data sent through one is received by the other.
+ *
+ * In %INF_SIMULATED_CONNECTION_IO_CONTROLLED mode, a latency and a bandwidth
+ * can be set for the connection (see inf_simulated_connection_set_latency()
+ * and inf_simulated_connection_set_bandwidth()), so that a slow network
+ * link can be simulated.
  */
 
 typedef struct _InfSimulatedConnectionPrivate InfSimulatedConnectionPrivate;
@@ -39,11 +44,25 @@ struct _InfSimulatedConnectionPrivate {
   InfIo* io;
   InfIoDispatch* io_handler;
 
+  InfIoTimeout* io_timeout;
+
   InfSimulatedConnection* target;
   InfSimulatedConnectionMode mode;
 
-  xmlNodePtr queue;
-  xmlNodePtr queue_last_item;
+  guint latency; /* in milliseconds */
+  guint bandwidth; /* in bytes per second, or 0 for unlimited */
+  /* Time at which the last queued message has been fully transmitted */
+  GTimeVal link_free;
+
+  GQueue queue;
+};
+
+typedef struct _InfSimulatedConnectionMessage InfSimulatedConnectionMessage;
+struct _InfSimulatedConnectionMessage {
+  xmlNodePtr xml;
+  /* Time at which the message arrives at the target, only used in
+   * IO_CONTROLLED mode with latency or bandwidth set. */
+  GTimeVal arrival;
 };
 
 enum {
@@ -53,6 +72,8 @@ enum {
 
   PROP_TARGET,
   PROP_MODE,
+  PROP_LATENCY,
+  PROP_BANDWIDTH,
 
   /* From InfXmlConnection */
   PROP_STATUS,
@@ -65,11 +86,35 @@ enum {
 
 static GObjectClass* parent_class;
 
+/* Returns the difference between two GTimeVal, in milliseconds, or 0 if
+ * first is before second. */
+static guint
+inf_simulated_connection_timeval_diff(GTimeVal* first,
+                                      GTimeVal* second)
+{
+  if(first->tv_sec < second->tv_sec ||
+     (first->tv_sec == second->tv_sec && first->tv_usec <= second->tv_usec))
+  {
+    return 0;
+  }
+
+  /* Round up, so that the timeout does not elapse too early */
+  return (first->tv_sec - second->tv_sec) * 1000 +
+         (first->tv_usec - second->tv_usec + 999) / 1000;
+}
+
+static void
+inf_simulated_connection_message_free(InfSimulatedConnectionMessage* message)
+{
+  xmlFreeNode(message->xml);
+  g_slice_free(InfSimulatedConnectionMessage, message);
+}
+
 static void
 inf_simulated_connection_clear_queue(InfSimulatedConnection* connection)
 {
   InfSimulatedConnectionPrivate* priv;
-  xmlNodePtr next;
+  InfSimulatedConnectionMessage* message;
 
   priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
 
@@ -81,14 +126,40 @@ inf_simulated_connection_clear_queue(InfSimulatedConnection* connection)
     priv->io_handler = NULL;
   }
 
-  while(priv->queue != NULL)
+  if(priv->io_timeout != NULL)
   {
-    next = priv->queue->next;
-    xmlFreeNode(priv->queue);
-    priv->queue = next;
+    g_assert(priv->io != NULL);
+
+    inf_io_remove_timeout(priv->io, priv->io_timeout);
+    priv->io_timeout = NULL;
   }
 
-  priv->queue_last_item = NULL;
+  while((message = g_queue_pop_head(&priv->queue)) != NULL)
+    inf_simulated_connection_message_free(message);
+}
+
+/* Makes the target receive the first message in the queue */
+static void
+inf_simulated_connection_deliver(InfSimulatedConnection* connection)
+{
+  InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+
+  /* Remove the message from the queue before delivering, since the target
+   * might close the connection in response, which clears the queue. */
+  message = g_queue_pop_head(&priv->queue);
+  g_assert(message != NULL);
+
+  inf_xml_connection_sent(INF_XML_CONNECTION(connection), message->xml);
+
+  inf_xml_connection_received(
+    INF_XML_CONNECTION(priv->target),
+    message->xml
+  );
+
+  inf_simulated_connection_message_free(message);
 }
 
 static void
@@ -162,9 +233,18 @@ inf_simulated_connection_init(GTypeInstance* instance,
   priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
 
   priv->io = NULL;
+  priv->io_handler = NULL;
+  priv->io_timeout = NULL;
 
   priv->target = NULL;
   priv->mode = INF_SIMULATED_CONNECTION_IMMEDIATE;
+
+  priv->latency = 0;
+  priv->bandwidth = 0;
+  priv->link_free.tv_sec = 0;
+  priv->link_free.tv_usec = 0;
+
+  g_queue_init(&priv->queue);
 }
 
 static void
@@ -178,6 +258,7 @@ inf_simulated_connection_dispose(GObject* object)
 
   inf_simulated_connection_unset_target(connection);
   g_assert(priv->io_handler == NULL);
+  g_assert(priv->io_timeout == NULL);
 
   if(priv->io != NULL)
   {
@@ -217,6 +298,12 @@ inf_simulated_connection_set_property(GObject* object,
   case PROP_MODE:
     inf_simulated_connection_set_mode(sim, g_value_get_enum(value));
     break;
+  case PROP_LATENCY:
+    inf_simulated_connection_set_latency(sim, g_value_get_uint(value));
+    break;
+  case PROP_BANDWIDTH:
+    inf_simulated_connection_set_bandwidth(sim, g_value_get_uint(value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -247,6 +334,12 @@ inf_simulated_connection_get_property(GObject* object,
   case PROP_MODE:
     g_value_set_enum(value, priv->mode);
     break;
+  case PROP_LATENCY:
+    g_value_set_uint(value, priv->latency);
+    break;
+  case PROP_BANDWIDTH:
+    g_value_set_uint(value, priv->bandwidth);
+    break;
   case PROP_STATUS:
     if(priv->target != NULL)
       g_value_set_enum(value, INF_XML_CONNECTION_OPEN);
@@ -299,11 +392,106 @@ inf_simulated_connection_dispatch_func(gpointer user_data)
   inf_simulated_connection_flush(connection);
 }
 
+static void
+inf_simulated_connection_timeout_func(gpointer user_data);
+
+/* Schedules a timeout for the arrival of the first message in the queue */
+static void
+inf_simulated_connection_schedule_arrival(InfSimulatedConnection* connection)
+{
+  InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+  GTimeVal current;
+
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+  g_assert(priv->io != NULL);
+  g_assert(priv->io_timeout == NULL);
+
+  message = g_queue_peek_head(&priv->queue);
+  if(message != NULL)
+  {
+    g_get_current_time(&current);
+
+    priv->io_timeout = inf_io_add_timeout(
+      priv->io,
+      inf_simulated_connection_timeval_diff(&message->arrival, &current),
+      inf_simulated_connection_timeout_func,
+      connection,
+      NULL
+    );
+  }
+}
+
+static void
+inf_simulated_connection_timeout_func(gpointer user_data)
+{
+  InfSimulatedConnection* connection;
+  InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+  GTimeVal current;
+
+  connection = INF_SIMULATED_CONNECTION(user_data);
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+
+  priv->io_timeout = NULL;
+  g_get_current_time(&current);
+
+  /* Deliver all messages that have arrived by now. Delivering a message may
+   * cause the target to send something back, or to close the connection. */
+  g_object_ref(connection);
+
+  while(priv->target != NULL && priv->io_timeout == NULL &&
+        (message = g_queue_peek_head(&priv->queue)) != NULL &&
+        inf_simulated_connection_timeval_diff(&message->arrival, &current) == 0)
+  {
+    inf_simulated_connection_deliver(connection);
+  }
+
+  if(priv->target != NULL && priv->io_timeout == NULL)
+    inf_simulated_connection_schedule_arrival(connection);
+
+  g_object_unref(connection);
+}
+
+/* Computes the time at which xml arrives at the target when it is sent
+ * now, taking latency and bandwidth of the link into account. */
+static void
+inf_simulated_connection_get_arrival(InfSimulatedConnection* connection,
+                                     xmlNodePtr xml,
+                                     GTimeVal* arrival)
+{
+  InfSimulatedConnectionPrivate* priv;
+  xmlBufferPtr buffer;
+  guint64 bytes;
+
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+  g_get_current_time(arrival);
+
+  /* Transmission starts when the previous message has been transmitted */
+  if(inf_simulated_connection_timeval_diff(&priv->link_free, arrival) > 0)
+    *arrival = priv->link_free;
+
+  if(priv->bandwidth > 0)
+  {
+    buffer = xmlBufferCreate();
+    xmlNodeDump(buffer, NULL, xml, 0, 0);
+    bytes = xmlBufferLength(buffer);
+    xmlBufferFree(buffer);
+
+    g_time_val_add(arrival, bytes * G_USEC_PER_SEC / priv->bandwidth);
+  }
+
+  priv->link_free = *arrival;
+  g_time_val_add(arrival, (glong)priv->latency * 1000);
+}
+
 static void
 inf_simulated_connection_xml_connection_send(InfXmlConnection* connection,
                                              xmlNodePtr xml)
 {
   InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+
   priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
 
   g_assert(priv->target != NULL);
@@ -318,32 +506,48 @@ inf_simulated_connection_xml_connection_send(InfXmlConnection* connection,
   case INF_SIMULATED_CONNECTION_DELAYED:
   case INF_SIMULATED_CONNECTION_IO_CONTROLLED:
     xmlUnlinkNode(xml);
-    if(priv->queue == NULL)
-    {
-      priv->queue = xml;
-      priv->queue_last_item = xml;
-    }
-    else
-    {
-      priv->queue_last_item->next = xml;
-      priv->queue_last_item = xml;
-    }
+
+    message = g_slice_new(InfSimulatedConnectionMessage);
+    message->xml = xml;
+    message->arrival.tv_sec = 0;
+    message->arrival.tv_usec = 0;
 
     if(priv->mode == INF_SIMULATED_CONNECTION_IO_CONTROLLED)
     {
-      if(priv->io_handler == NULL)
-      {
-        g_assert(priv->io != NULL);
+      g_assert(priv->io != NULL);
 
-        priv->io_handler = inf_io_add_dispatch(
-          priv->io,
-          inf_simulated_connection_dispatch_func,
-          connection,
-          NULL
+      if(priv->latency == 0 && priv->bandwidth == 0)
+      {
+        if(priv->io_handler == NULL && priv->io_timeout == NULL)
+        {
+          priv->io_handler = inf_io_add_dispatch(
+            priv->io,
+            inf_simulated_connection_dispatch_func,
+            connection,
+            NULL
+          );
+        }
+      }
+      else
+      {
+        inf_simulated_connection_get_arrival(
+          INF_SIMULATED_CONNECTION(connection),
+          xml,
+          &message->arrival
         );
       }
     }
 
+    g_queue_push_tail(&priv->queue, message);
+
+    if(priv->mode == INF_SIMULATED_CONNECTION_IO_CONTROLLED &&
+       priv->io_handler == NULL && priv->io_timeout == NULL)
+    {
+      inf_simulated_connection_schedule_arrival(
+        INF_SIMULATED_CONNECTION(connection)
+      );
+    }
+
     break;
   default:
     g_assert_not_reached();
@@ -406,6 +610,36 @@ inf_simulated_connection_class_init(gpointer g_class,
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_LATENCY,
+    g_param_spec_uint(
+      "latency",
+      "Latency",
+      "Time in milliseconds it takes a message to arrive at the target in "
+      "IO_CONTROLLED mode",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BANDWIDTH,
+    g_param_spec_uint(
+      "bandwidth",
+      "Bandwidth",
+      "Number of bytes per second that can be transmitted in IO_CONTROLLED "
+      "mode, or 0 for unlimited bandwidth",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
   g_object_class_override_property(object_class, PROP_NETWORK, "network");
   g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
@@ -583,7 +817,9 @@ inf_simulated_connection_connect(InfSimulatedConnection* connection,
  *
  * In %INF_SIMULATED_CONNECTION_IO_CONTROLLED mode, messages are queued and
  * received by the target as soon as a dispatch handler (see
- * inf_io_add_dispatch()) installed on the main loop is called.
+ * inf_io_add_dispatch()) installed on the main loop is called. If a latency
+ * or bandwidth has been set, then they are received when the simulated
+ * transmission time has elapsed instead.
  *
  * When changing the mode from %INF_SIMULATED_CONNECTION_DELAYED or
  * %INF_SIMULATED_CONNECTION_IO_CONTROLLED to
@@ -621,7 +857,6 @@ void
 inf_simulated_connection_flush(InfSimulatedConnection* connection)
 {
   InfSimulatedConnectionPrivate* priv;
-  xmlNodePtr next;
 
   priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
   g_return_if_fail(priv->target != NULL);
@@ -635,26 +870,87 @@ inf_simulated_connection_flush(InfSimulatedConnection* connection)
       inf_io_remove_dispatch(priv->io, priv->io_handler);
       priv->io_handler = NULL;
     }
+
+    if(priv->io_timeout != NULL)
+    {
+      inf_io_remove_timeout(priv->io, priv->io_timeout);
+      priv->io_timeout = NULL;
+    }
   }
 
-  while(priv->queue != NULL)
+  while(priv->target != NULL && !g_queue_is_empty(&priv->queue))
+    inf_simulated_connection_deliver(connection);
+}
+
+/**
+ * inf_simulated_connection_set_latency:
+ * @connection: A #InfSimulatedConnection.
+ * @latency: The latency of the link, in milliseconds.
+ *
+ * Sets the time it takes for a message to arrive at the target of
+ * @connection after it has been transmitted. This only has an effect in
+ * %INF_SIMULATED_CONNECTION_IO_CONTROLLED mode, and only for messages sent
+ * after the call to this function.
+ */
+void
+inf_simulated_connection_set_latency(InfSimulatedConnection* connection,
+                                     guint latency)
+{
+  InfSimulatedConnectionPrivate* priv;
+
+  g_return_if_fail(INF_IS_SIMULATED_CONNECTION(connection));
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+
+  if(priv->latency != latency)
   {
-    inf_xml_connection_sent(
-      INF_XML_CONNECTION(connection),
-      priv->queue
-    );
+    priv->latency = latency;
+    g_object_notify(G_OBJECT(connection), "latency");
+  }
+}
 
-    inf_xml_connection_received(
-      INF_XML_CONNECTION(priv->target),
-      priv->queue
-    );
+/**
+ * inf_simulated_connection_set_bandwidth:
+ * @connection: A #InfSimulatedConnection.
+ * @bandwidth: The bandwidth of the link, in bytes per second, or 0.
+ *
+ * Sets the number of bytes per second that can be transmitted through
+ * @connection. Messages are transmitted one after the other, so a message
+ * is delayed until all messages sent before have been transmitted. If
+ * @bandwidth is 0, then transmission takes no time. This only has an effect
+ * in %INF_SIMULATED_CONNECTION_IO_CONTROLLED mode, and only for messages sent
+ * after the call to this function.
+ */
+void
+inf_simulated_connection_set_bandwidth(InfSimulatedConnection* connection,
+                                       guint bandwidth)
+{
+  InfSimulatedConnectionPrivate* priv;
+
+  g_return_if_fail(INF_IS_SIMULATED_CONNECTION(connection));
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
 
-    next = priv->queue->next;
-    xmlFreeNode(priv->queue);
-    priv->queue = next;
+  if(priv->bandwidth != bandwidth)
+  {
+    priv->bandwidth = bandwidth;
+    g_object_notify(G_OBJECT(connection), "bandwidth");
   }
+}
 
-  priv->queue_last_item = NULL;
+/**
+ * inf_simulated_connection_get_queue_length:
+ * @connection: A #InfSimulatedConnection.
+ *
+ * Returns the number of messages that have been sent through @connection
+ * but have not yet been received by the target. This is always 0 in
+ * %INF_SIMULATED_CONNECTION_IMMEDIATE mode.
+ *
+ * Returns: The number of queued messages.
+ */
+guint
+inf_simulated_connection_get_queue_length(InfSimulatedConnection* connection)
+{
+  g_return_val_if_fail(INF_IS_SIMULATED_CONNECTION(connection), 0);
+  return INF_SIMULATED_CONNECTION_PRIVATE(connection)->queue.length;
 }
 
 /* vim:set et sw=2 ts=2: */
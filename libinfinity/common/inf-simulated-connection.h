@@ -103,6 +103,17 @@ inf_simulated_connection_set_mode(InfSimulatedConnection* connection,
 void
 inf_simulated_connection_flush(InfSimulatedConnection* connection);
 
+void
+inf_simulated_connection_set_latency(InfSimulatedConnection* connection,
+                                     guint latency);
+
+void
+inf_simulated_connection_set_bandwidth(InfSimulatedConnection* connection,
+                                       guint bandwidth);
+
+guint
+inf_simulated_connection_get_queue_length(InfSimulatedConnection* connection);
+
 G_END_DECLS
 
 #endif /* __INF_SIMULATED_CONNECTION_H__ */
@@ -19,6 +19,7 @@
 
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-io.h>
+#include <libinfinity/inf-marshal.h>
 
 /* TODO: Modularize the FD handling, then add epoll support */
 
@@ -104,6 +105,30 @@ struct _InfStandaloneIoPrivate {
 
   gboolean polling;
   gboolean loop_running;
+
+  /* Time at which poll() returned in the current iteration, and statistics
+   * about the time spent processing events after that. */
+  GTimeVal wakeup;
+  guint64 n_iterations;
+  guint64 busy_usec;
+  guint64 max_busy_usec;
+
+  /* Callback tracing, see inf_standalone_io_set_tracing() */
+  gboolean tracing;
+  guint slow_threshold;
+  guint trace_window;
+  GQueue trace_events;
+  GHashTable* trace_sites;
+};
+
+/* Upper bound for the number of trace events kept, in case many callbacks
+ * run within the trace window. */
+#define INF_STANDALONE_IO_TRACE_MAX_EVENTS 100000
+
+enum {
+  SLOW_CALLBACK,
+
+  LAST_SIGNAL
 };
 
 #ifdef G_OS_WIN32
@@ -129,6 +154,7 @@ static const InfStandaloneIoEventTableEntry inf_standalone_io_event_table[] =
 #define INF_STANDALONE_IO_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_STANDALONE_IO, InfStandaloneIoPrivate))
 
 static GObjectClass* parent_class;
+static guint standalone_io_signals[LAST_SIGNAL];
 
 static guint
 inf_standalone_io_timeval_diff(GTimeVal* first,
@@ -143,11 +169,135 @@ inf_standalone_io_timeval_diff(GTimeVal* first,
          (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
 }
 
+static void
+inf_standalone_io_trace_site_free(gpointer site)
+{
+  g_slice_free(InfStandaloneIoTraceSite, site);
+}
+
+static void
+inf_standalone_io_trace_clear_events(InfStandaloneIoPrivate* priv)
+{
+  InfStandaloneIoTraceEvent* event;
+
+  while(!g_queue_is_empty(&priv->trace_events))
+  {
+    event = (InfStandaloneIoTraceEvent*)g_queue_pop_head(&priv->trace_events);
+    g_slice_free(InfStandaloneIoTraceEvent, event);
+  }
+}
+
+/* Records a callback that has just returned. Call this only with the mutex
+ * unlocked. */
+static void
+inf_standalone_io_trace_callback(InfStandaloneIo* io,
+                                 const gchar* type,
+                                 gpointer func,
+                                 const GTimeVal* begin)
+{
+  InfStandaloneIoPrivate* priv;
+  InfStandaloneIoTraceEvent event;
+  InfStandaloneIoTraceEvent* stored;
+  InfStandaloneIoTraceSite* site;
+  GTimeVal end;
+  GTimeVal limit;
+  gint64 duration;
+  guint bucket;
+  gboolean slow;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  g_get_current_time(&end);
+  duration = (gint64)(end.tv_sec - begin->tv_sec) * G_USEC_PER_SEC +
+             (end.tv_usec - begin->tv_usec);
+
+  /* The system clock might have been adjusted */
+  if(duration < 0) duration = 0;
+
+  event.type = type;
+  event.func = func;
+  event.begin = *begin;
+  event.duration = duration;
+
+  slow = FALSE;
+  g_mutex_lock(priv->mutex);
+
+  /* The callback might have disabled tracing */
+  if(priv->tracing)
+  {
+    site = g_hash_table_lookup(priv->trace_sites, func);
+    if(site == NULL)
+    {
+      site = g_slice_new0(InfStandaloneIoTraceSite);
+      site->type = type;
+      site->func = func;
+      g_hash_table_insert(priv->trace_sites, func, site);
+    }
+
+    ++ site->n_calls;
+    site->total_usec += event.duration;
+    if(event.duration > site->max_usec)
+      site->max_usec = event.duration;
+
+    bucket = 0;
+    while(bucket < INF_STANDALONE_IO_TRACE_BUCKETS - 1 &&
+          event.duration > ((guint64)2 << bucket))
+    {
+      ++ bucket;
+    }
+
+    ++ site->histogram[bucket];
+
+    if(priv->trace_window > 0)
+    {
+      stored = g_slice_new(InfStandaloneIoTraceEvent);
+      *stored = event;
+      g_queue_push_tail(&priv->trace_events, stored);
+
+      limit = end;
+      g_time_val_add(&limit, -(glong)priv->trace_window * 1000);
+
+      /* Drop events that went out of the trace window */
+      while((stored = g_queue_peek_head(&priv->trace_events)) != NULL)
+      {
+        if(priv->trace_events.length <= INF_STANDALONE_IO_TRACE_MAX_EVENTS &&
+           (stored->begin.tv_sec > limit.tv_sec ||
+            (stored->begin.tv_sec == limit.tv_sec &&
+             stored->begin.tv_usec >= limit.tv_usec)))
+        {
+          break;
+        }
+
+        g_queue_pop_head(&priv->trace_events);
+        g_slice_free(InfStandaloneIoTraceEvent, stored);
+      }
+    }
+
+    if(priv->slow_threshold > 0 &&
+       event.duration >= (guint64)priv->slow_threshold * 1000)
+    {
+      slow = TRUE;
+    }
+  }
+
+  g_mutex_unlock(priv->mutex);
+
+  if(slow)
+  {
+    g_signal_emit(
+      G_OBJECT(io),
+      standalone_io_signals[SLOW_CALLBACK],
+      0,
+      &event
+    );
+  }
+}
+
 /* Run one iteration of the main loop. Call this only with the mutex locked
  * and a local reference added to io. */
 static void
-inf_standalone_io_iteration_impl(InfStandaloneIo* io,
-                                 InfStandaloneIoPollTimeout timeout)
+inf_standalone_io_iteration_run(InfStandaloneIo* io,
+                                InfStandaloneIoPollTimeout timeout)
 {
   InfStandaloneIoPrivate* priv;
   InfIoEvent events;
@@ -160,6 +310,8 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   InfIoTimeout* cur_timeout;
   InfIoDispatch* dispatch;
   guint elapsed;
+  gboolean tracing;
+  GTimeVal begin;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
@@ -212,6 +364,7 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
 
   g_mutex_lock(priv->mutex);
   priv->polling = FALSE;
+  g_get_current_time(&priv->wakeup);
 
 #ifdef G_OS_WIN32
   switch(result)
@@ -247,9 +400,20 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
       if(elapsed >= cur_timeout->msecs)
       {
         priv->timeouts = g_list_delete_link(priv->timeouts, item);
+        tracing = priv->tracing;
         g_mutex_unlock(priv->mutex);
 
+        if(tracing) g_get_current_time(&begin);
         cur_timeout->func(cur_timeout->user_data);
+        if(tracing)
+        {
+          inf_standalone_io_trace_callback(
+            io,
+            "timeout",
+            (gpointer)cur_timeout->func,
+            &begin
+          );
+        }
         if(cur_timeout->notify)
           cur_timeout->notify(cur_timeout->user_data);
         g_slice_free(InfIoTimeout, cur_timeout);
@@ -299,9 +463,20 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
       /* protect from removing the watch object via
        * inf_io_remove_watch() when running the callback. */
       watch->executing = TRUE;
+      tracing = priv->tracing;
       g_mutex_unlock(priv->mutex);
 
+      if(tracing) g_get_current_time(&begin);
       watch->func(watch->socket, events, watch->user_data);
+      if(tracing)
+      {
+        inf_standalone_io_trace_callback(
+          io,
+          "watch",
+          (gpointer)watch->func,
+          &begin
+        );
+      }
 
       g_mutex_lock(priv->mutex);
       watch->executing = FALSE;
@@ -383,9 +558,20 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
             /* protect from removing the watch object via
              * inf_io_remove_watch() when running the callback. */
             watch->executing = TRUE;
+            tracing = priv->tracing;
             g_mutex_unlock(priv->mutex);
 
+            if(tracing) g_get_current_time(&begin);
             watch->func(watch->socket, events, watch->user_data);
+            if(tracing)
+            {
+              inf_standalone_io_trace_callback(
+                io,
+                "watch",
+                (gpointer)watch->func,
+                &begin
+              );
+            }
 
             g_mutex_lock(priv->mutex);
             watch->executing = FALSE;
@@ -410,9 +596,20 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   {
     dispatch = (InfIoDispatch*)priv->dispatchs->data;
     priv->dispatchs = g_list_delete_link(priv->dispatchs, priv->dispatchs);
+    tracing = priv->tracing;
     g_mutex_unlock(priv->mutex);
 
+    if(tracing) g_get_current_time(&begin);
     dispatch->func(dispatch->user_data);
+    if(tracing)
+    {
+      inf_standalone_io_trace_callback(
+        io,
+        "dispatch",
+        (gpointer)dispatch->func,
+        &begin
+      );
+    }
     if(dispatch->notify)
       dispatch->notify(dispatch->user_data);
     g_slice_free(InfIoDispatch, dispatch);
@@ -421,6 +618,33 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   }
 }
 
+/* Runs one iteration of the main loop and records how long it took to
+ * process the events that woke us up. Call this only with the mutex locked
+ * and a local reference added to io. */
+static void
+inf_standalone_io_iteration_impl(InfStandaloneIo* io,
+                                 InfStandaloneIoPollTimeout timeout)
+{
+  InfStandaloneIoPrivate* priv;
+  GTimeVal current;
+  gint64 busy;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  inf_standalone_io_iteration_run(io, timeout);
+
+  g_get_current_time(&current);
+  busy = (gint64)(current.tv_sec - priv->wakeup.tv_sec) * G_USEC_PER_SEC +
+         (current.tv_usec - priv->wakeup.tv_usec);
+
+  /* The system clock might have been adjusted */
+  if(busy < 0) busy = 0;
+
+  ++ priv->n_iterations;
+  priv->busy_usec += busy;
+  if((guint64)busy > priv->max_busy_usec)
+    priv->max_busy_usec = busy;
+}
+
 static void
 inf_standalone_io_init(GTypeInstance* instance,
                        gpointer g_class)
@@ -475,6 +699,22 @@ inf_standalone_io_init(GTypeInstance* instance,
 
   priv->polling = FALSE;
   priv->loop_running = FALSE;
+
+  priv->n_iterations = 0;
+  priv->busy_usec = 0;
+  priv->max_busy_usec = 0;
+
+  priv->tracing = FALSE;
+  priv->slow_threshold = 0;
+  priv->trace_window = 0;
+  g_queue_init(&priv->trace_events);
+
+  priv->trace_sites = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    inf_standalone_io_trace_site_free
+  );
 }
 
 static void
@@ -552,6 +792,9 @@ inf_standalone_io_finalize(GObject* object)
   g_list_free(priv->timeouts);
   g_list_free(priv->dispatchs);
 
+  inf_standalone_io_trace_clear_events(priv);
+  g_hash_table_destroy(priv->trace_sites);
+
 #ifndef G_OS_WIN32
   if(close(priv->wakeup_pipe[0]) == -1)
   {
@@ -1037,12 +1280,37 @@ inf_standalone_io_class_init(gpointer g_class,
                              gpointer class_data)
 {
   GObjectClass* object_class;
+  InfStandaloneIoClass* io_class;
+
   object_class = G_OBJECT_CLASS(g_class);
+  io_class = INF_STANDALONE_IO_CLASS(g_class);
 
   parent_class = G_OBJECT_CLASS(g_type_class_peek_parent(g_class));
   g_type_class_add_private(g_class, sizeof(InfStandaloneIoPrivate));
 
   object_class->finalize = inf_standalone_io_finalize;
+  io_class->slow_callback = NULL;
+
+  /**
+   * InfStandaloneIo::slow-callback:
+   * @io: The #InfStandaloneIo emitting the signal.
+   * @event: A #InfStandaloneIoTraceEvent describing the callback.
+   *
+   * This signal is emitted after a watch, timeout or dispatch callback took
+   * longer than the threshold set with inf_standalone_io_set_tracing(). It
+   * can be used to log which callbacks block the main loop.
+   */
+  standalone_io_signals[SLOW_CALLBACK] = g_signal_new(
+    "slow-callback",
+    G_OBJECT_CLASS_TYPE(object_class),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET(InfStandaloneIoClass, slow_callback),
+    NULL, NULL,
+    inf_marshal_VOID__POINTER,
+    G_TYPE_NONE,
+    1,
+    G_TYPE_POINTER
+  );
 }
 
 static void
@@ -1263,4 +1531,188 @@ inf_standalone_io_loop_running(InfStandaloneIo* io)
   return running;
 }
 
+/**
+ * inf_standalone_io_get_statistics:
+ * @io: A #InfStandaloneIo.
+ * @statistics: Location to store the statistics.
+ *
+ * Fills @statistics with information about the main loop iterations @io
+ * has run so far. The time spent waiting in poll() is not counted as busy
+ * time, so @statistics describes how long events had to wait for the
+ * main loop while it was processing other events.
+ **/
+void
+inf_standalone_io_get_statistics(InfStandaloneIo* io,
+                                 InfStandaloneIoStatistics* statistics)
+{
+  InfStandaloneIoPrivate* priv;
+
+  g_return_if_fail(INF_IS_STANDALONE_IO(io));
+  g_return_if_fail(statistics != NULL);
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  g_mutex_lock(priv->mutex);
+  statistics->n_iterations = priv->n_iterations;
+  statistics->busy_usec = priv->busy_usec;
+  statistics->max_busy_usec = priv->max_busy_usec;
+  g_mutex_unlock(priv->mutex);
+}
+
+/**
+ * inf_standalone_io_set_tracing:
+ * @io: A #InfStandaloneIo.
+ * @slow_threshold: Time in milliseconds after which a callback is considered
+ * slow, or 0.
+ * @window: Time in milliseconds for which to keep trace events, or 0.
+ *
+ * Enables or disables timing of the watch, timeout and dispatch callbacks
+ * run by @io. If @slow_threshold is nonzero, then the
+ * #InfStandaloneIo::slow-callback signal is emitted for every callback that
+ * takes at least @slow_threshold milliseconds. If @window is nonzero, then
+ * all callbacks run within the last @window milliseconds are kept, so that
+ * they can be written to a file with inf_standalone_io_write_trace().
+ *
+ * While either is nonzero, @io also keeps a histogram of the callback
+ * durations for every callback function, see
+ * inf_standalone_io_foreach_trace_site(). If both are zero, tracing is
+ * disabled and all recorded data is discarded. Tracing is disabled by
+ * default, in which case it does not cost any time in the main loop.
+ **/
+void
+inf_standalone_io_set_tracing(InfStandaloneIo* io,
+                              guint slow_threshold,
+                              guint window)
+{
+  InfStandaloneIoPrivate* priv;
+
+  g_return_if_fail(INF_IS_STANDALONE_IO(io));
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  g_mutex_lock(priv->mutex);
+
+  priv->slow_threshold = slow_threshold;
+  priv->trace_window = window;
+
+  if(window == 0)
+    inf_standalone_io_trace_clear_events(priv);
+
+  if(slow_threshold == 0 && window == 0)
+  {
+    priv->tracing = FALSE;
+    g_hash_table_remove_all(priv->trace_sites);
+  }
+  else
+  {
+    priv->tracing = TRUE;
+  }
+
+  g_mutex_unlock(priv->mutex);
+}
+
+/**
+ * inf_standalone_io_foreach_trace_site:
+ * @io: A #InfStandaloneIo.
+ * @func: The function to call for each callback function.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Calls @func for every callback function that @io has run while tracing
+ * was enabled, with statistics about how long it took. The statistics are
+ * copied beforehand, so @func may use @io.
+ **/
+void
+inf_standalone_io_foreach_trace_site(InfStandaloneIo* io,
+                                     InfStandaloneIoTraceSiteFunc func,
+                                     gpointer user_data)
+{
+  InfStandaloneIoPrivate* priv;
+  GHashTableIter iter;
+  gpointer value;
+  InfStandaloneIoTraceSite* sites;
+  guint n_sites;
+  guint i;
+
+  g_return_if_fail(INF_IS_STANDALONE_IO(io));
+  g_return_if_fail(func != NULL);
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  g_mutex_lock(priv->mutex);
+
+  n_sites = g_hash_table_size(priv->trace_sites);
+  sites = g_new(InfStandaloneIoTraceSite, n_sites);
+
+  i = 0;
+  g_hash_table_iter_init(&iter, priv->trace_sites);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+    sites[i++] = *(InfStandaloneIoTraceSite*)value;
+
+  g_mutex_unlock(priv->mutex);
+
+  for(i = 0; i < n_sites; ++ i)
+    func(&sites[i], user_data);
+
+  g_free(sites);
+}
+
+/**
+ * inf_standalone_io_write_trace:
+ * @io: A #InfStandaloneIo.
+ * @filename: The file to write the trace to.
+ * @error: Location to store error information, if any.
+ *
+ * Writes the callbacks run by @io within the trace window set with
+ * inf_standalone_io_set_tracing() to @filename, in the JSON trace event
+ * format understood by chrome://tracing and Perfetto. Each callback is
+ * named after the address of the callback function, which can be resolved
+ * to a symbol name with a debugger or addr2line.
+ *
+ * Returns: %TRUE on success, or %FALSE if the file could not be written, in
+ * which case @error is set.
+ **/
+gboolean
+inf_standalone_io_write_trace(InfStandaloneIo* io,
+                              const gchar* filename,
+                              GError** error)
+{
+  InfStandaloneIoPrivate* priv;
+  InfStandaloneIoTraceEvent* event;
+  GString* str;
+  GList* item;
+  gboolean result;
+
+  g_return_val_if_fail(INF_IS_STANDALONE_IO(io), FALSE);
+  g_return_val_if_fail(filename != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  str = g_string_new("{\"traceEvents\":[");
+
+  g_mutex_lock(priv->mutex);
+
+  for(item = priv->trace_events.head; item != NULL; item = item->next)
+  {
+    event = (InfStandaloneIoTraceEvent*)item->data;
+
+    g_string_append_printf(
+      str,
+      "%s\n{\"name\":\"%p\",\"cat\":\"%s\",\"ph\":\"X\","
+      "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GUINT64_FORMAT ","
+      "\"pid\":1,\"tid\":1}",
+      item == priv->trace_events.head ? "" : ",",
+      event->func,
+      event->type,
+      (gint64)event->begin.tv_sec * G_USEC_PER_SEC + event->begin.tv_usec,
+      event->duration
+    );
+  }
+
+  g_mutex_unlock(priv->mutex);
+
+  g_string_append(str, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  result = g_file_set_contents(filename, str->str, str->len, error);
+  g_string_free(str, TRUE);
+
+  return result;
+}
+
 /* vim:set et sw=2 ts=2: */
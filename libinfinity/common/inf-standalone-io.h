@@ -34,14 +34,106 @@ G_BEGIN_DECLS
 typedef struct _InfStandaloneIo InfStandaloneIo;
 typedef struct _InfStandaloneIoClass InfStandaloneIoClass;
 
+/**
+ * INF_STANDALONE_IO_TRACE_BUCKETS:
+ *
+ * The number of buckets in the histogram of a #InfStandaloneIoTraceSite.
+ * Bucket i counts callbacks which took at most 2^(i+1) microseconds, but
+ * more than 2^i microseconds. The last bucket counts all longer callbacks,
+ * and the first one also counts callbacks that took no measurable time.
+ */
+#define INF_STANDALONE_IO_TRACE_BUCKETS 24
+
+/**
+ * InfStandaloneIoTraceEvent:
+ * @type: The kind of callback, either "watch", "timeout" or "dispatch".
+ * @func: The callback function that was run.
+ * @begin: The time at which the callback was started.
+ * @duration: The time the callback took, in microseconds.
+ *
+ * Describes a single callback run by a #InfStandaloneIo while tracing is
+ * enabled, see inf_standalone_io_set_tracing().
+ */
+typedef struct _InfStandaloneIoTraceEvent InfStandaloneIoTraceEvent;
+struct _InfStandaloneIoTraceEvent {
+  const gchar* type;
+  gpointer func;
+  GTimeVal begin;
+  guint64 duration;
+};
+
+/**
+ * InfStandaloneIoTraceSite:
+ * @type: The kind of callback, either "watch", "timeout" or "dispatch".
+ * @func: The callback function.
+ * @n_calls: How often the callback has been run.
+ * @total_usec: The total time spent in the callback, in microseconds.
+ * @max_usec: The longest time a single run of the callback took.
+ * @histogram: The distribution of the time the callback took, see
+ * %INF_STANDALONE_IO_TRACE_BUCKETS.
+ *
+ * Statistics about all runs of one callback function while tracing is
+ * enabled, see inf_standalone_io_foreach_trace_site().
+ */
+typedef struct _InfStandaloneIoTraceSite InfStandaloneIoTraceSite;
+struct _InfStandaloneIoTraceSite {
+  const gchar* type;
+  gpointer func;
+  guint64 n_calls;
+  guint64 total_usec;
+  guint64 max_usec;
+  guint64 histogram[INF_STANDALONE_IO_TRACE_BUCKETS];
+};
+
+/**
+ * InfStandaloneIoTraceSiteFunc:
+ * @site: The #InfStandaloneIoTraceSite for the current iteration.
+ * @user_data: The user_data passed to
+ * inf_standalone_io_foreach_trace_site().
+ *
+ * This is the prototype of the callback function passed to
+ * inf_standalone_io_foreach_trace_site().
+ */
+typedef void(*InfStandaloneIoTraceSiteFunc)(const InfStandaloneIoTraceSite*,
+                                            gpointer);
+
+/**
+ * InfStandaloneIoClass:
+ * @slow_callback: Default signal handler for the
+ * #InfStandaloneIo::slow-callback signal.
+ *
+ * This structure contains default signal handlers for #InfStandaloneIo.
+ */
 struct _InfStandaloneIoClass {
+  /*< private >*/
   GObjectClass parent_class;
+
+  /*< public >*/
+  void(*slow_callback)(InfStandaloneIo* io,
+                       const InfStandaloneIoTraceEvent* event);
 };
 
 struct _InfStandaloneIo {
   GObject parent;
 };
 
+/**
+ * InfStandaloneIoStatistics:
+ * @n_iterations: The number of main loop iterations run.
+ * @busy_usec: The total time, in microseconds, spent processing events.
+ * @max_busy_usec: The longest time, in microseconds, a single iteration
+ * spent processing events.
+ *
+ * Information about the main loop iterations run by a #InfStandaloneIo, see
+ * inf_standalone_io_get_statistics().
+ */
+typedef struct _InfStandaloneIoStatistics InfStandaloneIoStatistics;
+struct _InfStandaloneIoStatistics {
+  guint64 n_iterations;
+  guint64 busy_usec;
+  guint64 max_busy_usec;
+};
+
 GType
 inf_standalone_io_get_type(void) G_GNUC_CONST;
 
@@ -64,6 +156,25 @@ inf_standalone_io_loop_quit(InfStandaloneIo* io);
 gboolean
 inf_standalone_io_loop_running(InfStandaloneIo* io);
 
+void
+inf_standalone_io_get_statistics(InfStandaloneIo* io,
+                                 InfStandaloneIoStatistics* statistics);
+
+void
+inf_standalone_io_set_tracing(InfStandaloneIo* io,
+                              guint slow_threshold,
+                              guint window);
+
+void
+inf_standalone_io_foreach_trace_site(InfStandaloneIo* io,
+                                     InfStandaloneIoTraceSiteFunc func,
+                                     gpointer user_data);
+
+gboolean
+inf_standalone_io_write_trace(InfStandaloneIo* io,
+                              const gchar* filename,
+                              GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_STANDALONE_IO_H__ */
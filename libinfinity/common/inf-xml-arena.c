@@ -0,0 +1,379 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* InfXmlArena builds libxml2 trees whose nodes, attributes and strings are
+ * all carved out of a few large memory blocks instead of being allocated
+ * one by one. The whole tree is released at once with inf_xml_arena_reset(),
+ * and the blocks are reused for the next tree. This is used by
+ * InfXmppConnection to build incoming stanzas, which are only needed until
+ * they have been dispatched.
+ *
+ * The resulting trees can be read with the usual libxml2 API, and copied
+ * with xmlCopyNode(), but must not be modified, and no node must be freed
+ * with xmlFreeNode(). */
+
+#include <libinfinity/common/inf-xml-arena.h>
+
+#include <libxml/parserInternals.h> /* xmlStringText */
+#include <libxml/xmlmemory.h>
+
+#include <string.h>
+
+/* Size of a regular block. Larger blocks are allocated for allocations that
+ * do not fit into a regular block. */
+#define INF_XML_ARENA_BLOCK_SIZE 8192
+/* When the arena is reset, blocks beyond this total size are freed, so that
+ * a single large stanza does not keep its memory allocated forever. */
+#define INF_XML_ARENA_RETAIN_SIZE (8 * INF_XML_ARENA_BLOCK_SIZE)
+/* Initial capacity of a text node's content */
+#define INF_XML_ARENA_TEXT_SIZE 64
+
+#define INF_XML_ARENA_ALIGN(size) \
+  (((size) + 2 * sizeof(gpointer) - 1) & ~(2 * sizeof(gpointer) - 1))
+
+typedef struct _InfXmlArenaBlock InfXmlArenaBlock;
+struct _InfXmlArenaBlock {
+  InfXmlArenaBlock* next;
+  gsize size;
+};
+
+struct _InfXmlArena {
+  InfXmlArenaBlock* first;
+  InfXmlArenaBlock* current;
+  gsize pos;
+
+  /* The text node that was last created, so that consecutive calls to
+   * inf_xml_arena_add_content() can append to it. */
+  xmlNodePtr text;
+  gsize text_len;
+  gsize text_capacity;
+};
+
+static const gsize INF_XML_ARENA_HEADER_SIZE =
+  INF_XML_ARENA_ALIGN(sizeof(InfXmlArenaBlock));
+
+static InfXmlArenaBlock*
+inf_xml_arena_block_new(gsize size)
+{
+  InfXmlArenaBlock* block;
+
+  /* Allocate with libxml2's allocator, as the memory holds libxml2 trees */
+  block = xmlMalloc(INF_XML_ARENA_HEADER_SIZE + size);
+  if(block == NULL) g_error("Failed to allocate XML arena block");
+
+  block->next = NULL;
+  block->size = size;
+  return block;
+}
+
+static gpointer
+inf_xml_arena_alloc(InfXmlArena* arena,
+                    gsize size)
+{
+  InfXmlArenaBlock* block;
+  gpointer result;
+
+  size = INF_XML_ARENA_ALIGN(size);
+
+  if(arena->pos + size > arena->current->size)
+  {
+    block = arena->current->next;
+    if(block == NULL || block->size < size)
+    {
+      block = inf_xml_arena_block_new(MAX(size, INF_XML_ARENA_BLOCK_SIZE));
+      block->next = arena->current->next;
+      arena->current->next = block;
+    }
+
+    arena->current = block;
+    arena->pos = 0;
+  }
+
+  result = (guchar*)arena->current + INF_XML_ARENA_HEADER_SIZE + arena->pos;
+  arena->pos += size;
+  return result;
+}
+
+static gpointer
+inf_xml_arena_alloc0(InfXmlArena* arena,
+                     gsize size)
+{
+  gpointer result;
+  result = inf_xml_arena_alloc(arena, size);
+  memset(result, 0, size);
+  return result;
+}
+
+static xmlChar*
+inf_xml_arena_strdup(InfXmlArena* arena,
+                     const xmlChar* str)
+{
+  xmlChar* result;
+  gsize len;
+
+  len = strlen((const char*)str);
+  result = inf_xml_arena_alloc(arena, len + 1);
+  memcpy(result, str, len + 1);
+  return result;
+}
+
+static xmlNodePtr
+inf_xml_arena_new_text(InfXmlArena* arena,
+                       const xmlChar* content,
+                       gsize len,
+                       gsize capacity)
+{
+  xmlNodePtr text;
+
+  text = inf_xml_arena_alloc0(arena, sizeof(xmlNode));
+  text->type = XML_TEXT_NODE;
+  /* Using the same name pointer as libxml2 makes xmlCopyNode() and friends
+   * recognize the node as a regular text node. */
+  text->name = xmlStringText;
+  text->content = inf_xml_arena_alloc(arena, capacity);
+  memcpy(text->content, content, len);
+  text->content[len] = '\0';
+
+  return text;
+}
+
+/**
+ * inf_xml_arena_new:
+ *
+ * Creates a new #InfXmlArena.
+ *
+ * Returns: A new #InfXmlArena. Free with inf_xml_arena_free().
+ */
+InfXmlArena*
+inf_xml_arena_new(void)
+{
+  InfXmlArena* arena;
+  arena = g_slice_new(InfXmlArena);
+
+  arena->first = inf_xml_arena_block_new(INF_XML_ARENA_BLOCK_SIZE);
+  arena->current = arena->first;
+  arena->pos = 0;
+
+  arena->text = NULL;
+  arena->text_len = 0;
+  arena->text_capacity = 0;
+
+  return arena;
+}
+
+/**
+ * inf_xml_arena_free:
+ * @arena: A #InfXmlArena.
+ *
+ * Frees @arena, including all trees built into it.
+ */
+void
+inf_xml_arena_free(InfXmlArena* arena)
+{
+  InfXmlArenaBlock* block;
+  InfXmlArenaBlock* next;
+
+  for(block = arena->first; block != NULL; block = next)
+  {
+    next = block->next;
+    xmlFree(block);
+  }
+
+  g_slice_free(InfXmlArena, arena);
+}
+
+/**
+ * inf_xml_arena_reset:
+ * @arena: A #InfXmlArena.
+ *
+ * Releases all trees built into @arena at once. The memory is kept for
+ * reuse, up to a limit.
+ */
+void
+inf_xml_arena_reset(InfXmlArena* arena)
+{
+  InfXmlArenaBlock* block;
+  InfXmlArenaBlock* next;
+  gsize retained;
+
+  retained = arena->first->size;
+  block = arena->first;
+
+  while(block->next != NULL)
+  {
+    next = block->next;
+    if(retained + next->size > INF_XML_ARENA_RETAIN_SIZE)
+    {
+      block->next = next->next;
+      xmlFree(next);
+    }
+    else
+    {
+      retained += next->size;
+      block = next;
+    }
+  }
+
+  arena->current = arena->first;
+  arena->pos = 0;
+  arena->text = NULL;
+}
+
+/**
+ * inf_xml_arena_new_node:
+ * @arena: A #InfXmlArena.
+ * @parent: The parent node of the new node, or %NULL.
+ * @name: The name of the new node.
+ * @attrs: A %NULL-terminated array of alternating attribute names and
+ * values, as passed to a SAX startElement handler, or %NULL.
+ *
+ * Creates a new element node with the given attributes in @arena, and
+ * appends it to @parent's children if @parent is not %NULL.
+ *
+ * Returns: The new node. It is freed when @arena is reset.
+ */
+xmlNodePtr
+inf_xml_arena_new_node(InfXmlArena* arena,
+                       xmlNodePtr parent,
+                       const xmlChar* name,
+                       const xmlChar** attrs)
+{
+  xmlNodePtr node;
+  xmlAttrPtr attr;
+  xmlAttrPtr prev;
+  xmlNodePtr value;
+  const xmlChar** cur;
+
+  node = inf_xml_arena_alloc0(arena, sizeof(xmlNode));
+  node->type = XML_ELEMENT_NODE;
+  node->name = inf_xml_arena_strdup(arena, name);
+
+  if(attrs != NULL)
+  {
+    prev = NULL;
+    for(cur = attrs; *cur != NULL; cur += 2)
+    {
+      attr = inf_xml_arena_alloc0(arena, sizeof(xmlAttr));
+      attr->type = XML_ATTRIBUTE_NODE;
+      attr->name = inf_xml_arena_strdup(arena, cur[0]);
+      attr->parent = node;
+
+      if(cur[1] != NULL && *cur[1] != '\0')
+      {
+        value = inf_xml_arena_new_text(
+          arena,
+          cur[1],
+          strlen((const char*)cur[1]),
+          strlen((const char*)cur[1]) + 1
+        );
+
+        value->parent = (xmlNodePtr)attr;
+        attr->children = value;
+        attr->last = value;
+      }
+
+      if(prev == NULL)
+        node->properties = attr;
+      else
+        prev->next = attr;
+
+      attr->prev = prev;
+      prev = attr;
+    }
+  }
+
+  if(parent != NULL)
+  {
+    node->parent = parent;
+    node->prev = parent->last;
+
+    if(parent->last == NULL)
+      parent->children = node;
+    else
+      parent->last->next = node;
+
+    parent->last = node;
+  }
+
+  return node;
+}
+
+/**
+ * inf_xml_arena_add_content:
+ * @arena: A #InfXmlArena.
+ * @node: A node created with inf_xml_arena_new_node().
+ * @content: The text to add.
+ * @len: The length of @content, in bytes.
+ *
+ * Appends @content to the text content of @node. Consecutive calls for the
+ * same node extend the same text node, as xmlNodeAddContentLen() does.
+ */
+void
+inf_xml_arena_add_content(InfXmlArena* arena,
+                          xmlNodePtr node,
+                          const xmlChar* content,
+                          int len)
+{
+  xmlNodePtr text;
+  xmlChar* new_content;
+  gsize capacity;
+
+  if(len <= 0) return;
+
+  if(node->last != NULL && node->last == arena->text)
+  {
+    text = arena->text;
+    if(arena->text_len + len + 1 > arena->text_capacity)
+    {
+      /* Grow geometrically, so that long texts delivered in many chunks
+       * are copied only a few times. */
+      capacity = MAX(2 * arena->text_capacity, arena->text_len + len + 1);
+      new_content = inf_xml_arena_alloc(arena, capacity);
+      memcpy(new_content, text->content, arena->text_len);
+
+      text->content = new_content;
+      arena->text_capacity = capacity;
+    }
+
+    memcpy(text->content + arena->text_len, content, len);
+    arena->text_len += len;
+    text->content[arena->text_len] = '\0';
+  }
+  else
+  {
+    capacity = MAX(INF_XML_ARENA_TEXT_SIZE, (gsize)len + 1);
+    text = inf_xml_arena_new_text(arena, content, len, capacity);
+
+    text->parent = node;
+    text->prev = node->last;
+
+    if(node->last == NULL)
+      node->children = text;
+    else
+      node->last->next = text;
+
+    node->last = text;
+
+    arena->text = text;
+    arena->text_len = len;
+    arena->text_capacity = capacity;
+  }
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,56 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_XML_ARENA_H__
+#define __INF_XML_ARENA_H__
+
+#include <libxml/tree.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _InfXmlArena InfXmlArena;
+
+InfXmlArena*
+inf_xml_arena_new(void);
+
+void
+inf_xml_arena_free(InfXmlArena* arena);
+
+void
+inf_xml_arena_reset(InfXmlArena* arena);
+
+xmlNodePtr
+inf_xml_arena_new_node(InfXmlArena* arena,
+                       xmlNodePtr parent,
+                       const xmlChar* name,
+                       const xmlChar** attrs);
+
+void
+inf_xml_arena_add_content(InfXmlArena* arena,
+                          xmlNodePtr node,
+                          const xmlChar* content,
+                          int len);
+
+G_END_DECLS
+
+#endif /* __INF_XML_ARENA_H__ */
+
+/* vim:set et sw=2 ts=2: */
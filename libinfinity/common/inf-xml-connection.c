@@ -58,6 +58,10 @@ inf_xml_connection_base_init(gpointer g_class)
      * InfXmlConnection::received:
      * @connection: The #InfXmlConnection through which @node has been received
      * @node: An #xmlNodePtr refering to the XML node that has been received
+     *
+     * This signal is emitted whenever a message has been received. @node
+     * is owned by @connection and only valid during the signal emission.
+     * It must not be modified; use xmlCopyNode() to keep it around.
      */
     connection_signals[RECEIVED] = g_signal_new(
       "received",
@@ -347,7 +347,8 @@ inf_xml_util_add_child_text(xmlNodePtr xml,
  * Reads a node's child text. If there are &lt;uchar /&gt; child elements, as
  * added by inf_xml_util_add_child_text() this function will convert them
  * back to character codes. There should not be any other child elements in
- * @xml.
+ * @xml. It is an error if a &lt;uchar /&gt; element does not contain a valid
+ * Unicode character, so the returned text is always valid UTF-8.
  *
  * Returns: The node's child text, or %NULL on error. Free with g_free() when
  * no longer needed.
@@ -359,11 +360,29 @@ inf_xml_util_get_child_text(xmlNodePtr xml,
                             GError** error)
 {
   xmlNodePtr child;
-  /* Every keypress will have to be get_child_text'ed, so
-   * we assume that most child texts are very short. */
-  GString* result = g_string_sized_new(16);
+  GString* result;
   guint num_codepoint;
-  gsize char_count = 0;
+  gsize char_count;
+  gsize len;
+  gchar* text;
+
+  /* Every keypress will have to be get_child_text'ed, and usually the
+   * text consists of a single text node, so copy it directly in that
+   * case instead of going through a GString. */
+  child = xml->children;
+  if(child != NULL && child->type == XML_TEXT_NODE && child->next == NULL)
+  {
+    len = strlen((const gchar*)child->content);
+    text = g_memdup(child->content, len + 1);
+
+    if(chars) *chars = g_utf8_strlen(text, len);
+    if(bytes) *bytes = len;
+    return text;
+  }
+
+  /* We assume that most child texts are very short. */
+  result = g_string_sized_new(16);
+  char_count = 0;
   for(child = xml->children; child; child = child->next)
   {
     switch(child->type)
@@ -386,6 +405,23 @@ inf_xml_util_get_child_text(xmlNodePtr xml,
         g_string_free(result, TRUE);
         return NULL;
       }
+
+      /* Surrogates and values beyond the Unicode range cannot be encoded
+       * as UTF-8. */
+      if(!g_unichar_validate((gunichar) num_codepoint))
+      {
+        g_set_error(
+          error,
+          inf_request_error_quark(),
+          INF_REQUEST_ERROR_INVALID_NUMBER,
+          _("Attribute 'codepoint' does not contain a valid character (%u)"),
+          num_codepoint
+        );
+
+        g_string_free(result, TRUE);
+        return NULL;
+      }
+
       g_string_append_unichar(result, (gunichar) num_codepoint);
       ++char_count;
       break;
@@ -20,14 +20,17 @@
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/common/inf-xml-connection.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-xml-arena.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-certificate-credentials-private.h>
 
 #include <libinfinity/inf-marshal.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 
 #include <gnutls/x509.h>
+#include <zlib.h>
 
 #include <errno.h>
 #include <string.h>
@@ -60,6 +63,8 @@ typedef enum _InfXmppConnectionStatus {
   INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES,
   /* <starttls> request has been sent (client only) */
   INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED,
+  /* <compress> request has been sent (client only) */
+  INF_XMPP_CONNECTION_COMPRESSION_REQUESTED,
   /* TLS handshake is being performed */
   INF_XMPP_CONNECTION_HANDSHAKING,
   /* SASL authentication is in progress */
@@ -119,6 +124,7 @@ struct _InfXmppConnectionPrivate {
   /* XML parsing */
   gboolean parsing; /* Whether we are currently in an XML parser callback */
   xmlParserCtxtPtr parser;
+  InfXmlArena* arena;
   xmlNodePtr root;
   xmlNodePtr cur;
 
@@ -129,6 +135,21 @@ struct _InfXmppConnectionPrivate {
   const gchar* pull_data;
   gsize pull_len;
 
+  /* Stream compression (XEP-0138) */
+  gint compression_level;
+  z_stream* deflate;
+  z_stream* inflate;
+  /* The <stream:features> the server sent while we requested compression,
+   * so that we can go on with authentication if compression fails. */
+  xmlNodePtr compression_features;
+
+  /* Traffic statistics. bytes_in and bytes_out count the XML stream, the
+   * compressed counters the data after compression (before TLS). */
+  guint64 bytes_in;
+  guint64 bytes_out;
+  guint64 compressed_bytes_in;
+  guint64 compressed_bytes_out;
+
   /* SASL */
   InfSaslContext* sasl_context;
   InfSaslContext* sasl_own_context;
@@ -154,6 +175,13 @@ enum {
   PROP_SASL_CONTEXT,
   PROP_SASL_MECHANISMS,
 
+  PROP_COMPRESSION_LEVEL,
+  PROP_COMPRESSION_ENABLED,
+  PROP_BYTES_IN,
+  PROP_BYTES_OUT,
+  PROP_COMPRESSED_BYTES_IN,
+  PROP_COMPRESSED_BYTES_OUT,
+
   /* From InfXmlConnection */
   PROP_STATUS,
   PROP_NETWORK,
@@ -543,10 +571,12 @@ inf_xmpp_connection_pop_message(InfXmppConnection* connection)
   g_slice_free(InfXmppConnectionMessage, message);
 }
 
+/* Sends data to the remote site, through TLS if enabled. data is expected
+ * to be compressed already if stream compression is in use. */
 static void
-inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
-                               gconstpointer data,
-                               guint len)
+inf_xmpp_connection_send_raw(InfXmppConnection* xmpp,
+                             gconstpointer data,
+                             guint len)
 {
   InfXmppConnectionPrivate* priv;
   ssize_t cur_bytes;
@@ -554,11 +584,6 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
-  g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING);
-
-  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-    printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
-
   if(priv->session != NULL)
   {
     do
@@ -598,6 +623,60 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
+                               gconstpointer data,
+                               guint len)
+{
+  InfXmppConnectionPrivate* priv;
+  Bytef buffer[4096];
+  guint have;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING);
+
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+    printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
+
+  priv->bytes_out += len;
+
+  if(priv->deflate != NULL)
+  {
+    priv->deflate->next_in = (Bytef*)data;
+    priv->deflate->avail_in = len;
+
+    /* We always do a sync flush, so that the remote site can parse
+     * everything we sent so far without waiting for more data. */
+    do
+    {
+      priv->deflate->next_out = buffer;
+      priv->deflate->avail_out = sizeof(buffer);
+
+      ret = deflate(priv->deflate, Z_SYNC_FLUSH);
+      /* Z_BUF_ERROR just means that no progress was possible because all
+       * output has already been flushed. Anything else is a bug. */
+      g_assert(ret == Z_OK || ret == Z_BUF_ERROR);
+
+      have = sizeof(buffer) - priv->deflate->avail_out;
+      if(have > 0)
+      {
+        priv->compressed_bytes_out += have;
+        inf_xmpp_connection_send_raw(xmpp, buffer, have);
+      }
+
+      /* Sending might have failed and closed the connection, in which case
+       * the compression state has been released. */
+    } while(priv->deflate != NULL && priv->deflate->avail_out == 0);
+  }
+  else
+  {
+    priv->compressed_bytes_out += len;
+    inf_xmpp_connection_send_raw(xmpp, data, len);
+  }
+}
+
 static void
 inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
                              xmlNodePtr xml)
@@ -653,6 +732,26 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
   }
 
+  if(priv->deflate != NULL)
+  {
+    g_assert(priv->inflate != NULL);
+
+    deflateEnd(priv->deflate);
+    inflateEnd(priv->inflate);
+    g_slice_free(z_stream, priv->deflate);
+    g_slice_free(z_stream, priv->inflate);
+    priv->deflate = NULL;
+    priv->inflate = NULL;
+
+    g_object_notify(G_OBJECT(xmpp), "compression-enabled");
+  }
+
+  if(priv->compression_features != NULL)
+  {
+    xmlFreeNode(priv->compression_features);
+    priv->compression_features = NULL;
+  }
+
   if(priv->parser != NULL)
   {
     xmlFreeParserCtxt(priv->parser);
@@ -660,7 +759,7 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
 
     if(priv->root != NULL)
     {
-      xmlFreeNode(priv->root);
+      inf_xml_arena_reset(priv->arena);
       priv->root = NULL;
       priv->cur = NULL;
     }
@@ -726,6 +825,15 @@ inf_xmpp_connection_node_new_sasl(const gchar* name)
   );
 }
 
+static xmlNodePtr
+inf_xmpp_connection_node_new_compress(const gchar* name)
+{
+  return inf_xmpp_connection_node_new(
+    name,
+    "http://jabber.org/protocol/compress"
+  );
+}
+
 /*
  * XMPP deinitialization
  */
@@ -1105,6 +1213,18 @@ inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
     priv->status = INF_XMPP_CONNECTION_CONNECTED;
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
 
+    /* Remember the session so that the next connection to the same host
+     * can resume it instead of doing a full handshake. */
+    if(priv->site == INF_XMPP_CONNECTION_CLIENT &&
+       !gnutls_session_is_resumed(priv->session))
+    {
+      _inf_certificate_credentials_store_client_session(
+        priv->creds,
+        priv->session,
+        priv->remote_hostname
+      );
+    }
+
     if(priv->site == INF_XMPP_CONNECTION_SERVER ||
        priv->certificate_callback == NULL)
     {
@@ -1146,6 +1266,12 @@ inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
     switch(priv->site)
     {
     case INF_XMPP_CONNECTION_CLIENT:
+      /* Don't try to resume the session again with the next connection */
+      _inf_certificate_credentials_forget_client_session(
+        priv->creds,
+        priv->remote_hostname
+      );
+
       /* Terminate connection when GnuTLS handshake fails. Don't wait for
        * </stream:stream> as the server might not be aware of the problem. */
       inf_xmpp_connection_terminate(xmpp);
@@ -1246,6 +1372,28 @@ inf_xmpp_connection_tls_init(InfXmppConnection* xmpp)
 
   gnutls_dh_set_prime_bits(priv->session, xmpp_connection_dh_bits);
 
+  switch(priv->site)
+  {
+  case INF_XMPP_CONNECTION_CLIENT:
+    _inf_certificate_credentials_prepare_client_session(
+      priv->creds,
+      priv->session,
+      priv->remote_hostname
+    );
+
+    break;
+  case INF_XMPP_CONNECTION_SERVER:
+    _inf_certificate_credentials_prepare_server_session(
+      priv->creds,
+      priv->session
+    );
+
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
   gnutls_transport_set_ptr(priv->session, xmpp);
 
   gnutls_transport_set_push_function(
@@ -1262,6 +1410,168 @@ inf_xmpp_connection_tls_init(InfXmppConnection* xmpp)
   inf_xmpp_connection_tls_handshake(xmpp);
 }
 
+/*
+ * Stream compression
+ */
+
+static gboolean
+inf_xmpp_connection_compression_init(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->deflate == NULL && priv->inflate == NULL);
+
+  priv->deflate = g_slice_new(z_stream);
+  priv->deflate->zalloc = Z_NULL;
+  priv->deflate->zfree = Z_NULL;
+  priv->deflate->opaque = Z_NULL;
+
+  ret = deflateInit(priv->deflate, priv->compression_level);
+  if(ret != Z_OK)
+  {
+    g_slice_free(z_stream, priv->deflate);
+    priv->deflate = NULL;
+    return FALSE;
+  }
+
+  priv->inflate = g_slice_new(z_stream);
+  priv->inflate->zalloc = Z_NULL;
+  priv->inflate->zfree = Z_NULL;
+  priv->inflate->opaque = Z_NULL;
+  priv->inflate->next_in = Z_NULL;
+  priv->inflate->avail_in = 0;
+
+  ret = inflateInit(priv->inflate);
+  if(ret != Z_OK)
+  {
+    deflateEnd(priv->deflate);
+    g_slice_free(z_stream, priv->deflate);
+    g_slice_free(z_stream, priv->inflate);
+    priv->deflate = NULL;
+    priv->inflate = NULL;
+    return FALSE;
+  }
+
+  g_object_notify(G_OBJECT(xmpp), "compression-enabled");
+  return TRUE;
+}
+
+/* Returns whether the given <compression> stream feature or <compress>
+ * request contains the zlib method. */
+static gboolean
+inf_xmpp_connection_compression_has_zlib(xmlNodePtr xml)
+{
+  xmlNodePtr child;
+  xmlChar* content;
+  gboolean result;
+
+  result = FALSE;
+  for(child = xml->children; child != NULL && !result; child = child->next)
+  {
+    if(strcmp((const gchar*)child->name, "method") == 0)
+    {
+      content = xmlNodeGetContent(child);
+      if(content != NULL)
+      {
+        if(strcmp((const gchar*)content, "zlib") == 0)
+          result = TRUE;
+        xmlFree(content);
+      }
+    }
+  }
+
+  return result;
+}
+
+static void
+inf_xmpp_connection_parse_xml(InfXmppConnection* xmpp,
+                              const gchar* data,
+                              gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  priv->bytes_in += len;
+
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+  {
+    if(priv->session != NULL)
+      printf("\033[00;32m%.*s\033[00;00m\n", (int)len, data);
+    else
+      printf("\033[00;31m%.*s\033[00;00m\n", (int)len, data);
+  }
+
+  xmlParseChunk(priv->parser, data, len, 0);
+}
+
+/* Feeds data received from the remote site (after TLS decryption) into the
+ * XML parser, decompressing it first if stream compression is enabled. */
+static void
+inf_xmpp_connection_parse_chunk(InfXmppConnection* xmpp,
+                                const gchar* data,
+                                gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  Bytef buffer[4096];
+  gsize have;
+  int ret;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  priv->compressed_bytes_in += len;
+
+  if(priv->inflate == NULL)
+  {
+    inf_xmpp_connection_parse_xml(xmpp, data, len);
+  }
+  else
+  {
+    priv->inflate->next_in = (Bytef*)data;
+    priv->inflate->avail_in = len;
+
+    do
+    {
+      priv->inflate->next_out = buffer;
+      priv->inflate->avail_out = sizeof(buffer);
+
+      ret = inflate(priv->inflate, Z_SYNC_FLUSH);
+      if(ret != Z_OK && ret != Z_BUF_ERROR)
+      {
+        error = NULL;
+        g_set_error(
+          &error,
+          inf_xmpp_connection_error_quark,
+          INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED,
+          _("Failed to decompress data from the remote site: %s"),
+          priv->inflate->msg != NULL ? priv->inflate->msg : zError(ret)
+        );
+
+        inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+        g_error_free(error);
+
+        /* The stream cannot be recovered, so we also cannot parse a final
+         * </stream:stream>. Just close the underlaying TCP connection. */
+        inf_tcp_connection_close(priv->tcp);
+        break;
+      }
+
+      have = sizeof(buffer) - priv->inflate->avail_out;
+      if(have == 0) break;
+
+      inf_xmpp_connection_parse_xml(xmpp, (const gchar*)buffer, have);
+
+      /* Stop if the parser callbacks closed the connection */
+      if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+         priv->status == INF_XMPP_CONNECTION_CLOSED)
+      {
+        break;
+      }
+    } while(priv->inflate->avail_in > 0 || priv->inflate->avail_out == 0);
+  }
+}
+
 /*
  * Gsasl setup
  */
@@ -1657,27 +1967,11 @@ inf_xmpp_connection_process_start_element(InfXmppConnection* xmpp,
   InfXmppConnectionPrivate* priv;
   xmlNodePtr node;
 
-  const xmlChar** attr;
-  const xmlChar* attr_name;
-  const xmlChar* attr_value;
-
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
-  node = xmlNewNode(NULL, name);
-
-  if(attrs != NULL)
-  {
-    attr = attrs;
-    while(*attr != NULL)
-    {
-      attr_name = *attr;
-      ++ attr;
 
-      attr_value = *attr;
-      ++ attr;
-
-      xmlNewProp(node, attr_name, attr_value);
-    }
-  }
+  /* Incoming stanzas are built into the arena, which is reset in one go
+   * once the stanza has been processed. */
+  node = inf_xml_arena_new_node(priv->arena, priv->cur, name, attrs);
 
   if(priv->root == NULL)
   {
@@ -1689,7 +1983,7 @@ inf_xmpp_connection_process_start_element(InfXmppConnection* xmpp,
   else
   {
     g_assert(priv->cur != NULL);
-    priv->cur = xmlAddChild(priv->cur, node);
+    priv->cur = node;
   }
 }
 
@@ -1711,6 +2005,7 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   xmlNodePtr features;
   xmlNodePtr starttls;
+  xmlNodePtr compression;
   xmlNodePtr mechanisms;
   xmlNodePtr mechanism;
   gchar* mechanism_dup;
@@ -1747,8 +2042,10 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   features = xmlNewNode(NULL, (const xmlChar*)"stream:features");
 
-  /* Don't offer TLS if we have already authenticated. It's pointless now. */
-  if(priv->session == NULL &&
+  /* Don't offer TLS if we have already authenticated. It's pointless now.
+   * Also don't offer it when the stream is compressed already, since TLS
+   * cannot be layered below the compression anymore. */
+  if(priv->session == NULL && priv->deflate == NULL &&
      priv->status != INF_XMPP_CONNECTION_AUTH_INITIATED)
   {
     if(priv->security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
@@ -1760,6 +2057,28 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
     }
   }
 
+  /* Offer stream compression (XEP-0138) before authentication, unless we
+   * require the client to enable TLS first. */
+  if(priv->status == INF_XMPP_CONNECTION_INITIATED &&
+     priv->compression_level > 0 && priv->deflate == NULL &&
+     (priv->session != NULL ||
+      priv->security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_TLS))
+  {
+    compression = inf_xmpp_connection_node_new(
+      "compression",
+      "http://jabber.org/features/compress"
+    );
+
+    xmlNewTextChild(
+      compression,
+      NULL,
+      (const xmlChar*)"method",
+      (const xmlChar*)"zlib"
+    );
+
+    xmlAddChild(features, compression);
+  }
+
   if(priv->status == INF_XMPP_CONNECTION_INITIATED)
   {
     /* Not yet authenticated, so give the client a list of authentication
@@ -1850,6 +2169,60 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_process_compress(InfXmppConnection* xmpp,
+                                     xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr reply;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+  g_assert(priv->status == INF_XMPP_CONNECTION_INITIATED);
+
+  if(priv->compression_level == 0 || priv->deflate != NULL ||
+     !inf_xmpp_connection_compression_has_zlib(xml))
+  {
+    /* Keep the stream uncompressed, the client can go on with
+     * authentication. */
+    reply = inf_xmpp_connection_node_new_compress("failure");
+    xmlNewChild(reply, NULL, (const xmlChar*)"unsupported-method", NULL);
+    inf_xmpp_connection_send_xml(xmpp, reply);
+    xmlFreeNode(reply);
+  }
+  else
+  {
+    /* This is the last thing we send uncompressed */
+    reply = inf_xmpp_connection_node_new_compress("compressed");
+    inf_xmpp_connection_send_xml(xmpp, reply);
+    xmlFreeNode(reply);
+
+    if(!inf_xmpp_connection_compression_init(xmpp))
+    {
+      error = g_error_new_literal(
+        inf_xmpp_connection_error_quark,
+        INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED,
+        _("Failed to initialize stream compression")
+      );
+
+      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+      g_error_free(error);
+
+      /* The client expects compressed data now, so we cannot send
+       * </stream:stream> anymore. */
+      inf_tcp_connection_close(priv->tcp);
+    }
+    else
+    {
+      /* The client restarts the stream with a new <stream:stream>. The XML
+       * parser is replaced in received_cb() after having parsed the
+       * current chunk. */
+      priv->status = INF_XMPP_CONNECTION_CONNECTED;
+    }
+  }
+}
+
 static void
 inf_xmpp_connection_process_initiated(InfXmppConnection* xmpp,
                                       xmlNodePtr xml)
@@ -1871,7 +2244,7 @@ inf_xmpp_connection_process_initiated(InfXmppConnection* xmpp,
 
   /* I'm not totally sure how to do this in full compliance with the RFC.
    * Maybe we can ship with a simple self-signed ad-hoc certificate. */
-  if(priv->session == NULL &&
+  if(priv->session == NULL && priv->deflate == NULL &&
      priv->security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
   {
     if(strcmp((const gchar*)xml->name, "starttls") == 0)
@@ -1899,7 +2272,11 @@ inf_xmpp_connection_process_initiated(InfXmppConnection* xmpp,
     /* This should already have been allocated before having sent the list
      * of mechanisms to the client. */
     g_assert(priv->sasl_context != NULL);
-    if(strcmp((const gchar*)xml->name, "auth") == 0)
+    if(strcmp((const gchar*)xml->name, "compress") == 0)
+    {
+      inf_xmpp_connection_process_compress(xmpp, xml);
+    }
+    else if(strcmp((const gchar*)xml->name, "auth") == 0)
     {
       mech = xmlGetProp(xml, (const xmlChar*)"mechanism");
 
@@ -2089,6 +2466,68 @@ inf_xmpp_connection_sasl_suggest_mechanism(InfXmppConnection* xmpp,
   return suggestion;
 }
 
+/* Starts authentication as offered by the server in xml, or finishes
+ * stream negotiation if we have already authenticated. */
+static void
+inf_xmpp_connection_process_features_authentication(InfXmppConnection* xmpp,
+                                                     xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr child;
+  const char* suggestion;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES)
+  {
+    for(child = xml->children; child != NULL; child = child->next)
+      if(strcmp((const gchar*)child->name, "mechanisms") == 0)
+        break;
+
+    /* Server does not provide authentication mechanisms */
+    if(child == NULL)
+    {
+      error = g_error_new_literal(
+        inf_xmpp_connection_error_quark,
+        INF_XMPP_CONNECTION_ERROR_AUTHENTICATION_UNSUPPORTED,
+        _("The server does not provide any authentication mechanism")
+      );
+
+      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+      g_error_free(error);
+
+      inf_xmpp_connection_deinitiate(xmpp);
+    }
+    else if(inf_xmpp_connection_sasl_ensure(xmpp) == TRUE)
+    {
+      inf_xmpp_connection_load_sasl_remote_mechanisms(xmpp, child);
+
+      error = NULL;
+      suggestion = inf_xmpp_connection_sasl_suggest_mechanism(xmpp, &error);
+
+      if(!suggestion)
+      {
+        inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+        g_error_free(error);
+
+        /* Deinitiate if error signal handler does not retry authentication */
+        if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES)
+          inf_xmpp_connection_deinitiate(xmpp);
+      }
+      else
+      {
+        inf_xmpp_connection_sasl_init(xmpp, suggestion);
+      }
+    }
+  }
+  else if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
+  {
+    priv->status = INF_XMPP_CONNECTION_READY;
+    g_object_notify(G_OBJECT(xmpp), "status");
+  }
+}
+
 static void
 inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
                                      xmlNodePtr xml)
@@ -2097,7 +2536,7 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   xmlNodePtr child;
   xmlNodePtr req;
   xmlNodePtr starttls;
-  const char* suggestion;
+  xmlNodePtr compress;
   GError* error;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
@@ -2112,9 +2551,10 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
     return;
   }
   /* Don't try TLS anymore if we are already authenticated. This can happen
-   * if the server only offers TLS after authentication, but that's stupid. */
+   * if the server only offers TLS after authentication, but that's stupid.
+   * Also, TLS cannot be started anymore once the stream is compressed. */
   else if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES &&
-          priv->session == NULL)
+          priv->session == NULL && priv->deflate == NULL)
   {
     for(child = xml->children; child != NULL; child = child->next)
       if(strcmp((const gchar*)child->name, "starttls") == 0)
@@ -2171,54 +2611,39 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
     }
   }
 
-  /* If we did not request TLS above, then go on with authentication */
-  if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES)
+  /* If we did not request TLS above, then try to enable compression */
+  if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES &&
+     priv->compression_level > 0 && priv->deflate == NULL)
   {
     for(child = xml->children; child != NULL; child = child->next)
-      if(strcmp((const gchar*)child->name, "mechanisms") == 0)
+      if(strcmp((const gchar*)child->name, "compression") == 0)
         break;
 
-    /* Server does not provide authentication mechanisms */
-    if(child == NULL)
-    {
-      error = g_error_new_literal(
-        inf_xmpp_connection_error_quark,
-        INF_XMPP_CONNECTION_ERROR_AUTHENTICATION_UNSUPPORTED,
-        _("The server does not provide any authentication mechanism")
-      );
-
-      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
-      g_error_free(error);
-
-      inf_xmpp_connection_deinitiate(xmpp);
-    }
-    else if(inf_xmpp_connection_sasl_ensure(xmpp) == TRUE)
+    if(child != NULL && inf_xmpp_connection_compression_has_zlib(child))
     {
-      inf_xmpp_connection_load_sasl_remote_mechanisms(xmpp, child);
+      compress = inf_xmpp_connection_node_new_compress("compress");
 
-      error = NULL;
-      suggestion = inf_xmpp_connection_sasl_suggest_mechanism(xmpp, &error);
+      xmlNewTextChild(
+        compress,
+        NULL,
+        (const xmlChar*)"method",
+        (const xmlChar*)"zlib"
+      );
 
-      if(!suggestion)
-      {
-        inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
-        g_error_free(error);
+      inf_xmpp_connection_send_xml(xmpp, compress);
+      xmlFreeNode(compress);
 
-        /* Deinitiate if error signal handler does not retry authentication */
-        if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES)
-          inf_xmpp_connection_deinitiate(xmpp);
-      }
-      else
-      {
-        inf_xmpp_connection_sasl_init(xmpp, suggestion);
-      }
+      /* Remember the features so that we can go on with authentication in
+       * case the server refuses to compress the stream. */
+      g_assert(priv->compression_features == NULL);
+      priv->compression_features = xmlCopyNode(xml, 1);
+      priv->status = INF_XMPP_CONNECTION_COMPRESSION_REQUESTED;
     }
   }
-  else if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
-  {
-    priv->status = INF_XMPP_CONNECTION_READY;
-    g_object_notify(G_OBJECT(xmpp), "status");
-  }
+
+  /* If we did not request TLS or compression above, then go on with
+   * authentication */
+  inf_xmpp_connection_process_features_authentication(xmpp, xml);
 }
 
 static void
@@ -2260,6 +2685,64 @@ inf_xmpp_connection_process_encryption(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_process_compression(InfXmppConnection* xmpp,
+                                        xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr features;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+  g_assert(priv->status == INF_XMPP_CONNECTION_COMPRESSION_REQUESTED);
+  g_assert(priv->compression_features != NULL);
+
+  if(strcmp((const gchar*)xml->name, "compressed") == 0)
+  {
+    xmlFreeNode(priv->compression_features);
+    priv->compression_features = NULL;
+
+    if(!inf_xmpp_connection_compression_init(xmpp))
+    {
+      error = g_error_new_literal(
+        inf_xmpp_connection_error_quark,
+        INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED,
+        _("Failed to initialize stream compression")
+      );
+
+      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+      g_error_free(error);
+
+      /* The server expects compressed data now, so we cannot send
+       * </stream:stream> anymore. */
+      inf_tcp_connection_close(priv->tcp);
+    }
+    else
+    {
+      /* Reinitiate the stream, which happens in received_cb() after having
+       * parsed the current chunk because it replaces the XML parser. */
+      priv->status = INF_XMPP_CONNECTION_CONNECTED;
+    }
+  }
+  else if(strcmp((const gchar*)xml->name, "failure") == 0)
+  {
+    /* The server does not want to compress the stream, so go on with
+     * authentication as offered in the features it sent before. */
+    features = priv->compression_features;
+    priv->compression_features = NULL;
+
+    priv->status = INF_XMPP_CONNECTION_AWAITING_FEATURES;
+    inf_xmpp_connection_process_features_authentication(xmpp, features);
+    xmlFreeNode(features);
+  }
+  else
+  {
+    /* We got neither 'compressed' nor 'failure'. Ignore and wait for either
+     * of them. */
+  }
+}
+
 static void
 inf_xmpp_connection_process_authentication_error(
   InfXmppConnection* xmpp,
@@ -2481,6 +2964,11 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
         g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
         inf_xmpp_connection_process_encryption(xmpp, priv->root);
         break;
+      case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
+        /* This is a client-only state */
+        g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+        inf_xmpp_connection_process_compression(xmpp, priv->root);
+        break;
       case INF_XMPP_CONNECTION_AUTHENTICATING:
         inf_xmpp_connection_process_authentication(xmpp, priv->root);
         break;
@@ -2505,9 +2993,14 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
       }
     }
 
-    xmlFreeNode(priv->root);
-    priv->root = NULL;
-    priv->cur = NULL;
+    /* The root node might already have been released if the connection
+     * was closed while processing the stanza. */
+    if(priv->root != NULL)
+    {
+      inf_xml_arena_reset(priv->arena);
+      priv->root = NULL;
+      priv->cur = NULL;
+    }
   }
 }
 
@@ -2576,6 +3069,7 @@ inf_xmpp_connection_sax_start_element(void* context,
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
   case INF_XMPP_CONNECTION_READY:
     inf_xmpp_connection_process_start_element(xmpp, name, attrs);
@@ -2635,6 +3129,7 @@ inf_xmpp_connection_sax_end_element(void* context,
     case INF_XMPP_CONNECTION_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+    case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
     case INF_XMPP_CONNECTION_READY:
       /* Also terminate stream in these states */
       inf_xmpp_connection_terminate(xmpp);
@@ -2681,7 +3176,7 @@ inf_xmpp_connection_sax_characters(void* context,
   else
   {
     g_assert(priv->cur != NULL);
-    xmlNodeAddContentLen(priv->cur, content, len);
+    inf_xml_arena_add_content(priv->arena, priv->cur, content, len);
   }
 }
 
@@ -2945,6 +3440,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
   ssize_t res;
   GError* error;
   gboolean receiving;
+  InfXmppConnectionStatus prev_status;
 
   xmpp = INF_XMPP_CONNECTION(user_data);
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
@@ -2954,6 +3450,8 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
   if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS)
     return;
 
+  prev_status = priv->status;
+
   g_object_ref(xmpp);
 
   g_assert(priv->parsing == FALSE);
@@ -3005,9 +3503,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
         else
         {
           /* Feed decoded data into XML parser */
-          if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-            printf("\033[00;32m%.*s\033[00;00m\n", (int)res, buffer);
-          xmlParseChunk(priv->parser, buffer, res, 0);
+          inf_xmpp_connection_parse_chunk(xmpp, buffer, res);
 
           /* If the callback changed made us disconnect then don't try
            * to read more data. */
@@ -3022,9 +3518,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
     else
     {
       /* Feed input directly into XML parser */
-      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-        printf("\033[00;31m%.*s\033[00;00m\n", (int)len, (const char*)data);
-      xmlParseChunk(priv->parser, data, len, 0);
+      inf_xmpp_connection_parse_chunk(xmpp, data, len);
     }
   }
   else
@@ -3070,6 +3564,14 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
      * AUTHENTICATING */
     inf_xmpp_connection_initiate(xmpp);
   }
+  else if(priv->status == INF_XMPP_CONNECTION_CONNECTED &&
+          (prev_status == INF_XMPP_CONNECTION_INITIATED ||
+           prev_status == INF_XMPP_CONNECTION_COMPRESSION_REQUESTED))
+  {
+    /* Stream compression has been negotiated, so reinitiate the stream
+     * with a fresh XML parser. */
+    inf_xmpp_connection_initiate(xmpp);
+  }
 
   g_object_unref(xmpp);
 }
@@ -3278,6 +3780,7 @@ inf_xmpp_connection_get_xml_status(InfXmppConnection* xmpp)
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_HANDSHAKING:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
     return INF_XML_CONNECTION_OPENING;
@@ -3349,6 +3852,7 @@ inf_xmpp_connection_init(GTypeInstance* instance,
 
   priv->parsing = FALSE;
   priv->parser = NULL;
+  priv->arena = inf_xml_arena_new();
   priv->root = NULL;
   priv->cur = NULL;
 
@@ -3360,6 +3864,16 @@ inf_xmpp_connection_init(GTypeInstance* instance,
   priv->pull_data = NULL;
   priv->pull_len = 0;
 
+  priv->compression_level = 0;
+  priv->deflate = NULL;
+  priv->inflate = NULL;
+  priv->compression_features = NULL;
+
+  priv->bytes_in = 0;
+  priv->bytes_out = 0;
+  priv->compressed_bytes_in = 0;
+  priv->compressed_bytes_out = 0;
+
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
   priv->sasl_session = NULL;
@@ -3457,6 +3971,8 @@ inf_xmpp_connection_finalize(GObject* object)
   if(priv->sasl_error)
     g_error_free(priv->sasl_error);
 
+  inf_xml_arena_free(priv->arena);
+
   G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
@@ -3548,6 +4064,20 @@ inf_xmpp_connection_set_property(GObject* object,
     g_free(priv->sasl_local_mechanisms);
     priv->sasl_local_mechanisms = g_value_dup_string(value);
     break;
+  case PROP_COMPRESSION_LEVEL:
+    priv->compression_level = g_value_get_int(value);
+
+    /* Apply to the current stream if compression is already in use. This
+     * does not need a flush since we flush after every message anyway. */
+    if(priv->deflate != NULL)
+    {
+      deflateParams(
+        priv->deflate,
+        priv->compression_level,
+        Z_DEFAULT_STRATEGY
+      );
+    }
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -3598,6 +4128,24 @@ inf_xmpp_connection_get_property(GObject* object,
   case PROP_SASL_MECHANISMS:
     g_value_set_string(value, priv->sasl_local_mechanisms);
     break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_int(value, priv->compression_level);
+    break;
+  case PROP_COMPRESSION_ENABLED:
+    g_value_set_boolean(value, priv->deflate != NULL);
+    break;
+  case PROP_BYTES_IN:
+    g_value_set_uint64(value, priv->bytes_in);
+    break;
+  case PROP_BYTES_OUT:
+    g_value_set_uint64(value, priv->bytes_out);
+    break;
+  case PROP_COMPRESSED_BYTES_IN:
+    g_value_set_uint64(value, priv->compressed_bytes_in);
+    break;
+  case PROP_COMPRESSED_BYTES_OUT:
+    g_value_set_uint64(value, priv->compressed_bytes_out);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, inf_xmpp_connection_get_xml_status(xmpp));
     break;
@@ -3722,6 +4270,7 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
   case INF_XMPP_CONNECTION_AUTH_INITIATED:
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_READY:
     inf_xmpp_connection_deinitiate(INF_XMPP_CONNECTION(connection));
     break;
@@ -3895,6 +4444,89 @@ inf_xmpp_connection_class_init(gpointer g_class,
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_int(
+      "compression-level",
+      "Compression level",
+      "The zlib compression level to use for the stream, or 0 to neither "
+      "request nor offer stream compression",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_ENABLED,
+    g_param_spec_boolean(
+      "compression-enabled",
+      "Compression enabled",
+      "Whether the stream is compressed or not",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BYTES_IN,
+    g_param_spec_uint64(
+      "bytes-in",
+      "Bytes in",
+      "Number of XML bytes received, before decompression",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BYTES_OUT,
+    g_param_spec_uint64(
+      "bytes-out",
+      "Bytes out",
+      "Number of XML bytes sent, before compression",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSED_BYTES_IN,
+    g_param_spec_uint64(
+      "compressed-bytes-in",
+      "Compressed bytes in",
+      "Number of bytes received, as they were sent by the remote site",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSED_BYTES_OUT,
+    g_param_spec_uint64(
+      "compressed-bytes-out",
+      "Compressed bytes out",
+      "Number of bytes sent after compression",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
   g_object_class_override_property(object_class, PROP_NETWORK, "network");
   g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
@@ -4141,6 +4773,53 @@ inf_xmpp_connection_get_tls_enabled(InfXmppConnection* xmpp)
   return TRUE;
 }
 
+/**
+ * inf_xmpp_connection_get_tls_resumed:
+ * @xmpp: A #InfXmppConnection.
+ *
+ * Returns whether the TLS session of @xmpp was resumed from an earlier
+ * connection instead of being established with a full handshake. Sessions
+ * are cached in the #InfCertificateCredentials used by the connection, see
+ * inf_certificate_credentials_set_session_cache_size().
+ *
+ * Returns: %TRUE if TLS is enabled and the session was resumed, %FALSE
+ * otherwise.
+ */
+gboolean
+inf_xmpp_connection_get_tls_resumed(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+
+  g_return_val_if_fail(INF_IS_XMPP_CONNECTION(xmpp), FALSE);
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->status == INF_XMPP_CONNECTION_HANDSHAKING) return FALSE;
+  if(priv->session == NULL) return FALSE;
+
+  return gnutls_session_is_resumed(priv->session) != 0;
+}
+
+/**
+ * inf_xmpp_connection_get_compression_enabled:
+ * @xmpp: A #InfXmppConnection.
+ *
+ * Returns whether the stream is compressed, as negotiated according to
+ * XEP-0138. Compression is only negotiated if both sites have
+ * #InfXmppConnection:compression-level set to a non-zero value. Use the
+ * #InfXmppConnection:bytes-out and #InfXmppConnection:compressed-bytes-out
+ * properties (and their counterparts for incoming data) to find out how well
+ * the compression performs.
+ *
+ * Returns: %TRUE if the stream is compressed and %FALSE otherwise.
+ */
+gboolean
+inf_xmpp_connection_get_compression_enabled(InfXmppConnection* xmpp)
+{
+  g_return_val_if_fail(INF_IS_XMPP_CONNECTION(xmpp), FALSE);
+  return INF_XMPP_CONNECTION_PRIVATE(xmpp)->deflate != NULL;
+}
+
 /**
  * inf_xmpp_connection_set_certificate_callback:
  * @xmpp: A #InfXmppConnection.
@@ -81,6 +81,8 @@ typedef enum _InfXmppConnectionError {
   INF_XMPP_CONNECTION_ERROR_AUTHENTICATION_UNSUPPORTED,
   /* Server does not offer a suitable machnism */
   INF_XMPP_CONNECTION_ERROR_NO_SUITABLE_MECHANISM,
+  /* The compressed stream could not be decoded */
+  INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED,
 
   INF_XMPP_CONNECTION_ERROR_FAILED
 } InfXmppConnectionError;
@@ -163,6 +165,12 @@ inf_xmpp_connection_new(InfTcpConnection* tcp,
 gboolean
 inf_xmpp_connection_get_tls_enabled(InfXmppConnection* xmpp);
 
+gboolean
+inf_xmpp_connection_get_tls_resumed(InfXmppConnection* xmpp);
+
+gboolean
+inf_xmpp_connection_get_compression_enabled(InfXmppConnection* xmpp);
+
 void
 inf_xmpp_connection_set_certificate_callback(InfXmppConnection* xmpp,
                                              InfXmppConnectionCrtCallback cb,
@@ -541,4 +541,22 @@ inf_communication_manager_get_factory_for(InfCommunicationManager* manager,
   return NULL;
 }
 
+/**
+ * inf_communication_manager_get_registry:
+ * @manager: A #InfCommunicationManager.
+ *
+ * Returns the #InfCommunicationRegistry that the groups of @manager use to
+ * send messages. This is mostly useful to query statistics about the
+ * messages waiting to be sent, with
+ * inf_communication_registry_get_queue_lengths().
+ *
+ * Returns: The #InfCommunicationRegistry used by @manager.
+ */
+InfCommunicationRegistry*
+inf_communication_manager_get_registry(InfCommunicationManager* manager)
+{
+  g_return_val_if_fail(INF_COMMUNICATION_IS_MANAGER(manager), NULL);
+  return INF_COMMUNICATION_MANAGER_PRIVATE(manager)->registry;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -1111,4 +1111,48 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
   g_free(key.publisher_id);
 }
 
+/**
+ * inf_communication_registry_get_queue_lengths:
+ * @reg: A #InfCommunicationRegistry.
+ * @n_inner: Location to store the number of messages passed to the
+ * connections but not yet sent, or %NULL.
+ * @n_outer: Location to store the number of messages waiting to be passed to
+ * the connections, or %NULL.
+ *
+ * Counts the messages queued in @reg, summed over all registered groups and
+ * connections. A growing outer queue means that connections cannot keep up
+ * with the messages sent to them.
+ */
+void
+inf_communication_registry_get_queue_lengths(InfCommunicationRegistry* reg,
+                                             guint* n_inner,
+                                             guint* n_outer)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryEntry* entry;
+  GHashTableIter iter;
+  gpointer value;
+  xmlNodePtr xml;
+  guint inner;
+  guint outer;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(reg));
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(reg);
+  inner = 0;
+  outer = 0;
+
+  g_hash_table_iter_init(&iter, priv->entries);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    entry = (InfCommunicationRegistryEntry*)value;
+    inner += entry->inner_count;
+    for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
+      ++ outer;
+  }
+
+  if(n_inner != NULL) *n_inner = inner;
+  if(n_outer != NULL) *n_outer = outer;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -88,6 +88,11 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
                                            InfCommunicationGroup* group,
                                            InfXmlConnection* connection);
 
+void
+inf_communication_registry_get_queue_lengths(InfCommunicationRegistry* reg,
+                                             guint* n_inner,
+                                             guint* n_outer);
+
 G_END_DECLS
 
 #endif /* __INF_COMMUNICATION_REGISTRY_H__ */
@@ -66,12 +66,17 @@ struct _InfdDirectoryNode {
       const InfdNotePlugin* plugin;
       /* Timeout to save the session when inactive for some time */
       InfIoTimeout* save_timeout;
+      /* Whether the session was preloaded and has not been used since, in
+       * which case it is kept even though it is idle. */
+      gboolean preloaded;
     } note;
 
     struct {
-      /* List of connections that have this folder open and have to be
-       * notified if something happens with it. */
-      GSList* connections;
+      /* Set of connections that have this folder open and have to be
+       * notified if something happens with it, or NULL if there are none.
+       * Each connection's InfdDirectoryConnectionInfo references this node
+       * in turn. */
+      GHashTable* connections;
       /* First child node */
       InfdDirectoryNode* child;
       /* Whether we requested the node already from the background storage.
@@ -144,6 +149,9 @@ struct _InfdDirectorySubreq {
 typedef struct _InfdDirectoryConnectionInfo InfdDirectoryConnectionInfo;
 struct _InfdDirectoryConnectionInfo {
   guint seq_id;
+  /* Set of subdirectory nodes that the connection has explored, so that
+   * they can be cleaned up without walking the tree on disconnect. */
+  GHashTable* explored;
 };
 
 typedef struct _InfdDirectoryPrivate InfdDirectoryPrivate;
@@ -417,6 +425,10 @@ infd_directory_session_idle_notify_cb(GObject* object,
   /* Drop session from memory if it remains idle */
   if(infd_session_proxy_is_idle(INFD_SESSION_PROXY(object)))
   {
+    /* The session has been used if it became idle again, so it is no
+     * longer kept only because it was preloaded. */
+    node->shared.note.preloaded = FALSE;
+
     if(node->shared.note.save_timeout == NULL)
     {
       infd_directory_start_session_save_timeout(directory, node);
@@ -884,6 +896,7 @@ infd_directory_node_new_note(InfdDirectory* directory,
   node->shared.note.session = NULL;
   node->shared.note.plugin = plugin;
   node->shared.note.save_timeout = NULL;
+  node->shared.note.preloaded = FALSE;
 
   return node;
 }
@@ -904,6 +917,10 @@ infd_directory_node_free(InfdDirectory* directory,
   InfdDirectoryPrivate* priv;
   gboolean removed;
 
+  GHashTableIter iter;
+  gpointer key;
+  InfdDirectoryConnectionInfo* info;
+
   GSList* item;
   GSList* next;
   InfdDirectorySyncIn* sync_in;
@@ -917,7 +934,20 @@ infd_directory_node_free(InfdDirectory* directory,
   switch(node->type)
   {
   case INFD_STORAGE_NODE_SUBDIRECTORY:
-    g_slist_free(node->shared.subdir.connections);
+    if(node->shared.subdir.connections != NULL)
+    {
+      g_hash_table_iter_init(&iter, node->shared.subdir.connections);
+      while(g_hash_table_iter_next(&iter, &key, NULL))
+      {
+        info = g_hash_table_lookup(priv->connections, key);
+        g_assert(info != NULL);
+
+        g_hash_table_remove(info->explored, node);
+      }
+
+      g_hash_table_destroy(node->shared.subdir.connections);
+      node->shared.subdir.connections = NULL;
+    }
 
     /* Free child nodes */
     if(node->shared.subdir.explored == TRUE)
@@ -989,45 +1019,61 @@ infd_directory_node_free(InfdDirectory* directory,
   g_slice_free(InfdDirectoryNode, node);
 }
 
+/* Remembers that connection has explored node, so that it is notified
+ * about changes in node. */
 static void
-infd_directory_node_remove_connection(InfdDirectoryNode* node,
-                                      InfXmlConnection* connection)
+infd_directory_node_add_connection(InfdDirectory* directory,
+                                   InfdDirectoryNode* node,
+                                   InfXmlConnection* connection)
 {
-  InfdDirectoryNode* child;
-  GSList* item;
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryConnectionInfo* info;
 
   g_assert(node->type == INFD_STORAGE_NODE_SUBDIRECTORY);
   g_assert(node->shared.subdir.explored == TRUE);
 
-  item = g_slist_find(node->shared.subdir.connections, connection);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(info != NULL);
+
+  if(node->shared.subdir.connections == NULL)
+    node->shared.subdir.connections = g_hash_table_new(NULL, NULL);
+
+  g_hash_table_insert(node->shared.subdir.connections, connection, connection);
+  g_hash_table_insert(info->explored, node, node);
+}
 
-  /* Note that if the connection is not in this node's connection list,
-   * then it cannot be in a child's list either. */
-  if(item != NULL)
+/* Removes connection from the nodes it has explored */
+static void
+infd_directory_node_remove_connection(InfdDirectory* directory,
+                                      InfXmlConnection* connection)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryConnectionInfo* info;
+  InfdDirectoryNode* node;
+  GHashTableIter iter;
+  gpointer key;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(info != NULL);
+
+  g_hash_table_iter_init(&iter, info->explored);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
   {
-    node->shared.subdir.connections = g_slist_delete_link(
-      node->shared.subdir.connections,
-      item
-    );
+    node = (InfdDirectoryNode*)key;
+    g_assert(node->type == INFD_STORAGE_NODE_SUBDIRECTORY);
+    g_assert(node->shared.subdir.connections != NULL);
 
-    if(node->shared.subdir.explored == TRUE)
-    {
-      for(child = node->shared.subdir.child;
-          child != NULL;
-          child = child->next)
-      {
-        if(child->type == INFD_STORAGE_NODE_SUBDIRECTORY &&
-           child->shared.subdir.explored == TRUE)
-        {
-          infd_directory_node_remove_connection(child, connection);
-        }
-      }
-    }
-    else
+    g_hash_table_remove(node->shared.subdir.connections, connection);
+    if(g_hash_table_size(node->shared.subdir.connections) == 0)
     {
-      g_assert(node->shared.subdir.connections == NULL);
+      g_hash_table_destroy(node->shared.subdir.connections);
+      node->shared.subdir.connections = NULL;
     }
   }
+
+  g_hash_table_remove_all(info->explored);
 }
 
 /*
@@ -1138,34 +1184,43 @@ infd_directory_make_seq(InfdDirectory* directory,
  * clients that explored a certain subdirectory. */
 static void
 infd_directory_send(InfdDirectory* directory,
-                    GSList* connections,
+                    GHashTable* connections,
                     InfXmlConnection* exclude,
                     xmlNodePtr xml)
 {
   InfdDirectoryPrivate* priv;
-  GSList* item;
+  GHashTableIter iter;
+  gpointer key;
+  guint remaining;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  if(connections == NULL ||
-     (connections->data == exclude && connections->next == NULL))
+  remaining = 0;
+  if(connections != NULL)
+  {
+    remaining = g_hash_table_size(connections);
+    if(exclude != NULL && g_hash_table_lookup(connections, exclude) != NULL)
+      --remaining;
+  }
+
+  if(remaining == 0)
   {
     xmlFreeNode(xml);
   }
   else
   {
-    for(item = connections; item != NULL; item = g_slist_next(item))
+    g_hash_table_iter_init(&iter, connections);
+    while(g_hash_table_iter_next(&iter, &key, NULL))
     {
-      if(item->data == exclude) continue;
+      if(key == exclude) continue;
 
-      /* Do not copy this item if it is the last item to be sent because the
-       * connection manager takes ownership */
-      if(item->next != NULL &&
-         (item->next->data != exclude || item->next->next != NULL))
+      /* Do not copy the message for the last connection it is sent to
+       * because the connection manager takes ownership */
+      if(--remaining > 0)
       {
         inf_communication_group_send_message(
           INF_COMMUNICATION_GROUP(priv->group),
-          INF_XML_CONNECTION(item->data),
+          INF_XML_CONNECTION(key),
           xmlCopyNode(xml, 1)
         );
       }
@@ -1173,7 +1228,7 @@ infd_directory_send(InfdDirectory* directory,
       {
         inf_communication_group_send_message(
           INF_COMMUNICATION_GROUP(priv->group),
-          INF_XML_CONNECTION(item->data),
+          INF_XML_CONNECTION(key),
           xml
         );
       }
@@ -2235,6 +2290,35 @@ infd_directory_node_remove(InfdDirectory* directory,
   return TRUE;
 }
 
+/* Returns the session for the given node if it exists already, either
+ * because it is linked or because it is part of a subscription request. */
+static InfdSessionProxy*
+infd_directory_node_find_session(InfdDirectory* directory,
+                                 InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  GSList* item;
+  InfdDirectorySubreq* request;
+
+  g_assert(node->type == INFD_STORAGE_NODE_NOTE);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(node->shared.note.session != NULL)
+    return node->shared.note.session;
+
+  /* The session could already exist in a subscribe-session subreq */
+  for(item = priv->subscription_requests; item != NULL; item = item->next)
+  {
+    request = (InfdDirectorySubreq*)item->data;
+    if(request->type == INFD_DIRECTORY_SUBREQ_SESSION)
+      if(request->node_id == node->id)
+        return request->shared.session.session;
+  }
+
+  return NULL;
+}
+
 /* Returns the session for the given node. This does not link the session
  * (if it isn't already). This means that the next time this function is
  * called, the session will be created again if you don't link it yourself,
@@ -2247,8 +2331,6 @@ infd_directory_node_get_session(InfdDirectory* directory,
 {
   InfdDirectoryPrivate* priv;
   InfSession* session;
-  GSList* item;
-  InfdDirectorySubreq* request;
   InfdSessionProxy* proxy;
   gchar* path;
 
@@ -2256,10 +2338,9 @@ infd_directory_node_get_session(InfdDirectory* directory,
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  if(node->shared.note.session != NULL)
+  proxy = infd_directory_node_find_session(directory, node);
+  if(proxy != NULL)
   {
-    proxy = node->shared.note.session;
-
     g_object_ref(proxy);
     return proxy;
   }
@@ -2267,27 +2348,6 @@ infd_directory_node_get_session(InfdDirectory* directory,
   /* If we don't have a background storage then all nodes are in memory */
   g_assert(priv->storage != NULL);
 
-  /* The session could already exist in a subscribe-session subreq */
-  proxy = NULL;
-  for(item = priv->subscription_requests; item != NULL; item = item->next)
-  {
-    request = (InfdDirectorySubreq*)item->data;
-    if(request->type == INFD_DIRECTORY_SUBREQ_SESSION)
-    {
-      if(request->node_id == node->id)
-      {
-        proxy = request->shared.session.session;
-        break;
-      }
-    }
-  }
-
-  if(proxy != NULL)
-  {
-    g_object_ref(proxy);
-    return proxy;
-  }
-
   infd_directory_node_get_path(node, &path, NULL);
   session = node->shared.note.plugin->session_read(
     priv->storage,
@@ -2551,7 +2611,8 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
     if(infd_directory_node_explore(directory, node, error) == FALSE)
       return FALSE;
 
-  if(g_slist_find(node->shared.subdir.connections, connection) != NULL)
+  if(node->shared.subdir.connections != NULL &&
+     g_hash_table_lookup(node->shared.subdir.connections, connection) != NULL)
   {
     g_set_error(
       error,
@@ -2607,10 +2668,7 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
 
   /* Remember that this connection explored that node so that it gets
    * notified when changes occur. */
-  node->shared.subdir.connections = g_slist_prepend(
-    node->shared.subdir.connections,
-    connection
-  );
+  infd_directory_node_add_connection(directory, node, connection);
 
   g_free(seq);
   return TRUE;
@@ -3317,6 +3375,41 @@ infd_directory_handle_subscribe_nack(InfdDirectory* directory,
   return result;
 }
 
+static gboolean
+infd_directory_handle_hello(InfdDirectory* directory,
+                            InfXmlConnection* connection,
+                            const xmlNodePtr xml,
+                            GError** error)
+{
+  xmlChar* version;
+  guint major;
+  guint minor;
+  gboolean result;
+
+  version = inf_xml_util_get_attribute_required(
+    xml,
+    "protocol-version",
+    error
+  );
+
+  if(version == NULL) return FALSE;
+
+  result = inf_protocol_parse_version(
+    (const gchar*)version,
+    &major,
+    &minor,
+    error
+  );
+
+  xmlFree(version);
+  if(result == FALSE) return FALSE;
+
+  /* Sessions check this before sending messages that were added in later
+   * versions of the protocol. */
+  inf_protocol_set_remote_version(connection, major, minor);
+  return TRUE;
+}
+
 /*
  * Signal handlers.
  */
@@ -3352,10 +3445,7 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
   directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  if(priv->root != NULL && priv->root->shared.subdir.explored)
-  {
-    infd_directory_node_remove_connection(priv->root, connection);
-  }
+  infd_directory_node_remove_connection(directory, connection);
 
   /* Remove all subscription requests for this connection */
   item = priv->subscription_requests;
@@ -3369,6 +3459,7 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
   }
 
   info = g_hash_table_lookup(priv->connections, connection);
+  g_hash_table_destroy(info->explored);
   g_slice_free(InfdDirectoryConnectionInfo, info);
 
   inf_signal_handlers_disconnect_by_func(G_OBJECT(connection),
@@ -3705,7 +3796,8 @@ infd_directory_add_session(InfdDirectory* directory,
     directory
   );
 
-  if(infd_session_proxy_is_idle(node->shared.note.session))
+  if(infd_session_proxy_is_idle(node->shared.note.session) &&
+     !node->shared.note.preloaded)
   {
     infd_directory_start_session_save_timeout(directory, node);
   }
@@ -3843,6 +3935,16 @@ infd_directory_communication_object_received(InfCommunicationObject* object,
       &local_error
     );
   }
+  else if(strcmp((const char*)node->name, "hello") == 0)
+  {
+    /* Don't reply to hello. */
+    infd_directory_handle_hello(
+      directory,
+      connection,
+      node,
+      &local_error
+    );
+  }
   else
   {
     g_set_error(
@@ -4373,6 +4475,7 @@ infd_directory_add_connection(InfdDirectory* directory,
 
   info = g_slice_new(InfdDirectoryConnectionInfo);
   info->seq_id = seq_id;
+  info->explored = g_hash_table_new(NULL, NULL);
 
   g_hash_table_insert(priv->connections, connection, info);
   g_object_ref(connection);
@@ -4962,6 +5065,60 @@ infd_directory_iter_peek_session(InfdDirectory* directory,
   return node->shared.note.session;
 }
 
+/**
+ * infd_directory_iter_set_session:
+ * @directory: A #InfdDirectory.
+ * @iter: A #InfdDirectoryIter pointing to a note in @directory.
+ * @session: A #InfSession for the note @iter points to.
+ *
+ * Makes @session the running session for the note @iter points to. @session
+ * needs to have been read from the background storage of @directory with
+ * the note plugin of the note, for example in another thread, and must not
+ * have been modified since.
+ *
+ * This allows to load notes before they are needed. Therefore, unlike
+ * sessions created by infd_directory_iter_get_session(), @session is not
+ * removed from memory while it is idle until someone has subscribed to it.
+ *
+ * If the note has a running session already, @session is not used, and the
+ * existing session is returned.
+ *
+ * Return Value: A #InfdSessionProxy for the note @iter points to.
+ **/
+InfdSessionProxy*
+infd_directory_iter_set_session(InfdDirectory* directory,
+                                InfdDirectoryIter* iter,
+                                InfSession* session)
+{
+  InfdDirectoryNode* node;
+  InfdSessionProxy* proxy;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), NULL);
+  infd_directory_return_val_if_iter_fail(directory, iter, NULL);
+  g_return_val_if_fail(INF_IS_SESSION(session), NULL);
+
+  node = (InfdDirectoryNode*)iter->node;
+  g_return_val_if_fail(node->type == INFD_STORAGE_NODE_NOTE, NULL);
+
+  proxy = infd_directory_node_find_session(directory, node);
+  if(proxy != NULL)
+    return proxy;
+
+  inf_buffer_set_modified(inf_session_get_buffer(session), FALSE);
+
+  proxy = infd_directory_create_session_proxy_for_node(
+    directory,
+    node->id,
+    session
+  );
+
+  node->shared.note.preloaded = TRUE;
+  infd_directory_node_link_session(directory, node, proxy);
+  g_object_unref(proxy);
+
+  return node->shared.note.session;
+}
+
 /**
  * infd_directory_iter_save_session:
  * @directory: A #InfdDirectory.
@@ -187,6 +187,11 @@ InfdSessionProxy*
 infd_directory_iter_peek_session(InfdDirectory* directory,
                                  InfdDirectoryIter* iter);
 
+InfdSessionProxy*
+infd_directory_iter_set_session(InfdDirectory* directory,
+                                InfdDirectoryIter* iter,
+                                InfSession* session);
+
 gboolean
 infd_directory_iter_save_session(InfdDirectory* directory,
                                  InfdDirectoryIter* iter,
@@ -25,14 +25,14 @@
 
 #include <glib/gstdio.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <string.h>
 #include <errno.h>
 
 #ifdef G_OS_WIN32
 # include <windows.h>
 #else
-# include <sys/types.h>
-# include <sys/stat.h>
 # include <fcntl.h>
 # include <dirent.h>
 # include <unistd.h>
@@ -41,14 +41,22 @@
 typedef struct _InfdFilesystemStoragePrivate InfdFilesystemStoragePrivate;
 struct _InfdFilesystemStoragePrivate {
   gchar* root_directory;
+  InfdFilesystemStorageFormat format;
+  gboolean use_index;
 };
 
 enum {
   PROP_0,
 
-  PROP_ROOT_DIRECTORY
+  PROP_ROOT_DIRECTORY,
+  PROP_FORMAT,
+  PROP_USE_INDEX
 };
 
+#define INFD_FILESYSTEM_STORAGE_INDEX_NAME ".infd-index"
+#define INFD_FILESYSTEM_STORAGE_INDEX_VERSION "InfdIndex 2"
+#define INFD_FILESYSTEM_STORAGE_INDEX_SLACK 64
+
 #define INFD_FILESYSTEM_STORAGE_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_FILESYSTEM_STORAGE, InfdFilesystemStoragePrivate))
 
 static GObjectClass* parent_class;
@@ -67,7 +75,8 @@ infd_filesystem_storage_verify_path(const gchar* path,
   for(component = components; *component != NULL; ++ component)
   {
     if(*component == '\0' ||
-       strcmp(*component, ".") == 0 || strcmp(*component, "..") == 0)
+       strcmp(*component, ".") == 0 || strcmp(*component, "..") == 0 ||
+       strcmp(*component, INFD_FILESYSTEM_STORAGE_INDEX_NAME) == 0)
     {
       g_set_error(
         error,
@@ -235,6 +244,471 @@ infd_filesystem_storage_remove_rec(const gchar* path,
 #endif
 }
 
+/* The index caches the content of a directory, so that exploring it does not
+ * need to scan the directory. After the version line, it records the
+ * modification time of the directory as of the last change made through the
+ * storage. Then follows a snapshot of the directory, terminated by an "end"
+ * line, and the changes that were made through the storage afterwards. Each
+ * line consists of tab-separated fields. The index is only used if the
+ * directory modification time still matches the recorded one, so any change
+ * to the directory that was not made through the storage invalidates it. */
+
+/* The fields are fixed-width so that the line can be overwritten in place.
+ * They are zero-padded, so they must be read back with %d rather than %i,
+ * which would take them for octal numbers. */
+#define INFD_FILESYSTEM_STORAGE_INDEX_MTIME_FORMAT \
+  "mtime\t%020" G_GINT64_MODIFIER "d\t%09ld\n"
+
+static gboolean
+infd_filesystem_storage_index_stat(const gchar* full_name,
+                                   gint64* sec,
+                                   glong* nsec)
+{
+  struct stat buf;
+
+  if(g_stat(full_name, &buf) == -1)
+    return FALSE;
+
+  *sec = buf.st_mtime;
+#ifdef HAVE_STAT_MTIM
+  *nsec = buf.st_mtim.tv_nsec;
+#else
+  *nsec = 0;
+#endif
+  return TRUE;
+}
+
+/* Writes the current modification time of the given directory to stream */
+static gboolean
+infd_filesystem_storage_index_write_mtime(FILE* stream,
+                                          const gchar* full_name)
+{
+  GTimeVal now;
+  gint64 sec;
+  glong nsec;
+
+  if(!infd_filesystem_storage_index_stat(full_name, &sec, &nsec))
+    return FALSE;
+
+  /* If the modification time has a resolution of one second only, another
+   * change in the same second would not change it, so the index cannot be
+   * trusted until it has been rewritten after that second. */
+  g_get_current_time(&now);
+  if(nsec == 0 && sec >= now.tv_sec)
+    sec = -1;
+
+  fprintf(stream, INFD_FILESYSTEM_STORAGE_INDEX_MTIME_FORMAT, sec, nsec);
+  return TRUE;
+}
+
+static gboolean
+infd_filesystem_storage_index_is_valid(const gchar* full_name)
+{
+  gchar* index_name;
+  FILE* stream;
+  gchar line[64];
+  gboolean ret;
+  gint64 index_sec;
+  glong index_nsec;
+  gint64 sec;
+  glong nsec;
+
+  index_name = g_build_filename(
+    full_name,
+    INFD_FILESYSTEM_STORAGE_INDEX_NAME,
+    NULL
+  );
+
+  stream = g_fopen(index_name, "r");
+  g_free(index_name);
+
+  if(stream == NULL)
+    return FALSE;
+
+  ret = fgets(line, sizeof(line), stream) != NULL &&
+    strcmp(line, INFD_FILESYSTEM_STORAGE_INDEX_VERSION "\n") == 0 &&
+    fgets(line, sizeof(line), stream) != NULL &&
+    sscanf(
+      line,
+      "mtime\t%" G_GINT64_MODIFIER "d\t%ld",
+      &index_sec,
+      &index_nsec
+    ) == 2;
+
+  fclose(stream);
+
+  if(!ret || index_sec == -1)
+    return FALSE;
+  if(!infd_filesystem_storage_index_stat(full_name, &sec, &nsec))
+    return FALSE;
+
+  return sec == index_sec && nsec == index_nsec;
+}
+
+static gchar*
+infd_filesystem_storage_index_key(const gchar* name,
+                                  const gchar* identifier)
+{
+  if(identifier != NULL)
+    return g_strconcat(name, ".", identifier, NULL);
+  else
+    return g_strdup(name);
+}
+
+static gboolean
+infd_filesystem_storage_index_steal_func(gpointer key,
+                                         gpointer value,
+                                         gpointer user_data)
+{
+  GSList** list;
+  list = (GSList**)user_data;
+
+  *list = g_slist_prepend(*list, value);
+  g_free(key);
+  return TRUE;
+}
+
+static GSList*
+infd_filesystem_storage_index_steal(GHashTable* table)
+{
+  GSList* list;
+  list = NULL;
+
+  g_hash_table_foreach_steal(
+    table,
+    infd_filesystem_storage_index_steal_func,
+    &list
+  );
+
+  return list;
+}
+
+static gboolean
+infd_filesystem_storage_index_apply(GHashTable* table,
+                                    gchar* line)
+{
+  gchar* fields[4];
+  gchar* name;
+  gchar* identifier;
+  gchar* key;
+  guint n_fields;
+  gchar* sep;
+  InfdStorageNode* node;
+
+  n_fields = 0;
+  fields[n_fields++] = line;
+  for(sep = strchr(line, '\t'); sep != NULL; sep = strchr(sep + 1, '\t'))
+  {
+    if(n_fields == G_N_ELEMENTS(fields))
+      return FALSE;
+
+    *sep = '\0';
+    fields[n_fields++] = sep + 1;
+  }
+
+  if(n_fields < 2)
+    return FALSE;
+
+  name = g_strcompress(fields[1]);
+  identifier = NULL;
+  if(n_fields > 2)
+    identifier = g_strcompress(fields[2]);
+
+  if(strcmp(fields[0], "d") == 0 && n_fields == 2)
+  {
+    node = infd_storage_node_new_subdirectory(name);
+  }
+  else if(strcmp(fields[0], "n") == 0 && n_fields == 3)
+  {
+    node = infd_storage_node_new_note(name, identifier);
+  }
+  else if( (strcmp(fields[0], "rd") == 0 && n_fields == 2) ||
+           (strcmp(fields[0], "rn") == 0 && n_fields == 3))
+  {
+    node = NULL;
+  }
+  else
+  {
+    g_free(name);
+    g_free(identifier);
+    return FALSE;
+  }
+
+  /* This replaces an existing entry with the same name on disk */
+  key = infd_filesystem_storage_index_key(name, identifier);
+  if(node != NULL)
+  {
+    g_hash_table_insert(table, key, node);
+  }
+  else
+  {
+    g_hash_table_remove(table, key);
+    g_free(key);
+  }
+
+  g_free(name);
+  g_free(identifier);
+  return TRUE;
+}
+
+static void
+infd_filesystem_storage_index_write(const gchar* full_name,
+                                    GSList* list);
+
+/* Reads the index of the given directory, and returns TRUE if it is valid.
+ * In that case list is set to the nodes in the directory. */
+static gboolean
+infd_filesystem_storage_index_read(const gchar* full_name,
+                                   GSList** list)
+{
+  GHashTable* table;
+  gchar* index_name;
+  gchar* content;
+  gsize length;
+  gchar* line;
+  gchar* next;
+  gboolean have_snapshot;
+  guint n_changes;
+  guint n_nodes;
+
+  if(!infd_filesystem_storage_index_is_valid(full_name))
+    return FALSE;
+
+  index_name = g_build_filename(
+    full_name,
+    INFD_FILESYSTEM_STORAGE_INDEX_NAME,
+    NULL
+  );
+
+  if(!g_file_get_contents(index_name, &content, &length, NULL))
+  {
+    g_free(index_name);
+    return FALSE;
+  }
+
+  g_free(index_name);
+
+  table = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    (GDestroyNotify)infd_storage_node_free
+  );
+
+  line = content;
+  next = memchr(line, '\n', length);
+  if(next == NULL ||
+     (gsize)(next - line) != strlen(INFD_FILESYSTEM_STORAGE_INDEX_VERSION) ||
+     strncmp(line, INFD_FILESYSTEM_STORAGE_INDEX_VERSION, next - line) != 0)
+  {
+    g_hash_table_destroy(table);
+    g_free(content);
+    return FALSE;
+  }
+
+  /* Skip the modification time, which has been checked already */
+  line = next + 1;
+  next = memchr(line, '\n', content + length - line);
+  if(next == NULL)
+  {
+    g_hash_table_destroy(table);
+    g_free(content);
+    return FALSE;
+  }
+
+  have_snapshot = FALSE;
+  n_changes = 0;
+
+  /* A last line without newline is a change that was not written
+   * completely, so we ignore it. */
+  for(line = next + 1;
+      (next = memchr(line, '\n', content + length - line)) != NULL;
+      line = next + 1)
+  {
+    *next = '\0';
+
+    if(!have_snapshot && strcmp(line, "end") == 0)
+    {
+      have_snapshot = TRUE;
+    }
+    else if(!infd_filesystem_storage_index_apply(table, line))
+    {
+      g_hash_table_destroy(table);
+      g_free(content);
+      return FALSE;
+    }
+    else if(have_snapshot)
+    {
+      ++ n_changes;
+    }
+  }
+
+  g_free(content);
+
+  /* The snapshot was not written completely */
+  if(!have_snapshot)
+  {
+    g_hash_table_destroy(table);
+    return FALSE;
+  }
+
+  /* Replace the changes by a new snapshot once there are more of them than
+   * there are nodes in the directory. */
+  n_nodes = g_hash_table_size(table);
+  *list = infd_filesystem_storage_index_steal(table);
+  if(n_changes > n_nodes + INFD_FILESYSTEM_STORAGE_INDEX_SLACK)
+    infd_filesystem_storage_index_write(full_name, *list);
+
+  g_hash_table_destroy(table);
+  return TRUE;
+}
+
+static void
+infd_filesystem_storage_index_write_line(FILE* stream,
+                                         const gchar* op,
+                                         const gchar* name,
+                                         const gchar* identifier)
+{
+  gchar* escaped_name;
+  gchar* escaped_identifier;
+
+  escaped_name = g_strescape(name, NULL);
+  if(identifier != NULL)
+  {
+    escaped_identifier = g_strescape(identifier, NULL);
+    fprintf(stream, "%s\t%s\t%s\n", op, escaped_name, escaped_identifier);
+    g_free(escaped_identifier);
+  }
+  else
+  {
+    fprintf(stream, "%s\t%s\n", op, escaped_name);
+  }
+
+  g_free(escaped_name);
+}
+
+/* Writes a new snapshot of the given directory into its index. The file is
+ * overwritten in place, so that the directory itself is not modified if the
+ * index exists already. If anything fails, the index is removed. The
+ * modification time is taken after opening the index, since creating it
+ * modifies the directory. */
+static void
+infd_filesystem_storage_index_write(const gchar* full_name,
+                                    GSList* list)
+{
+  gchar* index_name;
+  FILE* stream;
+  GSList* item;
+  InfdStorageNode* node;
+  int ret;
+
+  index_name = g_build_filename(
+    full_name,
+    INFD_FILESYSTEM_STORAGE_INDEX_NAME,
+    NULL
+  );
+
+  stream = g_fopen(index_name, "w");
+  if(stream == NULL)
+  {
+    g_free(index_name);
+    return;
+  }
+
+  fprintf(stream, "%s\n", INFD_FILESYSTEM_STORAGE_INDEX_VERSION);
+  if(!infd_filesystem_storage_index_write_mtime(stream, full_name))
+  {
+    fclose(stream);
+    g_unlink(index_name);
+    g_free(index_name);
+    return;
+  }
+
+  for(item = list; item != NULL; item = item->next)
+  {
+    node = (InfdStorageNode*)item->data;
+    if(node->type == INFD_STORAGE_NODE_SUBDIRECTORY)
+    {
+      infd_filesystem_storage_index_write_line(stream, "d", node->name, NULL);
+    }
+    else
+    {
+      infd_filesystem_storage_index_write_line(
+        stream,
+        "n",
+        node->name,
+        node->identifier
+      );
+    }
+  }
+
+  fprintf(stream, "end\n");
+
+  ret = ferror(stream);
+  if(fclose(stream) != 0 || ret != 0)
+    g_unlink(index_name);
+
+  g_free(index_name);
+}
+
+/* Records a change made through the storage in the index of the directory
+ * containing it, and updates the modification time recorded in the index to
+ * the one after the change. The caller needs to check whether the index was
+ * valid before making the change, since the change itself invalidates it.
+ * The change is written first, so that the index stays invalid if updating
+ * the modification time fails. */
+static void
+infd_filesystem_storage_index_append(const gchar* full_name,
+                                     const gchar* op,
+                                     const gchar* path,
+                                     const gchar* identifier)
+{
+  gchar* index_name;
+  const gchar* name;
+  FILE* stream;
+  int ret;
+
+  index_name = g_build_filename(
+    full_name,
+    INFD_FILESYSTEM_STORAGE_INDEX_NAME,
+    NULL
+  );
+
+  name = strrchr(path, '/');
+  if(name != NULL) ++ name;
+  else name = path;
+
+  /* Not "a", which would create the index if it was removed meanwhile */
+  stream = g_fopen(index_name, "r+");
+  if(stream != NULL)
+  {
+    ret = fseek(stream, 0, SEEK_END);
+    if(ret == 0)
+    {
+      infd_filesystem_storage_index_write_line(stream, op, name, identifier);
+
+      ret = fseek(
+        stream,
+        strlen(INFD_FILESYSTEM_STORAGE_INDEX_VERSION) + 1,
+        SEEK_SET
+      );
+    }
+
+    if(ret == 0 &&
+       !infd_filesystem_storage_index_write_mtime(stream, full_name))
+    {
+      ret = -1;
+    }
+
+    if(ret == 0)
+      ret = ferror(stream);
+    if(fclose(stream) != 0 || ret != 0)
+      g_unlink(index_name);
+  }
+
+  g_free(index_name);
+}
+
 static void
 infd_filesystem_storage_init(GTypeInstance* instance,
                              gpointer g_class)
@@ -246,6 +720,8 @@ infd_filesystem_storage_init(GTypeInstance* instance,
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
   priv->root_directory = NULL;
+  priv->format = INFD_FILESYSTEM_STORAGE_FORMAT_XML;
+  priv->use_index = FALSE;
 }
 
 static void
@@ -282,6 +758,12 @@ infd_filesystem_storage_set_property(GObject* object,
       g_value_get_string(value)
     );
 
+    break;
+  case PROP_FORMAT:
+    priv->format = g_value_get_enum(value);
+    break;
+  case PROP_USE_INDEX:
+    priv->use_index = g_value_get_boolean(value);
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -306,6 +788,12 @@ infd_filesystem_storage_get_property(GObject* object,
   case PROP_ROOT_DIRECTORY:
     g_value_set_string(value, priv->root_directory);
     break;
+  case PROP_FORMAT:
+    g_value_set_enum(value, priv->format);
+    break;
+  case PROP_USE_INDEX:
+    g_value_set_boolean(value, priv->use_index);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -353,6 +841,13 @@ infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
 
   list = NULL;
 
+  if(priv->use_index &&
+     infd_filesystem_storage_index_read(full_name, &list) == TRUE)
+  {
+    g_free(full_name);
+    return list;
+  }
+
 #if !defined(G_OS_WIN32) && !defined(__APPLE__)
   dir_fd = open(full_name, O_NOFOLLOW | O_RDONLY);
   if(dir_fd == -1 || (dir = fdopendir(dir_fd)) == NULL)
@@ -375,8 +870,10 @@ infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
                                         NULL,
                                         &name_len,
                                         NULL);
-    if(converted_name != NULL && strcmp(converted_name, ".") != 0
-                              && strcmp(converted_name, "..") != 0)
+    if(converted_name != NULL &&
+       strcmp(converted_name, ".") != 0 &&
+       strcmp(converted_name, "..") != 0 &&
+       strcmp(converted_name, INFD_FILESYSTEM_STORAGE_INDEX_NAME) != 0)
     {
       filetype = F_UNKNOWN;
 
@@ -459,6 +956,13 @@ infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
   for(name = g_dir_read_name(dir); name != NULL; name = g_dir_read_name(dir))
   {
     converted_name = g_filename_to_utf8(name, -1, NULL, &name_len, NULL);
+    if(converted_name != NULL &&
+       strcmp(converted_name, INFD_FILESYSTEM_STORAGE_INDEX_NAME) == 0)
+    {
+      g_free(converted_name);
+      continue;
+    }
+
     if(converted_name != NULL)
     {
       file_path = g_build_filename(full_name, name, NULL);
@@ -490,6 +994,9 @@ infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
 
   g_dir_close(dir);
 #endif
+  if(priv->use_index)
+    infd_filesystem_storage_index_write(full_name, list);
+
   g_free(full_name);
   return list;
 }
@@ -503,6 +1010,8 @@ infd_filesystem_storage_storage_create_subdirectory(InfdStorage* storage,
   InfdFilesystemStoragePrivate* priv;
   gchar* converted_name;
   gchar* full_name;
+  gchar* parent_name;
+  gboolean index_valid;
   int ret;
   int save_errno;
 
@@ -519,17 +1028,35 @@ infd_filesystem_storage_storage_create_subdirectory(InfdStorage* storage,
   full_name = g_build_filename(priv->root_directory, converted_name, NULL);
   g_free(converted_name);
 
+  parent_name = NULL;
+  index_valid = FALSE;
+  if(priv->use_index)
+  {
+    parent_name = g_path_get_dirname(full_name);
+    index_valid = infd_filesystem_storage_index_is_valid(parent_name);
+  }
+
   ret = g_mkdir(full_name, 0755);
   save_errno = errno;
 
-  g_free(full_name);
   if(ret == -1)
   {
+    g_free(parent_name);
+    g_free(full_name);
     infd_filesystem_storage_system_error(save_errno, error);
     return FALSE;
   }
 
+  if(priv->use_index)
+  {
+    /* The new directory is empty, so we know its index already */
+    infd_filesystem_storage_index_write(full_name, NULL);
+    if(index_valid)
+      infd_filesystem_storage_index_append(parent_name, "d", path, NULL);
+  }
 
+  g_free(parent_name);
+  g_free(full_name);
   return TRUE;
 }
 
@@ -544,9 +1071,11 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   gchar* converted_name;
   gchar* disk_name;
   gchar* full_name;
+  gchar* parent_name;
 #ifdef G_OS_WIN32
   gchar* sep;
 #endif
+  gboolean index_valid;
   gboolean ret;
 
   fs_storage = INFD_FILESYSTEM_STORAGE(storage);
@@ -580,9 +1109,28 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   full_name = g_build_filename(priv->root_directory, disk_name, NULL);
   g_free(disk_name);
 
+  parent_name = NULL;
+  index_valid = FALSE;
+  if(priv->use_index)
+  {
+    parent_name = g_path_get_dirname(full_name);
+    index_valid = infd_filesystem_storage_index_is_valid(parent_name);
+  }
+
   ret = infd_filesystem_storage_remove_rec(full_name, error);
   g_free(full_name);
 
+  if(ret == TRUE && index_valid == TRUE)
+  {
+    infd_filesystem_storage_index_append(
+      parent_name,
+      identifier != NULL ? "rn" : "rd",
+      path,
+      identifier
+    );
+  }
+
+  g_free(parent_name);
   return ret;
 }
 
@@ -622,6 +1170,32 @@ infd_filesystem_storage_class_init(gpointer g_class,
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
     )
   );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_FORMAT,
+    g_param_spec_enum(
+      "format",
+      "Format",
+      "The format in which to write notes",
+      INFD_TYPE_FILESYSTEM_STORAGE_FORMAT,
+      INFD_FILESYSTEM_STORAGE_FORMAT_XML,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_USE_INDEX,
+    g_param_spec_boolean(
+      "use-index",
+      "Use index",
+      "Whether to keep an index of each directory to explore it without "
+      "scanning it",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 static void
@@ -639,6 +1213,38 @@ infd_filesystem_storage_storage_init(gpointer g_iface,
     infd_filesystem_storage_storage_remove_node;
 }
 
+GType
+infd_filesystem_storage_format_get_type(void)
+{
+  static GType filesystem_storage_format_type = 0;
+
+  if(!filesystem_storage_format_type)
+  {
+    static const GEnumValue filesystem_storage_format_values[] = {
+      {
+        INFD_FILESYSTEM_STORAGE_FORMAT_XML,
+        "INFD_FILESYSTEM_STORAGE_FORMAT_XML",
+        "xml"
+      }, {
+        INFD_FILESYSTEM_STORAGE_FORMAT_BINARY,
+        "INFD_FILESYSTEM_STORAGE_FORMAT_BINARY",
+        "binary"
+      }, {
+        0,
+        NULL,
+        NULL
+      }
+    };
+
+    filesystem_storage_format_type = g_enum_register_static(
+      "InfdFilesystemStorageFormat",
+      filesystem_storage_format_values
+    );
+  }
+
+  return filesystem_storage_format_type;
+}
+
 GType
 infd_filesystem_storage_get_type(void)
 {
@@ -730,6 +1336,8 @@ infd_filesystem_storage_open(InfdFilesystemStorage* storage,
   gchar* converted_name;
   gchar* disk_name;
   gchar* full_name;
+  gchar* parent_name;
+  gboolean index_valid;
   FILE* res;
   int save_errno;
 #ifndef G_OS_WIN32
@@ -751,6 +1359,16 @@ infd_filesystem_storage_open(InfdFilesystemStorage* storage,
   full_name = g_build_filename(priv->root_directory, disk_name, NULL);
   g_free(disk_name);
 
+  /* Only creating a new note changes the directory content */
+  parent_name = NULL;
+  index_valid = FALSE;
+  if(priv->use_index && strcmp(mode, "w") == 0 &&
+     !g_file_test(full_name, G_FILE_TEST_EXISTS))
+  {
+    parent_name = g_path_get_dirname(full_name);
+    index_valid = infd_filesystem_storage_index_is_valid(parent_name);
+  }
+
 #ifdef G_OS_WIN32
   res = g_fopen(full_name, mode);
 #else
@@ -768,11 +1386,96 @@ infd_filesystem_storage_open(InfdFilesystemStorage* storage,
 
   if(res == NULL)
   {
+    g_free(parent_name);
     infd_filesystem_storage_system_error(save_errno, error);
     return NULL;
   }
 
+  if(index_valid)
+    infd_filesystem_storage_index_append(parent_name, "n", path, identifier);
+
+  g_free(parent_name);
   return res;
 }
 
+/**
+ * infd_filesystem_storage_get_format:
+ * @storage: A #InfdFilesystemStorage.
+ *
+ * Returns the format in which notes are written into @storage. See
+ * infd_filesystem_storage_set_format().
+ *
+ * Returns: The format for newly written notes.
+ **/
+InfdFilesystemStorageFormat
+infd_filesystem_storage_get_format(InfdFilesystemStorage* storage)
+{
+  g_return_val_if_fail(
+    INFD_IS_FILESYSTEM_STORAGE(storage),
+    INFD_FILESYSTEM_STORAGE_FORMAT_XML
+  );
+
+  return INFD_FILESYSTEM_STORAGE_PRIVATE(storage)->format;
+}
+
+/**
+ * infd_filesystem_storage_set_format:
+ * @storage: A #InfdFilesystemStorage.
+ * @format: The format in which to write notes.
+ *
+ * Sets the format in which note plugins write notes into @storage. Note
+ * plugins detect the format of a note when reading it, so existing notes
+ * stay readable, and are converted to @format the next time they are
+ * written.
+ **/
+void
+infd_filesystem_storage_set_format(InfdFilesystemStorage* storage,
+                                   InfdFilesystemStorageFormat format)
+{
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+
+  INFD_FILESYSTEM_STORAGE_PRIVATE(storage)->format = format;
+  g_object_notify(G_OBJECT(storage), "format");
+}
+
+/**
+ * infd_filesystem_storage_get_use_index:
+ * @storage: A #InfdFilesystemStorage.
+ *
+ * Returns whether @storage keeps an index of its directories. See
+ * infd_filesystem_storage_set_use_index().
+ *
+ * Returns: Whether directory indices are used.
+ **/
+gboolean
+infd_filesystem_storage_get_use_index(InfdFilesystemStorage* storage)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  return INFD_FILESYSTEM_STORAGE_PRIVATE(storage)->use_index;
+}
+
+/**
+ * infd_filesystem_storage_set_use_index:
+ * @storage: A #InfdFilesystemStorage.
+ * @use_index: Whether to use directory indices.
+ *
+ * Sets whether @storage keeps an index of the content of each directory in
+ * a hidden file within that directory. With an index, reading a
+ * subdirectory only needs to read the index instead of scanning the
+ * directory and examining every file in it. The index is updated when
+ * subdirectories and notes are created or removed through @storage. If the
+ * directory was modified after the index was written, for example by
+ * another program, then the index is ignored, and the directory is scanned
+ * and indexed again.
+ **/
+void
+infd_filesystem_storage_set_use_index(InfdFilesystemStorage* storage,
+                                      gboolean use_index)
+{
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+
+  INFD_FILESYSTEM_STORAGE_PRIVATE(storage)->use_index = use_index;
+  g_object_notify(G_OBJECT(storage), "use-index");
+}
+
 /* vim:set et sw=2 ts=2: */
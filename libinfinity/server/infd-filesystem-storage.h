@@ -35,6 +35,8 @@ G_BEGIN_DECLS
 
 #define INFD_TYPE_FILESYSTEM_STORAGE_ITER            (infd_filesystem_storage_iter_get_type())
 
+#define INFD_TYPE_FILESYSTEM_STORAGE_FORMAT          (infd_filesystem_storage_format_get_type())
+
 typedef struct _InfdFilesystemStorage InfdFilesystemStorage;
 typedef struct _InfdFilesystemStorageClass InfdFilesystemStorageClass;
 
@@ -47,6 +49,21 @@ typedef enum _InfdFilesystemStorageError {
   INFD_FILESYSTEM_STORAGE_ERROR_FAILED
 } InfdFilesystemStorageError;
 
+/**
+ * InfdFilesystemStorageFormat:
+ * @INFD_FILESYSTEM_STORAGE_FORMAT_XML: Notes are stored as XML.
+ * @INFD_FILESYSTEM_STORAGE_FORMAT_BINARY: Notes are stored in a binary
+ * format specific to the note type, if the note plugin supports one, and
+ * as XML otherwise.
+ *
+ * The format in which note plugins write notes into a
+ * #InfdFilesystemStorage.
+ */
+typedef enum _InfdFilesystemStorageFormat {
+  INFD_FILESYSTEM_STORAGE_FORMAT_XML,
+  INFD_FILESYSTEM_STORAGE_FORMAT_BINARY
+} InfdFilesystemStorageFormat;
+
 struct _InfdFilesystemStorageClass {
   GObjectClass parent_class;
 };
@@ -55,6 +72,9 @@ struct _InfdFilesystemStorage {
   GObject parent;
 };
 
+GType
+infd_filesystem_storage_format_get_type(void) G_GNUC_CONST;
+
 GType
 infd_filesystem_storage_get_type(void) G_GNUC_CONST;
 
@@ -68,6 +88,20 @@ infd_filesystem_storage_open(InfdFilesystemStorage* storage,
                              const gchar* mode,
                              GError** error);
 
+InfdFilesystemStorageFormat
+infd_filesystem_storage_get_format(InfdFilesystemStorage* storage);
+
+void
+infd_filesystem_storage_set_format(InfdFilesystemStorage* storage,
+                                   InfdFilesystemStorageFormat format);
+
+gboolean
+infd_filesystem_storage_get_use_index(InfdFilesystemStorage* storage);
+
+void
+infd_filesystem_storage_set_use_index(InfdFilesystemStorage* storage,
+                                      gboolean use_index);
+
 G_END_DECLS
 
 #endif /* __INFD_FILESYSTEM_STORAGE_H__ */
@@ -42,6 +42,7 @@ struct _InfdXmppServerPrivate {
   InfdXmppServerStatus status;
   gchar* local_hostname;
   InfXmppConnectionSecurityPolicy security_policy;
+  gint compression_level;
 
   InfCertificateCredentials* tls_creds;
 
@@ -61,6 +62,7 @@ enum {
   PROP_SASL_MECHANISMS,
 
   PROP_SECURITY_POLICY,
+  PROP_COMPRESSION_LEVEL,
 
   /* Overridden from XML server */
   PROP_STATUS
@@ -110,6 +112,12 @@ infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
 
   g_free(addr_str);
 
+  g_object_set(
+    G_OBJECT(xmpp_connection),
+    "compression-level", priv->compression_level,
+    NULL
+  );
+
   /* We could, alternatively, keep the connection around until authentication
    * has completed and emit the new_connection signal after that, to guarantee
    * that the connection is open when new_connection is emitted. */
@@ -353,6 +361,7 @@ infd_xmpp_server_init(GTypeInstance* instance,
   priv->status = INFD_XMPP_SERVER_CLOSED;
   priv->local_hostname = g_strdup(g_get_host_name());
   priv->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED;
+  priv->compression_level = 0;
 
   priv->tls_creds = NULL;
   priv->sasl_context = NULL;
@@ -487,6 +496,9 @@ infd_xmpp_server_set_property(GObject* object,
   case PROP_SECURITY_POLICY:
     infd_xmpp_server_set_security_policy(xmpp, g_value_get_enum(value));
     break;
+  case PROP_COMPRESSION_LEVEL:
+    priv->compression_level = g_value_get_int(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -540,6 +552,9 @@ infd_xmpp_server_get_property(GObject* object,
   case PROP_SECURITY_POLICY:
     g_value_set_enum(value, priv->security_policy);
     break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_int(value, priv->compression_level);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -661,6 +676,21 @@ infd_xmpp_server_class_init(gpointer g_class,
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_int(
+      "compression-level",
+      "Compression level",
+      "The zlib compression level for new connections, or 0 to not offer "
+      "stream compression",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
 
   xmpp_server_signals[ERROR] = g_signal_new(
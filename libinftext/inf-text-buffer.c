@@ -475,6 +475,40 @@ inf_text_buffer_iter_get_author(InfTextBuffer* buffer,
   return iface->iter_get_author(buffer, iter);
 }
 
+/**
+ * inf_text_buffer_iter_borrow_text:
+ * @buffer: A #InfTextBuffer.
+ * @iter: A #InfTextBufferIter pointing into @buffer.
+ *
+ * Returns the text of the segment @iter points to, like
+ * inf_text_buffer_iter_get_text(), but without making a copy of it. Its
+ * size in bytes is given by inf_text_buffer_iter_get_bytes(). This is
+ * useful to walk through the whole document, for example to save it,
+ * without allocating a copy of every segment.
+ *
+ * Not every buffer implementation stores its text in a way that allows
+ * this. If @buffer does not, then this function returns %NULL and
+ * inf_text_buffer_iter_get_text() needs to be used instead.
+ *
+ * Return Value: The text of the segment @iter points to, or %NULL. It
+ * must not be modified or freed, and it is only valid until @buffer is
+ * modified or @iter is moved or destroyed.
+ **/
+gconstpointer
+inf_text_buffer_iter_borrow_text(InfTextBuffer* buffer,
+                                 InfTextBufferIter* iter)
+{
+  InfTextBufferIface* iface;
+
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(iter != NULL, NULL);
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+  if(iface->iter_borrow_text == NULL) return NULL;
+
+  return iface->iter_borrow_text(buffer, iter);
+}
+
 /**
  * inf_text_buffer_text_inserted:
  * @buffer: A #InfTextBuffer.
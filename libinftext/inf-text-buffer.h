@@ -93,6 +93,10 @@ struct _InfTextBufferIface {
                      guint pos,
                      InfTextChunk* chunk,
                      InfUser* user);
+
+  /* Added later, kept at the end so existing slots keep their offsets */
+  gconstpointer(*iter_borrow_text)(InfTextBuffer* buffer,
+                                   InfTextBufferIter* iter);
 };
 
 GType
@@ -160,6 +164,10 @@ guint
 inf_text_buffer_iter_get_author(InfTextBuffer* buffer,
                                 InfTextBufferIter* iter);
 
+gconstpointer
+inf_text_buffer_iter_borrow_text(InfTextBuffer* buffer,
+                                 InfTextBufferIter* iter);
+
 void
 inf_text_buffer_text_inserted(InfTextBuffer* buffer,
                               guint pos,
@@ -18,6 +18,7 @@
  */
 
 #include <libinftext/inf-text-chunk.h>
+#include <libinftext/inf-text-chunk-private.h>
 #include <libinfinity/common/inf-xml-util.h>
 
 #include <string.h>
@@ -29,6 +30,14 @@ struct _InfTextChunk {
   GSequence* segments;
   guint length; /* in characters */
   GQuark encoding;
+  /* Operations share their (immutable) chunks among each other when they
+   * are copied or transformed, see _inf_text_chunk_ref(). Shared chunks
+   * must not be modified, which all modifying functions check. */
+  guint ref_count;
+  /* If non-NULL, the text of all segments is stored in this single
+   * allocation instead of each segment owning its text, see
+   * _inf_text_chunk_pack(). */
+  gchar* storage;
 };
 
 typedef struct _InfTextChunkSegment InfTextChunkSegment;
@@ -49,6 +58,108 @@ inf_text_chunk_segment_free(InfTextChunkSegment* segment)
   g_slice_free(InfTextChunkSegment, segment);
 }
 
+/* Used for the segments of packed chunks, whose text is freed together
+ * with the chunk's storage. */
+static void
+inf_text_chunk_segment_free_packed(InfTextChunkSegment* segment)
+{
+  g_slice_free(InfTextChunkSegment, segment);
+}
+
+/* Copies the segments of source into a new sequence whose segment texts
+ * all point into a single newly allocated block, which is returned in
+ * storage. Adjacent segments by the same author are merged. */
+static GSequence*
+inf_text_chunk_pack_segments(InfTextChunk* source,
+                             gchar** storage)
+{
+  GSequence* segments;
+  GSequenceIter* iter;
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* new_segment;
+  gsize bytes;
+  gchar* pos;
+
+  bytes = 0;
+  for(iter = g_sequence_get_begin_iter(source->segments);
+      iter != g_sequence_get_end_iter(source->segments);
+      iter = g_sequence_iter_next(iter))
+  {
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+    bytes += segment->length;
+  }
+
+  segments = g_sequence_new(
+    (GDestroyNotify)inf_text_chunk_segment_free_packed
+  );
+
+  *storage = g_malloc(MAX(bytes, 1));
+  pos = *storage;
+  new_segment = NULL;
+
+  for(iter = g_sequence_get_begin_iter(source->segments);
+      iter != g_sequence_get_end_iter(source->segments);
+      iter = g_sequence_iter_next(iter))
+  {
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+    memcpy(pos, segment->text, segment->length);
+
+    if(new_segment != NULL && new_segment->author == segment->author)
+    {
+      new_segment->length += segment->length;
+    }
+    else
+    {
+      new_segment = g_slice_new(InfTextChunkSegment);
+      new_segment->author = segment->author;
+      new_segment->text = pos;
+      new_segment->length = segment->length;
+      new_segment->offset = segment->offset;
+      g_sequence_append(segments, new_segment);
+    }
+
+    pos += segment->length;
+  }
+
+  return segments;
+}
+
+/* Gives every segment of a packed chunk its own copy of its text again,
+ * so that the chunk can be modified. */
+static void
+inf_text_chunk_unpack(InfTextChunk* self)
+{
+  GSequence* segments;
+  GSequenceIter* iter;
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* new_segment;
+
+  g_assert(self->storage != NULL);
+
+  segments = g_sequence_new(
+    (GDestroyNotify)inf_text_chunk_segment_free
+  );
+
+  for(iter = g_sequence_get_begin_iter(self->segments);
+      iter != g_sequence_get_end_iter(self->segments);
+      iter = g_sequence_iter_next(iter))
+  {
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+    new_segment = g_slice_new(InfTextChunkSegment);
+    new_segment->author = segment->author;
+    new_segment->text = g_memdup(segment->text, segment->length);
+    new_segment->length = segment->length;
+    new_segment->offset = segment->offset;
+    g_sequence_append(segments, new_segment);
+  }
+
+  g_sequence_free(self->segments);
+  g_free(self->storage);
+
+  self->segments = segments;
+  self->storage = NULL;
+}
+
 static int
 inf_text_chunk_segment_cmp(gconstpointer first,
                            gconstpointer second,
@@ -247,6 +358,8 @@ inf_text_chunk_new(const gchar* encoding)
 
   chunk->length = 0;
   chunk->encoding = g_quark_from_string(encoding);
+  chunk->ref_count = 1;
+  chunk->storage = NULL;
 
   return chunk;
 }
@@ -287,6 +400,8 @@ inf_text_chunk_copy(InfTextChunk* self)
 
   new_chunk->length = self->length;
   new_chunk->encoding = self->encoding;
+  new_chunk->ref_count = 1;
+  new_chunk->storage = NULL;
 
   return new_chunk;
 }
@@ -302,8 +417,14 @@ void
 inf_text_chunk_free(InfTextChunk* self)
 {
   g_return_if_fail(self != NULL);
-  g_sequence_free(self->segments);
-  g_slice_free(InfTextChunk, self);
+  g_return_if_fail(self->ref_count > 0);
+
+  if(--self->ref_count == 0)
+  {
+    g_sequence_free(self->segments);
+    g_free(self->storage);
+    g_slice_free(InfTextChunk, self);
+  }
 }
 
 /**
@@ -466,8 +587,12 @@ inf_text_chunk_insert_text(InfTextChunk* self,
   InfTextChunkSegment* new_segment;
 
   g_return_if_fail(self != NULL);
+  g_return_if_fail(self->ref_count == 1);
   g_return_if_fail(offset <= self->length);
 
+  if(self->storage != NULL)
+    inf_text_chunk_unpack(self);
+
   if(self->length > 0)
   {
     iter = inf_text_chunk_get_segment(self, offset, &offset_index);
@@ -564,6 +689,76 @@ inf_text_chunk_insert_text(InfTextChunk* self,
 #endif
 }
 
+/**
+ * inf_text_chunk_take_text:
+ * @self: A #InfTextChunk.
+ * @text: Text to append, allocated with g_malloc().
+ * @bytes: Number of bytes of @text.
+ * @length: Number of characters contained in @text.
+ * @author: User that wrote @text.
+ *
+ * Appends text written by @author to the end of @self, taking ownership of
+ * @text. Unlike inf_text_chunk_insert_text(), this does not copy @text
+ * unless it needs to be merged into a previous segment by the same author,
+ * and it does not need to look up the segment at which to insert. This is
+ * meant to build up a chunk segment by segment, for example when
+ * extracting a slice from a buffer. @text is expected to be in the
+ * chunk's encoding.
+ **/
+void
+inf_text_chunk_take_text(InfTextChunk* self,
+                         gpointer text,
+                         gsize bytes,
+                         guint length,
+                         guint author)
+{
+  GSequenceIter* iter;
+  InfTextChunkSegment* segment;
+
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(self->ref_count == 1);
+  g_return_if_fail(text != NULL || bytes == 0);
+
+  if(self->storage != NULL)
+    inf_text_chunk_unpack(self);
+
+  if(bytes == 0)
+  {
+    g_free(text);
+    return;
+  }
+
+  segment = NULL;
+  if(self->length > 0)
+  {
+    iter = g_sequence_iter_prev(g_sequence_get_end_iter(self->segments));
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+  }
+
+  if(segment != NULL && segment->author == author)
+  {
+    segment->text = g_realloc(segment->text, segment->length + bytes);
+    memcpy(segment->text + segment->length, text, bytes);
+    segment->length += bytes;
+    g_free(text);
+  }
+  else
+  {
+    segment = g_slice_new(InfTextChunkSegment);
+    segment->author = author;
+    segment->text = text;
+    segment->length = bytes;
+    segment->offset = self->length;
+    g_sequence_append(self->segments, segment);
+  }
+
+  self->length += length;
+
+#ifdef CHUNK_CHECK_INTEGRITY
+  g_assert(inf_text_chunk_check_integrity(self) == TRUE);
+#endif
+}
+
 /**
  * inf_text_chunk_insert_chunk:
  * @self: A #InfTextChunk.
@@ -594,10 +789,14 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
   GSequenceIter* beyond;
 
   g_return_if_fail(self != NULL);
+  g_return_if_fail(self->ref_count == 1);
   g_return_if_fail(offset <= self->length);
   g_return_if_fail(text != NULL);
   g_return_if_fail(self->encoding == text->encoding);
 
+  if(self->storage != NULL)
+    inf_text_chunk_unpack(self);
+
   if(self->length > 0 && text->length > 0)
   {
     if(g_sequence_get_length(text->segments) == 1)
@@ -863,8 +1062,12 @@ inf_text_chunk_erase(InfTextChunk* self,
   InfTextChunkSegment* last;
 
   g_return_if_fail(self != NULL);
+  g_return_if_fail(self->ref_count == 1);
   g_return_if_fail(begin + length <= self->length);
 
+  if(self->storage != NULL)
+    inf_text_chunk_unpack(self);
+
   if(self->length > 0 && length > 0)
   {
     first_iter = inf_text_chunk_get_segment(self, begin, &first_index);
@@ -1290,4 +1493,60 @@ inf_text_chunk_iter_get_author(InfTextChunkIter* iter)
   return ((InfTextChunkSegment*)g_sequence_get(iter->first))->author;
 }
 
+/* Adds a reference to self, to be released again with inf_text_chunk_free().
+ * This must only be used for chunks that are not modified anymore, such as
+ * the ones owned by text operations. */
+InfTextChunk*
+_inf_text_chunk_ref(InfTextChunk* self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+  ++self->ref_count;
+  return self;
+}
+
+/* Creates a copy of self whose text is stored in a single allocation. This
+ * is used for chunks that are kept in request logs, which are not modified
+ * anymore, to avoid many small allocations for deleted text. */
+InfTextChunk*
+_inf_text_chunk_copy_packed(InfTextChunk* self)
+{
+  InfTextChunk* new_chunk;
+
+  g_return_val_if_fail(self != NULL, NULL);
+
+  new_chunk = g_slice_new(InfTextChunk);
+  new_chunk->segments = inf_text_chunk_pack_segments(self, &new_chunk->storage);
+  new_chunk->length = self->length;
+  new_chunk->encoding = self->encoding;
+  new_chunk->ref_count = 1;
+
+  return new_chunk;
+}
+
+/* Stores the text of self in a single allocation, like
+ * _inf_text_chunk_copy_packed() does for the copy. self must not be shared
+ * and there must not be any iterators pointing into it. */
+void
+_inf_text_chunk_pack(InfTextChunk* self)
+{
+  GSequence* segments;
+  gchar* storage;
+
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(self->ref_count == 1);
+
+  /* Nothing to gain if all text is already in one allocation */
+  if(self->storage != NULL ||
+     g_sequence_get_length(self->segments) <= 1)
+  {
+    return;
+  }
+
+  segments = inf_text_chunk_pack_segments(self, &storage);
+  g_sequence_free(self->segments);
+
+  self->segments = segments;
+  self->storage = storage;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -68,6 +68,13 @@ inf_text_chunk_insert_text(InfTextChunk* self,
                            guint length,
                            guint author);
 
+void
+inf_text_chunk_take_text(InfTextChunk* self,
+                         gpointer text,
+                         gsize bytes,
+                         guint length,
+                         guint author);
+
 void
 inf_text_chunk_insert_chunk(InfTextChunk* self,
                             guint offset,
@@ -296,6 +296,13 @@ inf_text_default_buffer_buffer_iter_get_author(InfTextBuffer* buffer,
   return inf_text_chunk_iter_get_author(&iter->chunk_iter);
 }
 
+static gconstpointer
+inf_text_default_buffer_buffer_iter_borrow_text(InfTextBuffer* buffer,
+                                                InfTextBufferIter* iter)
+{
+  return inf_text_chunk_iter_get_text(&iter->chunk_iter);
+}
+
 static void
 inf_text_default_buffer_class_init(gpointer g_class,
                                    gpointer class_data)
@@ -356,6 +363,7 @@ inf_text_default_buffer_text_buffer_init(gpointer g_iface,
   iface->iter_get_length = inf_text_default_buffer_buffer_iter_get_length;
   iface->iter_get_bytes = inf_text_default_buffer_buffer_iter_get_bytes;
   iface->iter_get_author = inf_text_default_buffer_buffer_iter_get_author;
+  iface->iter_borrow_text = inf_text_default_buffer_buffer_iter_borrow_text;
   iface->text_inserted = NULL;
   iface->text_erased = NULL;
 }
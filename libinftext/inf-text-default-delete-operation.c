@@ -19,6 +19,8 @@
 
 #include <libinftext/inf-text-default-delete-operation.h>
 #include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-chunk-private.h>
+#include <libinftext/inf-text-operations-private.h>
 #include <libinftext/inf-text-delete-operation.h>
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-buffer.h>
@@ -170,6 +172,27 @@ inf_text_default_delete_operation_get_property(GObject* object,
   }
 }
 
+/* Creates a new delete operation without going through the property
+ * machinery, taking ownership of chunk. Copied and transformed operations
+ * share the chunk with the original operation instead of copying it. */
+InfTextDefaultDeleteOperation*
+_inf_text_default_delete_operation_new_take(guint position,
+                                            InfTextChunk* chunk)
+{
+  InfTextDefaultDeleteOperation* operation;
+  InfTextDefaultDeleteOperationPrivate* priv;
+
+  operation = INF_TEXT_DEFAULT_DELETE_OPERATION(
+    g_object_new(INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION, NULL)
+  );
+
+  priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
+  priv->position = position;
+  priv->chunk = chunk;
+
+  return operation;
+}
+
 static gboolean
 inf_text_default_delete_operation_need_concurrency_id(
   InfAdoptedOperation* operation,
@@ -233,11 +256,9 @@ inf_text_default_delete_operation_copy(InfAdoptedOperation* operation)
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
 
   return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-      "position", priv->position,
-      "chunk", priv->chunk,
-      NULL
+    _inf_text_default_delete_operation_new_take(
+      priv->position,
+      _inf_text_chunk_ref(priv->chunk)
     )
   );
 }
@@ -284,10 +305,12 @@ inf_text_default_delete_operation_revert(InfAdoptedOperation* operation)
   InfTextDefaultDeleteOperationPrivate* priv;
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
 
+  /* The reverted operation reinserts the very same text, so share the
+   * chunk instead of keeping another copy of it in the request log. */
   return INF_ADOPTED_OPERATION(
-    inf_text_default_insert_operation_new(
+    _inf_text_default_insert_operation_new_take(
       priv->position,
-      priv->chunk
+      _inf_text_chunk_ref(priv->chunk)
     )
   );
 }
@@ -317,11 +340,9 @@ inf_text_default_delete_operation_transform_position(
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
 
   return INF_TEXT_DELETE_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-      "position", position,
-      "chunk", priv->chunk,
-      NULL
+    _inf_text_default_delete_operation_new_take(
+      position,
+      _inf_text_chunk_ref(priv->chunk)
     )
   );
 }
@@ -337,21 +358,14 @@ inf_text_default_delete_operation_transform_overlap(
 {
   InfTextDefaultDeleteOperationPrivate* priv;
   InfTextChunk* chunk;
-  GObject* result;
 
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
   chunk = inf_text_chunk_copy(priv->chunk);
   inf_text_chunk_erase(chunk, begin, length);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", position,
-    "chunk", chunk,
-    NULL
+  return INF_TEXT_DELETE_OPERATION(
+    _inf_text_default_delete_operation_new_take(position, chunk)
   );
-
-  inf_text_chunk_free(chunk);
-  return INF_TEXT_DELETE_OPERATION(result);
 }
 
 static InfAdoptedSplitOperation*
@@ -376,23 +390,17 @@ inf_text_default_delete_operation_transform_split(
     inf_text_chunk_get_length(priv->chunk) - split_pos
   );
 
-  first = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", priv->position,
-    "chunk", first_chunk,
-    NULL
+  first = G_OBJECT(
+    _inf_text_default_delete_operation_new_take(priv->position, first_chunk)
   );
 
-  second = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", priv->position + split_pos + split_len,
-    "chunk", second_chunk,
-    NULL
+  second = G_OBJECT(
+    _inf_text_default_delete_operation_new_take(
+      priv->position + split_pos + split_len,
+      second_chunk
+    )
   );
 
-  inf_text_chunk_free(first_chunk);
-  inf_text_chunk_free(second_chunk);
-
   result = inf_adopted_split_operation_new(
     INF_ADOPTED_OPERATION(first),
     INF_ADOPTED_OPERATION(second)
@@ -551,18 +559,14 @@ InfTextDefaultDeleteOperation*
 inf_text_default_delete_operation_new(guint position,
                                       InfTextChunk* chunk)
 {
-  GObject* object;
-
   g_return_val_if_fail(chunk != NULL, NULL);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", position,
-    "chunk", chunk,
-    NULL
+  /* Deleted text is kept in the request log for undo, so store it in a
+   * single allocation rather than one per segment. */
+  return _inf_text_default_delete_operation_new_take(
+    position,
+    _inf_text_chunk_copy_packed(chunk)
   );
-
-  return INF_TEXT_DEFAULT_DELETE_OPERATION(object);
 }
 
 /**
@@ -18,6 +18,8 @@
  */
 
 #include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-chunk-private.h>
+#include <libinftext/inf-text-operations-private.h>
 #include <libinftext/inf-text-default-delete-operation.h>
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-delete-operation.h>
@@ -124,6 +126,27 @@ inf_text_default_insert_operation_get_property(GObject* object,
   }
 }
 
+/* Creates a new insert operation without going through the property
+ * machinery, taking ownership of chunk. Copied and transformed operations
+ * share the chunk with the original operation instead of copying it. */
+InfTextDefaultInsertOperation*
+_inf_text_default_insert_operation_new_take(guint position,
+                                            InfTextChunk* chunk)
+{
+  InfTextDefaultInsertOperation* operation;
+  InfTextDefaultInsertOperationPrivate* priv;
+
+  operation = INF_TEXT_DEFAULT_INSERT_OPERATION(
+    g_object_new(INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION, NULL)
+  );
+
+  priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
+  priv->position = position;
+  priv->chunk = chunk;
+
+  return operation;
+}
+
 static gboolean
 inf_text_default_insert_operation_need_concurrency_id(
   InfAdoptedOperation* operation,
@@ -188,11 +211,9 @@ inf_text_default_insert_operation_copy(InfAdoptedOperation* operation)
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
   return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-      "position", priv->position,
-      "chunk", priv->chunk,
-      NULL
+    _inf_text_default_insert_operation_new_take(
+      priv->position,
+      _inf_text_chunk_ref(priv->chunk)
     )
   );
 }
@@ -230,8 +251,13 @@ inf_text_default_insert_operation_revert(InfAdoptedOperation* operation)
   InfTextDefaultInsertOperationPrivate* priv;
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
+  /* Share the chunk, so that undoing an insertion does not keep another
+   * copy of the inserted text in the request log. */
   return INF_ADOPTED_OPERATION(
-    inf_text_default_delete_operation_new(priv->position, priv->chunk)
+    _inf_text_default_delete_operation_new_take(
+      priv->position,
+      _inf_text_chunk_ref(priv->chunk)
+    )
   );
 }
 
@@ -256,18 +282,14 @@ inf_text_default_insert_operation_transform_position(
   guint position)
 {
   InfTextDefaultInsertOperationPrivate* priv;
-  GObject* result;
-
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", position,
-    "chunk", priv->chunk,
-    NULL
+  return INF_TEXT_INSERT_OPERATION(
+    _inf_text_default_insert_operation_new_take(
+      position,
+      _inf_text_chunk_ref(priv->chunk)
+    )
   );
-
-  return INF_TEXT_INSERT_OPERATION(result);
 }
 
 static void
@@ -418,18 +440,12 @@ InfTextDefaultInsertOperation*
 inf_text_default_insert_operation_new(guint pos,
                                       InfTextChunk* chunk)
 {
-  GObject* object;
-
   g_return_val_if_fail(chunk != NULL, NULL);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", pos,
-    "chunk", chunk,
-    NULL
+  return _inf_text_default_insert_operation_new_take(
+    pos,
+    inf_text_chunk_copy(chunk)
   );
-
-  return INF_TEXT_DEFAULT_INSERT_OPERATION(object);
 }
 
 /**
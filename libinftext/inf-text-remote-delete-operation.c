@@ -19,6 +19,8 @@
 
 #include <libinftext/inf-text-remote-delete-operation.h>
 #include <libinftext/inf-text-default-delete-operation.h>
+#include <libinftext/inf-text-operations-private.h>
+#include <libinftext/inf-text-chunk-private.h>
 #include <libinftext/inf-text-delete-operation.h>
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-buffer.h>
@@ -111,7 +113,7 @@ inf_text_remote_delete_operation_recon_copy(GSList* recon_list)
     recon = (InfTextRemoteDeleteOperationRecon*)item->data;
     new_recon = g_slice_new(InfTextRemoteDeleteOperationRecon);
     new_recon->position = recon->position;
-    new_recon->chunk = inf_text_chunk_copy(recon->chunk);
+    new_recon->chunk = _inf_text_chunk_ref(recon->chunk);
     new_list = g_slist_append_fast(new_list, &last, new_recon);
   }
 
@@ -175,7 +177,7 @@ inf_text_remote_delete_operation_recon_feed(GSList* recon_list,
     cur_len += inf_text_chunk_get_length(recon->chunk);
     new_recon = g_slice_new(InfTextRemoteDeleteOperationRecon);
     new_recon->position = recon->position;
-    new_recon->chunk = inf_text_chunk_copy(recon->chunk);
+    new_recon->chunk = _inf_text_chunk_ref(recon->chunk);
     new_list = g_slist_append_fast(new_list, &last, new_recon);
   }
 
@@ -473,10 +475,12 @@ inf_text_remote_delete_operation_make_reversible(InfAdoptedOperation* op,
 
   g_slist_free(list);
 
-  priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(op);
-  result = inf_text_default_delete_operation_new(priv->position, chunk);
+  /* The chunk was assembled from many slices, but the reversible operation
+   * ends up in the request log, so pack it into a single allocation. */
+  _inf_text_chunk_pack(chunk);
 
-  inf_text_chunk_free(chunk);
+  priv = INF_TEXT_REMOTE_DELETE_OPERATION_PRIVATE(op);
+  result = _inf_text_default_delete_operation_new_take(priv->position, chunk);
 
   return INF_ADOPTED_OPERATION(result);
 }
@@ -604,7 +608,7 @@ inf_text_remote_delete_operation_transform_split(
     {
       new_recon = g_slice_new(InfTextRemoteDeleteOperationRecon);
       new_recon->position = recon->position;
-      new_recon->chunk = inf_text_chunk_copy(recon->chunk);
+      new_recon->chunk = _inf_text_chunk_ref(recon->chunk);
       first_recon = g_slist_prepend(first_recon, new_recon);
 
       recon_cur_len += inf_text_chunk_get_length(recon->chunk);
@@ -613,7 +617,7 @@ inf_text_remote_delete_operation_transform_split(
     {
       new_recon = g_slice_new(InfTextRemoteDeleteOperationRecon);
       new_recon->position = recon->position - (split_pos + recon_cur_len);
-      new_recon->chunk = inf_text_chunk_copy(recon->chunk);
+      new_recon->chunk = _inf_text_chunk_ref(recon->chunk);
       second_recon = g_slist_prepend(second_recon, new_recon);
     }
   }
@@ -26,7 +26,12 @@
 #include <libinftext/inf-text-move-operation.h>
 #include <libinftext/inf-text-chunk.h>
 #include <libinftext/inf-text-user.h>
+#include <libinftext/inf-text-operations-private.h>
+#include <libinfinity/adopted/inf-adopted-split-operation.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/communication/inf-communication-joined-group.h>
+#include <libinfinity/common/inf-protocol.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
@@ -36,8 +41,11 @@
 #include <string.h>
 #include <errno.h>
 
-/* TODO: Optionally broadcast operations delayed to merge adjacent operations
- * and send as a single request. */
+typedef enum _InfTextSessionPendingType {
+  INF_TEXT_SESSION_PENDING_NONE,
+  INF_TEXT_SESSION_PENDING_INSERT,
+  INF_TEXT_SESSION_PENDING_DELETE
+} InfTextSessionPendingType;
 
 typedef struct _InfTextSessionLocalUser InfTextSessionLocalUser;
 struct _InfTextSessionLocalUser {
@@ -45,20 +53,46 @@ struct _InfTextSessionLocalUser {
   InfTextUser* user;
   GTimeVal last_caret_update;
   InfIoTimeout* caret_timeout;
+
+  /* Local text change that has been applied to the buffer but not yet been
+   * turned into a request, so that adjacent changes can be merged into it. */
+  InfTextSessionPendingType pending_type;
+  guint pending_pos;
+  InfTextChunk* pending_chunk;
+  InfIoTimeout* pending_timeout;
 };
 
 typedef struct _InfTextSessionPrivate InfTextSessionPrivate;
 struct _InfTextSessionPrivate {
   guint caret_update_interval;
+  guint coalesce_interval;
+  guint coalesce_max_length;
+  guint caret_relay_interval;
   GSList* local_users;
 
+  /* Remote users whose caret changed since the last relay */
+  GSList* caret_relay_users;
+  InfIoTimeout* caret_relay_timeout;
+
+  /* Peers before protocol 1.1 only understand caret changes sent as move
+   * requests. The server keeps track of the members of the hosted group to
+   * find out whether there are such peers, and tells the other clients to
+   * send move requests as well with caret_requests. */
+  InfCommunicationGroup* caret_group;
+  GSList* caret_members;
+  guint caret_n_legacy_members;
+  gboolean caret_requests;
+
   gboolean apply_request;
 };
 
 enum {
   PROP_0,
 
-  PROP_CARET_UPDATE_INTERVAL
+  PROP_CARET_UPDATE_INTERVAL,
+  PROP_COALESCE_INTERVAL,
+  PROP_COALESCE_MAX_LENGTH,
+  PROP_CARET_RELAY_INTERVAL
 };
 
 typedef struct _InfTextSessionInsertForeachData
@@ -78,6 +112,14 @@ struct _InfTextSessionEraseForeachData {
   InfUser* user;
 };
 
+typedef struct _InfTextSessionCaretTranslateData
+  InfTextSessionCaretTranslateData;
+struct _InfTextSessionCaretTranslateData {
+  InfUserTable* user_table;
+  InfAdoptedStateVector* time;
+  gboolean result;
+};
+
 #define INF_TEXT_SESSION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_SESSION, InfTextSessionPrivate))
 
 static InfAdoptedSessionClass* parent_class;
@@ -171,6 +213,264 @@ inf_text_session_segment_from_xml(GIConv* cd,
   return text;
 }
 
+/*
+ * Coalescing of local text changes
+ */
+
+/* Turns the pending text change of local into a request and broadcasts it.
+ * This needs to be done before any other request is generated or received,
+ * since the algorithm does not know about the pending change yet although
+ * it has already been applied to the buffer. */
+static void
+inf_text_session_flush_pending(InfTextSession* session,
+                               InfTextSessionLocalUser* local)
+{
+  InfAdoptedOperation* operation;
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedRequest* request;
+  InfTextChunk* chunk;
+
+  if(local->pending_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      inf_adopted_session_get_io(INF_ADOPTED_SESSION(session)),
+      local->pending_timeout
+    );
+
+    local->pending_timeout = NULL;
+  }
+
+  /* Reset state before generating the request, so that we don't try to
+   * flush again if this is re-entered via the execute-request signal. */
+  chunk = local->pending_chunk;
+  local->pending_chunk = NULL;
+
+  switch(local->pending_type)
+  {
+  case INF_TEXT_SESSION_PENDING_NONE:
+    g_assert(chunk == NULL);
+    return;
+  case INF_TEXT_SESSION_PENDING_INSERT:
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_insert_operation_new(local->pending_pos, chunk)
+    );
+    break;
+  case INF_TEXT_SESSION_PENDING_DELETE:
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_delete_operation_new(local->pending_pos, chunk)
+    );
+    break;
+  default:
+    g_assert_not_reached();
+    return;
+  }
+
+  local->pending_type = INF_TEXT_SESSION_PENDING_NONE;
+  inf_text_chunk_free(chunk);
+
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+
+  request = inf_adopted_algorithm_generate_request_noexec(
+    algorithm,
+    INF_ADOPTED_USER(local->user),
+    operation
+  );
+
+  inf_adopted_session_broadcast_request(INF_ADOPTED_SESSION(session), request);
+
+  g_object_unref(request);
+  g_object_unref(operation);
+}
+
+/* Flushes the pending changes of all local users except the given one, which
+ * may be NULL. */
+static void
+inf_text_session_flush_pending_except(InfTextSession* session,
+                                      InfTextSessionLocalUser* except)
+{
+  InfTextSessionPrivate* priv;
+  GSList* item;
+  InfTextSessionLocalUser* local;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  for(item = priv->local_users; item != NULL; item = g_slist_next(item))
+  {
+    local = (InfTextSessionLocalUser*)item->data;
+    if(local != except)
+      inf_text_session_flush_pending(session, local);
+  }
+}
+
+static void
+inf_text_session_pending_timeout_func(gpointer user_data)
+{
+  InfTextSessionLocalUser* local;
+  local = (InfTextSessionLocalUser*)user_data;
+
+  local->pending_timeout = NULL;
+  inf_text_session_flush_pending(local->session, local);
+}
+
+/* Makes the given change the pending change of local. The previous pending
+ * change needs to be flushed already. */
+static void
+inf_text_session_begin_pending(InfTextSession* session,
+                               InfTextSessionLocalUser* local,
+                               InfTextSessionPendingType type,
+                               guint pos,
+                               InfTextChunk* chunk)
+{
+  InfTextSessionPrivate* priv;
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  g_assert(local->pending_type == INF_TEXT_SESSION_PENDING_NONE);
+  g_assert(local->pending_timeout == NULL);
+
+  local->pending_type = type;
+  local->pending_pos = pos;
+  local->pending_chunk = inf_text_chunk_copy(chunk);
+
+  /* The timeout is not restarted when further changes are merged, so that
+   * continuous typing still gets broadcast in regular intervals. */
+  local->pending_timeout = inf_io_add_timeout(
+    inf_adopted_session_get_io(INF_ADOPTED_SESSION(session)),
+    priv->coalesce_interval,
+    inf_text_session_pending_timeout_func,
+    local,
+    NULL
+  );
+}
+
+/* Tries to merge an insertion into the pending change of local. Returns
+ * TRUE on success. */
+static gboolean
+inf_text_session_merge_pending_insert(InfTextSessionLocalUser* local,
+                                      guint pos,
+                                      InfTextChunk* chunk)
+{
+  guint pending_len;
+
+  if(local->pending_type != INF_TEXT_SESSION_PENDING_INSERT)
+    return FALSE;
+
+  /* Text inserted anywhere into the pending inserted text, including its
+   * boundaries, can be made part of it. */
+  pending_len = inf_text_chunk_get_length(local->pending_chunk);
+  if(pos < local->pending_pos || pos > local->pending_pos + pending_len)
+    return FALSE;
+
+  inf_text_chunk_insert_chunk(
+    local->pending_chunk,
+    pos - local->pending_pos,
+    chunk
+  );
+
+  return TRUE;
+}
+
+/* Tries to merge an erasure into the pending change of local. Returns
+ * TRUE on success. */
+static gboolean
+inf_text_session_merge_pending_erase(InfTextSessionLocalUser* local,
+                                     guint pos,
+                                     InfTextChunk* chunk)
+{
+  guint pending_len;
+  guint len;
+
+  if(local->pending_type == INF_TEXT_SESSION_PENDING_NONE)
+    return FALSE;
+
+  pending_len = inf_text_chunk_get_length(local->pending_chunk);
+  len = inf_text_chunk_get_length(chunk);
+
+  switch(local->pending_type)
+  {
+  case INF_TEXT_SESSION_PENDING_INSERT:
+    /* Erasing text that has not been broadcast yet, for example by
+     * backspacing over a typo, simply removes it from the pending text. */
+    if(pos < local->pending_pos ||
+       pos + len > local->pending_pos + pending_len)
+    {
+      return FALSE;
+    }
+
+    inf_text_chunk_erase(local->pending_chunk, pos - local->pending_pos, len);
+    if(inf_text_chunk_get_length(local->pending_chunk) == 0)
+    {
+      /* Nothing left to send */
+      inf_text_chunk_free(local->pending_chunk);
+      local->pending_chunk = NULL;
+      local->pending_type = INF_TEXT_SESSION_PENDING_NONE;
+    }
+
+    return TRUE;
+  case INF_TEXT_SESSION_PENDING_DELETE:
+    if(pos + len == local->pending_pos)
+    {
+      /* Backspace */
+      inf_text_chunk_insert_chunk(local->pending_chunk, 0, chunk);
+      local->pending_pos = pos;
+      return TRUE;
+    }
+    else if(pos == local->pending_pos)
+    {
+      /* Delete */
+      inf_text_chunk_insert_chunk(local->pending_chunk, pending_len, chunk);
+      return TRUE;
+    }
+
+    return FALSE;
+  default:
+    g_assert_not_reached();
+    return FALSE;
+  }
+}
+
+/* Handles a local insertion or erasure by local, either merging it into
+ * the pending change or starting a new one. */
+static void
+inf_text_session_local_change(InfTextSession* session,
+                              InfTextSessionLocalUser* local,
+                              InfTextSessionPendingType type,
+                              guint pos,
+                              InfTextChunk* chunk)
+{
+  InfTextSessionPrivate* priv;
+  gboolean merged;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  /* Requests of other local users need to be made on top of the changes
+   * that are already in the buffer. */
+  inf_text_session_flush_pending_except(session, local);
+
+  if(type == INF_TEXT_SESSION_PENDING_INSERT)
+    merged = inf_text_session_merge_pending_insert(local, pos, chunk);
+  else
+    merged = inf_text_session_merge_pending_erase(local, pos, chunk);
+
+  if(!merged)
+  {
+    inf_text_session_flush_pending(session, local);
+    inf_text_session_begin_pending(session, local, type, pos, chunk);
+  }
+  else if(local->pending_type == INF_TEXT_SESSION_PENDING_NONE &&
+          local->pending_timeout != NULL)
+  {
+    /* The pending change cancelled out */
+    inf_text_session_flush_pending(session, local);
+  }
+
+  if(local->pending_type != INF_TEXT_SESSION_PENDING_NONE &&
+     inf_text_chunk_get_length(local->pending_chunk) >=
+     priv->coalesce_max_length)
+  {
+    inf_text_session_flush_pending(session, local);
+  }
+}
+
 /*
  * Caret/Selection handling
  */
@@ -195,38 +495,157 @@ inf_text_session_find_local_user(InfTextSession* session,
   return NULL;
 }
 
-static void
-inf_text_session_broadcast_caret_selection(InfTextSession* session,
-                                           InfTextSessionLocalUser* local)
+/* Creates a user-caret-change message whose caret positions refer to the
+ * current state of the session. */
+static xmlNodePtr
+inf_text_session_caret_xml_new(InfTextSession* session)
 {
-  InfAdoptedOperation* operation;
   InfAdoptedAlgorithm* algorithm;
-  InfAdoptedRequest* request;
-  guint position;
-  int sel;
+  xmlNodePtr xml;
+  gchar* time;
 
   algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
-  position = inf_text_user_get_caret_position(local->user);
-  sel = inf_text_user_get_selection_length(local->user);
+  time = inf_adopted_state_vector_to_string(
+    inf_adopted_algorithm_get_current(algorithm)
+  );
 
-  operation = INF_ADOPTED_OPERATION(
-    inf_text_move_operation_new(position, sel)
+  xml = xmlNewNode(NULL, (const xmlChar*)"user-caret-change");
+  inf_xml_util_set_attribute(xml, "time", time);
+  g_free(time);
+
+  return xml;
+}
+
+static void
+inf_text_session_caret_xml_add_user(xmlNodePtr xml,
+                                    InfTextUser* user)
+{
+  xmlNodePtr child;
+
+  child = xmlNewChild(xml, NULL, (const xmlChar*)"user", NULL);
+  inf_xml_util_set_attribute_uint(child, "id", inf_user_get_id(INF_USER(user)));
+
+  inf_xml_util_set_attribute_uint(
+    child,
+    "caret",
+    inf_text_user_get_caret_position(user)
   );
 
-  request = inf_adopted_algorithm_generate_request_noexec(
-    algorithm,
-    INF_ADOPTED_USER(local->user),
-    operation
+  inf_xml_util_set_attribute_int(
+    child,
+    "selection",
+    inf_text_user_get_selection_length(user)
   );
+}
 
-  g_object_unref(operation);
+/* Returns whether caret changes need to be sent as move requests, because
+ * not all subscribed peers understand user-caret-change. */
+static gboolean
+inf_text_session_caret_use_requests(InfTextSession* session)
+{
+  InfTextSessionPrivate* priv;
+  InfCommunicationGroup* group;
+  InfXmlConnection* publisher;
 
-  inf_adopted_session_broadcast_request(
-    INF_ADOPTED_SESSION(session),
-    request
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+
+  if(group == NULL)
+    return FALSE;
+
+  if(INF_COMMUNICATION_IS_HOSTED_GROUP(group))
+    return priv->caret_n_legacy_members > 0;
+
+  if(priv->caret_requests)
+    return TRUE;
+
+  publisher = inf_communication_joined_group_get_publisher(
+    INF_COMMUNICATION_JOINED_GROUP(group)
   );
 
-  g_object_unref(request);
+  return !inf_protocol_check_remote_version(publisher, 1, 1);
+}
+
+/* Sends a user-caret-change message to all subscriptions which understand
+ * it. Takes ownership of xml. */
+static void
+inf_text_session_send_caret_xml(InfTextSession* session,
+                                xmlNodePtr xml)
+{
+  InfTextSessionPrivate* priv;
+  GSList* item;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  if(priv->caret_n_legacy_members == 0)
+  {
+    inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+  }
+  else
+  {
+    for(item = priv->caret_members; item != NULL; item = g_slist_next(item))
+    {
+      inf_communication_group_send_message(
+        priv->caret_group,
+        INF_XML_CONNECTION(item->data),
+        xmlCopyNode(xml, 1)
+      );
+    }
+
+    xmlFreeNode(xml);
+  }
+}
+
+/* Caret and selection changes are not sent as requests, since they do not
+ * need to be logged or undone. Instead, they are sent together with the
+ * state they refer to, and the receiver transforms them to its current
+ * state. Only if there are peers which do not understand this, they are
+ * sent as move requests as before. */
+static void
+inf_text_session_broadcast_caret_selection(InfTextSession* session,
+                                           InfTextSessionLocalUser* local)
+{
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  xmlNodePtr xml;
+
+  /* The caret position refers to the buffer including pending changes */
+  inf_text_session_flush_pending_except(session, NULL);
+
+  if(inf_text_session_caret_use_requests(session))
+  {
+    algorithm =
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_move_operation_new(
+        inf_text_user_get_caret_position(local->user),
+        inf_text_user_get_selection_length(local->user)
+      )
+    );
+
+    request = inf_adopted_algorithm_generate_request_noexec(
+      algorithm,
+      INF_ADOPTED_USER(local->user),
+      operation
+    );
+
+    g_object_unref(operation);
+
+    inf_adopted_session_broadcast_request(
+      INF_ADOPTED_SESSION(session),
+      request
+    );
+
+    g_object_unref(request);
+  }
+  else
+  {
+    xml = inf_text_session_caret_xml_new(session);
+    inf_text_session_caret_xml_add_user(xml, local->user);
+    inf_text_session_send_caret_xml(session, xml);
+  }
 
   g_get_current_time(&local->last_caret_update);
 
@@ -303,6 +722,328 @@ inf_text_session_selection_changed_cb(InfTextUser* user,
   }
 }
 
+static void
+inf_text_session_caret_translate_foreach_func(guint id,
+                                              guint value,
+                                              gpointer user_data)
+{
+  InfTextSessionCaretTranslateData* data;
+  InfUser* user;
+  InfAdoptedRequestLog* log;
+  guint n;
+
+  data = (InfTextSessionCaretTranslateData*)user_data;
+  n = inf_adopted_state_vector_get(data->time, id);
+
+  if(n < value)
+  {
+    /* The caret needs to be transformed against this user's requests since
+     * n, so they must still be in the request log. */
+    user = inf_user_table_lookup_user_by_id(data->user_table, id);
+    if(user == NULL)
+    {
+      data->result = FALSE;
+    }
+    else
+    {
+      log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+      if(n < inf_adopted_request_log_get_begin(log))
+        data->result = FALSE;
+    }
+  }
+}
+
+/* Transforms a caret position and selection of user at state time to the
+ * current state. Returns FALSE if this is not possible, in which case the
+ * caret update is outdated and should be dropped. The request this uses is
+ * neither logged nor cached. */
+static gboolean
+inf_text_session_translate_caret(InfTextSession* session,
+                                 InfTextUser* user,
+                                 InfAdoptedStateVector* time,
+                                 guint* position,
+                                 gint* length)
+{
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedStateVector* current;
+  InfTextSessionCaretTranslateData data;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  InfAdoptedRequest* translated;
+  guint user_id;
+
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+  current = inf_adopted_algorithm_get_current(algorithm);
+  user_id = inf_user_get_id(INF_USER(user));
+
+  if(inf_adopted_state_vector_compare(time, current) == 0)
+    return TRUE;
+
+  /* If the user has made requests since, then they have moved the caret
+   * already. */
+  if(inf_adopted_state_vector_get(time, user_id) !=
+     inf_adopted_state_vector_get(current, user_id))
+  {
+    return FALSE;
+  }
+
+  if(!inf_adopted_state_vector_causally_before(time, current))
+    return FALSE;
+
+  data.user_table = inf_session_get_user_table(INF_SESSION(session));
+  data.time = time;
+  data.result = TRUE;
+
+  inf_adopted_state_vector_foreach(
+    current,
+    inf_text_session_caret_translate_foreach_func,
+    &data
+  );
+
+  if(data.result == FALSE)
+    return FALSE;
+
+  operation = INF_ADOPTED_OPERATION(
+    inf_text_move_operation_new(*position, *length)
+  );
+
+  request = inf_adopted_request_new_do(time, user_id, operation);
+  g_object_unref(operation);
+
+  translated = inf_adopted_algorithm_translate_request(
+    algorithm,
+    request,
+    current
+  );
+
+  g_object_unref(request);
+  if(translated == NULL)
+    return FALSE;
+
+  operation = inf_adopted_request_get_operation(translated);
+  g_assert(INF_TEXT_IS_MOVE_OPERATION(operation));
+
+  *position = inf_text_move_operation_get_position(
+    INF_TEXT_MOVE_OPERATION(operation)
+  );
+
+  *length = inf_text_move_operation_get_length(
+    INF_TEXT_MOVE_OPERATION(operation)
+  );
+
+  g_object_unref(translated);
+  return TRUE;
+}
+
+/* Sends the carets of all remote users that changed since the last relay
+ * in a single message. This is done by the server only, so that clients
+ * receive at most one caret update per user per relay interval. */
+static void
+inf_text_session_relay_carets(InfTextSession* session)
+{
+  InfTextSessionPrivate* priv;
+  xmlNodePtr xml;
+  GSList* item;
+  InfTextUser* user;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  if(priv->caret_relay_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      inf_adopted_session_get_io(INF_ADOPTED_SESSION(session)),
+      priv->caret_relay_timeout
+    );
+
+    priv->caret_relay_timeout = NULL;
+  }
+
+  /* The carets refer to the buffer including pending changes */
+  inf_text_session_flush_pending_except(session, NULL);
+
+  xml = inf_text_session_caret_xml_new(session);
+  for(item = priv->caret_relay_users; item != NULL; item = g_slist_next(item))
+  {
+    user = INF_TEXT_USER(item->data);
+    if(inf_user_get_status(INF_USER(user)) != INF_USER_UNAVAILABLE)
+      inf_text_session_caret_xml_add_user(xml, user);
+  }
+
+  g_slist_free(priv->caret_relay_users);
+  priv->caret_relay_users = NULL;
+
+  if(xml->children != NULL)
+    inf_text_session_send_caret_xml(session, xml);
+  else
+    xmlFreeNode(xml);
+}
+
+static void
+inf_text_session_caret_relay_timeout_func(gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextSessionPrivate* priv;
+
+  session = INF_TEXT_SESSION(user_data);
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  priv->caret_relay_timeout = NULL;
+  inf_text_session_relay_carets(session);
+}
+
+/* Tells a client whether to send caret changes as move requests */
+static void
+inf_text_session_send_caret_mode(InfTextSession* session,
+                                 InfXmlConnection* connection,
+                                 gboolean requests)
+{
+  InfTextSessionPrivate* priv;
+  xmlNodePtr xml;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"caret-mode");
+  inf_xml_util_set_attribute(xml, "mode", requests ? "request" : "message");
+  inf_communication_group_send_message(priv->caret_group, connection, xml);
+}
+
+/* Tells all clients which understand user-caret-change and are not being
+ * synchronized whether to send caret changes as move requests. Clients being
+ * synchronized are told when synchronization is complete. */
+static void
+inf_text_session_broadcast_caret_mode(InfTextSession* session,
+                                      gboolean requests)
+{
+  InfTextSessionPrivate* priv;
+  InfXmlConnection* connection;
+  GSList* item;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  for(item = priv->caret_members; item != NULL; item = g_slist_next(item))
+  {
+    connection = INF_XML_CONNECTION(item->data);
+    if(inf_session_get_synchronization_status(INF_SESSION(session),
+                                              connection) ==
+       INF_SESSION_SYNC_NONE)
+    {
+      inf_text_session_send_caret_mode(session, connection, requests);
+    }
+  }
+}
+
+static void
+inf_text_session_caret_member_added_cb(InfCommunicationGroup* group,
+                                       InfXmlConnection* connection,
+                                       gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextSessionPrivate* priv;
+
+  session = INF_TEXT_SESSION(user_data);
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  if(inf_protocol_check_remote_version(connection, 1, 1))
+    priv->caret_members = g_slist_prepend(priv->caret_members, connection);
+  else if(priv->caret_n_legacy_members++ == 0)
+    inf_text_session_broadcast_caret_mode(session, TRUE);
+}
+
+static void
+inf_text_session_caret_member_removed_cb(InfCommunicationGroup* group,
+                                         InfXmlConnection* connection,
+                                         gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextSessionPrivate* priv;
+  GSList* item;
+
+  session = INF_TEXT_SESSION(user_data);
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  item = g_slist_find(priv->caret_members, connection);
+  if(item != NULL)
+  {
+    priv->caret_members = g_slist_delete_link(priv->caret_members, item);
+  }
+  else if(priv->caret_n_legacy_members > 0 &&
+          --priv->caret_n_legacy_members == 0)
+  {
+    inf_text_session_broadcast_caret_mode(session, FALSE);
+  }
+}
+
+static void
+inf_text_session_release_caret_group(InfTextSession* session)
+{
+  InfTextSessionPrivate* priv;
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  if(priv->caret_group != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->caret_group),
+      G_CALLBACK(inf_text_session_caret_member_added_cb),
+      session
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->caret_group),
+      G_CALLBACK(inf_text_session_caret_member_removed_cb),
+      session
+    );
+
+    g_object_unref(priv->caret_group);
+    priv->caret_group = NULL;
+  }
+
+  g_slist_free(priv->caret_members);
+  priv->caret_members = NULL;
+  priv->caret_n_legacy_members = 0;
+  priv->caret_requests = FALSE;
+}
+
+static void
+inf_text_session_notify_subscription_group_cb(GObject* object,
+                                              GParamSpec* pspec,
+                                              gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextSessionPrivate* priv;
+  InfCommunicationGroup* group;
+
+  session = INF_TEXT_SESSION(object);
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+
+  if(group == priv->caret_group)
+    return;
+
+  inf_text_session_release_caret_group(session);
+
+  /* Only the server needs to know the protocol versions of the members.
+   * The group is expected to be empty when it is set. */
+  if(group != NULL && INF_COMMUNICATION_IS_HOSTED_GROUP(group))
+  {
+    priv->caret_group = group;
+    g_object_ref(group);
+
+    g_signal_connect(
+      G_OBJECT(group),
+      "member-added",
+      G_CALLBACK(inf_text_session_caret_member_added_cb),
+      session
+    );
+
+    g_signal_connect(
+      G_OBJECT(group),
+      "member-removed",
+      G_CALLBACK(inf_text_session_caret_member_removed_cb),
+      session
+    );
+  }
+}
+
 static void
 inf_text_session_add_local_user(InfTextSession* session,
                                 InfTextUser* user)
@@ -318,6 +1059,11 @@ inf_text_session_add_local_user(InfTextSession* session,
   g_get_current_time(&local->last_caret_update);
   local->caret_timeout = NULL;
 
+  local->pending_type = INF_TEXT_SESSION_PENDING_NONE;
+  local->pending_pos = 0;
+  local->pending_chunk = NULL;
+  local->pending_timeout = NULL;
+
   priv->local_users = g_slist_prepend(priv->local_users, local);
 
   g_signal_connect_after(
@@ -344,6 +1090,17 @@ inf_text_session_remove_local_user(InfTextSession* session,
     );
   }
 
+  if(local->pending_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      inf_adopted_session_get_io(INF_ADOPTED_SESSION(session)),
+      local->pending_timeout
+    );
+  }
+
+  if(local->pending_chunk != NULL)
+    inf_text_chunk_free(local->pending_chunk);
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(local->user),
     G_CALLBACK(inf_text_session_selection_changed_cb),
@@ -381,6 +1138,13 @@ inf_text_session_local_user_removed_cb(InfUserTable* user_table,
   local = inf_text_session_find_local_user(session, INF_TEXT_USER(user));
   g_assert(local != NULL);
 
+  /* Pending text changes are already in the buffer, so they need to be
+   * sent to keep the other sites in sync. inf_session_set_user_status()
+   * sends the status change only after this has run, so that the request
+   * still reaches the others while the user is part of the session. */
+  if(inf_session_get_subscription_group(INF_SESSION(session)) != NULL)
+    inf_text_session_flush_pending(session, local);
+
   inf_text_session_remove_local_user(session, local);
 }
 
@@ -505,6 +1269,7 @@ inf_text_session_buffer_text_inserted_cb(InfTextBuffer* buffer,
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedRequest* request;
   InfUserTable* user_table;
+  InfTextSessionLocalUser* local;
   InfTextSessionInsertForeachData data;
 
   g_assert(INF_TEXT_IS_USER(user));
@@ -513,7 +1278,20 @@ inf_text_session_buffer_text_inserted_cb(InfTextBuffer* buffer,
   priv = INF_TEXT_SESSION_PRIVATE(session);
   user_table = inf_session_get_user_table(INF_SESSION(session));
 
-  if(priv->apply_request == FALSE)
+  if(priv->apply_request == FALSE && priv->coalesce_interval > 0)
+  {
+    local = inf_text_session_find_local_user(session, INF_TEXT_USER(user));
+    g_assert(local != NULL);
+
+    inf_text_session_local_change(
+      session,
+      local,
+      INF_TEXT_SESSION_PENDING_INSERT,
+      pos,
+      chunk
+    );
+  }
+  else if(priv->apply_request == FALSE)
   {
     operation = INF_ADOPTED_OPERATION(
       inf_text_default_insert_operation_new(pos, chunk)
@@ -579,6 +1357,7 @@ inf_text_session_buffer_text_erased_cb(InfTextBuffer* buffer,
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedRequest* request;
   InfUserTable* user_table;
+  InfTextSessionLocalUser* local;
   InfTextSessionEraseForeachData data;
 
   g_assert(INF_TEXT_IS_USER(user));
@@ -587,7 +1366,20 @@ inf_text_session_buffer_text_erased_cb(InfTextBuffer* buffer,
   priv = INF_TEXT_SESSION_PRIVATE(session);
   user_table = inf_session_get_user_table(INF_SESSION(session));
 
-  if(priv->apply_request == FALSE)
+  if(priv->apply_request == FALSE && priv->coalesce_interval > 0)
+  {
+    local = inf_text_session_find_local_user(session, INF_TEXT_USER(user));
+    g_assert(local != NULL);
+
+    inf_text_session_local_change(
+      session,
+      local,
+      INF_TEXT_SESSION_PENDING_DELETE,
+      pos,
+      chunk
+    );
+  }
+  else if(priv->apply_request == FALSE)
   {
     operation = INF_ADOPTED_OPERATION(
       inf_text_default_delete_operation_new(pos, chunk)
@@ -758,6 +1550,15 @@ inf_text_session_init(GTypeInstance* instance,
   priv = INF_TEXT_SESSION_PRIVATE(session);
 
   priv->caret_update_interval = 500;
+  priv->coalesce_interval = 0;
+  priv->coalesce_max_length = 256;
+  priv->caret_relay_interval = 100;
+  priv->caret_relay_users = NULL;
+  priv->caret_relay_timeout = NULL;
+  priv->caret_group = NULL;
+  priv->caret_members = NULL;
+  priv->caret_n_legacy_members = 0;
+  priv->caret_requests = FALSE;
   priv->apply_request = FALSE;
 }
 
@@ -798,6 +1599,14 @@ inf_text_session_constructor(GType type,
   if(status == INF_SESSION_RUNNING)
     inf_text_session_init_text_handlers(session);
 
+  inf_text_session_notify_subscription_group_cb(object, NULL, session);
+  g_signal_connect(
+    object,
+    "notify::subscription-group",
+    G_CALLBACK(inf_text_session_notify_subscription_group_cb),
+    session
+  );
+
   return object;
 }
 
@@ -834,6 +1643,8 @@ inf_text_session_dispose(GObject* object)
   user_table = inf_session_get_user_table(INF_SESSION(session));
   algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
 
+  /* Nothing is sent anymore at this point, so pending changes are
+   * dropped. */
   while(priv->local_users != NULL)
   {
     inf_text_session_remove_local_user(
@@ -842,6 +1653,27 @@ inf_text_session_dispose(GObject* object)
     );
   }
 
+  if(priv->caret_relay_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      inf_adopted_session_get_io(INF_ADOPTED_SESSION(session)),
+      priv->caret_relay_timeout
+    );
+
+    priv->caret_relay_timeout = NULL;
+  }
+
+  g_slist_free(priv->caret_relay_users);
+  priv->caret_relay_users = NULL;
+
+  inf_signal_handlers_disconnect_by_func(
+    object,
+    G_CALLBACK(inf_text_session_notify_subscription_group_cb),
+    session
+  );
+
+  inf_text_session_release_caret_group(session);
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(buffer),
     G_CALLBACK(inf_text_session_buffer_text_inserted_cb),
@@ -914,6 +1746,18 @@ inf_text_session_set_property(GObject* object,
   case PROP_CARET_UPDATE_INTERVAL:
     priv->caret_update_interval = g_value_get_uint(value);
     break;
+  case PROP_COALESCE_INTERVAL:
+    priv->coalesce_interval = g_value_get_uint(value);
+    /* Don't hold back changes anymore if coalescing was disabled */
+    if(priv->coalesce_interval == 0)
+      inf_text_session_flush_pending_except(session, NULL);
+    break;
+  case PROP_COALESCE_MAX_LENGTH:
+    priv->coalesce_max_length = g_value_get_uint(value);
+    break;
+  case PROP_CARET_RELAY_INTERVAL:
+    priv->caret_relay_interval = g_value_get_uint(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -937,6 +1781,15 @@ inf_text_session_get_property(GObject* object,
   case PROP_CARET_UPDATE_INTERVAL:
     g_value_set_uint(value, priv->caret_update_interval);
     break;
+  case PROP_COALESCE_INTERVAL:
+    g_value_set_uint(value, priv->coalesce_interval);
+    break;
+  case PROP_COALESCE_MAX_LENGTH:
+    g_value_set_uint(value, priv->coalesce_max_length);
+    break;
+  case PROP_CARET_RELAY_INTERVAL:
+    g_value_set_uint(value, priv->caret_relay_interval);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1015,6 +1868,317 @@ inf_text_session_handle_user_color_change(InfTextSession* session,
   return INF_COMMUNICATION_SCOPE_GROUP;
 }
 
+static InfCommunicationScope
+inf_text_session_handle_user_caret_change(InfTextSession* session,
+                                          InfXmlConnection* connection,
+                                          xmlNodePtr xml,
+                                          GError** error)
+{
+  InfTextSessionPrivate* priv;
+  InfCommunicationGroup* group;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfAdoptedStateVector* time;
+  xmlChar* time_attr;
+  xmlNodePtr child;
+  gboolean relay;
+  guint buffer_length;
+  guint user_id;
+  InfUser* user;
+  guint position;
+  gint length;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+  user_table = inf_session_get_user_table(INF_SESSION(session));
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+
+  /* The server relays caret updates of its clients to the other clients,
+   * clients only apply the updates they get from the server. */
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+  relay = group != NULL && INF_COMMUNICATION_IS_HOSTED_GROUP(group);
+
+  time_attr = inf_xml_util_get_attribute_required(xml, "time", error);
+  if(time_attr == NULL) return INF_COMMUNICATION_SCOPE_PTP;
+
+  time = inf_adopted_state_vector_from_string((const gchar*)time_attr, error);
+  xmlFree(time_attr);
+  if(time == NULL) return INF_COMMUNICATION_SCOPE_PTP;
+
+  /* Local changes that have been delayed need to be in the request log
+   * before the carets are transformed against them. */
+  inf_text_session_flush_pending_except(session, NULL);
+  buffer_length = inf_text_buffer_get_length(buffer);
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const char*)child->name, "user") != 0) continue;
+
+    if(!inf_xml_util_get_attribute_uint_required(child, "id", &user_id, error))
+      goto fail;
+    if(!inf_xml_util_get_attribute_uint_required(child, "caret", &position,
+                                                 error))
+      goto fail;
+    if(!inf_xml_util_get_attribute_int_required(child, "selection", &length,
+                                                error))
+      goto fail;
+
+    user = inf_user_table_lookup_user_by_id(user_table, user_id);
+    if(user == NULL)
+    {
+      g_set_error(
+        error,
+        inf_user_error_quark(),
+        INF_USER_ERROR_NO_SUCH_USER,
+        _("No such user with ID '%u'"),
+        user_id
+      );
+
+      goto fail;
+    }
+
+    if(relay &&
+       (inf_user_get_status(user) == INF_USER_UNAVAILABLE ||
+        inf_user_get_connection(user) != connection))
+    {
+      g_set_error(
+        error,
+        inf_user_error_quark(),
+        INF_USER_ERROR_NOT_JOINED,
+        "%s",
+        _("User did not join from this connection")
+      );
+
+      goto fail;
+    }
+
+    g_assert(INF_TEXT_IS_USER(user));
+
+    /* The server sends our own carets back to us, and carets of users that
+     * have left since are of no interest anymore. */
+    if(inf_user_get_status(user) == INF_USER_UNAVAILABLE ||
+       (inf_user_get_flags(user) & INF_USER_LOCAL) != 0)
+    {
+      continue;
+    }
+
+    if(!inf_text_session_translate_caret(session, INF_TEXT_USER(user), time,
+                                         &position, &length))
+    {
+      continue;
+    }
+
+    if(position > buffer_length ||
+       (length < 0 && (guint)-length > position) ||
+       (length > 0 && (guint)length > buffer_length - position))
+    {
+      g_set_error(
+        error,
+        inf_text_session_error_quark,
+        INF_TEXT_SESSION_ERROR_INVALID_CARET,
+        _("Invalid caret position %u with selection %d"),
+        position,
+        length
+      );
+
+      goto fail;
+    }
+
+    inf_text_user_set_selection(INF_TEXT_USER(user), position, length, TRUE);
+
+    /* Mark inactive users active if they do something, as for requests */
+    if(inf_user_get_status(user) == INF_USER_INACTIVE)
+      g_object_set(G_OBJECT(user), "status", INF_USER_ACTIVE, NULL);
+
+    if(relay && g_slist_find(priv->caret_relay_users, user) == NULL)
+    {
+      priv->caret_relay_users =
+        g_slist_prepend(priv->caret_relay_users, user);
+    }
+  }
+
+  inf_adopted_state_vector_free(time);
+
+  if(priv->caret_relay_users != NULL && priv->caret_relay_timeout == NULL)
+  {
+    if(priv->caret_relay_interval == 0)
+    {
+      inf_text_session_relay_carets(session);
+    }
+    else
+    {
+      priv->caret_relay_timeout = inf_io_add_timeout(
+        inf_adopted_session_get_io(INF_ADOPTED_SESSION(session)),
+        priv->caret_relay_interval,
+        inf_text_session_caret_relay_timeout_func,
+        session,
+        NULL
+      );
+    }
+  }
+
+  /* Caret updates are never forwarded as they are, the server relays them
+   * itself. */
+  return INF_COMMUNICATION_SCOPE_PTP;
+
+fail:
+  inf_adopted_state_vector_free(time);
+  return INF_COMMUNICATION_SCOPE_PTP;
+}
+
+static InfCommunicationScope
+inf_text_session_handle_caret_mode(InfTextSession* session,
+                                   InfXmlConnection* connection,
+                                   xmlNodePtr xml,
+                                   GError** error)
+{
+  InfTextSessionPrivate* priv;
+  InfCommunicationGroup* group;
+  xmlChar* mode;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+
+  if(group == NULL || !INF_COMMUNICATION_IS_JOINED_GROUP(group) ||
+     inf_communication_joined_group_get_publisher(
+       INF_COMMUNICATION_JOINED_GROUP(group)) != connection)
+  {
+    g_set_error(
+      error,
+      inf_text_session_error_quark,
+      INF_TEXT_SESSION_ERROR_FAILED,
+      "%s",
+      _("Caret mode can only be set by the server")
+    );
+
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+
+  mode = inf_xml_util_get_attribute_required(xml, "mode", error);
+  if(mode == NULL) return INF_COMMUNICATION_SCOPE_PTP;
+
+  if(strcmp((const char*)mode, "request") == 0)
+  {
+    priv->caret_requests = TRUE;
+  }
+  else if(strcmp((const char*)mode, "message") == 0)
+  {
+    priv->caret_requests = FALSE;
+  }
+  else
+  {
+    g_set_error(
+      error,
+      inf_text_session_error_quark,
+      INF_TEXT_SESSION_ERROR_FAILED,
+      _("Invalid caret mode: '%s'"),
+      (const gchar*)mode
+    );
+  }
+
+  xmlFree(mode);
+  return INF_COMMUNICATION_SCOPE_PTP;
+}
+
+typedef struct _InfTextSessionLogStatisticsData
+  InfTextSessionLogStatisticsData;
+struct _InfTextSessionLogStatisticsData {
+  InfTextSessionLogStatistics* statistics;
+  GHashTable* chunks;
+};
+
+static void
+inf_text_session_log_statistics_add_operation(
+  InfTextSessionLogStatisticsData* data,
+  InfAdoptedOperation* operation)
+{
+  InfTextChunk* chunk;
+  InfTextChunkIter iter;
+  GSList* list;
+  GSList* item;
+
+  if(INF_ADOPTED_IS_SPLIT_OPERATION(operation))
+  {
+    list = inf_adopted_split_operation_unsplit(
+      INF_ADOPTED_SPLIT_OPERATION(operation)
+    );
+
+    for(item = list; item != NULL; item = item->next)
+    {
+      inf_text_session_log_statistics_add_operation(
+        data,
+        INF_ADOPTED_OPERATION(item->data)
+      );
+    }
+
+    g_slist_free(list);
+    return;
+  }
+
+  if(INF_TEXT_IS_DEFAULT_INSERT_OPERATION(operation))
+  {
+    chunk = inf_text_default_insert_operation_get_chunk(
+      INF_TEXT_DEFAULT_INSERT_OPERATION(operation)
+    );
+  }
+  else if(INF_TEXT_IS_DEFAULT_DELETE_OPERATION(operation))
+  {
+    chunk = inf_text_default_delete_operation_get_chunk(
+      INF_TEXT_DEFAULT_DELETE_OPERATION(operation)
+    );
+  }
+  else
+  {
+    return;
+  }
+
+  ++ data->statistics->n_references;
+
+  /* Chunks shared between operations only take memory once */
+  if(g_hash_table_lookup(data->chunks, chunk) != NULL)
+    return;
+
+  g_hash_table_insert(data->chunks, chunk, chunk);
+  ++ data->statistics->n_chunks;
+
+  if(inf_text_chunk_iter_init(chunk, &iter))
+  {
+    do
+    {
+      ++ data->statistics->n_segments;
+      data->statistics->n_bytes += inf_text_chunk_iter_get_bytes(&iter);
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+}
+
+static void
+inf_text_session_log_statistics_foreach_user_func(InfUser* user,
+                                                  gpointer user_data)
+{
+  InfTextSessionLogStatisticsData* data;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* request;
+  guint i;
+
+  data = (InfTextSessionLogStatisticsData*)user_data;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+
+  for(i = inf_adopted_request_log_get_begin(log);
+      i < inf_adopted_request_log_get_end(log);
+      ++ i)
+  {
+    request = inf_adopted_request_log_get_request(log, i);
+    if(inf_adopted_request_get_request_type(request) ==
+       INF_ADOPTED_REQUEST_DO)
+    {
+      inf_text_session_log_statistics_add_operation(
+        data,
+        inf_adopted_request_get_operation(request)
+      );
+    }
+  }
+}
+
 /*
  * InfSession overrides
  */
@@ -1028,7 +2192,8 @@ inf_text_session_to_xml_sync(InfSession* session,
   xmlNodePtr xml;
   gboolean result;
 
-  gchar* text;
+  const gchar* text;
+  gchar* copy;
   gsize total_bytes;
   gsize bytes_left;
   GIConv cd;
@@ -1046,7 +2211,11 @@ inf_text_session_to_xml_sync(InfSession* session,
     while(result == TRUE)
     {
       /* Write segment in 1024 byte chunks */
-      text = inf_text_buffer_iter_get_text(buffer, iter);
+      copy = NULL;
+      text = inf_text_buffer_iter_borrow_text(buffer, iter);
+      if(text == NULL)
+        text = copy = inf_text_buffer_iter_get_text(buffer, iter);
+
       total_bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
       bytes_left = total_bytes;
 
@@ -1062,7 +2231,7 @@ inf_text_session_to_xml_sync(InfSession* session,
         );
       }
 
-      g_free(text);
+      g_free(copy);
       result = inf_text_buffer_iter_next(buffer, iter);
     }
 
@@ -1174,6 +2343,24 @@ inf_text_session_process_xml_run(InfSession* session,
       error
     );
   }
+  else if(strcmp((const char*)xml->name, "user-caret-change") == 0)
+  {
+    return inf_text_session_handle_user_caret_change(
+      INF_TEXT_SESSION(session),
+      connection,
+      xml,
+      error
+    );
+  }
+  else if(strcmp((const char*)xml->name, "caret-mode") == 0)
+  {
+    return inf_text_session_handle_caret_mode(
+      INF_TEXT_SESSION(session),
+      connection,
+      xml,
+      error
+    );
+  }
   else
   {
     return INF_SESSION_CLASS(parent_class)->process_xml_run(
@@ -1350,6 +2537,7 @@ static void
 inf_text_session_synchronization_complete(InfSession* session,
                                           InfXmlConnection* connection)
 {
+  InfTextSessionPrivate* priv;
   InfSessionStatus status;
   status = inf_session_get_status(session);
 
@@ -1365,6 +2553,19 @@ inf_text_session_synchronization_complete(InfSession* session,
    * synchronized the session to someone else (status == RUNNING). */
   if(status == INF_SESSION_SYNCHRONIZING)
     inf_text_session_init_text_handlers(INF_TEXT_SESSION(session));
+
+  /* A new client was not told whether to send move requests for caret
+   * changes while it was being synchronized. */
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+  if(status == INF_SESSION_RUNNING && priv->caret_n_legacy_members > 0 &&
+     g_slist_find(priv->caret_members, connection) != NULL)
+  {
+    inf_text_session_send_caret_mode(
+      INF_TEXT_SESSION(session),
+      connection,
+      TRUE
+    );
+  }
 }
 
 /*
@@ -1613,28 +2814,37 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
     if(!utf8_text)
       goto fail;
 
-    text = g_convert(
-      utf8_text,
-      in_bytes,
-      inf_text_buffer_get_encoding(buffer),
-      "UTF-8",
-      NULL,
-      &bytes,
-      error
-    );
+    /* Most buffers are UTF-8 encoded, in which case there is nothing to
+     * convert. inf_xml_util_get_child_text() only returns valid UTF-8, so
+     * the text does not need to be validated either. */
+    if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0)
+    {
+      text = utf8_text;
+      bytes = in_bytes;
+    }
+    else
+    {
+      text = g_convert(
+        utf8_text,
+        in_bytes,
+        inf_text_buffer_get_encoding(buffer),
+        "UTF-8",
+        NULL,
+        &bytes,
+        error
+      );
 
-    g_free(utf8_text);
-    if(text == NULL) goto fail;
+      g_free(utf8_text);
+      if(text == NULL) goto fail;
+    }
 
+    /* Hand both the text and the chunk on instead of copying them */
     chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
-    inf_text_chunk_insert_text(chunk, 0, text, bytes, length, user_id);
-    g_free(text);
+    inf_text_chunk_take_text(chunk, text, bytes, length, user_id);
 
     operation = INF_ADOPTED_OPERATION(
-      inf_text_default_insert_operation_new(pos, chunk)
+      _inf_text_default_insert_operation_new_take(pos, chunk)
     );
-
-    inf_text_chunk_free(chunk);
   }
   else if(strcmp((const char*)op_xml->name, "delete") == 0 ||
           strcmp((const char*)op_xml->name, "delete-caret") == 0)
@@ -1692,10 +2902,8 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
       g_iconv_close(cd);
 
       operation = INF_ADOPTED_OPERATION(
-        inf_text_default_delete_operation_new(pos, chunk)
+        _inf_text_default_delete_operation_new_take(pos, chunk)
       );
-
-      inf_text_chunk_free(chunk);
     }
     else
     {
@@ -1786,6 +2994,12 @@ fail:
   return NULL;
 }
 
+static void
+inf_text_session_flush_requests(InfAdoptedSession* session)
+{
+  inf_text_session_flush_pending_except(INF_TEXT_SESSION(session), NULL);
+}
+
 /*
  * Gype registration.
  */
@@ -1823,6 +3037,7 @@ inf_text_session_class_init(gpointer g_class,
 
   adopted_session_class->xml_to_request = inf_text_session_xml_to_request;
   adopted_session_class->request_to_xml = inf_text_session_request_to_xml;
+  adopted_session_class->flush_requests = inf_text_session_flush_requests;
 
   inf_text_session_error_quark = g_quark_from_static_string(
     "INF_TEXT_SESSION_ERROR"
@@ -1841,6 +3056,52 @@ inf_text_session_class_init(gpointer g_class,
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT
     )
   );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COALESCE_INTERVAL,
+    g_param_spec_uint(
+      "coalesce-interval",
+      "Coalesce interval",
+      "Maximum number of milliseconds local text changes are held back to "
+      "be merged with adjacent ones, or 0 to send every change immediately",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COALESCE_MAX_LENGTH,
+    g_param_spec_uint(
+      "coalesce-max-length",
+      "Coalesce maximum length",
+      "Number of characters after which merged local text changes are sent "
+      "without waiting for the coalesce interval to elapse",
+      1,
+      G_MAXUINT,
+      256,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_CARET_RELAY_INTERVAL,
+    g_param_spec_uint(
+      "caret-relay-interval",
+      "Caret relay interval",
+      "Number of milliseconds within which the server collects caret "
+      "updates of its clients before relaying them together, or 0 to relay "
+      "every update immediately",
+      0,
+      G_MAXUINT,
+      100,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 GType
@@ -2052,8 +3313,9 @@ inf_text_session_set_user_color(InfTextSession* session,
  * @user: The #InfTextUser for which to flush messages.
  *
  * This function sends all pending requests for @user immediately. Requests
- * that modify the buffer are not queued normally, but cursor movement
- * requests are delayed in case are issued frequently, to save bandwidth.
+ * that modify the buffer are not queued unless
+ * #InfTextSession:coalesce-interval is set, but cursor movement
+ * updates are delayed in case are issued frequently, to save bandwidth.
  *
  * The main purpose of this function is to send all pending requests before
  * changing a user's status to inactive or unavailable since inactive users
@@ -2079,8 +3341,49 @@ inf_text_session_flush_requests_for_user(InfTextSession* session,
 
   if(local->caret_timeout != NULL)
   {
+    /* This flushes pending text changes as well */
     inf_text_session_broadcast_caret_selection(session, local);
   }
+  else
+  {
+    inf_text_session_flush_pending(session, local);
+  }
+}
+
+/**
+ * inf_text_session_get_log_statistics:
+ * @session: A #InfTextSession.
+ * @statistics: Location to store the statistics.
+ *
+ * Fills @statistics with information about the text that is kept in the
+ * request logs of @session's users so that requests can be undone or
+ * transformed. This walks through all requests in the logs, so it should
+ * not be called too often.
+ */
+void
+inf_text_session_get_log_statistics(InfTextSession* session,
+                                    InfTextSessionLogStatistics* statistics)
+{
+  InfTextSessionLogStatisticsData data;
+
+  g_return_if_fail(INF_TEXT_IS_SESSION(session));
+  g_return_if_fail(statistics != NULL);
+
+  statistics->n_chunks = 0;
+  statistics->n_references = 0;
+  statistics->n_segments = 0;
+  statistics->n_bytes = 0;
+
+  data.statistics = statistics;
+  data.chunks = g_hash_table_new(NULL, NULL);
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_text_session_log_statistics_foreach_user_func,
+    &data
+  );
+
+  g_hash_table_destroy(data.chunks);
 }
 
 /* vim:set et sw=2 ts=2: */
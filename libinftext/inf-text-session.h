@@ -43,9 +43,33 @@ typedef struct _InfTextSessionClass InfTextSessionClass;
 typedef enum _InfTextSessionError {
   INF_TEXT_SESSION_ERROR_INVALID_HUE,
 
-  INF_TEXT_SESSION_ERROR_FAILED
+  INF_TEXT_SESSION_ERROR_FAILED,
+
+  /* After FAILED so that the existing error codes do not change */
+  INF_TEXT_SESSION_ERROR_INVALID_CARET
 } InfTextSessionError;
 
+/**
+ * InfTextSessionLogStatistics:
+ * @n_chunks: The number of distinct text chunks referenced by the request
+ * logs.
+ * @n_references: The number of operations in the request logs that
+ * reference a text chunk. This is larger than @n_chunks if operations
+ * share their text, for example an insertion and its undo.
+ * @n_segments: The total number of segments in the text chunks.
+ * @n_bytes: The total size of the text in the text chunks, in bytes.
+ *
+ * Describes the memory used for text kept in the request logs of a
+ * #InfTextSession, see inf_text_session_get_log_statistics().
+ */
+typedef struct _InfTextSessionLogStatistics InfTextSessionLogStatistics;
+struct _InfTextSessionLogStatistics {
+  guint n_chunks;
+  guint n_references;
+  guint n_segments;
+  gsize n_bytes;
+};
+
 struct _InfTextSessionClass {
   InfAdoptedSessionClass parent_class;
 };
@@ -83,6 +107,10 @@ void
 inf_text_session_flush_requests_for_user(InfTextSession* session,
                                          InfTextUser* user);
 
+void
+inf_text_session_get_log_statistics(InfTextSession* session,
+                                    InfTextSessionLogStatistics* statistics);
+
 G_END_DECLS
 
 #endif /* __INF_TEXT_SESSION_H__ */
@@ -48,14 +48,6 @@ struct _InfTextGtkBufferUserTags {
   GtkTextTag* colorless_tag;
 };
 
-typedef struct _InfTextGtkBufferTagRemove InfTextGtkBufferTagRemove;
-struct _InfTextGtkBufferTagRemove {
-  GtkTextBuffer* buffer;
-  GtkTextIter begin_iter;
-  GtkTextIter end_iter;
-  InfTextGtkBufferUserTags* ignore_tags;
-};
-
 typedef struct _InfTextGtkBufferPrivate InfTextGtkBufferPrivate;
 struct _InfTextGtkBufferPrivate {
   GtkTextBuffer* buffer;
@@ -496,24 +488,43 @@ inf_text_gtk_buffer_apply_tag_cb(GtkTextBuffer* gtk_buffer,
     g_signal_stop_emission_by_name(G_OBJECT(gtk_buffer), "apply-tag");
 }
 
+/* Removes all tags in the range from begin to end, except the ones in
+ * ignore_tags. Only the tags that are actually present in the range are
+ * looked at, which are the ones active at begin plus the ones toggled on
+ * inside the range, instead of trying to remove each tag from the
+ * buffer's tag table. */
 static void
-inf_text_gtk_buffer_buffer_insert_text_tag_table_foreach_func(GtkTextTag* tag,
-                                                              gpointer data)
+inf_text_gtk_buffer_remove_tags(GtkTextBuffer* buffer,
+                                const GtkTextIter* begin,
+                                const GtkTextIter* end,
+                                InfTextGtkBufferUserTags* ignore_tags)
 {
-  InfTextGtkBufferTagRemove* tag_remove;
-  tag_remove = (InfTextGtkBufferTagRemove*)data;
+  GtkTextIter iter;
+  GSList* tags;
+  GSList* item;
+  GtkTextTag* tag;
 
-  if(tag_remove->ignore_tags == NULL ||
-     (tag != tag_remove->ignore_tags->colored_tag &&
-      tag != tag_remove->ignore_tags->colorless_tag))
+  tags = gtk_text_iter_get_tags(begin);
+
+  iter = *begin;
+  while(gtk_text_iter_forward_to_tag_toggle(&iter, NULL) &&
+        gtk_text_iter_compare(&iter, end) < 0)
   {
-    gtk_text_buffer_remove_tag(
-      tag_remove->buffer,
-      tag,
-      &tag_remove->begin_iter,
-      &tag_remove->end_iter
-    );
+    tags = g_slist_concat(gtk_text_iter_get_toggled_tags(&iter, TRUE), tags);
+  }
+
+  for(item = tags; item != NULL; item = g_slist_next(item))
+  {
+    tag = GTK_TEXT_TAG(item->data);
+
+    if(ignore_tags == NULL ||
+       (tag != ignore_tags->colored_tag && tag != ignore_tags->colorless_tag))
+    {
+      gtk_text_buffer_remove_tag(buffer, tag, begin, end);
+    }
   }
+
+  g_slist_free(tags);
 }
 
 /* Record tracking:
@@ -697,7 +708,9 @@ inf_text_gtk_buffer_record_signal(InfTextGtkBuffer* buffer,
 {
   InfTextGtkBufferPrivate* priv;
   InfTextGtkBufferRecord* rec;
-  InfTextGtkBufferTagRemove tag_remove;
+  InfTextGtkBufferUserTags* user_tags;
+  GtkTextIter begin_iter;
+  GtkTextIter end_iter;
   GtkTextTag* tag;
 
   priv = INF_TEXT_GTK_BUFFER_PRIVATE(buffer);
@@ -722,46 +735,40 @@ inf_text_gtk_buffer_record_signal(InfTextGtkBuffer* buffer,
     );
 
     /* Tag the inserted text with the user's color */
-    tag_remove.buffer = priv->buffer;
-
-    tag_remove.ignore_tags = inf_text_gtk_buffer_get_user_tags(
+    user_tags = inf_text_gtk_buffer_get_user_tags(
       buffer,
       inf_user_get_id(INF_USER(priv->active_user))
     );
-    g_assert(tag_remove.ignore_tags != NULL);
+    g_assert(user_tags != NULL);
 
     tag = inf_text_gtk_buffer_get_user_tag(
       buffer,
-      tag_remove.ignore_tags,
+      user_tags,
       priv->show_user_colors
     );
 
     /* Remove other user tags, if any */
     gtk_text_buffer_get_iter_at_offset(
       priv->buffer,
-      &tag_remove.begin_iter,
+      &begin_iter,
       record->position
     );
 
     gtk_text_buffer_get_iter_at_offset(
       priv->buffer,
-      &tag_remove.end_iter,
+      &end_iter,
       record->position + inf_text_chunk_get_length(record->chunk)
     );
 
-    gtk_text_tag_table_foreach(
-      gtk_text_buffer_get_tag_table(tag_remove.buffer),
-      inf_text_gtk_buffer_buffer_insert_text_tag_table_foreach_func,
-      &tag_remove
+    inf_text_gtk_buffer_remove_tags(
+      priv->buffer,
+      &begin_iter,
+      &end_iter,
+      user_tags
     );
 
     /* Apply tag for this particular user */
-    gtk_text_buffer_apply_tag(
-      priv->buffer,
-      tag,
-      &tag_remove.begin_iter,
-      &tag_remove.end_iter
-    );
+    gtk_text_buffer_apply_tag(priv->buffer, tag, &begin_iter, &end_iter);
 
     /* Allow author tag changes within this function: */
     inf_signal_handlers_unblock_by_func(
@@ -1595,10 +1602,9 @@ inf_text_gtk_buffer_buffer_get_slice(InfTextBuffer* buffer,
 
     text = gtk_text_buffer_get_slice(priv->buffer, &begin, &iter, TRUE);
 
-    /* TODO: Faster inf_text_chunk_append that optionally eats text */
-    inf_text_chunk_insert_text(
+    /* The chunk takes ownership of text, so no need to copy it again */
+    inf_text_chunk_take_text(
       result,
-      len - remaining,
       text,
       strlen(text), /* I hate strlen. GTK+ should tell us how many bytes. */
       size,
@@ -1606,7 +1612,6 @@ inf_text_gtk_buffer_buffer_get_slice(InfTextBuffer* buffer,
     );
 
     remaining -= size;
-    g_free(text);
   }
 
   return result;
@@ -1620,8 +1625,17 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
 {
   InfTextGtkBufferPrivate* priv;
   InfTextChunkIter chunk_iter;
-  InfTextGtkBufferTagRemove tag_remove;
+  InfTextChunkIter next_iter;
+  GtkTextIter begin_iter;
+  GtkTextIter segment_iter;
+  GtkTextIter end_iter;
+  gchar* text;
+  gsize bytes;
+
+  InfTextGtkBufferUserTags* user_tags;
   GtkTextTag* tag;
+  guint author;
+  guint prev_author;
 
   GtkTextMark* mark;
   GtkTextIter insert_iter;
@@ -1629,7 +1643,6 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
   gboolean insert_at_selection_bound;
 
   priv = INF_TEXT_GTK_BUFFER_PRIVATE(buffer);
-  tag_remove.buffer = priv->buffer;
 
   /* This would have to be handled separately, but I think this is unlikely
    * to happen anyway. If it does happen then we would again need to rely on
@@ -1657,58 +1670,82 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
 
   if(inf_text_chunk_iter_init(chunk, &chunk_iter))
   {
-    gtk_text_buffer_get_iter_at_offset(
-      priv->buffer,
-      &tag_remove.end_iter,
-      pos
-    );
+    gtk_text_buffer_get_iter_at_offset(priv->buffer, &end_iter, pos);
+
+    /* Insert the whole chunk with a single insertion, so that the
+     * GtkTextBuffer is only modified once no matter how many authors
+     * wrote the chunk. Author tags are applied afterwards. If the chunk
+     * consists of only one segment we can insert that directly. */
+    next_iter = chunk_iter;
+    if(inf_text_chunk_iter_next(&next_iter))
+    {
+      text = inf_text_chunk_get_text(chunk, &bytes);
+      gtk_text_buffer_insert(priv->buffer, &end_iter, text, bytes);
+      g_free(text);
+    }
+    else
+    {
+      gtk_text_buffer_insert(
+        priv->buffer,
+        &end_iter,
+        inf_text_chunk_iter_get_text(&chunk_iter),
+        inf_text_chunk_iter_get_bytes(&chunk_iter)
+      );
+    }
+
+    /* Remove other tags. If we inserted the new text within another user's
+     * text, GtkTextBuffer automatically applies that tag to the new text. */
+    gtk_text_buffer_get_iter_at_offset(priv->buffer, &begin_iter, pos);
+    inf_text_gtk_buffer_remove_tags(priv->buffer, &begin_iter, &end_iter, NULL);
+
+    /* Tag each segment with its author. Tags are looked up in the user_tags
+     * hash table, and the tag of the previous segment is reused if the
+     * author did not change. */
+    prev_author = 0;
+    tag = NULL;
 
     do
     {
-      tag_remove.ignore_tags = inf_text_gtk_buffer_get_user_tags(
-        INF_TEXT_GTK_BUFFER(buffer),
-        inf_text_chunk_iter_get_author(&chunk_iter)
+      author = inf_text_chunk_iter_get_author(&chunk_iter);
+      segment_iter = begin_iter;
+
+      gtk_text_iter_forward_chars(
+        &begin_iter,
+        inf_text_chunk_iter_get_length(&chunk_iter)
       );
 
-      if(tag_remove.ignore_tags)
+      if(author != prev_author)
       {
-        tag = inf_text_gtk_buffer_get_user_tag(
+        user_tags = inf_text_gtk_buffer_get_user_tags(
           INF_TEXT_GTK_BUFFER(buffer),
-          tag_remove.ignore_tags,
-          priv->show_user_colors
+          author
         );
-      }
-      else
-      {
-        tag = NULL;
-      }
 
-      gtk_text_buffer_insert_with_tags(
-        tag_remove.buffer,
-        &tag_remove.end_iter,
-        inf_text_chunk_iter_get_text(&chunk_iter),
-        inf_text_chunk_iter_get_bytes(&chunk_iter),
-        tag,
-        NULL
-      );
-
-      /* Remove other user tags. If we inserted the new text within another
-       * user's text, GtkTextBuffer automatically applies that tag to the
-       * new text. */
+        if(user_tags != NULL)
+        {
+          tag = inf_text_gtk_buffer_get_user_tag(
+            INF_TEXT_GTK_BUFFER(buffer),
+            user_tags,
+            priv->show_user_colors
+          );
+        }
+        else
+        {
+          tag = NULL;
+        }
 
-      /* TODO: We could probably look for the tag that we have to remove
-       * before inserting text, to optimize this a bit. */
-      tag_remove.begin_iter = tag_remove.end_iter;
-      gtk_text_iter_backward_chars(
-        &tag_remove.begin_iter,
-        inf_text_chunk_iter_get_length(&chunk_iter)
-      );
+        prev_author = author;
+      }
 
-      gtk_text_tag_table_foreach(
-        gtk_text_buffer_get_tag_table(tag_remove.buffer),
-        inf_text_gtk_buffer_buffer_insert_text_tag_table_foreach_func,
-        &tag_remove
-      );
+      if(tag != NULL)
+      {
+        gtk_text_buffer_apply_tag(
+          priv->buffer,
+          tag,
+          &segment_iter,
+          &begin_iter
+        );
+      }
     } while(inf_text_chunk_iter_next(&chunk_iter));
 
     /* Fix left gravity of own cursor on remote insert */
@@ -1721,7 +1758,7 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
       mark = gtk_text_buffer_get_insert(priv->buffer);
       gtk_text_buffer_get_iter_at_mark(priv->buffer, &insert_iter, mark);
 
-      if(gtk_text_iter_equal(&insert_iter, &tag_remove.end_iter))
+      if(gtk_text_iter_equal(&insert_iter, &end_iter))
         insert_at_cursor = TRUE;
       else
         insert_at_cursor = FALSE;
@@ -1729,7 +1766,7 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
       mark = gtk_text_buffer_get_selection_bound(priv->buffer);
       gtk_text_buffer_get_iter_at_mark(priv->buffer, &insert_iter, mark);
 
-      if(gtk_text_iter_equal(&insert_iter, &tag_remove.end_iter))
+      if(gtk_text_iter_equal(&insert_iter, &end_iter))
         insert_at_selection_bound = TRUE;
       else
         insert_at_selection_bound = FALSE;
@@ -1743,7 +1780,7 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
         );
 
         gtk_text_iter_backward_chars(
-          &tag_remove.end_iter,
+          &end_iter,
           inf_text_chunk_get_length(chunk)
         );
 
@@ -1752,7 +1789,7 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
           gtk_text_buffer_move_mark(
             priv->buffer,
             gtk_text_buffer_get_insert(priv->buffer),
-            &tag_remove.end_iter
+            &end_iter
           );
         }
 
@@ -1761,7 +1798,7 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
           gtk_text_buffer_move_mark(
             priv->buffer,
             gtk_text_buffer_get_selection_bound(priv->buffer),
-            &tag_remove.end_iter
+            &end_iter
           );
         }
 
@@ -2137,6 +2174,8 @@ inf_text_gtk_buffer_text_buffer_init(gpointer g_iface,
   iface->iter_get_length = inf_text_gtk_buffer_buffer_iter_get_length;
   iface->iter_get_bytes = inf_text_gtk_buffer_buffer_iter_get_bytes;
   iface->iter_get_author = inf_text_gtk_buffer_buffer_iter_get_author;
+  /* GtkTextBuffer can only hand out copies of its text */
+  iface->iter_borrow_text = NULL;
   iface->text_inserted = NULL;
   iface->text_erased = NULL;
 }
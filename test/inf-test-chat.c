@@ -27,7 +27,9 @@
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-io.h>
 #include <libinfinity/common/inf-protocol.h>
+#include <libinfinity/common/inf-user-table.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 typedef struct _InfTestChat InfTestChat;
@@ -329,6 +331,114 @@ inf_test_chat_error_cb(InfXmppConnection* xmpp,
   fprintf(stderr, "Connection error: %s\n", error->message);
 }
 
+/* Logs the given number of messages in a local session, and reports how
+ * long it took to log them, to write the log to disk, and how many stanzas
+ * would be needed to synchronize the backlog. */
+static int
+inf_test_chat_bench(guint n_messages,
+                    const gchar* log_file)
+{
+  InfCommunicationManager* manager;
+  InfChatSession* session;
+  InfChatBuffer* buffer;
+  InfUser* user;
+  InfChatBufferMessage message;
+  xmlNodePtr container;
+  xmlNodePtr child;
+  GTimer* timer;
+  GError* error;
+  gchar text[64];
+  guint n_stanzas;
+  guint i;
+
+  manager = inf_communication_manager_new();
+  session = inf_chat_session_new(
+    manager,
+    n_messages,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  buffer = INF_CHAT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+
+  user = INF_USER(
+    g_object_new(
+      INF_TYPE_USER,
+      "id", 1,
+      "name", "bench",
+      "status", INF_USER_ACTIVE,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    user
+  );
+
+  error = NULL;
+  if(!inf_chat_session_set_log_file(session, log_file, &error))
+  {
+    fprintf(stderr, "Could not open log file: %s\n", error->message);
+    g_error_free(error);
+    g_object_unref(user);
+    g_object_unref(session);
+    g_object_unref(manager);
+    return 1;
+  }
+
+  timer = g_timer_new();
+  for(i = 0; i < n_messages; ++i)
+  {
+    g_snprintf(text, sizeof(text), "Message %u", i);
+
+    message.type = INF_CHAT_BUFFER_MESSAGE_NORMAL;
+    message.user = user;
+    message.text = text;
+    message.length = strlen(text);
+    message.time = time(NULL);
+    message.flags = 0;
+
+    g_signal_emit_by_name(session, "receive-message", &message);
+  }
+
+  printf(
+    "Logged %u messages in %.3f ms\n",
+    n_messages,
+    g_timer_elapsed(timer, NULL) * 1000.0
+  );
+
+  /* Closing the log file waits until all pending messages are written */
+  g_timer_start(timer);
+  inf_chat_session_set_log_file(session, NULL, NULL);
+
+  printf(
+    "Wrote log file in %.3f ms\n",
+    g_timer_elapsed(timer, NULL) * 1000.0
+  );
+
+  container = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+  INF_SESSION_GET_CLASS(session)->to_xml_sync(INF_SESSION(session), container);
+
+  n_stanzas = 0;
+  for(child = container->children; child != NULL; child = child->next)
+    ++ n_stanzas;
+
+  printf(
+    "Backlog of %u messages is synchronized in %u stanzas\n",
+    inf_chat_buffer_get_n_messages(buffer),
+    n_stanzas
+  );
+
+  xmlFreeNode(container);
+  g_timer_destroy(timer);
+  g_object_unref(user);
+  g_object_unref(session);
+  g_object_unref(manager);
+  return 0;
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -341,6 +451,14 @@ main(int argc, char* argv[])
   gnutls_global_init();
   g_type_init();
 
+  if(argc == 4 && strcmp(argv[1], "--bench") == 0)
+  {
+    if(!g_thread_supported())
+      g_thread_init(NULL);
+
+    return inf_test_chat_bench(strtoul(argv[2], NULL, 10), argv[3]);
+  }
+
   test.io = inf_standalone_io_new();
 #ifndef G_OS_WIN32
   test.input_fd = STDIN_FILENO;
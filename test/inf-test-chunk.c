@@ -23,6 +23,7 @@ int main()
 {
   InfTextChunk* chunk;
   InfTextChunk* chunk2;
+  InfTextChunk* chunk3;
 
   chunk2 = inf_text_chunk_new("UTF-8");
 
@@ -32,8 +33,21 @@ int main()
   inf_text_chunk_insert_text(chunk2, 3, "ü", 2, 1, 503);
   chunk = inf_text_chunk_substring(chunk2, 0, 3);
 
+  chunk3 = inf_text_chunk_new("UTF-8");
+  inf_text_chunk_take_text(chunk3, g_strdup("c"), 1, 1, 502);
+  inf_text_chunk_take_text(chunk3, g_strdup("b"), 1, 1, 501);
+  inf_text_chunk_take_text(chunk3, g_strdup(""), 0, 0, 501);
+  inf_text_chunk_take_text(chunk3, g_strdup("a"), 1, 1, 500);
+  if(!inf_text_chunk_equal(chunk, chunk3))
+    return 1;
+
+  inf_text_chunk_take_text(chunk3, g_strdup("ü"), 2, 1, 503);
+  if(!inf_text_chunk_equal(chunk2, chunk3))
+    return 1;
+
   inf_text_chunk_free(chunk);
   inf_text_chunk_free(chunk2);
+  inf_text_chunk_free(chunk3);
 
   return 0;
 }
@@ -0,0 +1,247 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Applies a document of about 1 MB, written by several authors, to an
+ * InfTextGtkBuffer, followed by a number of smaller multi-author
+ * insertions at random positions. Afterwards the whole buffer is read
+ * back with inf_text_buffer_get_slice() and compared to the expected
+ * content, including authorship. The time each step takes is printed. */
+
+#include <libinftextgtk/inf-text-gtk-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinftext/inf-text-chunk.h>
+#include <libinfinity/common/inf-user-table.h>
+
+#include <gtk/gtk.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define INF_TEST_GTK_BUFFER_SIZE (1024 * 1024)
+#define INF_TEST_GTK_BUFFER_AUTHORS 8
+#define INF_TEST_GTK_BUFFER_INSERTIONS 1000
+
+static const gchar INF_TEST_GTK_BUFFER_CHARSET[] =
+  "abcdefghijklmnopqrstuvwxyz     \n";
+
+/* Creates a chunk of about size bytes, consisting of segments between 1 and
+ * max_segment characters written by a random author each. */
+static InfTextChunk*
+inf_test_gtk_buffer_make_chunk(GRand* rand,
+                               guint size,
+                               guint max_segment)
+{
+  InfTextChunk* chunk;
+  guint total;
+  guint length;
+  guint author;
+  guint i;
+  gchar* text;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  total = 0;
+
+  while(total < size)
+  {
+    length = g_rand_int_range(rand, 1, max_segment + 1);
+    author = g_rand_int_range(rand, 1, INF_TEST_GTK_BUFFER_AUTHORS + 1);
+
+    text = g_malloc(length);
+    for(i = 0; i < length; ++i)
+    {
+      text[i] = INF_TEST_GTK_BUFFER_CHARSET[
+        g_rand_int_range(rand, 0, sizeof(INF_TEST_GTK_BUFFER_CHARSET) - 1)
+      ];
+    }
+
+    inf_text_chunk_take_text(chunk, text, length, length, author);
+    total += length;
+  }
+
+  return chunk;
+}
+
+/* Compares text and authorship of the two chunks. Unlike
+ * inf_text_chunk_equal() this does not require segment boundaries to match,
+ * since adjacent segments by the same author are not necessarily merged. */
+static gboolean
+inf_test_gtk_buffer_chunk_equal(InfTextChunk* first,
+                                InfTextChunk* second)
+{
+  InfTextChunkIter iter1;
+  InfTextChunkIter iter2;
+  gboolean have1;
+  gboolean have2;
+  gsize offset1;
+  gsize offset2;
+  gsize bytes;
+
+  have1 = inf_text_chunk_iter_init(first, &iter1);
+  have2 = inf_text_chunk_iter_init(second, &iter2);
+  offset1 = offset2 = 0;
+
+  while(have1 && have2)
+  {
+    if(inf_text_chunk_iter_get_author(&iter1) !=
+       inf_text_chunk_iter_get_author(&iter2))
+    {
+      return FALSE;
+    }
+
+    bytes = MIN(
+      inf_text_chunk_iter_get_bytes(&iter1) - offset1,
+      inf_text_chunk_iter_get_bytes(&iter2) - offset2
+    );
+
+    if(memcmp(
+         (const gchar*)inf_text_chunk_iter_get_text(&iter1) + offset1,
+         (const gchar*)inf_text_chunk_iter_get_text(&iter2) + offset2,
+         bytes) != 0)
+    {
+      return FALSE;
+    }
+
+    offset1 += bytes;
+    offset2 += bytes;
+
+    if(offset1 == inf_text_chunk_iter_get_bytes(&iter1))
+    {
+      have1 = inf_text_chunk_iter_next(&iter1);
+      offset1 = 0;
+    }
+
+    if(offset2 == inf_text_chunk_iter_get_bytes(&iter2))
+    {
+      have2 = inf_text_chunk_iter_next(&iter2);
+      offset2 = 0;
+    }
+  }
+
+  return !have1 && !have2;
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+  InfUserTable* user_table;
+  InfTextUser* user;
+  GtkTextBuffer* textbuffer;
+  InfTextGtkBuffer* buffer;
+  InfTextChunk* expected;
+  InfTextChunk* chunk;
+  InfTextChunk* slice;
+  GRand* rand;
+  GTimer* timer;
+  gchar* user_name;
+  guint length;
+  guint pos;
+  guint i;
+  gboolean equal;
+
+  g_type_init();
+
+  user_table = inf_user_table_new();
+  for(i = 1; i <= INF_TEST_GTK_BUFFER_AUTHORS; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "hue", (double)i / INF_TEST_GTK_BUFFER_AUTHORS,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  textbuffer = gtk_text_buffer_new(NULL);
+  buffer = inf_text_gtk_buffer_new(textbuffer, user_table);
+  inf_text_gtk_buffer_set_show_user_colors(buffer, TRUE);
+
+  rand = g_rand_new_with_seed(42);
+  timer = g_timer_new();
+
+  expected = inf_test_gtk_buffer_make_chunk(
+    rand,
+    INF_TEST_GTK_BUFFER_SIZE,
+    64
+  );
+
+  g_timer_start(timer);
+  inf_text_buffer_insert_chunk(INF_TEXT_BUFFER(buffer), 0, expected, NULL);
+  g_timer_stop(timer);
+
+  printf(
+    "Initial document: %u characters, %.3f s\n",
+    inf_text_chunk_get_length(expected),
+    g_timer_elapsed(timer, NULL)
+  );
+
+  g_timer_start(timer);
+  for(i = 0; i < INF_TEST_GTK_BUFFER_INSERTIONS; ++i)
+  {
+    chunk = inf_test_gtk_buffer_make_chunk(rand, 64, 8);
+    length = inf_text_chunk_get_length(expected);
+    pos = g_rand_int_range(rand, 0, length + 1);
+
+    inf_text_buffer_insert_chunk(INF_TEXT_BUFFER(buffer), pos, chunk, NULL);
+    inf_text_chunk_insert_chunk(expected, pos, chunk);
+    inf_text_chunk_free(chunk);
+  }
+  g_timer_stop(timer);
+
+  printf(
+    "%u insertions: %.3f s\n",
+    INF_TEST_GTK_BUFFER_INSERTIONS,
+    g_timer_elapsed(timer, NULL)
+  );
+
+  g_timer_start(timer);
+  slice = inf_text_buffer_get_slice(
+    INF_TEXT_BUFFER(buffer),
+    0,
+    inf_text_buffer_get_length(INF_TEXT_BUFFER(buffer))
+  );
+  g_timer_stop(timer);
+
+  printf("Slice: %.3f s\n", g_timer_elapsed(timer, NULL));
+
+  equal = inf_test_gtk_buffer_chunk_equal(slice, expected);
+  if(!equal)
+    fprintf(stderr, "Buffer content does not match expected content\n");
+
+  inf_text_chunk_free(slice);
+  inf_text_chunk_free(expected);
+  g_timer_destroy(timer);
+  g_rand_free(rand);
+  g_object_unref(buffer);
+  g_object_unref(textbuffer);
+  g_object_unref(user_table);
+
+  return equal ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,1235 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Runs a server and a number of clients within the same process, connected
+ * through InfSimulatedConnections with configurable latency and bandwidth.
+ * All clients join a single text document and then modify it according to
+ * a script, until the configured duration has elapsed. Afterwards the time
+ * the server spent processing incoming messages, the number of queued
+ * messages on the links, the time it took requests to arrive at the
+ * server and the size of the server's request logs are printed, and all
+ * documents are checked for convergence. */
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/adopted/inf-adopted-user.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-user-table.h>
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct _InfTestLoad InfTestLoad;
+typedef struct _InfTestLoadClient InfTestLoadClient;
+
+struct _InfTestLoadClient {
+  InfTestLoad* test;
+  guint index;
+  GRand* rand;
+
+  InfSimulatedConnection* client_conn;
+  InfSimulatedConnection* server_conn;
+  InfCommunicationManager* manager;
+  InfcBrowser* browser;
+  InfcSessionProxy* proxy;
+  InfTextUser* user;
+
+  InfIoTimeout* timeout;
+  guint step;
+
+  /* Maps the user's own component of the request vector to the time the
+   * request has been made, for requests not yet executed by the server. */
+  GHashTable* pending;
+
+  /* Queue depth statistics, upstream is client to server */
+  guint upstream_max;
+  guint64 upstream_sum;
+  guint downstream_max;
+  guint64 downstream_sum;
+};
+
+struct _InfTestLoad {
+  InfStandaloneIo* io;
+
+  /* Options */
+  gint n_clients;
+  gint latency;
+  gint bandwidth;
+  gint duration;
+  gint interval;
+  gint seed;
+  gchar* script;
+  gint n_viewers;
+  gint noop_interval;
+  gint noop_lag;
+
+  InfCommunicationManager* manager;
+  InfdDirectory* directory;
+  InfdSessionProxy* proxy;
+
+  InfTestLoadClient* clients;
+  guint n_joined;
+  gboolean stopped;
+  gboolean failed;
+
+  /* Maps user IDs to the client which joined the user */
+  GHashTable* users;
+
+  InfIoTimeout* sample_timeout;
+  InfIoTimeout* stop_timeout;
+  guint n_samples;
+
+  /* Total number of requests in the server's request logs */
+  guint log_size_max;
+  guint64 log_size_sum;
+
+  clock_t received_start;
+  clock_t received_time;
+  guint received_messages;
+  guint server_requests;
+
+  /* Time in milliseconds between a request being made on a client and its
+   * execution on the server */
+  GArray* latencies;
+};
+
+static gint
+inf_test_load_cmp_double(gconstpointer first,
+                         gconstpointer second)
+{
+  gdouble a = *(const gdouble*)first;
+  gdouble b = *(const gdouble*)second;
+  return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+static void
+inf_test_load_fail(InfTestLoad* test)
+{
+  test->failed = TRUE;
+  if(inf_standalone_io_loop_running(test->io))
+    inf_standalone_io_loop_quit(test->io);
+}
+
+static InfSession*
+inf_test_load_server_session_new(InfIo* io,
+                                 InfCommunicationManager* manager,
+                                 InfSessionStatus status,
+                                 InfCommunicationHostedGroup* sync_group,
+                                 InfXmlConnection* sync_connection,
+                                 gpointer user_data)
+{
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    INF_COMMUNICATION_GROUP(sync_group),
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static InfSession*
+inf_test_load_client_session_new(InfIo* io,
+                                 InfCommunicationManager* manager,
+                                 InfSessionStatus status,
+                                 InfCommunicationJoinedGroup* sync_group,
+                                 InfXmlConnection* sync_connection,
+                                 gpointer user_data)
+{
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    INF_COMMUNICATION_GROUP(sync_group),
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static const InfdNotePlugin INF_TEST_LOAD_SERVER_PLUGIN = {
+  NULL,
+  NULL,
+  "InfText",
+  inf_test_load_server_session_new,
+  NULL,
+  NULL
+};
+
+static const InfcNotePlugin INF_TEST_LOAD_CLIENT_PLUGIN = {
+  NULL,
+  "InfText",
+  inf_test_load_client_session_new
+};
+
+static gdouble
+inf_test_load_timeval_diff(GTimeVal* first,
+                           GTimeVal* second)
+{
+  return (first->tv_sec - second->tv_sec) * 1000.0 +
+         (first->tv_usec - second->tv_usec) / 1000.0;
+}
+
+static void
+inf_test_load_free_timeval(gpointer data)
+{
+  g_slice_free(GTimeVal, data);
+}
+
+/* Performs the next action from the script on behalf of the client's user */
+static void
+inf_test_load_client_step(InfTestLoadClient* client)
+{
+  InfTestLoad* test;
+  InfAdoptedSession* session;
+  InfAdoptedAlgorithm* algorithm;
+  InfTextBuffer* buffer;
+  InfUser* user;
+  guint length;
+  guint caret;
+  gchar c;
+
+  test = client->test;
+  session = INF_ADOPTED_SESSION(infc_session_proxy_get_session(client->proxy));
+  algorithm = inf_adopted_session_get_algorithm(session);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  user = INF_USER(client->user);
+
+  length = inf_text_buffer_get_length(buffer);
+  caret = inf_text_user_get_caret_position(client->user);
+
+  switch(test->script[client->step])
+  {
+  case 'i':
+    c = 'a' + g_rand_int_range(client->rand, 0, 26);
+    inf_text_buffer_insert_text(buffer, caret, &c, 1, 1, user);
+    break;
+  case 'e':
+    if(caret > 0)
+      inf_text_buffer_erase_text(buffer, caret - 1, 1, user);
+    break;
+  case 'u':
+    if(inf_adopted_algorithm_can_undo(algorithm, INF_ADOPTED_USER(user)))
+      inf_adopted_session_undo(session, INF_ADOPTED_USER(user), 1);
+    break;
+  case 'r':
+    if(inf_adopted_algorithm_can_redo(algorithm, INF_ADOPTED_USER(user)))
+      inf_adopted_session_redo(session, INF_ADOPTED_USER(user), 1);
+    break;
+  case 'c':
+    inf_text_user_set_selection(
+      client->user,
+      g_rand_int_range(client->rand, 0, length + 1),
+      0,
+      TRUE
+    );
+
+    break;
+  default:
+    /* Any other character makes the user idle for one interval */
+    break;
+  }
+
+  ++ client->step;
+  if(test->script[client->step] == '\0')
+    client->step = 0;
+}
+
+static void
+inf_test_load_client_timeout_func(gpointer user_data)
+{
+  InfTestLoadClient* client;
+  client = (InfTestLoadClient*)user_data;
+
+  client->timeout = inf_io_add_timeout(
+    INF_IO(client->test->io),
+    client->test->interval,
+    inf_test_load_client_timeout_func,
+    client,
+    NULL
+  );
+
+  inf_test_load_client_step(client);
+}
+
+static gboolean
+inf_test_load_check_convergence(InfTestLoad* test)
+{
+  InfSession* session;
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  gchar* server_text;
+  gsize server_bytes;
+  gchar* text;
+  gsize bytes;
+  gboolean result;
+  guint i;
+
+  session = infd_session_proxy_get_session(test->proxy);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  server_text = inf_text_chunk_get_text(chunk, &server_bytes);
+  inf_text_chunk_free(chunk);
+
+  printf("Final document: %u characters\n", inf_text_buffer_get_length(buffer));
+
+  result = TRUE;
+  for(i = 0; i < (guint)test->n_clients; ++i)
+  {
+    session = infc_session_proxy_get_session(test->clients[i].proxy);
+    buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+    chunk = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    text = inf_text_chunk_get_text(chunk, &bytes);
+    inf_text_chunk_free(chunk);
+
+    if(bytes != server_bytes || memcmp(text, server_text, bytes) != 0)
+    {
+      fprintf(stderr, "Client %u did not converge\n", i);
+      result = FALSE;
+    }
+
+    g_free(text);
+  }
+
+  g_free(server_text);
+  return result;
+}
+
+static void
+inf_test_load_log_size_foreach_func(InfUser* user,
+                                    gpointer user_data)
+{
+  InfAdoptedRequestLog* log;
+  guint* size;
+
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  size = (guint*)user_data;
+
+  *size += inf_adopted_request_log_get_end(log) -
+    inf_adopted_request_log_get_begin(log);
+}
+
+static guint
+inf_test_load_get_log_size(InfTestLoad* test)
+{
+  InfSession* session;
+  guint size;
+
+  session = infd_session_proxy_get_session(test->proxy);
+  size = 0;
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(session),
+    inf_test_load_log_size_foreach_func,
+    &size
+  );
+
+  return size;
+}
+
+static void
+inf_test_load_sample_timeout_func(gpointer user_data)
+{
+  InfTestLoad* test;
+  InfTestLoadClient* client;
+  guint upstream;
+  guint downstream;
+  guint log_size;
+  gboolean idle;
+  guint i;
+
+  test = (InfTestLoad*)user_data;
+  test->sample_timeout = NULL;
+
+  idle = TRUE;
+  for(i = 0; i < (guint)test->n_clients; ++i)
+  {
+    client = &test->clients[i];
+
+    upstream = inf_simulated_connection_get_queue_length(client->client_conn);
+    downstream =
+      inf_simulated_connection_get_queue_length(client->server_conn);
+
+    if(!test->stopped)
+    {
+      client->upstream_max = MAX(client->upstream_max, upstream);
+      client->upstream_sum += upstream;
+      client->downstream_max = MAX(client->downstream_max, downstream);
+      client->downstream_sum += downstream;
+    }
+
+    if(upstream > 0 || downstream > 0)
+      idle = FALSE;
+  }
+
+  if(!test->stopped)
+  {
+    log_size = inf_test_load_get_log_size(test);
+    test->log_size_max = MAX(test->log_size_max, log_size);
+    test->log_size_sum += log_size;
+
+    ++ test->n_samples;
+  }
+
+  /* Messages are delivered synchronously when they leave the queue, so when
+   * all queues are empty after the clients stopped, all requests have been
+   * processed everywhere. */
+  if(test->stopped && idle)
+  {
+    inf_standalone_io_loop_quit(test->io);
+  }
+  else
+  {
+    test->sample_timeout = inf_io_add_timeout(
+      INF_IO(test->io),
+      MAX(test->interval / 2, 1),
+      inf_test_load_sample_timeout_func,
+      test,
+      NULL
+    );
+  }
+}
+
+static void
+inf_test_load_stop_timeout_func(gpointer user_data)
+{
+  InfTestLoad* test;
+  InfTestLoadClient* client;
+  guint i;
+
+  test = (InfTestLoad*)user_data;
+  test->stop_timeout = NULL;
+  test->stopped = TRUE;
+
+  if(test->n_joined < (guint)test->n_clients)
+  {
+    fprintf(
+      stderr,
+      "Only %u out of %d clients joined within the given duration\n",
+      test->n_joined,
+      test->n_clients
+    );
+
+    inf_test_load_fail(test);
+    return;
+  }
+
+  for(i = 0; i < (guint)test->n_clients; ++i)
+  {
+    client = &test->clients[i];
+    if(client->timeout != NULL)
+    {
+      inf_io_remove_timeout(INF_IO(test->io), client->timeout);
+      client->timeout = NULL;
+    }
+  }
+}
+
+static void
+inf_test_load_server_received_before_cb(InfXmlConnection* connection,
+                                        xmlNodePtr xml,
+                                        gpointer user_data)
+{
+  InfTestLoad* test;
+  test = (InfTestLoad*)user_data;
+
+  test->received_start = clock();
+}
+
+static void
+inf_test_load_server_received_after_cb(InfXmlConnection* connection,
+                                       xmlNodePtr xml,
+                                       gpointer user_data)
+{
+  InfTestLoad* test;
+  test = (InfTestLoad*)user_data;
+
+  test->received_time += clock() - test->received_start;
+  ++ test->received_messages;
+}
+
+static void
+inf_test_load_server_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                        InfAdoptedUser* user,
+                                        InfAdoptedRequest* request,
+                                        gboolean apply,
+                                        gpointer user_data)
+{
+  InfTestLoad* test;
+  InfTestLoadClient* client;
+  GTimeVal* issued;
+  GTimeVal current;
+  guint component;
+  gdouble latency;
+
+  test = (InfTestLoad*)user_data;
+  ++ test->server_requests;
+
+  client = g_hash_table_lookup(
+    test->users,
+    GUINT_TO_POINTER(inf_user_get_id(INF_USER(user)))
+  );
+
+  if(client != NULL)
+  {
+    component = inf_adopted_state_vector_get(
+      inf_adopted_request_get_vector(request),
+      inf_user_get_id(INF_USER(user))
+    );
+
+    issued = g_hash_table_lookup(client->pending, GUINT_TO_POINTER(component));
+    if(issued != NULL)
+    {
+      g_get_current_time(&current);
+      latency = inf_test_load_timeval_diff(&current, issued);
+      g_array_append_val(test->latencies, latency);
+
+      g_hash_table_remove(client->pending, GUINT_TO_POINTER(component));
+    }
+  }
+}
+
+static void
+inf_test_load_client_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                        InfAdoptedUser* user,
+                                        InfAdoptedRequest* request,
+                                        gboolean apply,
+                                        gpointer user_data)
+{
+  InfTestLoadClient* client;
+  GTimeVal* issued;
+  guint component;
+
+  client = (InfTestLoadClient*)user_data;
+
+  if(INF_USER(user) == INF_USER(client->user))
+  {
+    component = inf_adopted_state_vector_get(
+      inf_adopted_request_get_vector(request),
+      inf_user_get_id(INF_USER(user))
+    );
+
+    issued = g_slice_new(GTimeVal);
+    g_get_current_time(issued);
+
+    g_hash_table_insert(client->pending, GUINT_TO_POINTER(component), issued);
+  }
+}
+
+static void
+inf_test_load_userjoin_finished_cb(InfcUserRequest* request,
+                                   InfUser* user,
+                                   gpointer user_data)
+{
+  InfTestLoadClient* client;
+  InfTestLoad* test;
+  InfAdoptedSession* session;
+
+  client = (InfTestLoadClient*)user_data;
+  test = client->test;
+
+  client->user = INF_TEXT_USER(user);
+  ++ test->n_joined;
+
+  g_hash_table_insert(
+    test->users,
+    GUINT_TO_POINTER(inf_user_get_id(user)),
+    client
+  );
+
+  session = INF_ADOPTED_SESSION(infc_session_proxy_get_session(client->proxy));
+
+  g_signal_connect(
+    G_OBJECT(inf_adopted_session_get_algorithm(session)),
+    "execute-request",
+    G_CALLBACK(inf_test_load_client_execute_request_cb),
+    client
+  );
+
+  /* Viewers only follow the document, without ever making a request */
+  if(!test->stopped && client->index < (guint)test->n_clients - test->n_viewers)
+  {
+    /* Spread the clients' actions evenly over the interval */
+    client->timeout = inf_io_add_timeout(
+      INF_IO(test->io),
+      test->interval * (client->index + 1) / test->n_clients,
+      inf_test_load_client_timeout_func,
+      client,
+      NULL
+    );
+  }
+}
+
+static void
+inf_test_load_request_failed_cb(InfcRequest* request,
+                                const GError* error,
+                                gpointer user_data)
+{
+  InfTestLoadClient* client;
+  client = (InfTestLoadClient*)user_data;
+
+  fprintf(stderr, "Client %u: %s\n", client->index, error->message);
+  inf_test_load_fail(client->test);
+}
+
+static void
+inf_test_load_join(InfTestLoadClient* client)
+{
+  InfAdoptedSession* session;
+  InfcUserRequest* request;
+  gchar* name;
+  GError* error;
+
+  GParameter params[3] = {
+    { "name", { 0 } },
+    { "vector", { 0 } },
+    { "caret-position", { 0 } }
+  };
+
+  session = INF_ADOPTED_SESSION(infc_session_proxy_get_session(client->proxy));
+  name = g_strdup_printf("Client_%u", client->index);
+
+  g_value_init(&params[0].value, G_TYPE_STRING);
+  g_value_init(&params[1].value, INF_ADOPTED_TYPE_STATE_VECTOR);
+  g_value_init(&params[2].value, G_TYPE_UINT);
+
+  g_value_take_string(&params[0].value, name);
+  g_value_set_boxed(
+    &params[1].value,
+    inf_adopted_algorithm_get_current(
+      inf_adopted_session_get_algorithm(session)
+    )
+  );
+
+  g_value_set_uint(&params[2].value, 0);
+
+  error = NULL;
+  request = infc_session_proxy_join_user(
+    client->proxy,
+    params,
+    G_N_ELEMENTS(params),
+    &error
+  );
+
+  g_value_unset(&params[0].value);
+  g_value_unset(&params[1].value);
+  g_value_unset(&params[2].value);
+
+  if(request == NULL)
+  {
+    fprintf(stderr, "Client %u: %s\n", client->index, error->message);
+    g_error_free(error);
+    inf_test_load_fail(client->test);
+  }
+  else
+  {
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "failed",
+      G_CALLBACK(inf_test_load_request_failed_cb),
+      client
+    );
+
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "finished",
+      G_CALLBACK(inf_test_load_userjoin_finished_cb),
+      client
+    );
+  }
+}
+
+static void
+inf_test_load_synchronization_complete_cb(InfSession* session,
+                                          InfXmlConnection* connection,
+                                          gpointer user_data)
+{
+  inf_test_load_join((InfTestLoadClient*)user_data);
+}
+
+static void
+inf_test_load_synchronization_failed_cb(InfSession* session,
+                                        InfXmlConnection* connection,
+                                        const GError* error,
+                                        gpointer user_data)
+{
+  InfTestLoadClient* client;
+  client = (InfTestLoadClient*)user_data;
+
+  fprintf(
+    stderr,
+    "Client %u: Synchronization failed: %s\n",
+    client->index,
+    error->message
+  );
+
+  inf_test_load_fail(client->test);
+}
+
+static void
+inf_test_load_set_noop_options(InfTestLoad* test,
+                               InfSession* session)
+{
+  g_object_set(
+    G_OBJECT(session),
+    "noop-interval", (guint)test->noop_interval,
+    "noop-lag", (guint)test->noop_lag,
+    NULL
+  );
+}
+
+static void
+inf_test_load_subscribe_finished_cb(InfcNodeRequest* request,
+                                    const InfcBrowserIter* iter,
+                                    gpointer user_data)
+{
+  InfTestLoadClient* client;
+  InfSession* session;
+
+  client = (InfTestLoadClient*)user_data;
+  client->proxy = infc_browser_iter_get_session(client->browser, iter);
+  g_assert(client->proxy != NULL);
+
+  session = infc_session_proxy_get_session(client->proxy);
+  inf_test_load_set_noop_options(client->test, session);
+  if(inf_session_get_status(session) == INF_SESSION_RUNNING)
+  {
+    inf_test_load_join(client);
+  }
+  else
+  {
+    g_signal_connect_after(
+      G_OBJECT(session),
+      "synchronization-complete",
+      G_CALLBACK(inf_test_load_synchronization_complete_cb),
+      client
+    );
+
+    g_signal_connect_after(
+      G_OBJECT(session),
+      "synchronization-failed",
+      G_CALLBACK(inf_test_load_synchronization_failed_cb),
+      client
+    );
+  }
+}
+
+static void
+inf_test_load_subscribe(InfTestLoadClient* client)
+{
+  InfcBrowserIter iter;
+  InfcNodeRequest* request;
+
+  infc_browser_iter_get_root(client->browser, &iter);
+  if(!infc_browser_iter_get_child(client->browser, &iter))
+  {
+    fprintf(stderr, "Client %u: Document not found\n", client->index);
+    inf_test_load_fail(client->test);
+    return;
+  }
+
+  request = infc_browser_iter_subscribe_session(client->browser, &iter);
+
+  g_signal_connect_after(
+    G_OBJECT(request),
+    "failed",
+    G_CALLBACK(inf_test_load_request_failed_cb),
+    client
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(request),
+    "finished",
+    G_CALLBACK(inf_test_load_subscribe_finished_cb),
+    client
+  );
+}
+
+static void
+inf_test_load_explore_finished_cb(InfcExploreRequest* request,
+                                  gpointer user_data)
+{
+  inf_test_load_subscribe((InfTestLoadClient*)user_data);
+}
+
+static void
+inf_test_load_notify_status_cb(GObject* object,
+                               GParamSpec* pspec,
+                               gpointer user_data)
+{
+  InfTestLoadClient* client;
+  InfcBrowserIter iter;
+  InfcExploreRequest* request;
+
+  client = (InfTestLoadClient*)user_data;
+
+  switch(infc_browser_get_status(client->browser))
+  {
+  case INFC_BROWSER_CONNECTED:
+    infc_browser_iter_get_root(client->browser, &iter);
+    request = infc_browser_iter_explore(client->browser, &iter);
+
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "failed",
+      G_CALLBACK(inf_test_load_request_failed_cb),
+      client
+    );
+
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "finished",
+      G_CALLBACK(inf_test_load_explore_finished_cb),
+      client
+    );
+
+    break;
+  case INFC_BROWSER_DISCONNECTED:
+    if(!client->test->stopped)
+    {
+      fprintf(stderr, "Client %u: Connection closed\n", client->index);
+      inf_test_load_fail(client->test);
+    }
+
+    break;
+  default:
+    break;
+  }
+}
+
+static void
+inf_test_load_client_init(InfTestLoad* test,
+                          InfTestLoadClient* client,
+                          guint index)
+{
+  client->test = test;
+  client->index = index;
+  client->rand = g_rand_new_with_seed(test->seed + index);
+
+  client->client_conn = inf_simulated_connection_new_with_io(INF_IO(test->io));
+  client->server_conn = inf_simulated_connection_new_with_io(INF_IO(test->io));
+  inf_simulated_connection_connect(client->client_conn, client->server_conn);
+
+  inf_simulated_connection_set_mode(
+    client->client_conn,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  inf_simulated_connection_set_mode(
+    client->server_conn,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  inf_simulated_connection_set_latency(client->client_conn, test->latency);
+  inf_simulated_connection_set_latency(client->server_conn, test->latency);
+  inf_simulated_connection_set_bandwidth(client->client_conn, test->bandwidth);
+  inf_simulated_connection_set_bandwidth(client->server_conn, test->bandwidth);
+
+  /* Connect before the directory adds the connection, so that these run
+   * before and after the server processes a message, respectively. */
+  g_signal_connect(
+    G_OBJECT(client->server_conn),
+    "received",
+    G_CALLBACK(inf_test_load_server_received_before_cb),
+    test
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(client->server_conn),
+    "received",
+    G_CALLBACK(inf_test_load_server_received_after_cb),
+    test
+  );
+
+  client->manager = inf_communication_manager_new();
+  client->browser = infc_browser_new(
+    INF_IO(test->io),
+    client->manager,
+    INF_XML_CONNECTION(client->client_conn)
+  );
+
+  infc_browser_add_plugin(client->browser, &INF_TEST_LOAD_CLIENT_PLUGIN);
+
+  g_signal_connect_after(
+    G_OBJECT(client->browser),
+    "notify::status",
+    G_CALLBACK(inf_test_load_notify_status_cb),
+    client
+  );
+
+  client->proxy = NULL;
+  client->user = NULL;
+  client->timeout = NULL;
+  client->step = 0;
+
+  client->pending = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    inf_test_load_free_timeval
+  );
+
+  client->upstream_max = 0;
+  client->upstream_sum = 0;
+  client->downstream_max = 0;
+  client->downstream_sum = 0;
+
+  infd_directory_add_connection(
+    test->directory,
+    INF_XML_CONNECTION(client->server_conn)
+  );
+}
+
+static void
+inf_test_load_client_finalize(InfTestLoadClient* client)
+{
+  if(client->timeout != NULL)
+    inf_io_remove_timeout(INF_IO(client->test->io), client->timeout);
+
+  g_hash_table_destroy(client->pending);
+  g_object_unref(client->browser);
+  g_object_unref(client->manager);
+
+  inf_simulated_connection_connect(client->client_conn, NULL);
+  g_object_unref(client->client_conn);
+  g_object_unref(client->server_conn);
+
+  g_rand_free(client->rand);
+}
+
+static void
+inf_test_load_report(InfTestLoad* test)
+{
+  InfTestLoadClient* client;
+  guint upstream_max;
+  guint downstream_max;
+  guint64 upstream_sum;
+  guint64 downstream_sum;
+  gdouble* latencies;
+  guint n;
+  guint i;
+
+  printf(
+    "Server: %u messages, %u requests, %.3f s CPU",
+    test->received_messages,
+    test->server_requests,
+    (gdouble)test->received_time / CLOCKS_PER_SEC
+  );
+
+  if(test->server_requests > 0)
+  {
+    printf(
+      ", %.3f ms CPU per request",
+      (gdouble)test->received_time * 1000.0 / CLOCKS_PER_SEC /
+      test->server_requests
+    );
+  }
+
+  printf("\n");
+
+  upstream_max = downstream_max = 0;
+  upstream_sum = downstream_sum = 0;
+  for(i = 0; i < (guint)test->n_clients; ++i)
+  {
+    client = &test->clients[i];
+    upstream_max = MAX(upstream_max, client->upstream_max);
+    downstream_max = MAX(downstream_max, client->downstream_max);
+    upstream_sum += client->upstream_sum;
+    downstream_sum += client->downstream_sum;
+  }
+
+  if(test->n_samples > 0)
+  {
+    printf(
+      "Queue depth: upstream %.2f avg, %u max; "
+      "downstream %.2f avg, %u max\n",
+      (gdouble)upstream_sum / test->n_samples / test->n_clients,
+      upstream_max,
+      (gdouble)downstream_sum / test->n_samples / test->n_clients,
+      downstream_max
+    );
+  }
+
+  if(test->n_samples > 0)
+  {
+    printf(
+      "Request log size: %.1f avg, %u max; %u after all clients settled\n",
+      (gdouble)test->log_size_sum / test->n_samples,
+      test->log_size_max,
+      inf_test_load_get_log_size(test)
+    );
+  }
+
+  n = test->latencies->len;
+  if(n > 0)
+  {
+    g_array_sort(test->latencies, inf_test_load_cmp_double);
+    latencies = (gdouble*)test->latencies->data;
+
+    printf(
+      "Request latency (%u requests): p50 %.1f ms, p90 %.1f ms, "
+      "p99 %.1f ms, max %.1f ms\n",
+      n,
+      latencies[n * 50 / 100],
+      latencies[n * 90 / 100],
+      latencies[n * 99 / 100],
+      latencies[n - 1]
+    );
+  }
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+  InfTestLoad test;
+  InfdDirectoryIter iter;
+  InfSession* session;
+  GOptionContext* context;
+  GError* error;
+  gboolean result;
+  gint i;
+
+  GOptionEntry entries[] = {
+    { "clients", 'n', 0, G_OPTION_ARG_INT, &test.n_clients,
+      "Number of simulated clients", "N" },
+    { "latency", 'l', 0, G_OPTION_ARG_INT, &test.latency,
+      "Latency of each link, in milliseconds", "MSECS" },
+    { "bandwidth", 'b', 0, G_OPTION_ARG_INT, &test.bandwidth,
+      "Bandwidth of each link, in bytes per second, 0 for unlimited",
+      "BYTES" },
+    { "duration", 'd', 0, G_OPTION_ARG_INT, &test.duration,
+      "Time the clients modify the document, in milliseconds", "MSECS" },
+    { "interval", 'i', 0, G_OPTION_ARG_INT, &test.interval,
+      "Time between two actions of a client, in milliseconds", "MSECS" },
+    { "seed", 's', 0, G_OPTION_ARG_INT, &test.seed,
+      "Seed for the random number generator", "SEED" },
+    { "script", 'S', 0, G_OPTION_ARG_STRING, &test.script,
+      "Actions each client repeats: i inserts a character at the caret, "
+      "e erases the character before the caret, u undoes, r redoes, c "
+      "moves the caret to a random position, anything else does nothing",
+      "SCRIPT" },
+    { "viewers", 'v', 0, G_OPTION_ARG_INT, &test.n_viewers,
+      "Number of clients which join but never modify the document", "N" },
+    { "noop-interval", 0, 0, G_OPTION_ARG_INT, &test.noop_interval,
+      "Maximum time after which a client acknowledges others' requests, "
+      "in milliseconds", "MSECS" },
+    { "noop-lag", 0, 0, G_OPTION_ARG_INT, &test.noop_lag,
+      "Number of requests after which a client acknowledges others' "
+      "requests right away, or 0 to only use the noop interval", "N" },
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  g_type_init();
+
+  test.n_clients = 10;
+  test.latency = 50;
+  test.bandwidth = 0;
+  test.duration = 10000;
+  test.interval = 100;
+  test.seed = 42;
+  test.script = NULL;
+  test.n_viewers = 0;
+  test.noop_interval = 30000;
+  test.noop_lag = 128;
+
+  error = NULL;
+  context = g_option_context_new("- Simulate many clients editing a document");
+  g_option_context_add_main_entries(context, entries, NULL);
+  result = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+
+  if(!result)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  if(test.n_clients <= 0 || test.latency < 0 || test.bandwidth < 0 ||
+     test.duration < 0 || test.interval <= 0 || test.n_viewers < 0 ||
+     test.n_viewers > test.n_clients || test.noop_interval < 0 ||
+     test.noop_lag < 0)
+  {
+    fprintf(stderr, "Invalid arguments\n");
+    return 1;
+  }
+
+  if(test.script == NULL || *test.script == '\0')
+  {
+    g_free(test.script);
+    test.script = g_strdup("iiiiiiecciiiieeuuriiii");
+  }
+
+  test.io = inf_standalone_io_new();
+  test.manager = inf_communication_manager_new();
+  test.directory = infd_directory_new(INF_IO(test.io), NULL, test.manager);
+  infd_directory_add_plugin(test.directory, &INF_TEST_LOAD_SERVER_PLUGIN);
+
+  infd_directory_iter_get_root(test.directory, &iter);
+  result = infd_directory_add_note(
+    test.directory,
+    &iter,
+    "load",
+    &INF_TEST_LOAD_SERVER_PLUGIN,
+    &iter,
+    &error
+  );
+
+  if(result == TRUE)
+  {
+    test.proxy = infd_directory_iter_get_session(
+      test.directory,
+      &iter,
+      &error
+    );
+  }
+
+  if(result == FALSE || test.proxy == NULL)
+  {
+    fprintf(stderr, "Could not create document: %s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  g_object_ref(test.proxy);
+  session = infd_session_proxy_get_session(test.proxy);
+  inf_test_load_set_noop_options(&test, session);
+
+  g_signal_connect(
+    G_OBJECT(inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))),
+    "execute-request",
+    G_CALLBACK(inf_test_load_server_execute_request_cb),
+    &test
+  );
+
+  test.n_joined = 0;
+  test.stopped = FALSE;
+  test.failed = FALSE;
+  test.users = g_hash_table_new(NULL, NULL);
+  test.n_samples = 0;
+  test.log_size_max = 0;
+  test.log_size_sum = 0;
+  test.received_time = 0;
+  test.received_messages = 0;
+  test.server_requests = 0;
+  test.latencies = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+  test.clients = g_new(InfTestLoadClient, test.n_clients);
+  for(i = 0; i < test.n_clients; ++i)
+    inf_test_load_client_init(&test, &test.clients[i], i);
+
+  test.sample_timeout = inf_io_add_timeout(
+    INF_IO(test.io),
+    MAX(test.interval / 2, 1),
+    inf_test_load_sample_timeout_func,
+    &test,
+    NULL
+  );
+
+  test.stop_timeout = inf_io_add_timeout(
+    INF_IO(test.io),
+    test.duration,
+    inf_test_load_stop_timeout_func,
+    &test,
+    NULL
+  );
+
+  printf(
+    "%d clients (%d viewers), %d ms latency, %d bytes/s bandwidth, "
+    "script \"%s\"\n",
+    test.n_clients,
+    test.n_viewers,
+    test.latency,
+    test.bandwidth,
+    test.script
+  );
+
+  printf(
+    "Noop interval %d ms, noop lag %d requests\n",
+    test.noop_interval,
+    test.noop_lag
+  );
+
+  inf_standalone_io_loop(test.io);
+
+  if(test.sample_timeout != NULL)
+    inf_io_remove_timeout(INF_IO(test.io), test.sample_timeout);
+  if(test.stop_timeout != NULL)
+    inf_io_remove_timeout(INF_IO(test.io), test.stop_timeout);
+
+  if(!test.failed)
+  {
+    inf_test_load_report(&test);
+    if(!inf_test_load_check_convergence(&test))
+      test.failed = TRUE;
+  }
+
+  /* Closing the connections is expected from now on */
+  test.stopped = TRUE;
+  for(i = 0; i < test.n_clients; ++i)
+    inf_test_load_client_finalize(&test.clients[i]);
+
+  g_free(test.clients);
+  g_array_free(test.latencies, TRUE);
+  g_hash_table_destroy(test.users);
+  g_object_unref(test.proxy);
+  g_object_unref(test.directory);
+  g_object_unref(test.manager);
+  g_object_unref(test.io);
+  g_free(test.script);
+
+  return test.failed ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
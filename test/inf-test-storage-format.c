@@ -0,0 +1,337 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Saves a text document with a given number of segments in both the XML
+ * and the binary document format of the text note plugin, loads it back,
+ * verifies that the loaded documents match the original one and prints the
+ * time needed for saving and loading. The note plugin module is loaded from
+ * the build tree the same way infinoted loads it, so it does not need to be
+ * installed. */
+
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/server/infd-note-plugin.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-chunk.h>
+#include <libinftext/inf-text-user.h>
+
+#include <gmodule.h>
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define INF_TEST_STORAGE_FORMAT_N_USERS 4
+
+static const InfdNotePlugin* inf_test_storage_format_plugin;
+
+static const gchar INF_TEST_STORAGE_FORMAT_TEXT[] =
+  "Lorem ipsum dolor sit amet, consectetur adipisici elit. \xc3\xa4\n";
+
+static InfSession*
+inf_test_storage_format_create(InfIo* io,
+                               InfCommunicationManager* manager,
+                               guint n_segments)
+{
+  InfSession* session;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfUser* users[INF_TEST_STORAGE_FORMAT_N_USERS];
+  gchar* name;
+  guint len;
+  guint i;
+
+  session = inf_test_storage_format_plugin->session_new(
+    io,
+    manager,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  user_table = inf_session_get_user_table(session);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+
+  for(i = 0; i < INF_TEST_STORAGE_FORMAT_N_USERS; ++ i)
+  {
+    name = g_strdup_printf("User %u", i + 1);
+
+    users[i] = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i + 1,
+        "name", name,
+        "hue", (gdouble)i / INF_TEST_STORAGE_FORMAT_N_USERS,
+        NULL
+      )
+    );
+
+    g_free(name);
+    inf_user_table_add_user(user_table, users[i]);
+    g_object_unref(users[i]);
+  }
+
+  len = g_utf8_strlen(INF_TEST_STORAGE_FORMAT_TEXT, -1);
+  for(i = 0; i < n_segments; ++ i)
+  {
+    inf_text_buffer_insert_text(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      INF_TEST_STORAGE_FORMAT_TEXT,
+      strlen(INF_TEST_STORAGE_FORMAT_TEXT),
+      len,
+      users[i % INF_TEST_STORAGE_FORMAT_N_USERS]
+    );
+  }
+
+  return session;
+}
+
+static gboolean
+inf_test_storage_format_run(InfdFilesystemStorage* storage,
+                            InfIo* io,
+                            InfCommunicationManager* manager,
+                            InfSession* session,
+                            InfdFilesystemStorageFormat format,
+                            const gchar* path)
+{
+  InfTextBuffer* buffer;
+  InfTextBuffer* loaded_buffer;
+  InfSession* loaded;
+  InfTextChunk* chunk;
+  InfTextChunk* loaded_chunk;
+  GTimer* timer;
+  GError* error;
+  gdouble save_time;
+  gdouble load_time;
+  gboolean result;
+
+  infd_filesystem_storage_set_format(storage, format);
+  timer = g_timer_new();
+
+  error = NULL;
+  result = inf_test_storage_format_plugin->session_write(
+    INFD_STORAGE(storage),
+    session,
+    path,
+    NULL,
+    &error
+  );
+
+  save_time = g_timer_elapsed(timer, NULL);
+  if(result == FALSE)
+  {
+    fprintf(stderr, "Failed to save %s: %s\n", path, error->message);
+    g_error_free(error);
+    g_timer_destroy(timer);
+    return FALSE;
+  }
+
+  g_timer_start(timer);
+  loaded = inf_test_storage_format_plugin->session_read(
+    INFD_STORAGE(storage),
+    io,
+    manager,
+    path,
+    NULL,
+    &error
+  );
+
+  load_time = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  if(loaded == NULL)
+  {
+    fprintf(stderr, "Failed to load %s: %s\n", path, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  loaded_buffer = INF_TEXT_BUFFER(inf_session_get_buffer(loaded));
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  loaded_chunk = inf_text_buffer_get_slice(
+    loaded_buffer,
+    0,
+    inf_text_buffer_get_length(loaded_buffer)
+  );
+
+  result = inf_text_chunk_equal(chunk, loaded_chunk);
+  inf_text_chunk_free(chunk);
+  inf_text_chunk_free(loaded_chunk);
+  g_object_unref(loaded);
+
+  printf(
+    "%-8s save: %8.2f ms, load: %8.2f ms\n",
+    format == INFD_FILESYSTEM_STORAGE_FORMAT_XML ? "XML" : "Binary",
+    save_time * 1000.0,
+    load_time * 1000.0
+  );
+
+  if(result == FALSE)
+    fprintf(stderr, "Loaded document %s does not match\n", path);
+
+  return result;
+}
+
+static gboolean
+inf_test_storage_format_load_plugin(void)
+{
+  GModule* module;
+  gchar* plugin_path;
+  gpointer plugin;
+
+  plugin_path = g_module_build_path(NOTE_PLUGIN_DIR, "infd-note-plugin-text");
+  module = g_module_open(plugin_path, G_MODULE_BIND_LOCAL);
+  g_free(plugin_path);
+
+  if(module == NULL)
+  {
+    fprintf(stderr, "%s\n", g_module_error());
+    return FALSE;
+  }
+
+  if(g_module_symbol(module, "INFD_NOTE_PLUGIN", &plugin) == FALSE)
+  {
+    fprintf(stderr, "%s\n", g_module_error());
+    g_module_close(module);
+    return FALSE;
+  }
+
+  g_module_make_resident(module);
+  g_module_close(module);
+
+  inf_test_storage_format_plugin = plugin;
+  return TRUE;
+}
+
+static void
+inf_test_storage_format_remove(const gchar* root_directory,
+                               const gchar* path)
+{
+  gchar* disk_name;
+  gchar* full_name;
+
+  disk_name = g_strconcat(path, ".InfText", NULL);
+  full_name = g_build_filename(root_directory, disk_name, NULL);
+  g_unlink(full_name);
+  g_free(full_name);
+  g_free(disk_name);
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+  InfdFilesystemStorage* storage;
+  InfSession* session;
+  GError* error;
+  gchar* root_directory;
+  guint n_segments;
+  gboolean result;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  if(!inf_test_storage_format_load_plugin())
+    return -1;
+
+  n_segments = 10000;
+  if(argc > 1)
+    n_segments = strtoul(argv[1], NULL, 10);
+
+  root_directory = g_strdup_printf(
+    "%s/inf-test-storage-format-%d",
+    g_get_tmp_dir(),
+    (int)getpid()
+  );
+
+  if(g_mkdir_with_parents(root_directory, 0700) != 0)
+  {
+    fprintf(stderr, "Failed to create %s\n", root_directory);
+    g_free(root_directory);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  manager = inf_communication_manager_new();
+  storage = infd_filesystem_storage_new(root_directory);
+
+  session = inf_test_storage_format_create(
+    INF_IO(io),
+    manager,
+    n_segments
+  );
+
+  printf("%u segments\n", n_segments);
+
+  result = inf_test_storage_format_run(
+    storage,
+    INF_IO(io),
+    manager,
+    session,
+    INFD_FILESYSTEM_STORAGE_FORMAT_XML,
+    "/document-xml"
+  );
+
+  if(result == TRUE)
+  {
+    result = inf_test_storage_format_run(
+      storage,
+      INF_IO(io),
+      manager,
+      session,
+      INFD_FILESYSTEM_STORAGE_FORMAT_BINARY,
+      "/document-binary"
+    );
+  }
+
+  inf_test_storage_format_remove(root_directory, "/document-xml");
+  inf_test_storage_format_remove(root_directory, "/document-binary");
+  g_rmdir(root_directory);
+  g_free(root_directory);
+
+  g_object_unref(session);
+  g_object_unref(storage);
+  g_object_unref(manager);
+  g_object_unref(io);
+
+  return result ? 0 : -1;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,266 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Creates, removes and explores nodes of an InfdFilesystemStorage with the
+ * directory index enabled, and checks that the index is used as long as all
+ * changes are made through the storage, and that it is discarded once the
+ * directory is changed behind its back. To find out whether the index was
+ * used, an entry that does not exist on disk is added to it. */
+
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/server/infd-storage.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static gint
+inf_test_storage_index_compare(gconstpointer first,
+                               gconstpointer second)
+{
+  return strcmp(*(const gchar* const*)first, *(const gchar* const*)second);
+}
+
+/* Returns the names of the nodes in the given directory, sorted and
+ * separated by spaces. */
+static gchar*
+inf_test_storage_index_read(InfdFilesystemStorage* storage,
+                            const gchar* path)
+{
+  GSList* list;
+  GSList* item;
+  GPtrArray* names;
+  InfdStorageNode* node;
+  GError* error;
+  gchar* result;
+
+  error = NULL;
+  list = infd_storage_read_subdirectory(INFD_STORAGE(storage), path, &error);
+  if(error != NULL)
+  {
+    fprintf(stderr, "Failed to read %s: %s\n", path, error->message);
+    g_error_free(error);
+    return NULL;
+  }
+
+  names = g_ptr_array_new();
+  for(item = list; item != NULL; item = item->next)
+  {
+    node = (InfdStorageNode*)item->data;
+    g_ptr_array_add(names, node->name);
+  }
+
+  g_ptr_array_sort(names, inf_test_storage_index_compare);
+  g_ptr_array_add(names, NULL);
+
+  result = g_strjoinv(" ", (gchar**)names->pdata);
+  g_ptr_array_free(names, TRUE);
+  infd_storage_node_list_free(list);
+  return result;
+}
+
+static gboolean
+inf_test_storage_index_check(InfdFilesystemStorage* storage,
+                             const gchar* step,
+                             const gchar* expected)
+{
+  gchar* names;
+  gboolean result;
+
+  names = inf_test_storage_index_read(storage, "/dir");
+  if(names == NULL)
+    return FALSE;
+
+  result = strcmp(names, expected) == 0;
+  if(result)
+    printf("%s: OK\n", step);
+  else
+    printf("%s: Expected \"%s\", got \"%s\"\n", step, expected, names);
+
+  g_free(names);
+  return result;
+}
+
+static gboolean
+inf_test_storage_index_create_note(InfdFilesystemStorage* storage,
+                                   const gchar* path)
+{
+  GError* error;
+  FILE* stream;
+
+  error = NULL;
+  stream = infd_filesystem_storage_open(storage, "InfText", path, "w", &error);
+  if(stream == NULL)
+  {
+    fprintf(stderr, "Failed to create %s: %s\n", path, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  fclose(stream);
+  return TRUE;
+}
+
+/* Adds an entry for a subdirectory that does not exist to the index. The
+ * index exists already, so this does not change the directory itself. */
+static gboolean
+inf_test_storage_index_add_ghost(const gchar* dir_name)
+{
+  gchar* index_name;
+  FILE* stream;
+  gboolean result;
+
+  index_name = g_build_filename(dir_name, ".infd-index", NULL);
+  stream = g_fopen(index_name, "a");
+  g_free(index_name);
+
+  if(stream == NULL)
+  {
+    fprintf(stderr, "Failed to open the index\n");
+    return FALSE;
+  }
+
+  fprintf(stream, "d\tghost\n");
+  result = fclose(stream) == 0;
+  return result;
+}
+
+static gboolean
+inf_test_storage_index_run(InfdFilesystemStorage* storage,
+                           const gchar* root_directory)
+{
+  GError* error;
+  gchar* dir_name;
+  gchar* note_name;
+  gboolean result;
+
+  error = NULL;
+  if(!infd_storage_create_subdirectory(INFD_STORAGE(storage), "/dir", &error))
+  {
+    fprintf(stderr, "Failed to create /dir: %s\n", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  dir_name = g_build_filename(root_directory, "dir", NULL);
+
+  /* Creating a note appends to the index written by
+   * infd_storage_create_subdirectory(), so the index must still be valid
+   * afterwards. */
+  result = inf_test_storage_index_create_note(storage, "/dir/a") &&
+    inf_test_storage_index_add_ghost(dir_name) &&
+    inf_test_storage_index_check(storage, "Index used", "a ghost");
+
+  /* Reading the index must not invalidate it */
+  if(result)
+  {
+    result = inf_test_storage_index_create_note(storage, "/dir/b") &&
+      inf_test_storage_index_check(storage, "Note added", "a b ghost");
+  }
+
+  if(result)
+  {
+    error = NULL;
+    result = infd_storage_remove_node(
+      INFD_STORAGE(storage),
+      "InfText",
+      "/dir/b",
+      &error
+    );
+
+    if(!result)
+    {
+      fprintf(stderr, "Failed to remove /dir/b: %s\n", error->message);
+      g_error_free(error);
+    }
+    else
+    {
+      result = inf_test_storage_index_check(storage, "Note removed", "a ghost");
+    }
+  }
+
+  /* A note created behind the storage's back invalidates the index */
+  if(result)
+  {
+    note_name = g_build_filename(dir_name, "c.InfText", NULL);
+    result = g_file_set_contents(note_name, "", 0, NULL);
+    g_free(note_name);
+
+    result = result &&
+      inf_test_storage_index_check(storage, "Index discarded", "a c");
+  }
+
+  g_free(dir_name);
+
+  error = NULL;
+  if(!infd_storage_remove_node(INFD_STORAGE(storage), NULL, "/dir", &error))
+  {
+    fprintf(stderr, "Failed to remove /dir: %s\n", error->message);
+    g_error_free(error);
+    result = FALSE;
+  }
+
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfdFilesystemStorage* storage;
+  GError* error;
+  gchar* root_directory;
+  gboolean result;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  root_directory = g_strdup_printf(
+    "%s/inf-test-storage-index-%d",
+    g_get_tmp_dir(),
+    (int)getpid()
+  );
+
+  if(g_mkdir_with_parents(root_directory, 0700) != 0)
+  {
+    fprintf(stderr, "Failed to create %s\n", root_directory);
+    g_free(root_directory);
+    return -1;
+  }
+
+  storage = infd_filesystem_storage_new(root_directory);
+  infd_filesystem_storage_set_use_index(storage, TRUE);
+
+  result = inf_test_storage_index_run(storage, root_directory);
+
+  g_object_unref(storage);
+  g_rmdir(root_directory);
+  g_free(root_directory);
+
+  return result ? 0 : -1;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -17,6 +17,8 @@
  * MA 02110-1301, USA.
  */
 
+#include "util/inf-test-util.h"
+
 #include <libinftext/inf-text-default-insert-operation.h>
 #include <libinftext/inf-text-default-delete-operation.h>
 #include <libinftext/inf-text-insert-operation.h>
@@ -26,6 +28,7 @@
 #include <libinftext/inf-text-chunk.h>
 #include <libinftext/inf-text-user.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/adopted/inf-adopted-split-operation.h>
 #include <libinfinity/adopted/inf-adopted-operation.h>
 #include <libinfinity/adopted/inf-adopted-user.h>
 
@@ -470,6 +473,101 @@ perform_c2(InfAdoptedOperation** begin,
   }
 }
 
+/* Splits a deletion of the whole document n_parts - 1 times by inserting a
+ * character into the deleted range, applies the resulting split operation
+ * and checks that only the inserted characters are left. Prints the number
+ * of transformations needed, since the parts of a split operation need to
+ * be transformed against each other before they can be applied. */
+static gboolean
+perform_split(guint n_parts)
+{
+  InfTextBuffer* buffer;
+  InfTextUser* user;
+  InfTextChunk* chunk;
+  InfAdoptedOperation* operation;
+  InfAdoptedOperation* insert;
+  InfAdoptedOperation* transformed;
+  GString* text;
+  gchar* result;
+  gsize bytes;
+  guint count;
+  guint i;
+  gboolean retval;
+
+  text = g_string_new(NULL);
+  for(i = 0; i < n_parts; ++ i)
+    g_string_append_c(text, 'a');
+
+  chunk = inf_text_chunk_new("UTF-8");
+  inf_text_chunk_insert_text(chunk, 0, text->str, text->len, text->len, 1);
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  user = INF_TEXT_USER(g_object_new(INF_TEXT_TYPE_USER, "id", 1, NULL));
+  inf_text_buffer_insert_chunk(buffer, 0, chunk, NULL);
+
+  operation = INF_ADOPTED_OPERATION(
+    inf_text_default_delete_operation_new(0, chunk)
+  );
+  inf_text_chunk_free(chunk);
+
+  for(i = 1; i < n_parts; ++ i)
+  {
+    /* Between the i-th and the (i+1)-th original character, behind the
+     * i-1 characters inserted before */
+    chunk = inf_text_chunk_new("UTF-8");
+    inf_text_chunk_insert_text(chunk, 0, "b", 1, 1, 2);
+    insert = INF_ADOPTED_OPERATION(
+      inf_text_default_insert_operation_new(2 * i - 1, chunk)
+    );
+
+    inf_text_buffer_insert_chunk(buffer, 2 * i - 1, chunk, NULL);
+    inf_text_chunk_free(chunk);
+
+    transformed = inf_adopted_operation_transform(
+      operation,
+      insert,
+      INF_ADOPTED_CONCURRENCY_NONE
+    );
+
+    g_object_unref(operation);
+    g_object_unref(insert);
+    operation = transformed;
+  }
+
+  inf_test_util_set_transformation_count(0);
+  inf_adopted_operation_apply(
+    operation,
+    INF_ADOPTED_USER(user),
+    INF_BUFFER(buffer)
+  );
+  count = inf_test_util_get_transformation_count();
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  result = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  retval = (bytes == n_parts - 1 && strspn(result, "b") == bytes);
+
+  printf(
+    "Split into %u parts: %u transformations to apply, %s\n",
+    n_parts,
+    count,
+    retval ? "OK" : "FAILED"
+  );
+
+  g_free(result);
+  g_string_free(text, TRUE);
+  g_object_unref(operation);
+  g_object_unref(user);
+  g_object_unref(buffer);
+  return retval;
+}
+
 int main()
 {
   InfAdoptedOperation** operations;
@@ -480,6 +578,7 @@ int main()
   int retval;
 
   g_type_init();
+  inf_test_util_count_transformations();
 
   retval = 0;
 
@@ -525,6 +624,10 @@ int main()
   if(result.passed < result.total)
     retval = -1;
 
+  for(i = 16; i <= 1024; i *= 4)
+    if(!perform_split(i))
+      retval = -1;
+
   for(i = 0; i < G_N_ELEMENTS(OPERATIONS); ++ i)
   {
     g_object_unref(G_OBJECT(operations[i]));
@@ -30,6 +30,7 @@
 #include <libinfinity/adopted/inf-adopted-session-replay.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
 #include <libinfinity/common/inf-init.h>
+#include <libinfinity/inf-signals.h>
 
 #include <string.h>
 
@@ -115,6 +116,7 @@ inf_test_text_replay_apply_operation_to_string(GString* string,
   InfAdoptedOperation* first;
   InfAdoptedOperation* second;
   InfAdoptedOperation* new_second;
+  guint count;
 
   if(INF_TEXT_IS_INSERT_OPERATION(operation))
   {
@@ -173,11 +175,14 @@ inf_test_text_replay_apply_operation_to_string(GString* string,
       NULL
     );
 
+    /* Don't count this as a transformation of the algorithm */
+    count = inf_test_util_get_transformation_count();
     new_second = inf_adopted_operation_transform(
       second,
       first,
       INF_ADOPTED_CONCURRENCY_NONE
     );
+    inf_test_util_set_transformation_count(count);
 
     inf_test_text_replay_apply_operation_to_string(string, first);
     inf_test_text_replay_apply_operation_to_string(string, new_second);
@@ -255,6 +260,66 @@ inf_test_text_replay_apply_request_cb_after(InfAdoptedAlgorithm* algorithm,
   g_string_free(buffer_content, TRUE);
 }
 
+/*
+ * Digest of buffer changes
+ */
+
+/* The digest of all changes made to the buffer during a replay, together
+ * with the number of transformations, allows to compare the results and
+ * the effort of different versions of the algorithm. */
+
+static void
+inf_test_text_replay_text_inserted_cb(InfTextBuffer* buffer,
+                                      guint pos,
+                                      InfTextChunk* chunk,
+                                      InfUser* user,
+                                      gpointer user_data)
+{
+  GChecksum* checksum;
+  gchar* text;
+  gchar* header;
+  gsize bytes;
+
+  checksum = (GChecksum*)user_data;
+  text = inf_text_chunk_get_text(chunk, &bytes);
+
+  header = g_strdup_printf(
+    "i %u %u %u:",
+    pos,
+    user != NULL ? inf_user_get_id(user) : 0,
+    (guint)bytes
+  );
+
+  g_checksum_update(checksum, (const guchar*)header, strlen(header));
+  g_checksum_update(checksum, (const guchar*)text, bytes);
+
+  g_free(header);
+  g_free(text);
+}
+
+static void
+inf_test_text_replay_text_erased_cb(InfTextBuffer* buffer,
+                                    guint pos,
+                                    InfTextChunk* chunk,
+                                    InfUser* user,
+                                    gpointer user_data)
+{
+  GChecksum* checksum;
+  gchar* text;
+
+  checksum = (GChecksum*)user_data;
+
+  text = g_strdup_printf(
+    "e %u %u %u;",
+    pos,
+    inf_text_chunk_get_length(chunk),
+    user != NULL ? inf_user_get_id(user) : 0
+  );
+
+  g_checksum_update(checksum, (const guchar*)text, strlen(text));
+  g_free(text);
+}
+
 /*
  * Undo grouping
  */
@@ -291,11 +356,72 @@ inf_test_text_replay_play_user_table_foreach_func(InfUser* user,
  * Entry point
  */
 
+static GQuark
+inf_test_text_replay_error_quark()
+{
+  return g_quark_from_static_string("INF_TEST_TEXT_REPLAY_ERROR");
+}
+
+/* Plays the record again in bulk mode, and checks that the result is the
+ * same as the one from the ordinary replay in expected. */
+static gboolean
+inf_test_text_replay_check_bulk(const gchar* filename,
+                                InfBuffer* expected,
+                                GError** error)
+{
+  InfAdoptedSessionReplay* replay;
+  InfAdoptedSession* session;
+  InfBuffer* buffer;
+  GString* expected_content;
+  GString* content;
+  gboolean result;
+
+  replay = inf_adopted_session_replay_new();
+  result = inf_adopted_session_replay_set_record(
+    replay,
+    filename,
+    &INF_TEST_TEXT_REPLAY_TEXT_PLUGIN,
+    error
+  );
+
+  if(result == TRUE)
+    result = inf_adopted_session_replay_play_to_end_bulk(replay, error);
+
+  if(result == TRUE)
+  {
+    session = inf_adopted_session_replay_get_session(replay);
+    buffer = inf_session_get_buffer(INF_SESSION(session));
+
+    expected_content =
+      inf_test_text_replay_load_buffer(INF_TEXT_BUFFER(expected));
+    content = inf_test_text_replay_load_buffer(INF_TEXT_BUFFER(buffer));
+
+    if(strcmp(expected_content->str, content->str) != 0)
+    {
+      g_set_error(
+        error,
+        inf_test_text_replay_error_quark(),
+        0,
+        "Buffer content after bulk replay differs from ordinary replay"
+      );
+
+      result = FALSE;
+    }
+
+    g_string_free(expected_content, TRUE);
+    g_string_free(content, TRUE);
+  }
+
+  g_object_unref(replay);
+  return result;
+}
+
 int main(int argc, char* argv[])
 {
   InfAdoptedSessionReplay* replay;
   InfAdoptedSession* session;
   GError* error;
+  gboolean result;
   int i;
   int ret;
 
@@ -304,6 +430,11 @@ int main(int argc, char* argv[])
   InfUserTable* user_table;
   InfTestTextReplayUndoGroupingInfo data;
   GSList* item;
+  GChecksum* checksum;
+  guint transformations;
+  guint allocations;
+
+  inf_test_util_count_allocations();
 
   if(argc < 2)
   {
@@ -319,6 +450,8 @@ int main(int argc, char* argv[])
     return -1;
   }
 
+  inf_test_util_count_transformations();
+
   ret = 0;
   for(i = 1; i < argc; ++ i)
   {
@@ -349,6 +482,21 @@ int main(int argc, char* argv[])
       user_table = inf_session_get_user_table(INF_SESSION(session));
       data.algorithm = inf_adopted_session_get_algorithm(session);
       data.undo_groupings = NULL;
+      checksum = g_checksum_new(G_CHECKSUM_MD5);
+
+      g_signal_connect(
+        buffer,
+        "text-inserted",
+        G_CALLBACK(inf_test_text_replay_text_inserted_cb),
+        checksum
+      );
+
+      g_signal_connect(
+        buffer,
+        "text-erased",
+        G_CALLBACK(inf_test_text_replay_text_erased_cb),
+        checksum
+      );
 
       g_signal_connect(
         data.algorithm,
@@ -379,7 +527,21 @@ int main(int argc, char* argv[])
         &data
       );
 
-      if(!inf_adopted_session_replay_play_to_end(replay, &error))
+      inf_test_util_set_transformation_count(0);
+      allocations = inf_test_util_get_allocation_count();
+      result = inf_adopted_session_replay_play_to_end(replay, &error);
+      transformations = inf_test_util_get_transformation_count();
+      allocations = inf_test_util_get_allocation_count() - allocations;
+
+      if(!result)
+      {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        error = NULL;
+
+        ret = -1;
+      }
+      else if(!inf_test_text_replay_check_bulk(argv[i], buffer, &error))
       {
         fprintf(stderr, "%s\n", error->message);
         g_error_free(error);
@@ -389,10 +551,29 @@ int main(int argc, char* argv[])
       }
       else
       {
-        fprintf(stderr, "\n");
+        fprintf(
+          stderr,
+          "%u transformations, %u allocations, digest %s\n",
+          transformations,
+          allocations,
+          g_checksum_get_string(checksum)
+        );
         /*inf_test_util_print_buffer(INF_TEXT_BUFFER(buffer));*/
       }
 
+      inf_signal_handlers_disconnect_by_func(
+        buffer,
+        G_CALLBACK(inf_test_text_replay_text_inserted_cb),
+        checksum
+      );
+
+      inf_signal_handlers_disconnect_by_func(
+        buffer,
+        G_CALLBACK(inf_test_text_replay_text_erased_cb),
+        checksum
+      );
+
+      g_checksum_free(checksum);
       g_string_free(content, TRUE);
       for(item = data.undo_groupings; item != NULL; item = item->next)
         g_object_unref(item->data);
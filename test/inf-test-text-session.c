@@ -419,6 +419,7 @@ int main(int argc, char* argv[])
   printf("Using random seed %u\n", rseed);
 
   g_type_init();
+  inf_test_util_count_transformations();
 
   if(argc > dirarg)
     dir = argv[dirarg];
@@ -451,9 +452,13 @@ int main(int argc, char* argv[])
     return -1;
   }
 
+  /* With the same random seed, the number of transformations can be
+   * compared between different versions of the algorithm. */
   printf(
-    "%u out of %u tests passed (real %g secs, algo %g secs)\n",
-    result.passed, result.total, elapsed, result.time
+    "%u out of %u tests passed (real %g secs, algo %g secs, "
+    "%u transformations)\n",
+    result.passed, result.total, elapsed, result.time,
+    inf_test_util_get_transformation_count()
   );
 
   if(result.passed < result.total)
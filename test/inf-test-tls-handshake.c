@@ -0,0 +1,334 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures how many TLS-secured XMPP connections per second can be
+ * established over the loopback interface, once with TLS session resumption
+ * disabled and once with it enabled. */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-xml-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-certificate-credentials.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct _InfTestTlsHandshake InfTestTlsHandshake;
+struct _InfTestTlsHandshake {
+  InfStandaloneIo* io;
+  InfIpAddress* address;
+  guint port;
+  InfCertificateCredentials* client_creds;
+
+  guint count;
+  guint done;
+  guint resumed;
+  gboolean failed;
+
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  GSList* server_connections;
+};
+
+static void inf_test_tls_handshake_start(InfTestTlsHandshake* test);
+
+static void
+inf_test_tls_handshake_next_func(gpointer user_data)
+{
+  InfTestTlsHandshake* test;
+  test = (InfTestTlsHandshake*)user_data;
+
+  g_object_unref(test->xmpp);
+  g_object_unref(test->tcp);
+  test->xmpp = NULL;
+  test->tcp = NULL;
+
+  if(test->failed || test->done == test->count)
+    inf_standalone_io_loop_quit(test->io);
+  else
+    inf_test_tls_handshake_start(test);
+}
+
+static void
+inf_test_tls_handshake_error_cb(InfXmlConnection* connection,
+                                const GError* error,
+                                gpointer user_data)
+{
+  InfTestTlsHandshake* test;
+  test = (InfTestTlsHandshake*)user_data;
+
+  fprintf(stderr, "Connection error occured: %s\n", error->message);
+  test->failed = TRUE;
+}
+
+static void
+inf_test_tls_handshake_notify_status_cb(GObject* object,
+                                        GParamSpec* pspec,
+                                        gpointer user_data)
+{
+  InfTestTlsHandshake* test;
+  InfXmlConnectionStatus status;
+
+  test = (InfTestTlsHandshake*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  switch(status)
+  {
+  case INF_XML_CONNECTION_OPEN:
+    ++test->done;
+    if(inf_xmpp_connection_get_tls_resumed(INF_XMPP_CONNECTION(object)))
+      ++test->resumed;
+
+    inf_xml_connection_close(INF_XML_CONNECTION(object));
+    break;
+  case INF_XML_CONNECTION_CLOSED:
+    /* Don't release the connection from within its own signal handler */
+    inf_io_add_dispatch(
+      INF_IO(test->io),
+      inf_test_tls_handshake_next_func,
+      test,
+      NULL
+    );
+
+    break;
+  default:
+    break;
+  }
+}
+
+static void
+inf_test_tls_handshake_start(InfTestTlsHandshake* test)
+{
+  GError* error;
+
+  error = NULL;
+  test->tcp = inf_tcp_connection_new_and_open(
+    INF_IO(test->io),
+    test->address,
+    test->port,
+    &error
+  );
+
+  if(test->tcp == NULL)
+  {
+    fprintf(stderr, "Could not open connection: %s\n", error->message);
+    g_error_free(error);
+    test->failed = TRUE;
+    inf_standalone_io_loop_quit(test->io);
+    return;
+  }
+
+  test->xmpp = inf_xmpp_connection_new(
+    test->tcp,
+    INF_XMPP_CONNECTION_CLIENT,
+    NULL,
+    "localhost",
+    INF_XMPP_CONNECTION_SECURITY_ONLY_TLS,
+    test->client_creds,
+    NULL,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->xmpp),
+    "error",
+    G_CALLBACK(inf_test_tls_handshake_error_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->xmpp),
+    "notify::status",
+    G_CALLBACK(inf_test_tls_handshake_notify_status_cb),
+    test
+  );
+}
+
+static void
+inf_test_tls_handshake_new_connection_cb(InfdXmlServer* server,
+                                         InfXmlConnection* connection,
+                                         gpointer user_data)
+{
+  InfTestTlsHandshake* test;
+  test = (InfTestTlsHandshake*)user_data;
+
+  /* Keep server-side connections alive until the end of the run */
+  test->server_connections = g_slist_prepend(
+    test->server_connections,
+    g_object_ref(connection)
+  );
+}
+
+static gboolean
+inf_test_tls_handshake_run(InfTestTlsHandshake* test,
+                           InfCertificateCredentials* server_creds,
+                           guint cache_size)
+{
+  GTimer* timer;
+  gdouble elapsed;
+  GSList* item;
+
+  inf_certificate_credentials_set_session_cache_size(server_creds, cache_size);
+  inf_certificate_credentials_set_session_cache_size(
+    test->client_creds,
+    cache_size
+  );
+
+  test->done = 0;
+  test->resumed = 0;
+  test->failed = FALSE;
+
+  timer = g_timer_new();
+  inf_test_tls_handshake_start(test);
+  if(!test->failed) inf_standalone_io_loop(test->io);
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  for(item = test->server_connections; item != NULL; item = item->next)
+    g_object_unref(item->data);
+  g_slist_free(test->server_connections);
+  test->server_connections = NULL;
+
+  if(test->failed) return FALSE;
+
+  printf(
+    "cache size %4u: %u connections in %.3fs (%.1f/s), %u resumed\n",
+    cache_size,
+    test->done,
+    elapsed,
+    test->done / elapsed,
+    test->resumed
+  );
+
+  return TRUE;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestTlsHandshake test;
+  InfCertificateCredentials* server_creds;
+  InfdTcpServer* tcp;
+  InfdXmppServer* xmpp;
+  gnutls_dh_params_t dh_params;
+  const gchar* key_file;
+  const gchar* cert_file;
+  GError* error;
+  int res;
+  int ret;
+
+  key_file = argc > 1 ? argv[1] : "key.pem";
+  cert_file = argc > 2 ? argv[2] : "cert.pem";
+  test.count = argc > 3 ? atoi(argv[3]) : 200;
+
+  gnutls_global_init();
+  g_type_init();
+
+  server_creds = inf_certificate_credentials_new();
+  res = gnutls_certificate_set_x509_key_file(
+    inf_certificate_credentials_get(server_creds),
+    cert_file,
+    key_file,
+    GNUTLS_X509_FMT_PEM
+  );
+
+  if(res != 0)
+  {
+    fprintf(stderr, "Could not load certificate: %s\n", gnutls_strerror(res));
+    inf_certificate_credentials_unref(server_creds);
+    return -1;
+  }
+
+  /* Use DH key exchange like infinoted does */
+  gnutls_dh_params_init(&dh_params);
+  gnutls_dh_params_generate2(dh_params, 1024);
+  gnutls_certificate_set_dh_params(
+    inf_certificate_credentials_get(server_creds),
+    dh_params
+  );
+
+  test.io = inf_standalone_io_new();
+  test.address = inf_ip_address_new_loopback4();
+  test.client_creds = inf_certificate_credentials_new();
+  test.tcp = NULL;
+  test.xmpp = NULL;
+  test.server_connections = NULL;
+
+  tcp = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test.io,
+    "local-address", test.address,
+    "local-port", 0,
+    NULL
+  );
+
+  error = NULL;
+  if(infd_tcp_server_open(tcp, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    ret = -1;
+  }
+  else
+  {
+    g_object_get(G_OBJECT(tcp), "local-port", &test.port, NULL);
+
+    xmpp = infd_xmpp_server_new(
+      tcp,
+      INF_XMPP_CONNECTION_SECURITY_ONLY_TLS,
+      server_creds,
+      NULL,
+      NULL
+    );
+
+    g_signal_connect(
+      G_OBJECT(xmpp),
+      "new-connection",
+      G_CALLBACK(inf_test_tls_handshake_new_connection_cb),
+      &test
+    );
+
+    ret = 0;
+    if(!inf_test_tls_handshake_run(&test, server_creds, 0) ||
+       !inf_test_tls_handshake_run(&test, server_creds, 256))
+    {
+      ret = -1;
+    }
+
+    infd_xml_server_close(INFD_XML_SERVER(xmpp));
+    g_object_unref(xmpp);
+  }
+
+  g_object_unref(tcp);
+  inf_ip_address_free(test.address);
+  g_object_unref(test.io);
+
+  inf_certificate_credentials_unref(test.client_creds);
+  inf_certificate_credentials_unref(server_creds);
+  gnutls_dh_params_deinit(dh_params);
+  gnutls_global_deinit();
+
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,293 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2011 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Parses recorded XML traffic, such as the session records in test/replay,
+ * and counts the memory allocations done while building a DOM tree for
+ * every stanza, once with the regular libxml2 API and once with
+ * InfXmlArena, as done by InfXmppConnection. Each child of the document's
+ * root node is treated as a stanza, like the children of <stream:stream>
+ * in an XMPP stream. */
+
+#include <libinfinity/common/inf-xml-arena.h>
+
+#include <libxml/parser.h>
+#include <libxml/xmlmemory.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum _InfTestXmlArenaMode {
+  /* Only parse, to find out how many allocations the parser does itself */
+  INF_TEST_XML_ARENA_PARSE,
+  INF_TEST_XML_ARENA_TREE,
+  INF_TEST_XML_ARENA_ARENA
+} InfTestXmlArenaMode;
+
+typedef struct _InfTestXmlArena InfTestXmlArena;
+struct _InfTestXmlArena {
+  InfTestXmlArenaMode mode;
+  InfXmlArena* arena;
+  xmlNodePtr root;
+  xmlNodePtr cur;
+  guint depth;
+  guint stanzas;
+};
+
+static guint64 inf_test_xml_arena_allocations;
+
+static void*
+inf_test_xml_arena_malloc(size_t size)
+{
+  ++inf_test_xml_arena_allocations;
+  return malloc(size);
+}
+
+static void*
+inf_test_xml_arena_realloc(void* mem,
+                           size_t size)
+{
+  ++inf_test_xml_arena_allocations;
+  return realloc(mem, size);
+}
+
+static char*
+inf_test_xml_arena_strdup(const char* str)
+{
+  ++inf_test_xml_arena_allocations;
+  return strdup(str);
+}
+
+static void
+inf_test_xml_arena_start_element(void* context,
+                                 const xmlChar* name,
+                                 const xmlChar** attrs)
+{
+  InfTestXmlArena* test;
+  xmlNodePtr node;
+  const xmlChar** attr;
+
+  test = (InfTestXmlArena*)context;
+  if(test->depth++ == 0) return; /* document root */
+  if(test->depth == 2) ++test->stanzas;
+
+  switch(test->mode)
+  {
+  case INF_TEST_XML_ARENA_PARSE:
+    return;
+  case INF_TEST_XML_ARENA_TREE:
+    node = xmlNewNode(NULL, name);
+    if(attrs != NULL)
+      for(attr = attrs; *attr != NULL; attr += 2)
+        xmlNewProp(node, attr[0], attr[1]);
+
+    if(test->cur != NULL)
+      xmlAddChild(test->cur, node);
+    break;
+  case INF_TEST_XML_ARENA_ARENA:
+    node = inf_xml_arena_new_node(test->arena, test->cur, name, attrs);
+    break;
+  default:
+    g_assert_not_reached();
+    return;
+  }
+
+  if(test->root == NULL) test->root = node;
+  test->cur = node;
+}
+
+static void
+inf_test_xml_arena_end_element(void* context,
+                               const xmlChar* name)
+{
+  InfTestXmlArena* test;
+  test = (InfTestXmlArena*)context;
+
+  if(--test->depth == 0) return;
+  if(test->mode == INF_TEST_XML_ARENA_PARSE) return;
+
+  test->cur = test->cur->parent;
+  if(test->cur == NULL)
+  {
+    if(test->mode == INF_TEST_XML_ARENA_ARENA)
+      inf_xml_arena_reset(test->arena);
+    else
+      xmlFreeNode(test->root);
+
+    test->root = NULL;
+  }
+}
+
+static void
+inf_test_xml_arena_characters(void* context,
+                              const xmlChar* content,
+                              int len)
+{
+  InfTestXmlArena* test;
+  test = (InfTestXmlArena*)context;
+
+  if(test->cur == NULL) return;
+
+  if(test->mode == INF_TEST_XML_ARENA_ARENA)
+    inf_xml_arena_add_content(test->arena, test->cur, content, len);
+  else
+    xmlNodeAddContentLen(test->cur, content, len);
+}
+
+static xmlSAXHandler inf_test_xml_arena_handler;
+
+/* Returns the number of allocations, or 0 on error */
+static guint64
+inf_test_xml_arena_run(InfTestXmlArenaMode mode,
+                       gchar** contents,
+                       gsize* lengths,
+                       int n_files,
+                       guint64 parser_allocations)
+{
+  static const gchar* const mode_names[] = { "parse", "tree", "arena" };
+
+  InfTestXmlArena test;
+  xmlParserCtxtPtr parser;
+  guint64 allocations;
+  GTimer* timer;
+  int i;
+
+  test.mode = mode;
+  test.arena = NULL;
+  test.root = NULL;
+  test.cur = NULL;
+  test.depth = 0;
+  test.stanzas = 0;
+
+  inf_test_xml_arena_allocations = 0;
+  timer = g_timer_new();
+
+  /* The arena is created once per connection, so count its allocation */
+  if(mode == INF_TEST_XML_ARENA_ARENA)
+    test.arena = inf_xml_arena_new();
+
+  for(i = 0; i < n_files; ++ i)
+  {
+    parser = xmlCreatePushParserCtxt(
+      &inf_test_xml_arena_handler,
+      &test,
+      NULL,
+      0,
+      NULL
+    );
+
+    if(xmlParseChunk(parser, contents[i], lengths[i], 1) != 0)
+    {
+      fprintf(stderr, "Failed to parse input file %d\n", i + 1);
+      xmlFreeParserCtxt(parser);
+      if(test.arena != NULL) inf_xml_arena_free(test.arena);
+      g_timer_destroy(timer);
+      return 0;
+    }
+
+    xmlFreeParserCtxt(parser);
+  }
+
+  if(test.arena != NULL) inf_xml_arena_free(test.arena);
+  allocations = inf_test_xml_arena_allocations;
+
+  printf(
+    "%-5s: %u stanzas, %" G_GUINT64_FORMAT " allocations, "
+    "%.2f per stanza%s, %.3fs\n",
+    mode_names[mode],
+    test.stanzas,
+    allocations,
+    (double)(allocations - parser_allocations) / MAX(test.stanzas, 1),
+    mode == INF_TEST_XML_ARENA_PARSE ? "" : " beyond parsing",
+    g_timer_elapsed(timer, NULL)
+  );
+
+  g_timer_destroy(timer);
+  return MAX(allocations, 1);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+  gchar** contents;
+  gsize* lengths;
+  GError* error;
+  guint64 parser_allocations;
+  int result;
+  int i;
+
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <file1> [file2] ...\n", argv[0]);
+    return -1;
+  }
+
+  xmlMemSetup(
+    free,
+    inf_test_xml_arena_malloc,
+    inf_test_xml_arena_realloc,
+    inf_test_xml_arena_strdup
+  );
+
+  inf_test_xml_arena_handler.startElement = inf_test_xml_arena_start_element;
+  inf_test_xml_arena_handler.endElement = inf_test_xml_arena_end_element;
+  inf_test_xml_arena_handler.characters = inf_test_xml_arena_characters;
+
+  contents = g_malloc(sizeof(gchar*) * (argc - 1));
+  lengths = g_malloc(sizeof(gsize) * (argc - 1));
+
+  for(i = 1; i < argc; ++ i)
+  {
+    error = NULL;
+    if(!g_file_get_contents(argv[i], &contents[i-1], &lengths[i-1], &error))
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      return -1;
+    }
+  }
+
+  result = -1;
+  parser_allocations = inf_test_xml_arena_run(
+    INF_TEST_XML_ARENA_PARSE,
+    contents,
+    lengths,
+    argc - 1,
+    0
+  );
+
+  if(parser_allocations > 0 &&
+     inf_test_xml_arena_run(INF_TEST_XML_ARENA_TREE, contents, lengths,
+                            argc - 1, parser_allocations) > 0 &&
+     inf_test_xml_arena_run(INF_TEST_XML_ARENA_ARENA, contents, lengths,
+                            argc - 1, parser_allocations) > 0)
+  {
+    result = 0;
+  }
+
+  for(i = 0; i < argc - 1; ++ i)
+    g_free(contents[i]);
+  g_free(contents);
+  g_free(lengths);
+
+  return result;
+}
+
+/* vim:set et sw=2 ts=2: */
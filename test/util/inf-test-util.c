@@ -22,10 +22,58 @@
 #include <libinftext/inf-text-default-insert-operation.h>
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-delete-operation.h>
+#include <libinftext/inf-text-default-delete-operation.h>
+#include <libinftext/inf-text-remote-delete-operation.h>
+#include <libinftext/inf-text-move-operation.h>
 
+#include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/adopted/inf-adopted-split-operation.h>
 #include <libinfinity/common/inf-xml-util.h>
 
 #include <string.h>
+#include <stdlib.h>
+
+#define INF_TEST_UTIL_N_OPERATION_TYPES 6
+
+typedef InfAdoptedOperation*(*InfTestUtilTransformFunc)(
+  InfAdoptedOperation*,
+  InfAdoptedOperation*,
+  InfAdoptedConcurrencyId
+);
+
+typedef struct _InfTestUtilTransformCounter InfTestUtilTransformCounter;
+struct _InfTestUtilTransformCounter {
+  GType types[INF_TEST_UTIL_N_OPERATION_TYPES];
+  InfTestUtilTransformFunc funcs[INF_TEST_UTIL_N_OPERATION_TYPES];
+  guint count;
+  guint depth;
+};
+
+static InfTestUtilTransformCounter inf_test_util_transform_counter;
+static guint inf_test_util_allocation_count;
+
+static gpointer
+inf_test_util_counting_malloc(gsize n_bytes)
+{
+  ++ inf_test_util_allocation_count;
+  return malloc(n_bytes);
+}
+
+static gpointer
+inf_test_util_counting_realloc(gpointer mem,
+                               gsize n_bytes)
+{
+  ++ inf_test_util_allocation_count;
+  return realloc(mem, n_bytes);
+}
+
+static gpointer
+inf_test_util_counting_calloc(gsize n_blocks,
+                              gsize n_block_bytes)
+{
+  ++ inf_test_util_allocation_count;
+  return calloc(n_blocks, n_block_bytes);
+}
 
 static int
 inf_test_util_dir_foreach_sort_func(gconstpointer first,
@@ -34,12 +82,114 @@ inf_test_util_dir_foreach_sort_func(gconstpointer first,
   return strcmp(first, second);
 }
 
+static InfAdoptedOperation*
+inf_test_util_counting_transform(InfAdoptedOperation* operation,
+                                 InfAdoptedOperation* against,
+                                 InfAdoptedConcurrencyId concurrency_id)
+{
+  InfTestUtilTransformCounter* counter;
+  InfTestUtilTransformFunc func;
+  InfAdoptedOperation* result;
+  GType type;
+  guint i;
+
+  counter = &inf_test_util_transform_counter;
+  func = NULL;
+
+  /* Subclasses initialized after the counter was installed inherit it */
+  for(type = G_TYPE_FROM_INSTANCE(operation); func == NULL;
+      type = g_type_parent(type))
+  {
+    g_assert(type != 0);
+    for(i = 0; i < INF_TEST_UTIL_N_OPERATION_TYPES; ++ i)
+      if(counter->types[i] == type)
+        func = counter->funcs[i];
+  }
+
+  /* Only count transformations of whole operations, not the ones that
+   * split operations do for their parts. */
+  if(counter->depth == 0)
+    ++ counter->count;
+
+  ++ counter->depth;
+  result = func(operation, against, concurrency_id);
+  -- counter->depth;
+
+  return result;
+}
+
 GQuark
 inf_test_util_parse_error_quark(void)
 {
   return g_quark_from_static_string("INF_TEST_UTIL_PARSE_ERROR");
 }
 
+/* Needs to be called before any other GLib function. Slice allocations are
+ * counted as well, by making GSlice use g_malloc(). */
+void
+inf_test_util_count_allocations(void)
+{
+  static GMemVTable vtable = {
+    inf_test_util_counting_malloc,
+    inf_test_util_counting_realloc,
+    free,
+    inf_test_util_counting_calloc,
+    NULL,
+    NULL
+  };
+
+  g_mem_set_vtable(&vtable);
+  g_setenv("G_SLICE", "always-malloc", TRUE);
+}
+
+guint
+inf_test_util_get_allocation_count(void)
+{
+  return inf_test_util_allocation_count;
+}
+
+void
+inf_test_util_count_transformations(void)
+{
+  InfTestUtilTransformCounter* counter;
+  InfAdoptedOperationIface* iface;
+  gpointer klass;
+  guint i;
+
+  counter = &inf_test_util_transform_counter;
+  if(counter->types[0] != 0)
+    return;
+
+  counter->types[0] = INF_ADOPTED_TYPE_NO_OPERATION;
+  counter->types[1] = INF_ADOPTED_TYPE_SPLIT_OPERATION;
+  counter->types[2] = INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION;
+  counter->types[3] = INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION;
+  counter->types[4] = INF_TEXT_TYPE_REMOTE_DELETE_OPERATION;
+  counter->types[5] = INF_TEXT_TYPE_MOVE_OPERATION;
+
+  for(i = 0; i < INF_TEST_UTIL_N_OPERATION_TYPES; ++ i)
+  {
+    /* The class reference is kept, so that the vtable stays around */
+    klass = g_type_class_ref(counter->types[i]);
+    iface = g_type_interface_peek(klass, INF_ADOPTED_TYPE_OPERATION);
+
+    counter->funcs[i] = iface->transform;
+    iface->transform = inf_test_util_counting_transform;
+  }
+}
+
+guint
+inf_test_util_get_transformation_count(void)
+{
+  return inf_test_util_transform_counter.count;
+}
+
+void
+inf_test_util_set_transformation_count(guint count)
+{
+  inf_test_util_transform_counter.count = count;
+}
+
 void
 inf_test_util_print_operation(InfAdoptedOperation* op)
 {
@@ -35,6 +35,21 @@ typedef enum {
 GQuark
 inf_test_util_parse_error_quark(void);
 
+void
+inf_test_util_count_allocations(void);
+
+guint
+inf_test_util_get_allocation_count(void);
+
+void
+inf_test_util_count_transformations(void);
+
+guint
+inf_test_util_get_transformation_count(void);
+
+void
+inf_test_util_set_transformation_count(guint count);
+
 void
 inf_test_util_print_operation(InfAdoptedOperation* op);
 